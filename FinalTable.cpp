@@ -3,9 +3,19 @@
 #include <stdlib.h>
 #include <string>
 #include <vector>
-#include <fstream>
 #include <algorithm>
-#include <sstream>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h> // Cursor position for late latching
+#endif
 
 // Include GLEW
 #include <GL/glew.h>
@@ -17,20 +27,180 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "common/gpuresources.hpp"
+#include "common/gpuquery.hpp"
+#include "common/dynres.hpp"
+#include "common/meshpool.hpp"
+#include "common/ringbuffer.hpp"
+#include "common/meshoptimizer.hpp"
+#include "common/meshprocess.hpp"
+#include "common/tablegen.hpp"
+#include "common/objloader.hpp"
+#include "common/latency.hpp"
+#include "common/arena.hpp"
+#include "common/allocation.hpp"
+#include "common/framegraph.hpp"
+#include "common/jobsystem.hpp"
+#include "common/scenegraph.hpp"
+#include "common/trace.hpp"
+#include "common/inputqueue.hpp"
+#include "common/glcontext.hpp"
+#include "common/ibl.hpp"
+#include "common/occlusion.hpp"
+#include "common/picking.hpp"
+#include "common/streaming.hpp"
+#include "common/startup.hpp"
+#include "common/capture.hpp"
+#include "common/renderserver.hpp"
+
 using namespace glm;
 
 #define WINDOW_TITLE "Modern OpenGL" // Window title Macro
-#define LEG_X 0.067913f //Recurring Texture Coordinate
 
 //Window Dimensions
 GLint WindowWidth = 800, WindowHeight = 600;
 
+//Render thread. The GLUT thread only queues input; the render thread owns
+//the GL context and applies the input at the start of each frame, so the
+//state a frame reads never changes under it
+GLContext glContext;
+std::thread renderThread;
+std::atomic<bool> renderRunning(false);
+InputQueue inputQueue;
+#define RENDER_IDLE_MS 1 // Sleep of the render thread while no input arrives
+
+//Window title, built by the render thread and set by the GLUT thread, which
+//owns the window. Double buffered : the render thread writes the slot that
+//is not published.
+char windowTitles[2][768];
+std::atomic<unsigned int> windowTitleVersion(0);
+#define WINDOW_TITLE_POLL_MS 100
+
 //Buffer declarations
-GLuint vertexbuffer, uvbuffer, normalbuffer;
-GLuint VertexArrayID;
+MeshPool meshPool; // Shared vertex and index buffers of every static mesh
+RingBuffer frameRing; // Per-frame uniforms, per-object data and draw commands
+GLuint VertexArrayID; // Empty vertex array for full screen passes
+
+//Frame graph. The scene renders into transient targets sized for the
+//largest dynamic resolution scale
+FrameGraph frameGraph;
+GLint SceneTargetWidth = 0, SceneTargetHeight = 0; // Size of the scene targets
+GLint SceneWidth = 0, SceneHeight = 0; // Part of the target rendered this frame
+
+//Table parts, one mesh per TablePart
+constexpr TableGeometry defaultTableGeometry = buildTableGeometry(DEFAULT_TABLE_DIMENSIONS);
+TableDimensions tableDimensions = DEFAULT_TABLE_DIMENSIONS; // Edited with t g y h
+int tableMeshes[TABLE_PART_COUNT]; // Mesh pool ids
+
+//Job system, the render thread is thread 0
+JobSystem jobSystem;
+GLint jobThreads = 0; // 0 is one per hardware thread
+bool jobBenchmark = false; // Measure the scheduler instead of running the viewer
+#define DRAW_LIST_CHUNK 64 // Tables placed per job at least
+#define UPLOAD_CHUNK 256 // Draws written per job at least
+
+//Tracing. Captures start with --trace or n, and are written on n or on exit
+const char * traceFile = NULL; // trace.json when not given
+
+//Mesh optimizer mode, run instead of the viewer
+const char * optimizeMeshInput = NULL; // OBJ file, or "table" for the generated table
+const char * optimizeMeshOutput = NULL;
+glm::vec4 tableMaterial = glm::vec4(0.3f, 0.3f, 0.3f, 5.0f); // Specular color and exponent
+
+//One opaque draw : a mesh placed in the scene
+struct DrawItem {
+	int mesh;
+	glm::mat4 model;
+	glm::vec4 material;
+	glm::vec3 center_worldspace;
+	GLfloat depth; // Distance along the view direction, used for sorting
+	unsigned int features; // Shader features the object needs, SHADER_*
+	int node; // Scene graph index, orders the draws of a variant when depth does not
+};
+std::vector<DrawItem> drawList;
+GLint showroomSize = 1; // Tables per side of the showroom grid
+#define SHOWROOM_SPACING 0.8f
+
+//Scene graph : the showroom, its rows, their tables, then one node per part
+SceneGraph sceneGraph;
+std::vector<SceneNode> partNodes; // TABLE_PART_COUNT per table, in table order
+std::vector<int> visibleNodes; // Scene graph indices of the parts drawn this frame
+GLfloat legOffset = 0.0f; // Height of the moved leg, edited with u j
+
+//Indirect draw data built from the draw list, written into the frame ring
+GLintptr drawCommandOffset = 0, objectDataOffset = 0;
+GLsizei drawCommandCount = 0;
+bool multiDrawIndirect = false; // Set when glMultiDrawElementsIndirect is available
+GLint drawCallCount = 0; // Draw calls issued for the scene last frame
+
+//Viewport layout. Every pane draws the same draw list with its own camera
+enum ViewLayout { LAYOUT_SINGLE, LAYOUT_QUAD, LAYOUT_COUNT };
+#define VIEW_MAX_PANES 4 // MAX_VIEW_PANES of the shaders
+struct ViewPane {
+	const char * name;
+	glm::vec4 rect;       // x, y, width, height as fractions of the scene region
+	bool perspective;     // The orbit camera, otherwise orthographic along direction
+	glm::vec3 direction;  // From the showroom center towards the eye
+	glm::vec3 up;
+};
+ViewLayout viewLayout = LAYOUT_SINGLE;
+ViewPane viewPanes[VIEW_MAX_PANES];
+GLint viewPaneCount = 1;
+glm::mat4 paneViews[VIEW_MAX_PANES], paneProjections[VIEW_MAX_PANES];
+bool viewportArray = false; // glViewportIndexed is available
+bool vertexViewportIndex = false; // Vertex shaders can write gl_ViewportIndex
+GLint paneInstances = 1; // Panes drawn by each draw, as instances of every object
+std::vector<unsigned char> nodeVisible; // Set while collecting the parts seen by any pane
+
+//Shader variants of StandardShading, keyed by their features. Each feature
+//is a #define injected into the sources; a variant is compiled the first
+//time a draw needs it, or at startup with --precompile-shaders
+#define SHADER_SPECULAR 1 // SPECULAR : the specular highlight
+#define SHADER_TEXTURE 2  // TEXTURE : diffuse color from the texture
+#define SHADER_LIGHT 4    // LIGHT_COUNT 1, otherwise 0 and ambient only
+#define SHADER_AO 8       // AMBIENT_OCCLUSION : ambient scaled by the SSAO result
+#define SHADER_PBR 16     // PBR : microfacet shading lit by the environment too
+#define SHADER_VARIANT_COUNT 32
+struct ShaderVariant {
+	GLuint program; // 0 until compiled
+	GLint textureID, occlusionID, firstPaneID;
+	bool failed; // Not tried again
+};
+ShaderVariant shaderVariants[SHADER_VARIANT_COUNT];
+bool precompileShaders = false;
+bool lowQuality = false; // No specular anywhere
+
+//Consecutive draw commands shaded with the same variant
+struct DrawBatch {
+	unsigned int features;
+	GLsizei first, count;
+};
+std::vector<DrawBatch> drawBatches;
 
 //Uniform Value ID's
-GLuint programID, MatrixID, ModelMatrixID, ViewMatrixID, LightID, Texture, TextureID, ColorID, IntensityID;
+GLuint Texture;
+GLuint upscaleProgramID, SceneTextureID, SceneRegionID, SceneTexelSizeID, SharpnessID;
+GLuint depthProgramID;
+GLuint ssaoProgramID, ssaoBlurProgramID, ssaoUpsampleProgramID;
+GLint SsaoProjectionID, SsaoInverseProjectionID, SsaoPaneRectID, SsaoPaneCountID, SsaoDownsampleID, SsaoRegionSizeID;
+GLint BlurDirectionID, BlurRegionSizeID;
+GLint UpsampleInverseProjectionID, UpsamplePaneRectID, UpsamplePaneCountID, UpsampleDownsampleID, UpsampleRegionSizeID;
+GLint DepthFirstPaneID;
+GLuint hizProgramID;
+GLint HizRegionSizeID;
+
+//Values shared by every program for one frame, laid out like the std140
+//FrameUniforms block of the shaders
+struct FrameUniforms {
+	glm::mat4 VP[VIEW_MAX_PANES];
+	glm::mat4 V[VIEW_MAX_PANES];
+	glm::vec3 LightPosition_worldspace;
+	GLint PaneInstances;
+	glm::vec3 LightColor;
+	GLfloat LightPower;
+};
+#define FRAME_UNIFORMS_BINDING 0
+GLint uniformBufferAlignment = 256;
 
 //Input Function Values
 GLfloat lastMouseX = 400, lastMouseY = 300;
@@ -39,6 +209,11 @@ GLfloat sensitivity = 0.010f;
 GLchar currentKey;
 bool mouseDetected = true;
 
+//Input latency values
+LatencyTracker inputLatency;
+bool lateLatch = false; // Read the newest mouse position right before the uniform upload
+double lateLatchWaitMs = 0.0; // Time spent waiting for the GPU to finish the previous frame
+
 //Global vector declarations
 glm::vec3 cameraPosition = glm::vec3(0.0f, 0.0f, 0.0f); // Initial camera position. Placed 5 units in Z
 glm::vec3 CameraUpY = glm::vec3(0.0f, 1.0f, 0.0f); // Temporary y unit vector
@@ -50,25 +225,216 @@ glm::vec3 lightPos = glm::vec3(4,4,4);
 glm::vec3 lightColor = vec3(1,1,1);
 GLfloat lightIntensity = 50.0f;
 
+//Dynamic resolution values
+DynamicResolution dynamicResolution;
+GpuQuery frameTimer;
+double cpuFrameMs = -1.0;
+GLfloat upscaleSharpness = 0.5f; // 0 is plain bilinear upscaling
+
+//Overdraw reduction values
+bool depthPrepass = true; // Lay down depth first, then shade with GL_EQUAL
+bool sortFrontToBack = true;
+GpuQuery shadedSamples; // Fragments that went through the lighting shader
+
+//Screen-space ambient occlusion. Computed from the pre-pass depth at a
+//fraction of the scene resolution, blurred, then brought back up for the
+//ambient term of the lighting shader
+enum SsaoMode { SSAO_OFF, SSAO_HALF, SSAO_QUARTER };
+SsaoMode ssaoMode = SSAO_HALF;
+#define SSAO_KERNEL_SIZE 12 // SSAO_KERNEL_SIZE of SSAO.fragmentshader
+GLfloat ssaoRadius = 0.1f; // View space units
+GpuQuery ssaoTimer; // All the SSAO passes, inside the frame timer
+
+//Physically based shading. The environment lights the tables through the
+//split-sum approximation; it is prefiltered once and cached on disk
+bool pbrShading = false;
+const char * environmentFile = NULL; // Equirectangular BMP or HDR, a procedural sky when not given
+EnvironmentLighting environment;
+glm::vec4 varnishMaterial = glm::vec4(0.04f, 0.04f, 0.04f, 120.0f); // F0 of lacquer, roughness 0.13
+#define ENVIRONMENT_UNIT 2 // Texture units of the environment maps
+#define BRDF_UNIT 3
+
+//Occlusion culling. The depth of a past frame, read back a few frames late
+//and reprojected, hides the objects behind what it drew
+bool occlusionCulling = true;
+OcclusionCuller occlusionCuller;
+struct OcclusionStatistics {
+	int objects;         // In some pane's frustum but hidden in all of them
+	long long triangles; // Work left out per frame : every pass and pane
+	long long vertices;
+	long long fragments; // Estimated from the screen rectangles of the bounds
+};
+OcclusionStatistics occlusionStats;
+std::vector<int> occludedNodes; // In a frustum and hidden there, this frame
+std::vector<float> occludedPixels; // Per node, pixels of the panes it was hidden in
+
+//Picking. A left click names the part under the cursor, found on the CPU
+//against the scene graph bounds and the triangles of each mesh
+std::vector<MeshBVH> meshBVHs; // By mesh pool id
+std::vector<int> nodeParts; // Position in partNodes of every scene node, -1 for the others
+const char * tablePartNames[TABLE_PART_COUNT] = {
+	"front left leg", "front right leg", "back left leg", "back right leg", "top",
+	"left bridge", "front bridge", "right bridge", "back bridge"
+};
+struct PickResult {
+	int table;          // Index in the showroom, row by row
+	int part;           // TABLE_*
+	int triangle;       // In the part's mesh, as drawn
+	glm::vec3 point;    // World space
+};
+
+//Streaming. With --streaming the showroom is cut into square cells of tables,
+//each with a table variant of its own that is loaded on the job system around
+//the camera. The tables of a cell are drawn as one block until it is resident.
+bool streaming = false;
+CellStreamer cellStreamer;
+size_t streamCpuBudget = 2048 * 1024, streamGpuBudget = 1024 * 1024;
+#define STREAM_CELL_TABLES 8 // Tables per side of a cell
+#define STREAM_PREFETCH_DISTANCE 8.0f // Cells whose center is nearer the camera are loaded ahead
+GLint streamCellsPerSide = 1;
+std::vector<int> partCells; // Cell of every part, in partNodes order
+std::vector<glm::vec3> cellCenters;
+TableDimensions streamedDimensions = DEFAULT_TABLE_DIMENSIONS; // Only changed while no load runs
+int placeholderMesh = -1; // One box around the whole table
+int placeholderDraws = 0; // Tables drawn as a block last frame
+
+//Startup. Everything the first frame needs is loaded by a StartupLoader; the
+//time until the first frame is swapped is measured from the launch
+std::chrono::steady_clock::time_point launchTime = std::chrono::steady_clock::now();
+bool firstFrameSwapped = false;
+
+//Allocation tracking. Every heap allocation is counted; after the warm-up
+//frames, a frame in which nothing changed makes none. Frames that allocate
+//are reported with the scopes that did.
+#define ALLOCATION_WARMUP_FRAMES 30
+#define ALLOCATION_REPORT_MS 1000 // Shortest time between two reports
+AllocationCount frameAllocations = { 0, 0, 0 }; // By every thread during the last frame
+long long renderedFrames = 0;
+long long allocatingFrames = 0; // After the warm-up
+
+//Video capture. With --capture the camera sweeps across the showroom and back
+//over a fixed number of frames, whatever the time they take to render, and
+//every frame is written to a Y4M video. The viewer runs on afterwards.
+const char * captureFile = NULL; // FILE.y4m, or |command reading the video on its input
+GLint captureFrameCount = 120, captureFps = 30;
+GLint capturedFrames = 0;
+FrameCapture frameCapture;
+
+//Render server. With --serve the window stays hidden and frames are drawn for
+//the clients of a Unix domain socket. Up to SERVE_BATCH_FRAMES requests are
+//drawn back to back, read back into one buffer and waited for with one fence.
+#define SERVE_BATCH_FRAMES RING_BUFFER_FRAMES // A batch never waits on the frame ring
+#define SERVE_WAIT_SLICE 1000000 // ns one glClientWaitSync call may block
+const char * serveSocket = NULL;
+GLint serveMaxWidth = 1920, serveMaxHeight = 1080; // Size of the scene targets
+RenderServer renderServer;
+GLuint serveReadback = 0; // SERVE_BATCH_FRAMES images of the largest size
+GLintptr serveReadbackOffset = 0; // Where the frame being drawn is read back to
+
+//Render client, run instead of the viewer to load a server
+const char * renderClientSocket = NULL;
+GLint clientRequests = 100, clientConnections = 4, clientWidth = 640, clientHeight = 480;
+int clientFormat = RENDER_IMAGE_BMP;
+const char * clientOutput = NULL; // Gets the first image
+bool clientShutdown = false;
+
 //Function Prototypes
 void URenderGraphics(void);
+void URenderFrame();
+void URenderRequest(const RenderRequestMessage & request);
+bool UServeRequests();
+void URenderThread();
+bool UProcessInput();
+void UDisplay();
+void UReshapeWindow(int w, int h);
 void UResizeWindow(int w, int h);
+void UShowWindowTitle(int);
+void UCloseWindow();
 void UCreateBuffers();
+void UUploadTable(const TableGeometry & geometry, bool update);
+void URebuildTable();
 void UKeyboard(unsigned char key, GLint x, GLint y);
 void UKeyReleased(unsigned char key, GLint x, GLint y);
 void UMouseMove(int x, int y);
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
-GLuint loadBMP_custom(const char * imagepath);
+void UMouseButton(int button, int state, int x, int y);
+bool UPick(int x, int y, PickResult & result);
+void UPickAndReport(int x, int y);
+void UApplyKey(unsigned char key);
+void UApplyMouse(int x, int y, bool orbit);
+void ULatchInput();
+void UParseArguments(int argc, char* argv[]);
+void UCleanup();
+int UOptimizeMeshTool();
+int UJobBenchmark();
+void USceneTargetSize();
+void UBuildFrameGraph();
+bool USsaoActive();
+void USsaoKernel(glm::vec3 kernel[SSAO_KERNEL_SIZE]);
+void USetPaneUniforms(GLint projectionID, GLint inverseProjectionID, GLint paneRectID, GLint paneCountID);
+void UUpdateWindowTitle();
+void UCountFrameAllocations(const AllocationCount & start);
+bool UCapturing();
+void UTurntableCamera();
+void UCaptureFrame();
+void UOrbitCamera();
+void UBuildShowroom();
+void UStreamCellBounds(int cell);
+void UUpdateStreaming();
+void ULoadCell(int cell, CellContent & out_content);
+int UPartMesh(int index);
+const MeshBVH * UPartBVH(int index);
+template <int BOXES>
+void UBoxMesh(const AssemblyGeometry<BOXES> & geometry, int box, std::vector<MeshVertex> & out_vertices, std::vector<unsigned int> & out_indices);
+void UUploadPlaceholder(bool update);
+void UMoveLeg(GLfloat offset);
+void UToggleTrace();
+void USetLayout(ViewLayout layout);
+void UPaneCameras(const glm::mat4 & ViewMatrix);
+void UPaneRect(GLint pane, GLint & x, GLint & y, GLint & width, GLint & height);
+void UPaneViewport(GLint pane);
+void UPaneViewProjections(glm::mat4 viewProjections[VIEW_MAX_PANES], glm::vec4 rects[VIEW_MAX_PANES]);
+void USetPaneViewports();
+void UBuildDrawList(const glm::mat4 & ViewMatrix);
+void UUploadFrameUniforms();
+void UUploadDrawList();
+void UDrawScene(GLint firstPaneID);
+void UDrawShaded();
+void UDrawCommands(GLsizei first, GLsizei count);
+unsigned int UPaneFeatures(GLint firstPane);
+const ShaderVariant & UShaderVariant(unsigned int features);
+void UShaderDefines(unsigned int features, char * defines, size_t size);
+void UInitShaderVariant(unsigned int features, GLuint program);
+bool UPrepareEnvironment(void *);
+bool UUploadEnvironment(void *);
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char * defines = NULL);
 
 int main(int argc, char* argv[])
 {
-	// Open a window and create its OpenGL context
+	// Open a window and create its OpenGL context. It is handed to the render
+	// thread once everything is loaded.
+	GLContext::initThreads();
 	glutInit(&argc, argv);
+	UParseArguments(argc, argv);
+	traceThreadName("Main thread");
+	if (traceFile)
+		traceStart();
+	if (optimizeMeshInput)
+		return UOptimizeMeshTool();
+	if (jobBenchmark)
+		return UJobBenchmark();
+	if (renderClientSocket)
+		return runRenderClient(renderClientSocket, clientRequests, clientConnections, clientWidth, clientHeight,
+			clientFormat, clientOutput, clientShutdown);
+	jobSystem.start(jobThreads);
+	printf("Job system : %d threads\n", jobSystem.threadCount());
 	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
 	glutInitWindowSize(WindowWidth, WindowHeight);
 	glutCreateWindow(WINDOW_TITLE);
+	// A server only needs the window for its GL context
+	if (serveSocket)
+		glutHideWindow();
 
-	glutReshapeFunc(UResizeWindow);
+	glutReshapeFunc(UReshapeWindow);
 
 	// Initialize GLEW
 	glewExperimental = true; // Needed for core profile
@@ -85,1519 +451,1918 @@ int main(int argc, char* argv[])
 	// Accept fragment if it closer to the camera than the former one
 	glDepthFunc(GL_LESS); 
 
-	// Create and compile our GLSL program from the shaders
-	programID = LoadShaders( "StandardShading.vertexshader", "StandardShading.fragmentshader" );
-
-	// Get a handle for our "MVP" uniform
-	MatrixID = glGetUniformLocation(programID, "MVP");
-	ViewMatrixID = glGetUniformLocation(programID, "V");
-	ModelMatrixID = glGetUniformLocation(programID, "M");
-
-	// Load the texture
-	Texture = loadBMP_custom("TableTexture.bmp");
+	// The files are read and decoded on the job system while this thread
+	// sets up the rest, compiling and uploading whatever has arrived
+	StartupLoader loader;
+	int upscaleProgram = loader.addProgram("Upscale.vertexshader", "Upscale.fragmentshader");
+	int depthProgram = loader.addProgram("DepthOnly.vertexshader", "DepthOnly.fragmentshader");
+	int ssaoProgram = loader.addProgram("Upscale.vertexshader", "SSAO.fragmentshader");
+	int ssaoBlurProgram = loader.addProgram("Upscale.vertexshader", "SSAOBlur.fragmentshader");
+	int ssaoUpsampleProgram = loader.addProgram("Upscale.vertexshader", "SSAOUpsample.fragmentshader");
+	int hizProgram = loader.addProgram("Upscale.vertexshader", "HiZReduce.fragmentshader");
+
+	// The variants of the lighting shader are compiled when first drawn with,
+	// unless asked for up front
+	int variantPrograms[SHADER_VARIANT_COUNT];
+	for (unsigned int features = 0; features < SHADER_VARIANT_COUNT; features++) {
+		variantPrograms[features] = -1;
+		bool canonical = (features & SHADER_LIGHT) || !(features & SHADER_SPECULAR);
+		if (precompileShaders && canonical && (pbrShading || !(features & SHADER_PBR))) {
+			char defines[128];
+			UShaderDefines(features, defines, sizeof(defines));
+			variantPrograms[features] = loader.addProgram("StandardShading.vertexshader", "StandardShading.fragmentshader", defines);
+		}
+	}
+	int tableTexture = loader.addTexture("TableTexture.bmp");
 
-	// Get a handle for our "myTextureSampler" uniform
-	TextureID  = glGetUniformLocation(programID, "myTextureSampler");
+	// The environment maps come from the cache, or are prefiltered on the job
+	// system the first time
+	int environmentTask = pbrShading ? loader.addTask("Environment", UPrepareEnvironment, UUploadEnvironment, NULL) : -1;
+	loader.start(jobSystem);
 
 	UCreateBuffers();
+	loader.poll();
+
+	// Per-frame data is written straight into mapped memory. Start with room
+	// for one table, the ring grows with the showroom
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferAlignment);
+	frameRing.create(64 * 1024);
+	if (occlusionCulling)
+		occlusionCuller.create();
+
+	// Panes share every buffer, texture and program. With viewport arrays and
+	// gl_ViewportIndex in the vertex shader all of them are drawn at once.
+	viewportArray = GLEW_VERSION_4_1 || GLEW_ARB_viewport_array;
+	vertexViewportIndex = viewportArray && (GLEW_ARB_shader_viewport_layer_array || GLEW_AMD_vertex_shader_viewport_index);
+	USetLayout(viewLayout);
+
+	// Transient targets are cleared to the background color
+	frameGraph.setClearColor(0.0f, 0.0f, 0.4f, 0.0f);
+	USceneTargetSize();
+	frameTimer.create(GL_TIME_ELAPSED);
+	shadedSamples.create(GL_SAMPLES_PASSED);
+	ssaoTimer.create(GL_TIMESTAMP);
+	inputLatency.create();
+	loader.poll();
+
+	// A shader that is missing or does not compile stops here; the texture
+	// and the environment are optional
+	if (!loader.finish()) {
+		fprintf(stderr, "Failed to build the shaders, see above\n");
+		jobSystem.stop();
+		return -1;
+	}
+	if (environmentTask >= 0 && !loader.succeeded(environmentTask)) {
+		printf("Physically based shading turned off\n");
+		pbrShading = false;
+	}
+	Texture = loader.texture(tableTexture);
+	for (unsigned int features = 0; features < SHADER_VARIANT_COUNT; features++) {
+		if (variantPrograms[features] >= 0)
+			UInitShaderVariant(features, loader.program(variantPrograms[features]));
+	}
 
-	// Get a handle for our lighting uniforms
-	glUseProgram(programID);
-	LightID = glGetUniformLocation(programID, "LightPosition_worldspace");
-	ColorID = glGetUniformLocation(programID, "LightColor");
-	IntensityID = glGetUniformLocation(programID, "LightPower");
+	// The program that scales the offscreen scene up to the window
+	upscaleProgramID = loader.program(upscaleProgram);
+	SceneTextureID = glGetUniformLocation(upscaleProgramID, "sceneTextureSampler");
+	SceneRegionID = glGetUniformLocation(upscaleProgramID, "SceneRegion");
+	SceneTexelSizeID = glGetUniformLocation(upscaleProgramID, "SceneTexelSize");
+	SharpnessID = glGetUniformLocation(upscaleProgramID, "Sharpness");
+
+	// The program of the depth pre-pass
+	depthProgramID = loader.program(depthProgram);
+	glUniformBlockBinding(depthProgramID, glGetUniformBlockIndex(depthProgramID, "FrameUniforms"), FRAME_UNIFORMS_BINDING);
+	DepthFirstPaneID = glGetUniformLocation(depthProgramID, "FirstPane");
+
+	// The programs of the ambient occlusion passes. The samplers and the
+	// kernel never change.
+	glm::vec3 kernel[SSAO_KERNEL_SIZE];
+	USsaoKernel(kernel);
+	ssaoProgramID = loader.program(ssaoProgram);
+	glUseProgram(ssaoProgramID);
+	glUniform1i(glGetUniformLocation(ssaoProgramID, "depthSampler"), 0);
+	glUniform3fv(glGetUniformLocation(ssaoProgramID, "Kernel"), SSAO_KERNEL_SIZE, &kernel[0].x);
+	glUniform1f(glGetUniformLocation(ssaoProgramID, "Radius"), ssaoRadius);
+	SsaoProjectionID = glGetUniformLocation(ssaoProgramID, "Projection");
+	SsaoInverseProjectionID = glGetUniformLocation(ssaoProgramID, "InverseProjection");
+	SsaoPaneRectID = glGetUniformLocation(ssaoProgramID, "PaneRect");
+	SsaoPaneCountID = glGetUniformLocation(ssaoProgramID, "PaneCount");
+	SsaoDownsampleID = glGetUniformLocation(ssaoProgramID, "Downsample");
+	SsaoRegionSizeID = glGetUniformLocation(ssaoProgramID, "RegionSize");
+
+	ssaoBlurProgramID = loader.program(ssaoBlurProgram);
+	glUseProgram(ssaoBlurProgramID);
+	glUniform1i(glGetUniformLocation(ssaoBlurProgramID, "occlusionSampler"), 0);
+	BlurDirectionID = glGetUniformLocation(ssaoBlurProgramID, "Direction");
+	BlurRegionSizeID = glGetUniformLocation(ssaoBlurProgramID, "RegionSize");
+
+	ssaoUpsampleProgramID = loader.program(ssaoUpsampleProgram);
+	glUseProgram(ssaoUpsampleProgramID);
+	glUniform1i(glGetUniformLocation(ssaoUpsampleProgramID, "depthSampler"), 0);
+	glUniform1i(glGetUniformLocation(ssaoUpsampleProgramID, "occlusionSampler"), 1);
+	UpsampleInverseProjectionID = glGetUniformLocation(ssaoUpsampleProgramID, "InverseProjection");
+	UpsamplePaneRectID = glGetUniformLocation(ssaoUpsampleProgramID, "PaneRect");
+	UpsamplePaneCountID = glGetUniformLocation(ssaoUpsampleProgramID, "PaneCount");
+	UpsampleDownsampleID = glGetUniformLocation(ssaoUpsampleProgramID, "Downsample");
+	UpsampleRegionSizeID = glGetUniformLocation(ssaoUpsampleProgramID, "RegionSize");
+
+	// The program that reduces the depth for the occlusion culler
+	hizProgramID = loader.program(hizProgram);
+	glUseProgram(hizProgramID);
+	glUniform1i(glGetUniformLocation(hizProgramID, "depthSampler"), 0);
+	glUniform2i(glGetUniformLocation(hizProgramID, "TargetSize"), HIZ_WIDTH, HIZ_HEIGHT);
+	HizRegionSizeID = glGetUniformLocation(hizProgramID, "RegionSize");
+	glUseProgram(0);
+
+	// The frames of a batch are read back side by side, then the clients are
+	// let in
+	if (serveSocket) {
+		GLsizeiptr bytes = (GLsizeiptr)SERVE_BATCH_FRAMES * serveMaxWidth * serveMaxHeight * 4;
+		serveReadback = GPU_CREATE(GPU_BUFFER, GPU_MEMORY_STREAMING, "Server readback");
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, serveReadback);
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+		gpuResources.setSize(GPU_BUFFER, serveReadback, bytes, GL_NONE);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		if (!renderServer.start(serveSocket, serveMaxWidth, serveMaxHeight)) {
+			jobSystem.stop();
+			return -1;
+		}
+	}
 
 	glutKeyboardFunc(UKeyboard); //Detects keys pressed
 
 	glutKeyboardUpFunc(UKeyReleased); //Detects keys released
 
-	glutDisplayFunc(URenderGraphics);
+	glutDisplayFunc(UDisplay);
 
 	glutPassiveMotionFunc(UMouseMove); //Detects mouse movement
 
-	glutMainLoop();
+	glutMouseFunc(UMouseButton); //Detects clicks, for picking
 
-	// Cleanup VBO and shader
-	glDeleteBuffers(1, &vertexbuffer);
-	glDeleteBuffers(1, &uvbuffer);
-	glDeleteBuffers(1, &normalbuffer);
-	glDeleteProgram(programID);
-	glDeleteTextures(1, &Texture);
-	glDeleteVertexArrays(1, &VertexArrayID);
+	glutTimerFunc(WINDOW_TITLE_POLL_MS, UShowWindowTitle, 0);
 
-	return 0;
-}
+	// Closing the window returns from the main loop instead of exiting, and
+	// the GL objects are released while the context still exists
+	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+	glutCloseFunc(UCloseWindow);
 
-void URenderGraphics(void){
-	// Clear the screen
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	if (!glContext.detach()) {
+		fprintf(stderr, "Failed to hand the GL context to the render thread\n");
+		return -1;
+	}
+	renderRunning = true;
+	renderThread = std::thread(URenderThread);
+
+	glutMainLoop();
 
-	// Use our shader
-	glUseProgram(programID);
+	jobSystem.stop();
 
-	CameraForwardZ = front;
+	return 0;
+}
 
-	//Determine projection based on whether or not Z is held
-	glm::mat4 ProjectionMatrix;
-		if (currentKey == 'z') {
-			ProjectionMatrix = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, 0.1f, 100.0f);
+/* Owns the GL context : applies the queued input and renders a frame
+ * whenever some arrived, then releases the GL objects once the window is
+ * closed. Polls instead of waiting so the GLUT thread never has to wake it. */
+void URenderThread()
+{
+	traceThreadName("Render thread");
+	if (!glContext.makeCurrent())
+		return;
+	// Startup is over, the frames use the jobs from here on
+	jobSystem.takeMainThread();
+
+	while (renderRunning.load()) {
+		// A server draws what its clients ask for, as soon as they do
+		if (serveSocket) {
+			UProcessInput();
+			if (!UServeRequests())
+				std::this_thread::sleep_for(std::chrono::milliseconds(RENDER_IDLE_MS));
+			continue;
 		}
-		else {
-			ProjectionMatrix = glm::perspective(glm::radians(45.0f), (GLfloat)WindowWidth / (GLfloat)WindowHeight, 0.1f, 100.0f);
+		// A capture renders frame after frame, input or not
+		if (!UProcessInput() && !UCapturing()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(RENDER_IDLE_MS));
+			continue;
 		}
-	glm::mat4 ViewMatrix = glm::lookAt(CameraForwardZ, cameraPosition, CameraUpY);
-	glm::mat4 ModelMatrix = glm::mat4(1.0);
-	glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-	// Send our transformation to the currently bound shader,
-	// in the "MVP" uniform
-	glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-	glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-
-	// Send lighting values to the shader
-	glUniform3f(LightID, lightPos.x, lightPos.y, lightPos.z);
-	glUniform3f(ColorID, lightColor.r, lightColor.g, lightColor.b);
-	glUniform1f(IntensityID, lightIntensity);
-
-	// Bind our texture in Texture Unit 0
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, Texture);
-	// Set our "myTextureSampler" sampler to use Texture Unit 0
-	glUniform1i(TextureID, 0);
-
-	// 1rst attribute buffer : vertices
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glVertexAttribPointer(
-		0,                  // attribute
-		3,                  // size
-		GL_FLOAT,           // type
-		GL_FALSE,           // normalized?
-		0,                  // stride
-		(void*)0            // array buffer offset
-	);
-
-	// 2nd attribute buffer : UVs
-	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-	glVertexAttribPointer(
-		1,                                // attribute
-		2,                                // size
-		GL_FLOAT,                         // type
-		GL_FALSE,                         // normalized?
-		0,                                // stride
-		(void*)0                          // array buffer offset
-	);
-
-	// 3rd attribute buffer : normals
-	glEnableVertexAttribArray(2);
-	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-	glVertexAttribPointer(
-		2,                                // attribute
-		3,                                // size
-		GL_FLOAT,                         // type
-		GL_FALSE,                         // normalized?
-		0,                                // stride
-		(void*)0                          // array buffer offset
-	);
-
-	// Draw the triangles !
-	glDrawArrays(GL_TRIANGLES, 0, 324 );
-
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
-	glDisableVertexAttribArray(2);
+		URenderGraphics();
+	}
 
-	// Swap buffers
-	glutSwapBuffers();
+	UCleanup();
+	glContext.release();
 }
 
-/* Resizes the window*/
-void UResizeWindow(int w, int h)
+/* Stops the render thread, which cleans up while the context still exists */
+void UCloseWindow()
 {
-	WindowWidth = w;
-	WindowHeight = h;
-	glViewport(0, 0, WindowWidth, WindowHeight);
+	renderRunning = false;
+	if (renderThread.joinable())
+		renderThread.join();
 }
 
-void UCreateBuffers(){
-	// Our vertices. Three consecutive floats give a 3D vertex; Three consecutive vertices give a triangle.
-			GLfloat g_vertex_buffer_data[] = {
-
-				//Front Left Leg
+/* Releases every GL object, then reports the ones that were not released.
+ * Runs on the render thread. */
+void UCleanup()
+{
+	// The clients get no more frames
+	if (renderServer.running())
+		renderServer.stop();
+	gpuResources.destroy(GPU_BUFFER, serveReadback);
+
+	// A capture cut short by closing the window keeps what it has
+	if (frameCapture.isOpen()) {
+		frameCapture.close();
+		frameCapture.printStatistics();
+	}
 
-				-0.235f,-0.235f,-0.625f,	//front bottom left
-				-0.235f,-0.165f,-0.625f,	//back bottom left		//Left Face
-				-0.235f,-0.165f, 0.595f,	//back top left
+	// Cleanup VBO and shader
+	cellStreamer.destroy();
+	meshPool.destroy();
+	frameRing.destroy();
+	for (int i = 0; i < SHADER_VARIANT_COUNT; i++)
+		gpuResources.destroy(GPU_PROGRAM, shaderVariants[i].program);
+	gpuResources.destroy(GPU_PROGRAM, upscaleProgramID);
+	gpuResources.destroy(GPU_PROGRAM, depthProgramID);
+	gpuResources.destroy(GPU_PROGRAM, ssaoProgramID);
+	gpuResources.destroy(GPU_PROGRAM, ssaoBlurProgramID);
+	gpuResources.destroy(GPU_PROGRAM, ssaoUpsampleProgramID);
+	gpuResources.destroy(GPU_PROGRAM, hizProgramID);
+	occlusionCuller.destroy();
+	gpuResources.destroy(GPU_TEXTURE, Texture);
+	environment.destroy();
+	gpuResources.destroy(GPU_VERTEX_ARRAY, VertexArrayID);
+	frameGraph.destroy();
+	frameTimer.destroy();
+	shadedSamples.destroy();
+	ssaoTimer.destroy();
+	inputLatency.print(lateLatch ? "late latch" : "GLUT order");
+	inputLatency.destroy();
+	if (inputQueue.dropped() > 0)
+		printf("Input : %d events dropped, the queue was full\n", inputQueue.dropped());
+	printf("Allocations : %lld of %lld frames after the warm-up allocated\n", allocatingFrames,
+		renderedFrames > ALLOCATION_WARMUP_FRAMES ? renderedFrames - ALLOCATION_WARMUP_FRAMES : 0LL);
+	allocationPrintScopes(false);
+	if (traceEnabled)
+		UToggleTrace();
+	traceDestroyGpu();
+
+	gpuResources.print();
+	gpuResources.reportLeaks();
+}
 
-				-0.165f,-0.235f,0.595f,		//front top right
-				-0.235f,-0.235f,-0.625f,	//front bottom left		//Front Face
-				-0.235f,-0.235f,0.595f,		//front top left
+void URenderGraphics(void){
+	TRACE_SCOPE("URenderGraphics");
+	AllocationCount allocationStart = allocationTotals();
+	URenderFrame();
+	UUpdateWindowTitle();
 
-				-0.165f,-0.165f,-0.625f,	//back bottom right
-				-0.235f,-0.235f,-0.625f,	//front bottom left		//Bottom Face
-				-0.165f,-0.235f,-0.625f,	//front bottom right
+	// Read the frame back while the back buffer still holds it
+	if (UCapturing())
+		UCaptureFrame();
 
-				-0.165f,-0.235f,0.595f,		//front top right
-				-0.165f,-0.235f,-0.625f,	//front bottom right	//Front Face
-				-0.235f,-0.235f,-0.625f,	//front bottom left
+	// Swap buffers
+	{
+		TRACE_SCOPE("Swap buffers");
+		ALLOCATION_SCOPE("Swap buffers");
+		glContext.swapBuffers();
+	}
 
-				-0.235f,-0.235f,-0.625f,	//front bottom left
-				-0.235f,-0.165f, 0.595f,	//back top left			//Left Face
-				-0.235f,-0.235f,0.595f,		//front top left
+	// Time when the GPU is done with the swapped frame
+	inputLatency.frameSwapped();
+	inputLatency.poll();
+	traceCollectGpu();
+	UCountFrameAllocations(allocationStart);
 
-				-0.165f,-0.165f,-0.625f,	//back bottom right
-				-0.235f,-0.165f,-0.625f,	//back bottom left		//Bottom Face
-				-0.235f,-0.235f,-0.625f,	//front bottom left
+	if (!firstFrameSwapped) {
+		firstFrameSwapped = true;
+		printf("Startup : first frame swapped %.1f ms after launch\n",
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launchTime).count());
+	}
+}
 
-				-0.235f,-0.165f, 0.595f,	//back top left
-				-0.235f,-0.165f,-0.625f,	//back bottom left		//Back Face
-				-0.165f,-0.165f,-0.625f,	//back bottom right
+/* Draws the scene from the current camera at the current window size, all of
+ * a frame but the title and the swap */
+void URenderFrame()
+{
+	std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
 
-				-0.165f,-0.165f,0.595f,		//back top right
-				-0.165f,-0.235f,-0.625f,	//front bottom right	//Right Face
-				-0.165f,-0.235f,0.595f,		//front top right
+	// Pick this frame's render size from the previous frames' timings
+	updateDynamicResolution(dynamicResolution, frameTimer.milliseconds(), cpuFrameMs);
+	dynamicResolutionSize(dynamicResolution, WindowWidth, WindowHeight, SceneWidth, SceneHeight);
 
-				-0.165f,-0.235f,-0.625f,	//front bottom right
-				-0.165f,-0.165f,0.595f,		//back top right		//Right Face
-				-0.165f,-0.165f,-0.625f,	//back bottom right
+	frameTimer.begin();
 
-				-0.165f,-0.165f,0.595f,		//back top right
-				-0.165f,-0.235f,0.595f,		//front top right		//Top Face
-				-0.235f,-0.235f,0.595f,		//front top left
+	// Every input event since the last frame is answered by this one
+	if (!lateLatch)
+		inputLatency.inputLatched();
+	if (UCapturing())
+		UTurntableCamera();
+	CameraForwardZ = front;
+	glm::mat4 ViewMatrix = glm::lookAt(CameraForwardZ, cameraPosition, CameraUpY);
+	UPaneCameras(ViewMatrix);
 
-				-0.165f,-0.165f,0.595f,		//back top right
-				-0.235f,-0.235f,0.595f,		//front top left		//Top Face
-				-0.235f,-0.165f, 0.595f,	//back top left
+	// Cells loaded since the last frame replace their placeholders
+	if (streaming) {
+		ALLOCATION_SCOPE("Streaming update");
+		UUpdateStreaming();
+	}
 
-				-0.165f,-0.165f,0.595f,		//back top right
-				-0.235f,-0.165f, 0.595f,	//back top left			//Back Face
-				-0.165f,-0.165f,-0.625f,	//back bottom right
+	// Only the subtrees changed since the last frame are transformed again
+	{
+		TRACE_SCOPE("Scene graph update");
+		ALLOCATION_SCOPE("Scene graph update");
+		sceneGraph.update();
+	}
+	UBuildDrawList(ViewMatrix);
+
+	// Wait for the GPU to release the oldest frame's data, then write this frame's
+	GLsizeiptr frameBytes = sizeof(FrameUniforms) + uniformBufferAlignment
+		+ drawList.size() * (sizeof(ObjectData) + sizeof(DrawElementsIndirectCommand)) + 32;
+	frameRing.beginFrame(frameBytes);
+
+	// Late latch : once the GPU has caught up with the previous frame, take
+	// the newest mouse position and build the view again. Only the culling
+	// and draw order above used the older view.
+	lateLatchWaitMs = 0.0;
+	if (lateLatch) {
+		lateLatchWaitMs = inputLatency.waitForPreviousFrame();
+		ULatchInput();
+		inputLatency.inputLatched();
+		CameraForwardZ = front;
+		ViewMatrix = glm::lookAt(CameraForwardZ, cameraPosition, CameraUpY);
+		UPaneCameras(ViewMatrix);
+	}
 
-				//Front Right Leg
+	UUploadFrameUniforms();
+	UUploadDrawList();
+	frameRing.finishWrites();
+	drawCallCount = 0;
+
+	// Render the scene into the used part of the offscreen targets, then
+	// upscale it to the window
+	{
+		ALLOCATION_SCOPE("Frame graph");
+		UBuildFrameGraph();
+		frameGraph.compile();
+		if (frameGraph.layoutChanged())
+			frameGraph.printStatistics();
+		TRACE_GPU_SCOPE("Frame");
+		frameGraph.execute();
+	}
 
-				 0.165f,-0.235f,-0.625f,	//front bottom left
-				 0.165f,-0.165f,-0.625f,	//back bottom left		//Left Face
-				 0.165f,-0.165f, 0.595f,	//back top left
+	// Nothing reads this frame's ring section after the passes
+	frameRing.endFrame();
 
-				 0.235f,-0.235f,0.595f,		//front top right
-				 0.165f,-0.235f,-0.625f,	//front bottom left		//Front Face
-				 0.165f,-0.235f,0.595f,		//front top left
+	frameTimer.end();
 
-				 0.235f,-0.165f,-0.625f,	//back bottom right
-				 0.165f,-0.235f,-0.625f,	//front bottom left		//Bottom Face
-				 0.235f,-0.235f,-0.625f,	//front bottom right
+	// Waiting on the GPU is not CPU work, keep it out of the resolution controller
+	cpuFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count() - lateLatchWaitMs;
+}
 
-				 0.235f,-0.235f,0.595f,		//front top right
-				 0.235f,-0.235f,-0.625f,	//front bottom right	//Front Face
-				 0.165f,-0.235f,-0.625f,	//front bottom left
+/* Draws the frame a client asked for. The window size is the request's, so
+ * at the locked scale of 1 the scene region is exactly the image and the
+ * targets keep their size. */
+void URenderRequest(const RenderRequestMessage & request)
+{
+	camYaw = request.yaw;
+	camPitch = request.pitch;
+	UOrbitCamera();
+	lightPos = glm::make_vec3(request.lightPosition);
+	lightColor = glm::make_vec3(request.lightColor);
+	lightIntensity = request.lightPower;
+	WindowWidth = request.width;
+	WindowHeight = request.height;
+	URenderFrame();
+}
 
-				 0.165f,-0.235f,-0.625f,	//front bottom left
-				 0.165f,-0.165f, 0.595f,	//back top left			//Left Face
-				 0.165f,-0.235f,0.595f,		//front top left
+/* Draws up to SERVE_BATCH_FRAMES queued requests back to back, each read back
+ * to its own part of one buffer, then waits for all of them on a single fence
+ * and hands the images to the server. Returns false when none was queued. */
+bool UServeRequests()
+{
+	int tickets[SERVE_BATCH_FRAMES];
+	int count = renderServer.takeRequests(tickets, SERVE_BATCH_FRAMES);
+	if (count == 0)
+		return false;
+
+	TRACE_SCOPE("Serve requests");
+	GLsizeiptr frameBytes = (GLsizeiptr)serveMaxWidth * serveMaxHeight * 4;
+	for (int i = 0; i < count; i++) {
+		serveReadbackOffset = i * frameBytes;
+		URenderRequest(renderServer.ticket(tickets[i]).request);
+	}
+	GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+	{
+		TRACE_SCOPE("Server readback wait");
+		GLenum status;
+		do
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, SERVE_WAIT_SLICE);
+		while (status == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(fence);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, serveReadback);
+	const unsigned char * pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * frameBytes, GL_MAP_READ_BIT);
+	bool readable = pixels != NULL;
+	if (pixels) {
+		for (int i = 0; i < count; i++) {
+			RenderTicket & ticket = renderServer.ticket(tickets[i]);
+			size_t bytes = (size_t)ticket.request.width * ticket.request.height * 4;
+			ticket.pixels.resize(bytes);
+			memcpy(&ticket.pixels[0], pixels + i * frameBytes, bytes);
+		}
+		// The buffer's content was lost meanwhile, like on a mode switch
+		readable = glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+	}
+	if (!readable)
+		printf("Render server : the readback of %d frames could not be read\n", count);
+	// The clients of a failed batch are told so instead of getting garbage
+	for (int i = 0; i < count; i++) {
+		renderServer.ticket(tickets[i]).status = readable ? RENDER_OK : RENDER_FAILED;
+		renderServer.finishRequest(tickets[i]);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	traceCollectGpu();
+	return true;
+}
 
-				 0.235f,-0.165f,-0.625f,	//back bottom right
-				 0.165f,-0.165f,-0.625f,	//back bottom left		//Bottom Face
-				 0.165f,-0.235f,-0.625f,	//front bottom left
+/* Queues the new window size for the render thread */
+void UReshapeWindow(int w, int h)
+{
+	InputEvent event = { INPUT_RESIZE, w, h, 0, false, 0 };
+	inputQueue.push(event);
+}
 
-				 0.165f,-0.165f, 0.595f,	//back top left
-				 0.165f,-0.165f,-0.625f,	//back bottom left		//Back Face
-				 0.235f,-0.165f,-0.625f,	//back bottom right
+/* Asks the render thread for a frame, when the window needs repainting */
+void UDisplay()
+{
+	InputEvent event = { INPUT_REDISPLAY, 0, 0, 0, false, 0 };
+	inputQueue.push(event);
+}
 
-				 0.235f,-0.165f,0.595f,		//back top right
-				 0.235f,-0.235f,-0.625f,	//front bottom right	//Right Face
-				 0.235f,-0.235f,0.595f,		//front top right
+/* Resizes the window*/
+void UResizeWindow(int w, int h)
+{
+	WindowWidth = w;
+	WindowHeight = h;
+	glViewport(0, 0, WindowWidth, WindowHeight);
+	USceneTargetSize();
+}
 
-				 0.235f,-0.235f,-0.625f,	//front bottom right
-				 0.235f,-0.165f,0.595f,		//back top right		//Right Face
-				 0.235f,-0.165f,-0.625f,	//back bottom right
+/* Parses the command line options :
+ * --min-scale=S --max-scale=S --lock-scale=S --frame-budget=MS
+ * --showroom=N --no-prepass --no-sort --late-latch --no-aliasing
+ * --optimize-mesh=FILE.obj|table --optimize-output=FILE.obj
+ * --threads=N --job-benchmark --layout=single|quad
+ * --trace=FILE.json --debug-groups --precompile-shaders --low-quality
+ * --ssao=off|half|quarter --pbr --environment=FILE.bmp|FILE.hdr --no-occlusion
+ * --streaming --stream-cpu-budget=KB --stream-gpu-budget=KB
+ * --capture=FILE.y4m|"|command" --capture-frames=N --capture-fps=N
+ * --serve=SOCKET --serve-size=WxH
+ * --render-client=SOCKET --client-requests=N --client-connections=N
+ * --client-size=WxH --client-format=bmp|i420 --client-output=FILE --client-shutdown
+ * --gpu-budget=geometry|streaming|texture|target|other:MB (repeatable) */
+void UParseArguments(int argc, char* argv[])
+{
+	float minScale = 0.25f, maxScale = 1.0f, budgetMs = 16.6f, lockScale = 0.0f;
+
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--min-scale=", 12) == 0)
+			minScale = (float)atof(argv[i] + 12);
+		else if (strncmp(argv[i], "--max-scale=", 12) == 0)
+			maxScale = (float)atof(argv[i] + 12);
+		else if (strncmp(argv[i], "--lock-scale=", 13) == 0)
+			lockScale = (float)atof(argv[i] + 13);
+		else if (strncmp(argv[i], "--frame-budget=", 15) == 0)
+			budgetMs = (float)atof(argv[i] + 15);
+		else if (strncmp(argv[i], "--showroom=", 11) == 0)
+			showroomSize = atoi(argv[i] + 11);
+		else if (strcmp(argv[i], "--no-prepass") == 0)
+			depthPrepass = false;
+		else if (strcmp(argv[i], "--no-sort") == 0)
+			sortFrontToBack = false;
+		else if (strcmp(argv[i], "--late-latch") == 0)
+			lateLatch = true;
+		else if (strcmp(argv[i], "--no-aliasing") == 0)
+			frameGraph.setAliasing(false);
+		else if (strncmp(argv[i], "--optimize-mesh=", 16) == 0)
+			optimizeMeshInput = argv[i] + 16;
+		else if (strncmp(argv[i], "--optimize-output=", 18) == 0)
+			optimizeMeshOutput = argv[i] + 18;
+		else if (strncmp(argv[i], "--threads=", 10) == 0)
+			jobThreads = atoi(argv[i] + 10);
+		else if (strcmp(argv[i], "--job-benchmark") == 0)
+			jobBenchmark = true;
+		else if (strcmp(argv[i], "--layout=single") == 0)
+			viewLayout = LAYOUT_SINGLE;
+		else if (strcmp(argv[i], "--layout=quad") == 0)
+			viewLayout = LAYOUT_QUAD;
+		else if (strncmp(argv[i], "--trace=", 8) == 0)
+			traceFile = argv[i] + 8;
+		else if (strcmp(argv[i], "--debug-groups") == 0)
+			traceDebugGroups = true;
+		else if (strcmp(argv[i], "--precompile-shaders") == 0)
+			precompileShaders = true;
+		else if (strcmp(argv[i], "--low-quality") == 0)
+			lowQuality = true;
+		else if (strcmp(argv[i], "--ssao=off") == 0)
+			ssaoMode = SSAO_OFF;
+		else if (strcmp(argv[i], "--ssao=half") == 0)
+			ssaoMode = SSAO_HALF;
+		else if (strcmp(argv[i], "--ssao=quarter") == 0)
+			ssaoMode = SSAO_QUARTER;
+		else if (strcmp(argv[i], "--no-occlusion") == 0)
+			occlusionCulling = false;
+		else if (strcmp(argv[i], "--pbr") == 0)
+			pbrShading = true;
+		else if (strcmp(argv[i], "--streaming") == 0)
+			streaming = true;
+		else if (strncmp(argv[i], "--stream-cpu-budget=", 20) == 0)
+			streamCpuBudget = (size_t)atoi(argv[i] + 20) * 1024;
+		else if (strncmp(argv[i], "--stream-gpu-budget=", 20) == 0)
+			streamGpuBudget = (size_t)atoi(argv[i] + 20) * 1024;
+		else if (strncmp(argv[i], "--capture=", 10) == 0)
+			captureFile = argv[i] + 10;
+		else if (strncmp(argv[i], "--capture-frames=", 17) == 0)
+			captureFrameCount = atoi(argv[i] + 17);
+		else if (strncmp(argv[i], "--capture-fps=", 14) == 0)
+			captureFps = atoi(argv[i] + 14);
+		else if (strncmp(argv[i], "--serve=", 8) == 0)
+			serveSocket = argv[i] + 8;
+		else if (strncmp(argv[i], "--serve-size=", 13) == 0)
+			sscanf(argv[i] + 13, "%dx%d", &serveMaxWidth, &serveMaxHeight);
+		else if (strncmp(argv[i], "--render-client=", 16) == 0)
+			renderClientSocket = argv[i] + 16;
+		else if (strncmp(argv[i], "--client-requests=", 18) == 0)
+			clientRequests = atoi(argv[i] + 18);
+		else if (strncmp(argv[i], "--client-connections=", 21) == 0)
+			clientConnections = atoi(argv[i] + 21);
+		else if (strncmp(argv[i], "--client-size=", 14) == 0)
+			sscanf(argv[i] + 14, "%dx%d", &clientWidth, &clientHeight);
+		else if (strcmp(argv[i], "--client-format=bmp") == 0)
+			clientFormat = RENDER_IMAGE_BMP;
+		else if (strcmp(argv[i], "--client-format=i420") == 0)
+			clientFormat = RENDER_IMAGE_I420;
+		else if (strncmp(argv[i], "--client-output=", 16) == 0)
+			clientOutput = argv[i] + 16;
+		else if (strcmp(argv[i], "--client-shutdown") == 0)
+			clientShutdown = true;
+		else if (strncmp(argv[i], "--environment=", 14) == 0) {
+			environmentFile = argv[i] + 14;
+			pbrShading = true;
+		}
+		else if (strncmp(argv[i], "--gpu-budget=", 13) == 0) {
+			char name[32];
+			float megabytes;
+			int category = -1;
+			if (sscanf(argv[i] + 13, "%31[^:]:%f", name, &megabytes) == 2)
+				category = gpuMemoryCategoryFromName(name);
+			if (category >= 0)
+				gpuResources.setBudget((GpuMemoryCategory)category, (long long)(megabytes * 1024.0f * 1024.0f));
+			else
+				printf("Ignoring bad budget %s\n", argv[i]);
+		}
+		else
+			printf("Ignoring unknown option %s\n", argv[i]);
+	}
 
-				 0.235f,-0.165f,0.595f,		//back top right
-				 0.235f,-0.235f,0.595f,		//front top right		//Top Face
-				 0.165f,-0.235f,0.595f,		//front top left
+	if (showroomSize < 1) showroomSize = 1;
+	if (maxScale <= 0.0f) maxScale = 1.0f;
+	if (minScale <= 0.0f || minScale > maxScale) minScale = maxScale;
+	initDynamicResolution(dynamicResolution, minScale, maxScale, budgetMs);
+	if (lockScale > 0.0f) {
+		dynamicResolution.locked = true;
+		dynamicResolution.lockedScale = lockScale;
+	}
 
-				 0.235f,-0.165f,0.595f,		//back top right
-				 0.165f,-0.235f,0.595f,		//front top left		//Top Face
-				 0.165f,-0.165f, 0.595f,	//back top left
+	// A capture has to look the same however long its frames take : the
+	// render scale stays put, and the culling by a depth read back a varying
+	// number of frames late is left out
+	if (captureFile) {
+		if (captureFrameCount < 1) captureFrameCount = 1;
+		if (captureFps < 1) captureFps = 30;
+		if (!dynamicResolution.locked) {
+			dynamicResolution.locked = true;
+			dynamicResolution.lockedScale = maxScale;
+		}
+		occlusionCulling = false;
+		if (streaming)
+			printf("Capture : streamed cells appear as they load, two captures may differ\n");
+	}
 
-				 0.235f,-0.165f,0.595f,		//back top right
-				 0.165f,-0.165f, 0.595f,	//back top left			//Back Face
-				 0.235f,-0.165f,-0.625f,	//back bottom right
+	// A server draws each request at its exact size into targets of the
+	// largest size, and its frames are unrelated to one another : no scaling,
+	// no culling by an older frame's depth, and no mouse to latch
+	if (serveSocket) {
+		if (serveMaxWidth < 1 || serveMaxHeight < 1) {
+			serveMaxWidth = 1920;
+			serveMaxHeight = 1080;
+		}
+		initDynamicResolution(dynamicResolution, 1.0f, 1.0f, budgetMs);
+		dynamicResolution.locked = true;
+		occlusionCulling = false;
+		lateLatch = false;
+		if (captureFile) {
+			printf("Capture : not available with --serve\n");
+			captureFile = NULL;
+		}
+	}
+}
 
-				 //Back Left Leg
+/* Runs an asset through the mesh processing and optimization stages and
+ * prints the cache, overdraw and fetch statistics before and after */
+int UOptimizeMeshTool()
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<unsigned int> indices;
+	MeshStatistics before, after;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (strcmp(optimizeMeshInput, "table") == 0) {
+		// All the parts of the generated table as one mesh, in generator order
+		for (int v = 0; v < TableGeometry::VERTEX_COUNT; v++) {
+			MeshVertex vertex;
+			vertex.position = glm::make_vec3(&defaultTableGeometry.positions[v * 3]);
+			vertex.uv = glm::make_vec2(&defaultTableGeometry.uvs[v * 2]);
+			vertex.normal = glm::make_vec3(&defaultTableGeometry.normals[v * 3]);
+			vertex.tangent = glm::vec4(0.0f);
+			vertices.push_back(vertex);
+		}
+		for (int i = 0; i < TableGeometry::INDEX_COUNT; i++)
+			indices.push_back(defaultTableGeometry.indices[i] + (i / BOX_INDEX_COUNT) * BOX_VERTEX_COUNT);
+		optimizeMesh(indices, vertices, &before, &after);
+	}
+	else {
+		std::vector<glm::vec3> corners;
+		std::vector<glm::vec2> uvs;
+		if (!loadOBJ(optimizeMeshInput, corners, uvs))
+			return -1;
+		// Large meshes are processed on every core
+		jobSystem.start(jobThreads);
+		processMesh(corners, uvs, DEFAULT_CREASE_ANGLE, vertices, indices, &before, &after, &jobSystem);
+		jobSystem.stop();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-				 -0.235f,0.165f,-0.625f,	//front bottom left
-				 -0.235f,0.235f,-0.625f,	//back bottom left		//Left Face
-				 -0.235f,0.235f, 0.595f,	//back top left
+	printf("%s : %d triangles, %d vertices, processed in %.2f s\n", optimizeMeshInput,
+		(int)indices.size() / 3, (int)vertices.size(), seconds);
+	printMeshStatistics("Before", before);
+	printMeshStatistics("After", after);
 
-				 -0.165f,0.165f,0.595f,		//front top right
-				 -0.235f,0.165f,-0.625f,	//front bottom left		//Front Face
-				 -0.235f,0.165f,0.595f,		//front top left
+	if (optimizeMeshOutput && !saveOBJ(optimizeMeshOutput, vertices, indices))
+		return -1;
+	return 0;
+}
 
-				 -0.165f,0.235f,-0.625f,	//back bottom right
-				 -0.235f,0.165f,-0.625f,	//front bottom left		//Bottom Face
-				 -0.165f,0.165f,-0.625f,	//front bottom right
+/* Measures the job system : the cost of scheduling one empty job, then how
+ * a parallel-for over a transform workload scales from 1 to N threads */
+int UJobBenchmark()
+{
+	int maxThreads = jobThreads > 0 ? jobThreads : (int)std::thread::hardware_concurrency();
+	if (maxThreads < 1) maxThreads = 1;
+	printf("Job benchmark, 1 to %d threads\n", maxThreads);
+
+	// Batches stay below the pool size so no job in flight gets overwritten
+	const int batchSize = JOB_POOL_SIZE / 2, batchCount = 256;
+	printf("\nScheduling overhead, %d empty jobs\n", batchSize * batchCount);
+	for (int threads = 1; threads <= maxThreads; threads++) {
+		jobSystem.start(threads);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int batch = 0; batch < batchCount; batch++) {
+			Job * root = jobSystem.create([](Job *, const void *) {});
+			for (int i = 0; i < batchSize - 1; i++)
+				jobSystem.run(jobSystem.createChild(root, [](Job *, const void *) {}));
+			jobSystem.run(root);
+			jobSystem.wait(root);
+		}
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		printf("%2d threads : %6.1f ns per job\n", threads, ns / ((double)batchSize * batchCount));
+		jobSystem.stop();
+	}
 
-				 -0.165f,0.165f,0.595f,		//front top right
-				 -0.165f,0.165f,-0.625f,	//front bottom right	//Front Face
-				 -0.235f,0.165f,-0.625f,	//front bottom left
+	// The draw list work : a model matrix and a view depth per object
+	const size_t objectCount = 1 << 20;
+	const int repeats = 10;
+	std::vector<glm::mat4> models(objectCount);
+	std::vector<GLfloat> depths(objectCount);
+	glm::mat4 view = glm::lookAt(glm::vec3(3.0f, 4.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	printf("\nScaling, %d objects transformed %d times\n", (int)objectCount, repeats);
+	double singleMs = 0.0;
+	for (int threads = 1; threads <= maxThreads; threads++) {
+		jobSystem.start(threads);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int repeat = 0; repeat < repeats; repeat++) {
+			jobSystem.parallelFor(objectCount, DRAW_LIST_CHUNK, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					glm::vec3 offset((GLfloat)(i & 1023), (GLfloat)(i >> 10), (GLfloat)repeat);
+					models[i] = glm::translate(glm::mat4(1.0f), offset);
+					depths[i] = -(view * models[i] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)).z;
+				}
+			});
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+		if (threads == 1)
+			singleMs = ms;
+		printf("%2d threads : %7.2f ms, speedup %.2fx, efficiency %3.0f%%\n",
+			threads, ms, singleMs / ms, 100.0 * singleMs / ms / threads);
+		jobSystem.stop();
+	}
+	return 0;
+}
 
-				 -0.235f,0.165f,-0.625f,	//front bottom left
-				 -0.235f,0.235f, 0.595f,	//back top left			//Left Face
-				 -0.235f,0.165f,0.595f,		//front top left
+/* Sizes the scene targets for the largest scale at the current window size.
+ * The frame graph allocates them when it next compiles. */
+void USceneTargetSize()
+{
+	if (serveSocket) {
+		SceneTargetWidth = serveMaxWidth;
+		SceneTargetHeight = serveMaxHeight;
+		return;
+	}
+	SceneTargetWidth = (GLint)(WindowWidth * dynamicResolution.maxScale + 0.5f);
+	SceneTargetHeight = (GLint)(WindowHeight * dynamicResolution.maxScale + 0.5f);
+	if (SceneTargetWidth < 1) SceneTargetWidth = 1;
+	if (SceneTargetHeight < 1) SceneTargetHeight = 1;
+}
 
-				 -0.165f,0.235f,-0.625f,	//back bottom right
-				 -0.235f,0.235f,-0.625f,	//back bottom left		//Bottom Face
-				 -0.235f,0.165f,-0.625f,	//front bottom left
+/* Declares this frame's passes and the targets they read and write */
+void UBuildFrameGraph()
+{
+	frameGraph.reset();
+
+	FrameGraphTextureDesc colorDesc = { SceneTargetWidth, SceneTargetHeight, GL_RGBA8 };
+	FrameGraphTextureDesc depthDesc = { SceneTargetWidth, SceneTargetHeight, GL_DEPTH_COMPONENT24 };
+	FrameGraphResource sceneColor = frameGraph.createTexture("Scene color", colorDesc);
+	FrameGraphResource sceneDepth = frameGraph.createTexture("Scene depth", depthDesc);
+	FrameGraphResource backbuffer = frameGraph.importBackbuffer("Backbuffer");
+
+	// Depth pre-pass : only positions are needed and no color is written, so
+	// the lighting shader below runs once per visible pixel
+	if (depthPrepass) {
+		int pass = frameGraph.addPass("Depth pre-pass", []() {
+			USetPaneViewports();
+			glEnable(GL_DEPTH_TEST);
+			glUseProgram(depthProgramID);
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			UDrawScene(DepthFirstPaneID);
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		});
+		frameGraph.write(pass, sceneDepth);
+	}
 
-				 -0.235f,0.235f, 0.595f,	//back top left
-				 -0.235f,0.235f,-0.625f,	//back bottom left		//Back Face
-				 -0.165f,0.235f,-0.625f,	//back bottom right
+	// Ambient occlusion from the pre-pass depth : occlusion and view depth at
+	// low resolution, a blur across then down that keeps to each surface, and
+	// an upsample guided by the full resolution depth
+	FrameGraphResource occlusion = -1;
+	if (USsaoActive()) {
+		GLint downsample = ssaoMode == SSAO_QUARTER ? 4 : 2;
+		FrameGraphTextureDesc lowDesc = { (SceneTargetWidth + downsample - 1) / downsample,
+			(SceneTargetHeight + downsample - 1) / downsample, GL_RG16F };
+		FrameGraphTextureDesc occlusionDesc = { SceneTargetWidth, SceneTargetHeight, GL_R8 };
+		FrameGraphResource raw = frameGraph.createTexture("SSAO raw", lowDesc);
+		FrameGraphResource blurredX = frameGraph.createTexture("SSAO blur X", lowDesc);
+		FrameGraphResource blurred = frameGraph.createTexture("SSAO blurred", lowDesc);
+		occlusion = frameGraph.createTexture("Occlusion", occlusionDesc);
+		GLint lowWidth = (SceneWidth + downsample - 1) / downsample, lowHeight = (SceneHeight + downsample - 1) / downsample;
+
+		int pass = frameGraph.addPass("SSAO", [sceneDepth, downsample, lowWidth, lowHeight]() {
+			ssaoTimer.begin();
+			glViewport(0, 0, lowWidth, lowHeight);
+			glDisable(GL_DEPTH_TEST);
+			glUseProgram(ssaoProgramID);
+			USetPaneUniforms(SsaoProjectionID, SsaoInverseProjectionID, SsaoPaneRectID, SsaoPaneCountID);
+			glUniform1i(SsaoDownsampleID, downsample);
+			glUniform2i(SsaoRegionSizeID, SceneWidth, SceneHeight);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, frameGraph.texture(sceneDepth));
+			glBindVertexArray(VertexArrayID);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+		});
+		frameGraph.read(pass, sceneDepth);
+		frameGraph.write(pass, raw);
+
+		for (int direction = 0; direction < 2; direction++) {
+			FrameGraphResource source = direction == 0 ? raw : blurredX;
+			pass = frameGraph.addPass(direction == 0 ? "SSAO blur X" : "SSAO blur Y", [source, direction, lowWidth, lowHeight]() {
+				glViewport(0, 0, lowWidth, lowHeight);
+				glUseProgram(ssaoBlurProgramID);
+				glUniform2i(BlurDirectionID, direction == 0 ? 1 : 0, direction);
+				glUniform2i(BlurRegionSizeID, lowWidth, lowHeight);
+				glBindTexture(GL_TEXTURE_2D, frameGraph.texture(source));
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+			});
+			frameGraph.read(pass, source);
+			frameGraph.write(pass, direction == 0 ? blurredX : blurred);
+		}
 
-				 -0.165f,0.235f,0.595f,		//back top right
-				 -0.165f,0.165f,-0.625f,	//front bottom right	//Right Face
-				 -0.165f,0.165f,0.595f,		//front top right
+		pass = frameGraph.addPass("SSAO upsample", [sceneDepth, blurred, downsample, lowWidth, lowHeight]() {
+			glViewport(0, 0, SceneWidth, SceneHeight);
+			glUseProgram(ssaoUpsampleProgramID);
+			USetPaneUniforms(-1, UpsampleInverseProjectionID, UpsamplePaneRectID, UpsamplePaneCountID);
+			glUniform1i(UpsampleDownsampleID, downsample);
+			glUniform2i(UpsampleRegionSizeID, lowWidth, lowHeight);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, frameGraph.texture(blurred));
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, frameGraph.texture(sceneDepth));
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+			ssaoTimer.end();
+		});
+		frameGraph.read(pass, sceneDepth);
+		frameGraph.read(pass, blurred);
+		frameGraph.write(pass, occlusion);
+	}
 
-				 -0.165f,0.165f,-0.625f,	//front bottom right
-				 -0.165f,0.235f,0.595f,		//back top right		//Right Face
-				 -0.165f,0.235f,-0.625f,	//back bottom right
+	int shading = frameGraph.addPass("Shading", [occlusion]() {
+		USetPaneViewports();
+		glEnable(GL_DEPTH_TEST);
 
-				 -0.165f,0.235f,0.595f,		//back top right
-				 -0.165f,0.165f,0.595f,		//front top right		//Top Face
-				 -0.235f,0.165f,0.595f,		//front top left
+		// Depth is final after the pre-pass, shade only the fragments that won
+		if (depthPrepass) {
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+		}
 
-				 -0.165f,0.235f,0.595f,		//back top right
-				 -0.235f,0.165f,0.595f,		//front top left		//Top Face
-				 -0.235f,0.235f, 0.595f,	//back top left
+		// Bind our texture in Texture Unit 0, the occlusion in unit 1
+		if (occlusion >= 0) {
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, frameGraph.texture(occlusion));
+		}
+		if (pbrShading) {
+			glActiveTexture(GL_TEXTURE0 + ENVIRONMENT_UNIT);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, environment.specularTexture());
+			glActiveTexture(GL_TEXTURE0 + BRDF_UNIT);
+			glBindTexture(GL_TEXTURE_2D, environment.brdfTexture());
+		}
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, Texture);
+
+		// Draw the triangles ! Count the fragments that get shaded
+		shadedSamples.begin();
+		UDrawShaded();
+		shadedSamples.end();
+
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	});
+	if (depthPrepass)
+		frameGraph.readAttachment(shading, sceneDepth);
+	else
+		frameGraph.write(shading, sceneDepth);
+	frameGraph.write(shading, sceneColor);
+	if (occlusion >= 0)
+		frameGraph.read(shading, occlusion);
+
+	// Farthest depth under each texel of a small buffer, read back for the
+	// occlusion culling of the frames a little later
+	if (occlusionCulling) {
+		FrameGraphTextureDesc hizDesc = { HIZ_WIDTH, HIZ_HEIGHT, GL_R32F };
+		FrameGraphResource hiz = frameGraph.createTexture("Hi-Z depth", hizDesc);
+		int pass = frameGraph.addPass("Hi-Z reduce", [sceneDepth]() {
+			glViewport(0, 0, HIZ_WIDTH, HIZ_HEIGHT);
+			glDisable(GL_DEPTH_TEST);
+			glUseProgram(hizProgramID);
+			glUniform2i(HizRegionSizeID, SceneWidth, SceneHeight);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, frameGraph.texture(sceneDepth));
+			glBindVertexArray(VertexArrayID);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+
+			glm::mat4 viewProjections[VIEW_MAX_PANES];
+			glm::vec4 paneRects[VIEW_MAX_PANES];
+			UPaneViewProjections(viewProjections, paneRects);
+			occlusionCuller.capture(viewProjections, paneRects, viewPaneCount);
+		});
+		frameGraph.read(pass, sceneDepth);
+		frameGraph.write(pass, hiz);
+		frameGraph.keep(pass);
+	}
 
-				 -0.165f,0.235f,0.595f,		//back top right
-				 -0.235f,0.235f, 0.595f,	//back top left			//Back Face
-				 -0.165f,0.235f,-0.625f,	//back bottom right
+	// A server reads the rendered region back for its client instead
+	if (serveSocket) {
+		int readback = frameGraph.addPass("Server readback", []() {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, serveReadback);
+			glReadPixels(0, 0, SceneWidth, SceneHeight, GL_BGRA, GL_UNSIGNED_BYTE, (void*)serveReadbackOffset);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		});
+		frameGraph.readAttachment(readback, sceneColor);
+		frameGraph.keep(readback);
+		return;
+	}
 
-				 //Back Right Leg
+	// Upscale the rendered region to the whole window
+	int upscale = frameGraph.addPass("Upscale", [sceneColor]() {
+		glViewport(0, 0, WindowWidth, WindowHeight);
+		glDisable(GL_DEPTH_TEST);
+
+		glUseProgram(upscaleProgramID);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, frameGraph.texture(sceneColor));
+		glUniform1i(SceneTextureID, 0);
+		glUniform2f(SceneRegionID, (GLfloat)SceneWidth / SceneTargetWidth, (GLfloat)SceneHeight / SceneTargetHeight);
+		glUniform2f(SceneTexelSizeID, 1.0f / SceneTargetWidth, 1.0f / SceneTargetHeight);
+		// Sharpening only helps when there is something to upscale
+		glUniform1f(SharpnessID, SceneWidth < WindowWidth ? upscaleSharpness : 0.0f);
+		glBindVertexArray(VertexArrayID);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	});
+	frameGraph.read(upscale, sceneColor);
+	frameGraph.write(upscale, backbuffer);
+}
 
-				 0.165f,0.165f,-0.625f,		//front bottom left
-				 0.165f,0.235f,-0.625f,		//back bottom left		//Left Face
-				 0.165f,0.235f, 0.595f,		//back top left
+/* Ambient occlusion reads the depth the pre-pass lays down */
+bool USsaoActive()
+{
+	return ssaoMode != SSAO_OFF && depthPrepass;
+}
 
-				 0.235f,0.165f,0.595f,		//front top right
-				 0.165f,0.165f,-0.625f,		//front bottom left		//Front Face
-				 0.165f,0.165f,0.595f,		//front top left
+/* Samples of the occlusion hemisphere around +Z, packed closer to the
+ * center where nearby geometry occludes most. Fixed seed, the same every
+ * run. */
+void USsaoKernel(glm::vec3 kernel[SSAO_KERNEL_SIZE])
+{
+	unsigned int random = 0x9E3779B9u;
+	for (int i = 0; i < SSAO_KERNEL_SIZE; i++) {
+		glm::vec3 sample;
+		do {
+			for (int axis = 0; axis < 3; axis++) {
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				sample[axis] = (random & 0xFFFF) / 65535.0f * 2.0f - 1.0f;
+			}
+			sample.z = glm::abs(sample.z);
+		} while (glm::dot(sample, sample) > 1.0f || glm::dot(sample, sample) < 0.01f);
+
+		GLfloat scale = (GLfloat)(i + 1) / SSAO_KERNEL_SIZE;
+		kernel[i] = glm::normalize(sample) * (0.1f + 0.9f * scale * scale);
+	}
+}
 
-				 0.235f,0.235f,-0.625f,		//back bottom right
-				 0.165f,0.165f,-0.625f,		//front bottom left		//Bottom Face
-				 0.235f,0.165f,-0.625f,		//front bottom right
+/* Uploads the projection of every pane and its rectangle in scene target
+ * pixels, for the passes that turn depth back into view space. An ID of -1
+ * is skipped. */
+void USetPaneUniforms(GLint projectionID, GLint inverseProjectionID, GLint paneRectID, GLint paneCountID)
+{
+	glm::mat4 inverses[VIEW_MAX_PANES];
+	glm::vec4 rects[VIEW_MAX_PANES];
+	for (GLint pane = 0; pane < viewPaneCount; pane++) {
+		GLint x, y, width, height;
+		UPaneRect(pane, x, y, width, height);
+		rects[pane] = glm::vec4((GLfloat)x, (GLfloat)y, (GLfloat)glm::max(width, 1), (GLfloat)glm::max(height, 1));
+		inverses[pane] = glm::inverse(paneProjections[pane]);
+	}
+	if (projectionID >= 0)
+		glUniformMatrix4fv(projectionID, viewPaneCount, GL_FALSE, glm::value_ptr(paneProjections[0]));
+	glUniformMatrix4fv(inverseProjectionID, viewPaneCount, GL_FALSE, glm::value_ptr(inverses[0]));
+	glUniform4fv(paneRectID, viewPaneCount, glm::value_ptr(rects[0]));
+	glUniform1i(paneCountID, viewPaneCount);
+}
 
-				 0.235f,0.165f,0.595f,		//front top right
-				 0.235f,0.165f,-0.625f,		//front bottom right	//Front Face
-				 0.165f,0.165f,-0.625f,		//front bottom left
+/* Places the tables of the showroom in the scene graph : rows of tables
+ * under one root, the parts of each table under the table */
+void UBuildShowroom()
+{
+	sceneGraph.clear();
+	partNodes.clear();
+	nodeParts.clear();
+	sceneGraph.reserve(1 + showroomSize + showroomSize * showroomSize * (1 + TABLE_PART_COUNT));
+
+	GLfloat origin = (showroomSize - 1) * SHOWROOM_SPACING * 0.5f;
+	SceneNode root = sceneGraph.createNode(-1, glm::mat4(1.0f), -1);
+	for (GLint row = 0; row < showroomSize; row++) {
+		glm::vec3 rowOffset(0.0f, row * SHOWROOM_SPACING - origin, 0.0f);
+		SceneNode rowNode = sceneGraph.createNode(root, glm::translate(glm::mat4(1.0f), rowOffset), -1);
+
+		for (GLint column = 0; column < showroomSize; column++) {
+			glm::vec3 offset(column * SHOWROOM_SPACING - origin, 0.0f, 0.0f);
+			SceneNode table = sceneGraph.createNode(rowNode, glm::translate(glm::mat4(1.0f), offset), -1);
+
+			// The part meshes are modelled in table space
+			for (GLint part = 0; part < TABLE_PART_COUNT; part++) {
+				const MeshRange & mesh = meshPool.mesh(tableMeshes[part]);
+				SceneNode node = sceneGraph.createNode(table, glm::mat4(1.0f), tableMeshes[part]);
+				sceneGraph.setLocalBounds(node, mesh.boundsMin, mesh.boundsMax);
+				nodeParts.resize(node + 1, -1);
+				nodeParts[node] = (int)partNodes.size();
+				partNodes.push_back(node);
+			}
+		}
+	}
 
-				 0.165f,0.165f,-0.625f,		//front bottom left
-				 0.165f,0.235f, 0.595f,		//back top left			//Left Face
-				 0.165f,0.165f,0.595f,		//front top left
+	// Cells of STREAM_CELL_TABLES squared tables, the last row and column of
+	// cells may be partial
+	if (streaming) {
+		streamCellsPerSide = (showroomSize + STREAM_CELL_TABLES - 1) / STREAM_CELL_TABLES;
+		partCells.resize(partNodes.size());
+		cellCenters.assign(streamCellsPerSide * streamCellsPerSide, glm::vec3(0.0f));
+		std::vector<int> cellTables(cellCenters.size(), 0);
+		for (GLint table = 0; table < showroomSize * showroomSize; table++) {
+			GLint row = table / showroomSize, column = table % showroomSize;
+			int cell = (row / STREAM_CELL_TABLES) * streamCellsPerSide + column / STREAM_CELL_TABLES;
+			for (GLint part = 0; part < TABLE_PART_COUNT; part++)
+				partCells[table * TABLE_PART_COUNT + part] = cell;
+			cellCenters[cell] += glm::vec3(column * SHOWROOM_SPACING - origin, row * SHOWROOM_SPACING - origin, 0.0f);
+			cellTables[cell]++;
+		}
+		for (size_t cell = 0; cell < cellCenters.size(); cell++)
+			cellCenters[cell] /= (GLfloat)cellTables[cell];
+
+		cellStreamer.create((int)cellCenters.size(), ULoadCell, streamCpuBudget, streamGpuBudget);
+		for (size_t cell = 0; cell < cellCenters.size(); cell++)
+			UStreamCellBounds((int)cell);
+		printf("Streaming : %d cells of up to %d tables, budgets %.0f KB CPU %.0f KB GPU\n", (int)cellCenters.size(),
+			STREAM_CELL_TABLES * STREAM_CELL_TABLES, streamCpuBudget / 1024.0, streamGpuBudget / 1024.0);
+	}
 
-				 0.235f,0.235f,-0.625f,		//back bottom right
-				 0.165f,0.235f,-0.625f,		//back bottom left		//Bottom Face
-				 0.165f,0.165f,-0.625f,		//front bottom left
+	sceneGraph.update();
+	printf("Scene graph : %d nodes, %d parts\n", sceneGraph.size(), (int)partNodes.size());
+}
 
-				 0.165f,0.235f, 0.595f,		//back top left
-				 0.165f,0.235f,-0.625f,		//back bottom left		//Back Face
-				 0.235f,0.235f,-0.625f,		//back bottom right
+/* Gives the parts of a cell's tables the bounds of what is drawn for them :
+ * the cell's own variant once resident, the placeholder block otherwise */
+void UStreamCellBounds(int cell)
+{
+	bool resident = cellStreamer.resident(cell);
+	GLint firstRow = (cell / streamCellsPerSide) * STREAM_CELL_TABLES, firstColumn = (cell % streamCellsPerSide) * STREAM_CELL_TABLES;
+	GLint lastRow = glm::min(firstRow + STREAM_CELL_TABLES, showroomSize), lastColumn = glm::min(firstColumn + STREAM_CELL_TABLES, showroomSize);
+	for (GLint row = firstRow; row < lastRow; row++) {
+		for (GLint column = firstColumn; column < lastColumn; column++) {
+			GLint table = row * showroomSize + column;
+			for (GLint part = 0; part < TABLE_PART_COUNT; part++) {
+				int mesh = resident ? cellStreamer.mesh(cell, part) : (part == TABLE_TOP ? placeholderMesh : tableMeshes[part]);
+				const MeshRange & range = meshPool.mesh(mesh);
+				sceneGraph.setLocalBounds(partNodes[table * TABLE_PART_COUNT + part], range.boundsMin, range.boundsMax);
+			}
+		}
+	}
+}
 
-				 0.235f,0.235f,0.595f,		//back top right
-				 0.235f,0.165f,-0.625f,		//front bottom right	//Right Face
-				 0.235f,0.165f,0.595f,		//front top right
+/* Starts the loads and uploads of the cells requested last frame, and
+ * updates the bounds of the cells that moved in or out */
+void UUpdateStreaming()
+{
+	cellStreamer.update(meshPool, jobSystem);
+	const std::vector<int> & changed = cellStreamer.changedCells();
+	for (size_t i = 0; i < changed.size(); i++)
+		UStreamCellBounds(changed[i]);
+}
 
-				 0.235f,0.165f,-0.625f,		//front bottom right
-				 0.235f,0.235f,0.595f,		//back top right		//Right Face
-				 0.235f,0.235f,-0.625f,		//back bottom right
+/* Generates the table variant of a cell, on a worker : its dimensions vary a
+ * little around the edited table, by a hash of the cell */
+void ULoadCell(int cell, CellContent & out_content)
+{
+	unsigned int hash = (unsigned int)cell * 2654435761u;
+	GLfloat a = ((hash >> 8) & 255) / 255.0f - 0.5f, b = ((hash >> 16) & 255) / 255.0f - 0.5f;
+	TableDimensions dimensions = streamedDimensions;
+	dimensions.topWidth *= 1.0f + a * 0.2f;
+	dimensions.topDepth *= 1.0f + b * 0.2f;
+	dimensions.height *= 1.0f + (a + b) * 0.1f;
+	dimensions.legThickness *= 1.0f + b * 0.4f;
+	TableGeometry geometry = buildTableGeometry(dimensions);
+
+	out_content.vertices.resize(TABLE_PART_COUNT);
+	out_content.indices.resize(TABLE_PART_COUNT);
+	out_content.bvhs.resize(TABLE_PART_COUNT);
+	for (int part = 0; part < TABLE_PART_COUNT; part++) {
+		UBoxMesh(geometry, part, out_content.vertices[part], out_content.indices[part]);
+		std::vector<glm::vec3> positions(out_content.vertices[part].size());
+		for (size_t v = 0; v < positions.size(); v++)
+			positions[v] = out_content.vertices[part][v].position;
+		out_content.bvhs[part].build(positions, out_content.indices[part]);
+	}
+}
 
-				 0.235f,0.235f,0.595f,		//back top right
-				 0.235f,0.165f,0.595f,		//front top right		//Top Face
-				 0.165f,0.165f,0.595f,		//front top left
+/* The mesh drawn for a part, from its scene graph index. -1 when a cell that
+ * is not resident leaves the part out. */
+int UPartMesh(int index)
+{
+	if (!streaming)
+		return sceneGraph.meshAt(index);
+	int part = nodeParts[sceneGraph.nodeAt(index)];
+	int cell = partCells[part];
+	if (cellStreamer.resident(cell))
+		return cellStreamer.mesh(cell, part % TABLE_PART_COUNT);
+	return part % TABLE_PART_COUNT == TABLE_TOP ? placeholderMesh : -1;
+}
 
-				 0.235f,0.235f,0.595f,		//back top right
-				 0.165f,0.165f,0.595f,		//front top left		//Top Face
-				 0.165f,0.235f, 0.595f,		//back top left
+/* The triangles picking tests for a part, NULL when nothing is drawn */
+const MeshBVH * UPartBVH(int index)
+{
+	int mesh = UPartMesh(index);
+	if (mesh < 0)
+		return NULL;
+	if (streaming) {
+		int part = nodeParts[sceneGraph.nodeAt(index)];
+		if (cellStreamer.resident(partCells[part]))
+			return &cellStreamer.meshBVH(partCells[part], part % TABLE_PART_COUNT);
+	}
+	return &meshBVHs[mesh];
+}
 
-				 0.235f,0.235f,0.595f,		//back top right
-				 0.165f,0.235f, 0.595f,		//back top left			//Back Face
-				 0.235f,0.235f,-0.625f,		//back bottom right
+/* Slides the front left leg of the middle table up or down on its own, and
+ * reports what the scene graph had to update for it */
+void UMoveLeg(GLfloat offset)
+{
+	legOffset = glm::clamp(legOffset + offset, -0.2f, 0.2f);
+	GLint middle = (showroomSize / 2) * showroomSize + showroomSize / 2;
+	SceneNode leg = partNodes[middle * TABLE_PART_COUNT + TABLE_LEG_FRONT_LEFT];
+	sceneGraph.setLocalTransform(leg, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, legOffset)));
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	sceneGraph.update();
+	double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	printf("Leg moved to %.2f : %d of %d nodes transformed, %d bounds refit, %.1f us\n", legOffset,
+		sceneGraph.statistics().updatedNodes, sceneGraph.size(), sceneGraph.statistics().refitNodes, us);
+}
 
-				 //Table Top
+/* Starts a trace capture, or stops the running one and writes it out */
+void UToggleTrace()
+{
+	if (traceEnabled) {
+		traceStop();
+		traceWrite(traceFile ? traceFile : "trace.json");
+	}
+	else {
+		traceStart();
+		printf("Trace : capturing, press n again to write it\n");
+	}
+}
 
-				 -0.255f,-0.255f,0.595f,	//front bottom left
-				 -0.255f,0.255f,0.595f,		//back bottom left		//Left Face
-				 -0.255f,0.255f,0.625f,		//back top left
+/* Switches the viewport layout. The panes are drawn in one pass when the
+ * vertex shader can route instances to viewports, one pane per draw
+ * otherwise. */
+void USetLayout(ViewLayout layout)
+{
+	// Z is height : the top view looks down, front and side look level
+	const ViewPane perspective = { "Perspective", glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), true, glm::vec3(0.0f), glm::vec3(0.0f) };
+	const ViewPane top = { "Top", glm::vec4(0.0f, 0.5f, 0.5f, 0.5f), false, glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f) };
+	const ViewPane front = { "Front", glm::vec4(0.0f, 0.0f, 0.5f, 0.5f), false, glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) };
+	const ViewPane side = { "Side", glm::vec4(0.5f, 0.0f, 0.5f, 0.5f), false, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) };
+
+	viewLayout = layout;
+	if (layout == LAYOUT_QUAD) {
+		viewPanes[0] = top;
+		viewPanes[1] = perspective;
+		viewPanes[1].rect = glm::vec4(0.5f, 0.5f, 0.5f, 0.5f);
+		viewPanes[2] = front;
+		viewPanes[3] = side;
+		viewPaneCount = 4;
+	}
+	else {
+		viewPanes[0] = perspective;
+		viewPaneCount = 1;
+	}
 
-				 0.255f,-0.255f,0.625f,		//front top right
-				 -0.255f,-0.255f,0.595f,	//front bottom left		//Front Face
-				 -0.255f,-0.255f,0.625f,	//front top left
+	paneInstances = vertexViewportIndex ? viewPaneCount : 1;
+	meshPool.setObjectDivisor(paneInstances);
+	printf("Layout : %d pane%s, %s\n", viewPaneCount, viewPaneCount > 1 ? "s" : "",
+		paneInstances > 1 ? "drawn together with instanced viewports" : "one draw per pane");
+}
 
-				 0.255f,0.255f,0.595f,		//back bottom right
-				 -0.255f,-0.255f,0.595f,	//front bottom left		//Bottom Face
-				 0.255f,-0.255f,0.595f,		//front bottom right
+/* Computes the camera of every pane. The perspective pane follows the orbit
+ * camera, the orthographic panes frame the whole showroom. */
+void UPaneCameras(const glm::mat4 & ViewMatrix)
+{
+	GLfloat showroomExtent = (showroomSize - 1) * SHOWROOM_SPACING * 0.5f;
+	GLfloat halfSize = showroomExtent + glm::max(tableDimensions.height, tableDimensions.topWidth) * 0.6f;
+	GLfloat distance = halfSize * 4.0f + 1.0f;
+
+	for (GLint pane = 0; pane < viewPaneCount; pane++) {
+		const ViewPane & view = viewPanes[pane];
+		GLfloat aspect = (WindowWidth * view.rect.z) / glm::max(WindowHeight * view.rect.w, 1.0f);
+
+		if (view.perspective) {
+			//Determine projection based on whether or not Z is held
+			if (currentKey == 'z') {
+				paneProjections[pane] = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, 0.1f, 100.0f);
+			}
+			else {
+				paneProjections[pane] = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 100.0f);
+			}
+			paneViews[pane] = ViewMatrix;
+		}
+		else {
+			paneProjections[pane] = glm::ortho(-halfSize * aspect, halfSize * aspect, -halfSize, halfSize, 0.1f, distance * 2.0f);
+			paneViews[pane] = glm::lookAt(view.direction * distance, glm::vec3(0.0f), view.up);
+		}
+	}
+}
 
-				 0.255f,-0.255f,0.625f,		//front top right
-				 0.255f,-0.255f,0.595f,		//front bottom right	//Front Face
-				 -0.255f,-0.255f,0.595f,	//front bottom left
+/* A pane's part of the scene region in pixels. Neighbouring panes share
+ * their edges exactly. */
+void UPaneRect(GLint pane, GLint & x, GLint & y, GLint & width, GLint & height)
+{
+	const glm::vec4 & rect = viewPanes[pane].rect;
+	x = (GLint)(rect.x * SceneWidth);
+	y = (GLint)(rect.y * SceneHeight);
+	width = (GLint)((rect.x + rect.z) * SceneWidth) - x;
+	height = (GLint)((rect.y + rect.w) * SceneHeight) - y;
+}
 
-				 -0.255f,-0.255f,0.595f,	//front bottom left
-				 -0.255f,0.255f,0.625f,		//back top left			//Left Face
-				 -0.255f,-0.255f,0.625f,	//front top left
+/* The camera of every pane, and its rectangle as fractions of the region */
+void UPaneViewProjections(glm::mat4 viewProjections[VIEW_MAX_PANES], glm::vec4 rects[VIEW_MAX_PANES])
+{
+	for (GLint pane = 0; pane < viewPaneCount; pane++) {
+		viewProjections[pane] = paneProjections[pane] * paneViews[pane];
+		rects[pane] = viewPanes[pane].rect;
+	}
+}
 
-				 0.255f,0.255f,0.595f,		//back bottom right
-				 -0.255f,0.255f,0.595f,		//back bottom left		//Bottom Face
-				 -0.255f,-0.255f,0.595f,	//front bottom left
+/* Sets the only viewport to a pane */
+void UPaneViewport(GLint pane)
+{
+	GLint x, y, width, height;
+	UPaneRect(pane, x, y, width, height);
+	glViewport(x, y, width, height);
+}
 
-				 -0.255f,0.255f,0.625f,		//back top left
-				 -0.255f,0.255f,0.595f,		//back bottom left		//Back Face
-				 0.255f,0.255f,0.595f,		//back bottom right
+/* Sets the viewports of the panes drawn together, or the first pane's */
+void USetPaneViewports()
+{
+	if (paneInstances == 1) {
+		UPaneViewport(0);
+		return;
+	}
+	for (GLint pane = 0; pane < viewPaneCount; pane++) {
+		GLint x, y, width, height;
+		UPaneRect(pane, x, y, width, height);
+		glViewportIndexedf(pane, (GLfloat)x, (GLfloat)y, (GLfloat)width, (GLfloat)height);
+	}
+}
 
-				 0.255f,0.255f,0.625f,		//back top right
-				 0.255f,-0.255f,0.595f,		//front bottom right	//Right Face
-				 0.255f,-0.255f,0.625f,		//front top right
+/* Collects the table parts inside the frustum of any pane, culling whole
+ * rows and tables by their bounds, and orders them for drawing. The draw
+ * items of the visible parts are filled in parallel. */
+void UBuildDrawList(const glm::mat4 & ViewMatrix)
+{
+	TRACE_SCOPE("UBuildDrawList");
+	ALLOCATION_SCOPE("UBuildDrawList");
+	visibleNodes.clear();
+	placeholderDraws = 0;
+	nodeVisible.resize(sceneGraph.size(), 0);
+	occludedPixels.resize(sceneGraph.size(), 0.0f);
+
+	// The newest depth read back, reprojected into this frame's cameras
+	bool occlusion = false;
+	if (occlusionCulling) {
+		glm::mat4 viewProjections[VIEW_MAX_PANES];
+		glm::vec4 paneRects[VIEW_MAX_PANES];
+		UPaneViewProjections(viewProjections, paneRects);
+		occlusion = occlusionCuller.prepare(viewProjections, paneRects, viewPaneCount);
+	}
 
-				 0.255f,-0.255f,0.595f,		//front bottom right
-				 0.255f,0.255f,0.625f,		//back top right		//Right Face
-				 0.255f,0.255f,0.595f,		//back bottom right
+	// nodeVisible is 1 once a pane sees the part, 2 while it was only hidden
+	for (GLint pane = 0; pane < viewPaneCount; pane++) {
+		Frustum frustum = frustumFromMatrix(paneProjections[pane] * paneViews[pane]);
+		GLint x, y, width, height;
+		UPaneRect(pane, x, y, width, height);
+		GLfloat panePixels = (GLfloat)width * height;
+		sceneGraph.cull(frustum, [pane, occlusion, panePixels](int index) {
+			if (nodeVisible[index] == 1)
+				return;
+			int mesh = UPartMesh(index);
+			if (streaming) {
+				int cell = partCells[nodeParts[sceneGraph.nodeAt(index)]];
+				cellStreamer.request(cell, glm::distance(cellCenters[cell], CameraForwardZ), true);
+			}
+			if (mesh < 0)
+				return;
+			float coverage;
+			if (occlusion && occlusionCuller.occluded(pane, sceneGraph.worldMinAt(index), sceneGraph.worldMaxAt(index), &coverage)) {
+				if (nodeVisible[index] == 0) {
+					nodeVisible[index] = 2;
+					occludedNodes.push_back(index);
+				}
+				occludedPixels[index] += coverage * panePixels;
+				return;
+			}
+			nodeVisible[index] = 1;
+			visibleNodes.push_back(index);
+			if (mesh == placeholderMesh)
+				placeholderDraws++;
+		});
+	}
 
-				 0.255f,0.255f,0.625f,		//back top right
-				 0.255f,-0.255f,0.625f,		//front top right		//Top Face
-				 -0.255f,-0.255f,0.625f,	//front top left
+	// The cells around the camera load ahead, before they come into view
+	if (streaming) {
+		for (size_t cell = 0; cell < cellCenters.size(); cell++) {
+			GLfloat distance = glm::distance(cellCenters[cell], CameraForwardZ);
+			if (distance < STREAM_PREFETCH_DISTANCE)
+				cellStreamer.request((int)cell, distance, false);
+		}
+	}
 
-				 0.255f,0.255f,0.625f,		//back top right
-				 -0.255f,-0.255f,0.625f,	//front top left		//Top Face
-				 -0.255f,0.255f,0.625f,		//back top left
+	// What the parts hidden in every pane would have cost : each is drawn in
+	// every pane, by the pre-pass and the shading pass
+	GLint passes = depthPrepass ? 2 : 1;
+	memset(&occlusionStats, 0, sizeof(occlusionStats));
+	for (size_t i = 0; i < occludedNodes.size(); i++) {
+		int node = occludedNodes[i];
+		if (nodeVisible[node] == 2) {
+			const MeshRange & mesh = meshPool.mesh(UPartMesh(node));
+			occlusionStats.objects++;
+			occlusionStats.triangles += (long long)mesh.indexCount / 3 * viewPaneCount * passes;
+			occlusionStats.vertices += (long long)mesh.vertexCount * viewPaneCount * passes;
+			occlusionStats.fragments += (long long)occludedPixels[node] * passes;
+		}
+		nodeVisible[node] = 0;
+		occludedPixels[node] = 0.0f;
+	}
+	occludedNodes.clear();
+	for (size_t i = 0; i < visibleNodes.size(); i++)
+		nodeVisible[visibleNodes[i]] = 0;
+	drawList.resize(visibleNodes.size());
+
+	// A missing texture or a light turned off to 0 leave their terms out
+	unsigned int frameFeatures = (Texture != 0 ? SHADER_TEXTURE : 0) | (lightIntensity != 0.0f ? SHADER_LIGHT : 0)
+		| (USsaoActive() ? SHADER_AO : 0) | (pbrShading ? SHADER_PBR : 0);
+
+	jobSystem.parallelFor(visibleNodes.size(), DRAW_LIST_CHUNK, [&](size_t begin, size_t end) {
+		TRACE_SCOPE("Draw items");
+		for (size_t i = begin; i < end; i++) {
+			int node = visibleNodes[i];
+			DrawItem & item = drawList[i];
+			item.node = node;
+			item.mesh = UPartMesh(node);
+			item.model = sceneGraph.worldAt(node);
+			item.material = pbrShading ? varnishMaterial : tableMaterial;
+			item.features = frameFeatures;
+			if (!lowQuality && glm::vec3(item.material) != glm::vec3(0.0f))
+				item.features |= SHADER_SPECULAR;
+			item.center_worldspace = (sceneGraph.worldMinAt(node) + sceneGraph.worldMaxAt(node)) * 0.5f;
+			// The camera looks down -Z in view space
+			item.depth = -(ViewMatrix * glm::vec4(item.center_worldspace, 1.0f)).z;
+		}
+	});
+
+	// Nearest first, so later draws fail the depth test instead of being shaded.
+	// The order follows the orbit camera, orthographic panes see few overlaps.
+	// Objects are grouped by shader variant first, each group is one batch.
+	if (sortFrontToBack) {
+		std::sort(drawList.begin(), drawList.end(), [](const DrawItem & a, const DrawItem & b) {
+			return a.features != b.features ? a.features < b.features : a.depth < b.depth;
+		});
+	}
+	else {
+		// Not std::stable_sort, which takes a temporary buffer every frame
+		std::sort(drawList.begin(), drawList.end(), [](const DrawItem & a, const DrawItem & b) {
+			return a.features != b.features ? a.features < b.features : a.node < b.node;
+		});
+	}
+}
 
-				 0.255f,0.255f,0.625f,		//back top right
-				 -0.255f,0.255f,0.625f,		//back top left			//Back Face
-				 0.255f,0.255f,0.595f,		//back bottom right
+/* Writes the pane cameras and light values into the frame ring and binds
+ * them to the FrameUniforms block */
+void UUploadFrameUniforms()
+{
+	GLintptr offset;
+	FrameUniforms * uniforms = (FrameUniforms*)frameRing.allocate(sizeof(FrameUniforms), uniformBufferAlignment, offset);
+	if (!uniforms)
+		return;
+
+	for (GLint pane = 0; pane < VIEW_MAX_PANES; pane++) {
+		GLint used = pane < viewPaneCount ? pane : 0;
+		uniforms->VP[pane] = paneProjections[used] * paneViews[used];
+		uniforms->V[pane] = paneViews[used];
+	}
+	uniforms->LightPosition_worldspace = lightPos;
+	uniforms->PaneInstances = paneInstances;
+	uniforms->LightColor = lightColor;
+	uniforms->LightPower = lightIntensity;
 
-				 //Left Bridge
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, frameRing.buffer(), offset, sizeof(FrameUniforms));
+}
 
-				 -0.235f,-0.165f,-0.325f,	//front bottom left
-				 -0.235f,0.165f,-0.325f,	//back bottom left		//Left Face
-				 -0.235f,0.165f,-0.255f,	//back top left
+/* Writes the draw list into the frame ring as indirect draw commands and
+ * per-object data. Draw i reads object i through its base instance. */
+void UUploadDrawList()
+{
+	TRACE_SCOPE("UUploadDrawList");
+	ALLOCATION_SCOPE("UUploadDrawList");
+	drawCommandCount = 0;
+	if (drawList.empty())
+		return;
+
+	ObjectData * objects = (ObjectData*)frameRing.allocate(drawList.size() * sizeof(ObjectData), 16, objectDataOffset);
+	DrawElementsIndirectCommand * commands = (DrawElementsIndirectCommand*)frameRing.allocate(
+		drawList.size() * sizeof(DrawElementsIndirectCommand), 4, drawCommandOffset);
+	if (!objects || !commands)
+		return;
+
+	// Whole structs are written in order, the mapping may be write-combined.
+	// Each job writes its own contiguous range of both arrays.
+	jobSystem.parallelFor(drawList.size(), UPLOAD_CHUNK, [&](size_t begin, size_t end) {
+		TRACE_SCOPE("Draw commands");
+		for (size_t i = begin; i < end; i++) {
+			const DrawItem & item = drawList[i];
+			const MeshRange & mesh = meshPool.mesh(item.mesh);
+
+			DrawElementsIndirectCommand command;
+			command.count = mesh.indexCount;
+			command.instanceCount = paneInstances;
+			command.firstIndex = mesh.firstIndex;
+			command.baseVertex = mesh.baseVertex;
+			command.baseInstance = (GLuint)i;
+			commands[i] = command;
+
+			ObjectData object;
+			object.model = item.model;
+			object.material = item.material;
+			objects[i] = object;
+		}
+	});
+	drawCommandCount = (GLsizei)drawList.size();
+
+	drawBatches.clear();
+	for (GLsizei i = 0; i < drawCommandCount; i++) {
+		if (drawBatches.empty() || drawBatches.back().features != drawList[i].features) {
+			DrawBatch batch = { drawList[i].features, i, 0 };
+			drawBatches.push_back(batch);
+		}
+		drawBatches.back().count++;
+	}
 
-				 -0.165f,-0.165f,-0.255f,	//front top right
-				 -0.235f,-0.165f,-0.325f,	//front bottom left		//Front Face
-				 -0.235f,-0.165f,-0.255f,	//front top left
+	if (multiDrawIndirect)
+		meshPool.bindObjectBuffer(frameRing.buffer(), objectDataOffset);
+}
 
-				 -0.165f,0.165f,-0.325f,	//back bottom right
-				 -0.235f,-0.165f,-0.325f,	//front bottom left		//Bottom Face
-				 -0.165f,-0.165f,-0.325f,	//front bottom right
+/* Issues the whole draw list with the currently bound program, whose
+ * FirstPane uniform is at firstPaneID. Each draw covers paneInstances panes. */
+void UDrawScene(GLint firstPaneID)
+{
+	if (drawCommandCount == 0)
+		return;
+
+	for (GLint firstPane = 0; firstPane < viewPaneCount; firstPane += paneInstances) {
+		glUniform1i(firstPaneID, firstPane);
+		// Panes drawn one at a time get the plain viewport
+		if (paneInstances == 1 && viewPaneCount > 1)
+			UPaneViewport(firstPane);
+		UDrawCommands(0, drawCommandCount);
+	}
 
-				 -0.165f,-0.165f,-0.255f,	//front top right
-				 -0.165f,-0.165f,-0.325f,	//front bottom right	//Front Face
-				 -0.235f,-0.165f,-0.325f,	//front bottom left
+	glBindVertexArray(VertexArrayID);
+}
 
-				 -0.235f,-0.165f,-0.325f,	//front bottom left
-				 -0.235f,0.165f,-0.255f,	//back top left			//Left Face
-				 -0.235f,-0.165f,-0.255f,	//front top left
+/* Issues the draw list batch by batch, each with the cheapest variant of
+ * the lighting shader that draws it correctly in the panes being drawn */
+void UDrawShaded()
+{
+	if (drawCommandCount == 0)
+		return;
+
+	// Whatever the previous pass left bound is not ours, even if it is 0
+	bool bound = false;
+	GLuint boundProgram = 0;
+	for (GLint firstPane = 0; firstPane < viewPaneCount; firstPane += paneInstances) {
+		if (paneInstances == 1 && viewPaneCount > 1)
+			UPaneViewport(firstPane);
+
+		unsigned int paneFeatures = UPaneFeatures(firstPane);
+		for (size_t b = 0; b < drawBatches.size(); b++) {
+			const ShaderVariant & variant = UShaderVariant(drawBatches[b].features & paneFeatures);
+			// A variant that failed to build has no program to draw with
+			if (variant.program == 0)
+				continue;
+			if (!bound || variant.program != boundProgram) {
+				glUseProgram(variant.program);
+				// Set our "myTextureSampler" sampler to use Texture Unit 0, the
+				// occlusion is on unit 1
+				glUniform1i(variant.textureID, 0);
+				glUniform1i(variant.occlusionID, 1);
+				boundProgram = variant.program;
+				bound = true;
+			}
+			glUniform1i(variant.firstPaneID, firstPane);
+			UDrawCommands(drawBatches[b].first, drawBatches[b].count);
+		}
+	}
 
-				 -0.165f,0.165f,-0.325f,	//back bottom right
-				 -0.235f,0.165f,-0.325f,	//back bottom left		//Bottom Face
-				 -0.235f,-0.165f,-0.325f,	//front bottom left
+	glBindVertexArray(VertexArrayID);
+}
 
-				 -0.235f,0.165f,-0.255f,	//back top left
-				 -0.235f,0.165f,-0.325f,	//back bottom left		//Back Face
-				 -0.165f,0.165f,-0.325f,	//back bottom right
+/* Draws commands [first, first + count) of the draw list */
+void UDrawCommands(GLsizei first, GLsizei count)
+{
+	if (multiDrawIndirect) {
+		// One call for the whole range, however many objects it has
+		glBindVertexArray(meshPool.vertexArray());
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, frameRing.buffer());
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+			(void*)(drawCommandOffset + first * sizeof(DrawElementsIndirectCommand)), count, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		drawCallCount++;
+	}
+	else {
+		// Without base instance support, point the per-object attributes at
+		// each object in turn. The commands are rebuilt from the draw list
+		// rather than read back from the mapped ring.
+		for (GLsizei i = first; i < first + count; i++) {
+			const MeshRange & mesh = meshPool.mesh(drawList[i].mesh);
+			meshPool.bindObjectBuffer(frameRing.buffer(), objectDataOffset + i * sizeof(ObjectData));
+			glBindVertexArray(meshPool.vertexArray());
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT,
+				(void*)(mesh.firstIndex * sizeof(unsigned int)), paneInstances, mesh.baseVertex);
+			drawCallCount++;
+		}
+	}
+}
 
-				 -0.165f,0.165f,-0.255f,	//back top right
-				 -0.165f,-0.165f,-0.325f,	//front bottom right	//Right Face
-				 -0.165f,-0.165f,-0.255f,	//front top right
+/* Features the panes drawn together from firstPane allow. Orthographic panes
+ * are views for measuring the layout and go without the highlight; panes
+ * drawn in one pass get what any of them needs. */
+unsigned int UPaneFeatures(GLint firstPane)
+{
+	unsigned int features = SHADER_TEXTURE | SHADER_LIGHT | SHADER_AO | SHADER_PBR;
+	for (GLint pane = firstPane; pane < firstPane + paneInstances && pane < viewPaneCount; pane++) {
+		// Perspective projections send w from -z, orthographic ones keep it 1
+		if (paneProjections[pane][2][3] != 0.0f)
+			features |= SHADER_SPECULAR;
+	}
+	return features;
+}
 
-				 -0.165f,-0.165f,-0.325f,	//front bottom right
-				 -0.165f,0.165f,-0.255f,	//back top right		//Right Face
-				 -0.165f,0.165f,-0.325f,	//back bottom right
+/* The variant of the lighting shader with the given features, compiled on
+ * first use. The highlight is left out along with the light it reflects. */
+const ShaderVariant & UShaderVariant(unsigned int features)
+{
+	if (!(features & SHADER_LIGHT))
+		features &= ~SHADER_SPECULAR;
+	ShaderVariant & variant = shaderVariants[features];
+	if (variant.program || variant.failed)
+		return variant;
+
+	char defines[128];
+	UShaderDefines(features, defines, sizeof(defines));
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	GLuint program = LoadShaders( "StandardShading.vertexshader", "StandardShading.fragmentshader", defines );
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("Shader variant%s%s%s%s light count %d : compiled in %.1f ms\n",
+		features & SHADER_SPECULAR ? " specular" : "", features & SHADER_TEXTURE ? " texture" : "",
+		features & SHADER_AO ? " occlusion" : "", features & SHADER_PBR ? " pbr" : "", features & SHADER_LIGHT ? 1 : 0, ms);
+	UInitShaderVariant(features, program);
+	return variant;
+}
 
-				 -0.165f,0.165f,-0.255f,	//back top right
-				 -0.165f,-0.165f,-0.255f,	//front top right		//Top Face
-				 -0.235f,-0.165f,-0.255f,	//front top left
+/* The #define lines that select the features of a lighting shader variant */
+void UShaderDefines(unsigned int features, char * defines, size_t size)
+{
+	snprintf(defines, size, "%s%s%s%s#define LIGHT_COUNT %d\n",
+		features & SHADER_SPECULAR ? "#define SPECULAR\n" : "",
+		features & SHADER_TEXTURE ? "#define TEXTURE\n" : "",
+		features & SHADER_AO ? "#define AMBIENT_OCCLUSION\n" : "",
+		features & SHADER_PBR ? "#define PBR\n" : "",
+		features & SHADER_LIGHT ? 1 : 0);
+}
 
-				 -0.165f,0.165f,-0.255f,	//back top right
-				 -0.235f,-0.165f,-0.255f,	//front top left		//Top Face
-				 -0.235f,0.165f,-0.255f,	//back top left
+/* Looks up the uniforms of a freshly built variant and sets those that never
+ * change. A program that failed to build stays 0 and UDrawShaded skips the
+ * batches that need it. */
+void UInitShaderVariant(unsigned int features, GLuint program)
+{
+	ShaderVariant & variant = shaderVariants[features];
+	variant.program = program;
+	variant.failed = program == 0;
+	if (!program)
+		return;
+
+	// Matrices and lighting come from the "FrameUniforms" block, model matrices
+	// from the per-object data
+	glUniformBlockBinding(variant.program, glGetUniformBlockIndex(variant.program, "FrameUniforms"), FRAME_UNIFORMS_BINDING);
+	variant.textureID = glGetUniformLocation(variant.program, "myTextureSampler");
+	variant.occlusionID = glGetUniformLocation(variant.program, "occlusionSampler");
+	variant.firstPaneID = glGetUniformLocation(variant.program, "FirstPane");
+
+	// The environment does not change while running
+	if (features & SHADER_PBR) {
+		glUseProgram(variant.program);
+		glUniform1i(glGetUniformLocation(variant.program, "environmentSampler"), ENVIRONMENT_UNIT);
+		glUniform1i(glGetUniformLocation(variant.program, "brdfSampler"), BRDF_UNIT);
+		glUniform3fv(glGetUniformLocation(variant.program, "IrradianceSH"), IBL_SH_COEFFICIENTS, &environment.irradianceSH()[0].x);
+		glUniform1f(glGetUniformLocation(variant.program, "EnvironmentMaxLod"), environment.maxLod());
+	}
+}
 
-				 -0.165f,0.165f,-0.255f,	//back top right
-				 -0.235f,0.165f,-0.255f,	//back top left			//Back Face
-				 -0.165f,0.165f,-0.325f,	//back bottom right
+/* The environment lighting, loaded as a startup task : read or prefiltered on
+ * a worker, then uploaded on the GL thread */
+bool UPrepareEnvironment(void *)
+{
+	return environment.prepare(environmentFile, jobSystem);
+}
 
-				 //Front Bridge
+bool UUploadEnvironment(void *)
+{
+	environment.upload();
+	return true;
+}
 
-				 -0.165f,-0.235f,-0.325f,	//front bottom left
-				 -0.165f,-0.165f,-0.325f,	//back bottom left		//Left Face
-				 -0.165f,-0.165f,-0.255f,	//back top left
+/* Shows the render scale and frame timings in the title bar twice a second */
+void UUpdateWindowTitle()
+{
+	static std::chrono::steady_clock::time_point lastUpdate;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - lastUpdate < std::chrono::milliseconds(500))
+		return;
+	lastUpdate = now;
+
+	// Not the published slot. The fence keeps the writes below from being
+	// seen before the last version, which tells the reader the slot is reused.
+	unsigned int version = windowTitleVersion.load(std::memory_order_relaxed);
+	char * title = windowTitles[(version + 1) & 1];
+	std::atomic_thread_fence(std::memory_order_release);
+	char ssaoText[48] = "";
+	if (USsaoActive())
+		snprintf(ssaoText, sizeof(ssaoText), ", %s res SSAO %.2f ms", ssaoMode == SSAO_QUARTER ? "quarter" : "half", ssaoTimer.milliseconds());
+	char occlusionText[96] = "";
+	if (occlusionCulling)
+		snprintf(occlusionText, sizeof(occlusionText), ", %d occluded saving %lld triangles %lld fragments (%.2f ms)",
+			occlusionStats.objects, occlusionStats.triangles, occlusionStats.fragments, occlusionCuller.prepareMilliseconds());
+	char streamingText[160] = "";
+	if (streaming) {
+		const StreamingStatistics & stream = cellStreamer.statistics();
+		snprintf(streamingText, sizeof(streamingText), ", %d tables as blocks, %d cells on gpu %.0f/%.0f KB, cpu %.0f/%.0f KB, %d queued %d loading, %lld evicted",
+			placeholderDraws, stream.gpuCells, stream.gpuBytes / 1024.0, stream.gpuBudget / 1024.0, stream.cpuBytes / 1024.0, stream.cpuBudget / 1024.0,
+			stream.queued, stream.loading, stream.cpuEvictions + stream.gpuEvictions);
+	}
+	char captureText[64] = "";
+	if (frameCapture.isOpen())
+		snprintf(captureText, sizeof(captureText), " - capturing %d/%d, %.2f ms per frame", capturedFrames, captureFrameCount,
+			frameCapture.statistics().renderMs / (capturedFrames > 0 ? capturedFrames : 1));
+	snprintf(title, sizeof(windowTitles[0]), "%s - %dx%d (%.0f%%%s) gpu %.2f ms cpu %.2f ms stall %.2f ms, %lld allocations %.1f KB - %d of %d objects in %d draw calls, %lld shaded fragments%s%s%s%s%s%s - input p50 %.1f p99 %.1f ms%s%s",
+		WINDOW_TITLE, SceneWidth, SceneHeight, dynamicResolution.scale * 100.0f,
+		dynamicResolution.locked ? " locked" : "", frameTimer.milliseconds(), cpuFrameMs, frameRing.lastStallMs(),
+		frameAllocations.allocations, frameAllocations.bytes / 1024.0,
+		(int)drawList.size(), (int)partNodes.size(), drawCallCount, (long long)shadedSamples.result(),
+		depthPrepass ? ", pre-pass" : "", sortFrontToBack ? ", sorted" : "", ssaoText, occlusionText, streamingText, pbrShading ? ", pbr" : "",
+		inputLatency.percentile(0.5), inputLatency.percentile(0.99), lateLatch ? " late latch" : "", captureText);
+	windowTitleVersion.store(version + 1, std::memory_order_release);
+}
 
-				 0.165f,-0.235f,-0.255f,	//front top right
-				 -0.165f,-0.235f,-0.325f,	//front bottom left		//Front Face
-				 -0.165f,-0.235f,-0.255f,	//front top left
+/* Keeps what the frame allocated, on every thread, for the title. After the
+ * warm-up, reports the frames that allocated with the scopes that did, at
+ * most once per ALLOCATION_REPORT_MS. */
+void UCountFrameAllocations(const AllocationCount & start)
+{
+	static std::chrono::steady_clock::time_point lastReport;
+	static long long unreported = 0;
+	frameAllocations = allocationTotals() - start;
+	renderedFrames++;
+	if (renderedFrames <= ALLOCATION_WARMUP_FRAMES) {
+		allocationMarkScopes();
+		return;
+	}
+	if (frameAllocations.allocations == 0)
+		return;
+
+	allocatingFrames++;
+	unreported++;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - lastReport < std::chrono::milliseconds(ALLOCATION_REPORT_MS))
+		return;
+	lastReport = now;
+	printf("Allocations : %lld frames allocated since the last report, frame %lld made %lld allocations, %.1f KB\n",
+		unreported, renderedFrames, frameAllocations.allocations, frameAllocations.bytes / 1024.0);
+	allocationPrintScopes(true);
+	unreported = 0;
+}
 
-				 0.165f,-0.165f,-0.325f,	//back bottom right
-				 -0.165f,-0.235f,-0.325f,	//front bottom left		//Bottom Face
-				 0.165f,-0.235f,-0.325f,	//front bottom right
+/* True while frames of a capture are left to render */
+bool UCapturing()
+{
+	return captureFile && capturedFrames < captureFrameCount;
+}
 
-				 0.165f,-0.235f,-0.255f,	//front top right
-				 0.165f,-0.235f,-0.325f,	//front bottom right	//Front Face
-				 -0.165f,-0.235f,-0.325f,	//front bottom left
+/* Sweeps the camera across the allowed yaw and back over the capture. The
+ * angle only depends on the frame number, so the video is the same at any
+ * frame rate the machine reaches. */
+void UTurntableCamera()
+{
+	GLfloat turn = (GLfloat)capturedFrames / captureFrameCount;
+	camYaw = 1.57f * sin(turn * 6.2831853f);
+	UOrbitCamera();
+}
 
-				 -0.165f,-0.235f,-0.325f,	//front bottom left
-				 -0.165f,-0.165f,-0.255f,	//back top left			//Left Face
-				 -0.165f,-0.235f,-0.255f,	//front top left
+/* Queues the readback of this frame, opening the video on the first one and
+ * closing it after the last */
+void UCaptureFrame()
+{
+	if (!frameCapture.isOpen()) {
+		if (!frameCapture.open(captureFile, WindowWidth, WindowHeight, captureFps, jobSystem)) {
+			captureFile = NULL;
+			return;
+		}
+		printf("Capture : recording %d frames at %d fps to %s\n", captureFrameCount, captureFps, captureFile);
+	}
 
-				 0.165f,-0.165f,-0.325f,	//back bottom right
-				 -0.165f,-0.165f,-0.325f,	//back bottom left		//Bottom Face
-				 -0.165f,-0.235f,-0.325f,	//front bottom left
+	bool captured = frameCapture.capture(WindowWidth, WindowHeight);
+	if (captured)
+		capturedFrames++;
+	else
+		printf("Capture : the window shrank, stopped after %d frames\n", capturedFrames);
+	if (!captured || capturedFrames == captureFrameCount || frameCapture.failed()) {
+		frameCapture.close();
+		frameCapture.printStatistics();
+		captureFile = NULL;
+	}
+}
 
-				 -0.165f,-0.165f,-0.255f,	//back top left
-				 -0.165f,-0.165f,-0.325f,	//back bottom left		//Back Face
-				 0.165f,-0.165f,-0.325f,	//back bottom right
+/* Sets the newest title the render thread published. A copy the render
+ * thread may have overwritten meanwhile is dropped, the next poll shows the
+ * newer one. */
+void UShowWindowTitle(int)
+{
+	// A client asked the server to stop. The render thread cleans up while
+	// the window and its context still exist.
+	if (renderServer.shutdownRequested()) {
+		UCloseWindow();
+		glutLeaveMainLoop();
+		return;
+	}
+	static unsigned int shown = 0;
+	unsigned int version = windowTitleVersion.load(std::memory_order_acquire);
+	if (version != shown) {
+		char title[sizeof(windowTitles[0])];
+		memcpy(title, windowTitles[version & 1], sizeof(title));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (windowTitleVersion.load(std::memory_order_relaxed) == version) {
+			glutSetWindowTitle(title);
+			shown = version;
+		}
+	}
+	glutTimerFunc(WINDOW_TITLE_POLL_MS, UShowWindowTitle, 0);
+}
 
-				 0.165f,-0.165f,-0.255f,	//back top right
-				 0.165f,-0.235f,-0.325f,	//front bottom right	//Right Face
-				 0.165f,-0.235f,-0.255f,	//front top right
+/* Uploads each part of the generated table as a mesh of its own, or
+ * overwrites the meshes of a table already in the pool */
+void UUploadTable(const TableGeometry & geometry, bool update)
+{
+	for (int part = 0; part < TABLE_PART_COUNT; part++) {
+		std::vector<MeshVertex> meshVertices;
+		std::vector<unsigned int> indices;
+		UBoxMesh(geometry, part, meshVertices, indices);
+		if (update)
+			meshPool.updateMesh(tableMeshes[part], meshVertices, indices);
+		else
+			tableMeshes[part] = meshPool.addMesh(meshVertices, indices);
+
+		// Picking tests the triangles in the order they are drawn
+		std::vector<glm::vec3> meshPositions(meshVertices.size());
+		for (size_t v = 0; v < meshVertices.size(); v++)
+			meshPositions[v] = meshVertices[v].position;
+		meshBVHs.resize(meshPool.meshCount());
+		meshBVHs[tableMeshes[part]].build(meshPositions, indices);
+	}
+}
 
-				 0.165f,-0.235f,-0.325f,	//front bottom right
-				 0.165f,-0.165f,-0.255f,	//back top right		//Right Face
-				 0.165f,-0.165f,-0.325f,	//back bottom right
+/* One box of an assembly as a mesh of its own, with tangents */
+template <int BOXES>
+void UBoxMesh(const AssemblyGeometry<BOXES> & geometry, int box, std::vector<MeshVertex> & out_vertices, std::vector<unsigned int> & out_indices)
+{
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> uvs;
+	for (int v = box * BOX_VERTEX_COUNT; v < (box + 1) * BOX_VERTEX_COUNT; v++) {
+		positions.push_back(glm::make_vec3(&geometry.positions[v * 3]));
+		uvs.push_back(glm::make_vec2(&geometry.uvs[v * 2]));
+		normals.push_back(glm::make_vec3(&geometry.normals[v * 3]));
+	}
+	out_indices.assign(&geometry.indices[box * BOX_INDEX_COUNT], &geometry.indices[(box + 1) * BOX_INDEX_COUNT]);
+	processIndexedMesh(positions, uvs, normals, out_indices, out_vertices);
+}
 
-				 0.165f,-0.165f,-0.255f,	//back top right
-				 0.165f,-0.235f,-0.255f,	//front top right		//Top Face
-				 -0.165f,-0.235f,-0.255f,	//front top left
+/* Uploads the block drawn for the tables of cells still streaming in, or
+ * overwrites it after an edit */
+void UUploadPlaceholder(bool update)
+{
+	AssemblyGeometry<1> geometry = buildAssemblyGeometry(buildTableBlock(streamedDimensions));
+	std::vector<MeshVertex> meshVertices;
+	std::vector<unsigned int> indices;
+	UBoxMesh(geometry, 0, meshVertices, indices);
+	if (update)
+		meshPool.updateMesh(placeholderMesh, meshVertices, indices);
+	else
+		placeholderMesh = meshPool.addMesh(meshVertices, indices);
+
+	std::vector<glm::vec3> meshPositions(meshVertices.size());
+	for (size_t v = 0; v < meshVertices.size(); v++)
+		meshPositions[v] = meshVertices[v].position;
+	meshBVHs.resize(meshPool.meshCount());
+	meshBVHs[placeholderMesh].build(meshPositions, indices);
+}
 
-				 0.165f,-0.165f,-0.255f,	//back top right
-				 -0.165f,-0.235f,-0.255f,	//front top left		//Top Face
-				 -0.165f,-0.165f,-0.255f,	//back top left
+/* Generates the table again from the edited dimensions */
+void URebuildTable()
+{
+	ALLOCATION_SCOPE("URebuildTable");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	TableGeometry geometry = buildTableGeometry(tableDimensions);
+	std::chrono::steady_clock::time_point generated = std::chrono::steady_clock::now();
+	UUploadTable(geometry, true);
+	// Every table's parts have new bounds
+	for (size_t i = 0; i < partNodes.size(); i++) {
+		const MeshRange & mesh = meshPool.mesh(sceneGraph.mesh(partNodes[i]));
+		sceneGraph.setLocalBounds(partNodes[i], mesh.boundsMin, mesh.boundsMax);
+	}
+	// The streamed variants follow the edit : every cell loads again
+	if (streaming) {
+		cellStreamer.clear();
+		streamedDimensions = tableDimensions;
+		UUploadPlaceholder(true);
+		for (size_t cell = 0; cell < cellCenters.size(); cell++)
+			UStreamCellBounds((int)cell);
+	}
+	std::chrono::steady_clock::time_point uploaded = std::chrono::steady_clock::now();
 
-				 0.165f,-0.165f,-0.255f,	//back top right
-				 -0.165f,-0.165f,-0.255f,	//back top left			//Back Face
-				 0.165f,-0.165f,-0.325f,	//back bottom right
+	printf("Table rebuilt : height %.2f, legs %.2f, generated in %.1f us, uploaded in %.1f us\n",
+		tableDimensions.height, tableDimensions.legThickness,
+		std::chrono::duration<double, std::micro>(generated - start).count(),
+		std::chrono::duration<double, std::micro>(uploaded - generated).count());
+}
 
-				 //Right Bridge
+void UCreateBuffers(){
+			TRACE_SCOPE("UCreateBuffers");
+			// The default table is generated at compile time
+			meshPool.create(4096, 16384);
+			UUploadTable(defaultTableGeometry, false);
+			if (streaming)
+				UUploadPlaceholder(false);
+			UBuildShowroom();
+
+			// Empty vertex array, bound whenever no mesh is drawn
+			VertexArrayID = GPU_CREATE(GPU_VERTEX_ARRAY, GPU_MEMORY_OTHER, "Full screen passes");
+			glBindVertexArray(VertexArrayID);
 
-				 0.165f,-0.165f,-0.325f,	//front bottom left
-				 0.165f,0.165f,-0.325f,		//back bottom left		//Left Face
-				 0.165f,0.165f,-0.255f,		//back top left
+			// The whole scene goes out in one glMultiDrawElementsIndirect when the
+			// driver supports it (GL 4.3 or ARB_multi_draw_indirect). Each command
+			// finds its object through baseInstance, which needs GL 4.2 or
+			// ARB_base_instance as well.
+			multiDrawIndirect = (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect) && (GLEW_VERSION_4_2 || GLEW_ARB_base_instance);
+			printf("Multi-draw indirect %s\n", multiDrawIndirect ? "enabled" : "not supported, drawing objects one by one");
+}
 
-				 0.235f,-0.165f,-0.255f,	//front top right
-				 0.165f,-0.165f,-0.325f,	//front bottom left		//Front Face
-				 0.165f,-0.165f,-0.255f,	//front top left
+/* The GLUT callbacks only queue the input, with the time it came in */
+void UKeyboard(unsigned char key, GLint x, GLint y)
+{
+	InputEvent event = { INPUT_KEY_DOWN, x, y, key, false, 0 };
+	inputQueue.push(event);
+}
 
-				 0.235f,0.165f,-0.325f,		//back bottom right
-				 0.165f,-0.165f,-0.325f,	//front bottom left		//Bottom Face
-				 0.235f,-0.165f,-0.325f,	//front bottom right
+void UKeyReleased(unsigned char key, GLint x, GLint y)
+{
+	InputEvent event = { INPUT_KEY_UP, x, y, key, false, 0 };
+	inputQueue.push(event);
+}
 
-				 0.235f,-0.165f,-0.255f,	//front top right
-				 0.235f,-0.165f,-0.325f,	//front bottom right	//Front Face
-				 0.165f,-0.165f,-0.325f,	//front bottom left
-
-				 0.165f,-0.165f,-0.325f,	//front bottom left
-				 0.165f,0.165f,-0.255f,		//back top left			//Left Face
-				 0.165f,-0.165f,-0.255f,	//front top left
-
-				 0.235f,0.165f,-0.325f,		//back bottom right
-				 0.165f,0.165f,-0.325f,		//back bottom left		//Bottom Face
-				 0.165f,-0.165f,-0.325f,	//front bottom left
-
-				 0.165f,0.165f,-0.255f,		//back top left
-				 0.165f,0.165f,-0.325f,		//back bottom left		//Back Face
-				 0.235f,0.165f,-0.325f,		//back bottom right
-
-				 0.235f,0.165f,-0.255f,		//back top right
-				 0.235f,-0.165f,-0.325f,	//front bottom right	//Right Face
-				 0.235f,-0.165f,-0.255f,	//front top right
-
-				 0.235f,-0.165f,-0.325f,	//front bottom right
-				 0.235f,0.165f,-0.255f,		//back top right		//Right Face
-				 0.235f,0.165f,-0.325f,		//back bottom right
-
-				 0.235f,0.165f,-0.255f,		//back top right
-				 0.235f,-0.165f,-0.255f,	//front top right		//Top Face
-				 0.165f,-0.165f,-0.255f,	//front top left
-
-				 0.235f,0.165f,-0.255f,		//back top right
-				 0.165f,-0.165f,-0.255f,	//front top left		//Top Face
-				 0.165f,0.165f,-0.255f,		//back top left
-
-				 0.235f,0.165f,-0.255f,		//back top right
-				 0.165f,0.165f,-0.255f,		//back top left			//Back Face
-				 0.235f,0.165f,-0.325f,		//back bottom right
-
-				 //Back Bridge
-
-				 -0.165f,0.165f,-0.325f,	//front bottom left
-				 -0.165f,0.235f,-0.325f,	//back bottom left		//Left Face
-				 -0.165f,0.235f,-0.255f,	//back top left
-
-				 0.165f,0.165f,-0.255f,		//front top right
-				 -0.165f,0.165f,-0.325f,	//front bottom left		//Front Face
-				 -0.165f,0.165f,-0.255f,	//front top left
-
-				 0.165f,0.235f,-0.325f,		//back bottom right
-				 -0.165f,0.165f,-0.325f,	//front bottom left		//Bottom Face
-				 0.165f,0.165f,-0.325f,		//front bottom right
-
-				 0.165f,0.165f,-0.255f,		//front top right
-				 0.165f,0.165f,-0.325f,		//front bottom right	//Front Face
-				 -0.165f,0.165f,-0.325f,	//front bottom left
-
-				 -0.165f,0.165f,-0.325f,	//front bottom left
-				 -0.165f,0.235f,-0.255f,	//back top left			//Left Face
-				 -0.165f,0.165f,-0.255f,	//front top left
-
-				 0.165f,0.235f,-0.325f,		//back bottom right
-				 -0.165f,0.235f,-0.325f,	//back bottom left		//Bottom Face
-				 -0.165f,0.165f,-0.325f,	//front bottom left
-
-				 -0.165f,0.235f,-0.255f,	//back top left
-				 -0.165f,0.235f,-0.325f,	//back bottom left		//Back Face
-				 0.165f,0.235f,-0.325f,		//back bottom right
-
-				 0.165f,0.235f,-0.255f,		//back top right
-				 0.165f,0.165f,-0.325f,		//front bottom right	//Right Face
-				 0.165f,0.165f,-0.255f,		//front top right
-
-				 0.165f,0.165f,-0.325f,		//front bottom right
-				 0.165f,0.235f,-0.255f,		//back top right		//Right Face
-				 0.165f,0.235f,-0.325f,		//back bottom right
-
-				 0.165f,0.235f,-0.255f,		//back top right
-				 0.165f,0.165f,-0.255f,		//front top right		//Top Face
-				 -0.165f,0.165f,-0.255f,	//front top left
-
-				 0.165f,0.235f,-0.255f,		//back top right
-				 -0.165f,0.165f,-0.255f,	//front top left		//Top Face
-				 -0.165f,0.235f,-0.255f,	//back top left
-
-				 0.165f,0.235f,-0.255f,		//back top right
-				 -0.165f,0.235f,-0.255f,	//back top left			//Back Face
-				 0.165f,0.235f,-0.325f		//back bottom right
-
-			};
-
-			// Two UV coordinatesfor each vertex. They were created with Blender.
-			GLfloat g_uv_buffer_data[] = {
-				//Front Left Leg
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 0.0f,
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 1.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 0.0f,
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-
-				//Front Right Leg
-
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 0.0f,
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 1.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 0.0f,
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-
-				//Back Left Leg
-
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 0.0f,
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 1.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 0.0f,
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-
-				//Back Right Leg
-
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 0.0f,
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 1.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 0.0f,
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-
-				//Table Top
-
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 0.0f,
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 1.0f,
-				0.0f, 0.0f,
-
-				0.0f, 1.0f,
-				0.0f, 0.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 0.0f,
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-
-				1.0f, 1.0f,
-				1.0f, 0.0f,
-				0.25f, 0.0f,
-
-				1.0f, 1.0f,
-				0.25f, 0.0f,
-				0.25f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 1.0f,
-				0.0f, 0.0f,
-
-				//Front Bridge
-
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 0.0f,
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 1.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 0.0f,
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-
-				//Left Bridge
-
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 0.0f,
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 1.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 0.0f,
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-
-				//Right Bridge
-
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 0.0f,
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 1.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 0.0f,
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-
-				//Back Bridge
-
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 0.0f,
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 1.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 0.0f,
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-
-				LEG_X, 1.0f,
-				LEG_X, 0.0f,
-				0.0f, 0.0f,
-
-				LEG_X, 1.0f,
-				0.0f, 0.0f,
-				0.0f, 1.0f,
-
-				0.0f, 1.0f,
-				LEG_X, 1.0f,
-				0.0f, 0.0f
-			};
-
-			GLfloat normal_buffer_data[] = {
-
-					//Front Left Leg
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back bottom left		//Left Face
-					-1.0f,0.0f,0.0f,			//back top left
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom left		//Front Face
-					0.0f,0.0f,1.0f,				//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//front bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom right
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom right	//Front Face
-					0.0f,0.0f,1.0f,				//front bottom left
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back top left			//Left Face
-					-1.0f,0.0f,0.0f,			//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//back bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom left
-
-					0.0f,0.0f,-1.0f,			//back top left
-					0.0f,0.0f,-1.0f,			//back bottom left		//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					1.0f,0.0f,0.0f,				//back top right
-					1.0f,0.0f,0.0f,				//front bottom right	//Right Face
-					1.0f,0.0f,0.0f,				//front top right
-
-					1.0f,0.0f,0.0f,				//front bottom right
-					1.0f,0.0f,0.0f,				//back top right		//Right Face
-					1.0f,0.0f,0.0f,				//back bottom right
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top right		//Top Face
-					0.0f,1.0f,0.0f,				//front top left
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top left		//Top Face
-					0.0f,1.0f,0.0f,				//back top left
-
-					0.0f,0.0f,-1.0f,			//back top right
-					0.0f,0.0f,-1.0f,			//back top left			//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					//Front Right Leg
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back bottom left		//Left Face
-					-1.0f,0.0f,0.0f,			//back top left
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom left		//Front Face
-					0.0f,0.0f,1.0f,				//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//front bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom right
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom right	//Front Face
-					0.0f,0.0f,1.0f,				//front bottom left
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back top left			//Left Face
-					-1.0f,0.0f,0.0f,			//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//back bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom left
-
-					0.0f,0.0f,-1.0f,			//back top left
-					0.0f,0.0f,-1.0f,			//back bottom left		//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					1.0f,0.0f,0.0f,				//back top right
-					1.0f,0.0f,0.0f,				//front bottom right	//Right Face
-					1.0f,0.0f,0.0f,				//front top right
-
-					1.0f,0.0f,0.0f,				//front bottom right
-					1.0f,0.0f,0.0f,				//back top right		//Right Face
-					1.0f,0.0f,0.0f,				//back bottom right
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top right		//Top Face
-					0.0f,1.0f,0.0f,				//front top left
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top left		//Top Face
-					0.0f,1.0f,0.0f,				//back top left
-
-					0.0f,0.0f,-1.0f,			//back top right
-					0.0f,0.0f,-1.0f,			//back top left			//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					//Back Left Leg
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back bottom left		//Left Face
-					-1.0f,0.0f,0.0f,			//back top left
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom left		//Front Face
-					0.0f,0.0f,1.0f,				//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//front bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom right
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom right	//Front Face
-					0.0f,0.0f,1.0f,				//front bottom left
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back top left			//Left Face
-					-1.0f,0.0f,0.0f,			//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//back bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom left
-
-					0.0f,0.0f,-1.0f,			//back top left
-					0.0f,0.0f,-1.0f,			//back bottom left		//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					1.0f,0.0f,0.0f,				//back top right
-					1.0f,0.0f,0.0f,				//front bottom right	//Right Face
-					1.0f,0.0f,0.0f,				//front top right
-
-					1.0f,0.0f,0.0f,				//front bottom right
-					1.0f,0.0f,0.0f,				//back top right		//Right Face
-					1.0f,0.0f,0.0f,				//back bottom right
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top right		//Top Face
-					0.0f,1.0f,0.0f,				//front top left
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top left		//Top Face
-					0.0f,1.0f,0.0f,				//back top left
-
-					0.0f,0.0f,-1.0f,			//back top right
-					0.0f,0.0f,-1.0f,			//back top left			//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					//Back Right Leg
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back bottom left		//Left Face
-					-1.0f,0.0f,0.0f,			//back top left
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom left		//Front Face
-					0.0f,0.0f,1.0f,				//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//front bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom right
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom right	//Front Face
-					0.0f,0.0f,1.0f,				//front bottom left
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back top left			//Left Face
-					-1.0f,0.0f,0.0f,			//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//back bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom left
-
-					0.0f,0.0f,-1.0f,			//back top left
-					0.0f,0.0f,-1.0f,			//back bottom left		//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					1.0f,0.0f,0.0f,				//back top right
-					1.0f,0.0f,0.0f,				//front bottom right	//Right Face
-					1.0f,0.0f,0.0f,				//front top right
-
-					1.0f,0.0f,0.0f,				//front bottom right
-					1.0f,0.0f,0.0f,				//back top right		//Right Face
-					1.0f,0.0f,0.0f,				//back bottom right
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top right		//Top Face
-					0.0f,1.0f,0.0f,				//front top left
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top left		//Top Face
-					0.0f,1.0f,0.0f,				//back top left
-
-					0.0f,0.0f,-1.0f,			//back top right
-					0.0f,0.0f,-1.0f,			//back top left			//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					//Table Top
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back bottom left		//Left Face
-					-1.0f,0.0f,0.0f,			//back top left
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom left		//Front Face
-					0.0f,0.0f,1.0f,				//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//front bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom right
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom right	//Front Face
-					0.0f,0.0f,1.0f,				//front bottom left
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back top left			//Left Face
-					-1.0f,0.0f,0.0f,			//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//back bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom left
-
-					0.0f,0.0f,-1.0f,			//back top left
-					0.0f,0.0f,-1.0f,			//back bottom left		//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					1.0f,0.0f,0.0f,				//back top right
-					1.0f,0.0f,0.0f,				//front bottom right	//Right Face
-					1.0f,0.0f,0.0f,				//front top right
-
-					1.0f,0.0f,0.0f,				//front bottom right
-					1.0f,0.0f,0.0f,				//back top right		//Right Face
-					1.0f,0.0f,0.0f,				//back bottom right
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top right		//Top Face
-					0.0f,1.0f,0.0f,				//front top left
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top left		//Top Face
-					0.0f,1.0f,0.0f,				//back top left
-
-					0.0f,0.0f,-1.0f,			//back top right
-					0.0f,0.0f,-1.0f,			//back top left			//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					//Left Bridge
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back bottom left		//Left Face
-					-1.0f,0.0f,0.0f,			//back top left
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom left		//Front Face
-					0.0f,0.0f,1.0f,				//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//front bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom right
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom right	//Front Face
-					0.0f,0.0f,1.0f,				//front bottom left
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back top left			//Left Face
-					-1.0f,0.0f,0.0f,			//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//back bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom left
-
-					0.0f,0.0f,-1.0f,			//back top left
-					0.0f,0.0f,-1.0f,			//back bottom left		//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					1.0f,0.0f,0.0f,				//back top right
-					1.0f,0.0f,0.0f,				//front bottom right	//Right Face
-					1.0f,0.0f,0.0f,				//front top right
-
-					1.0f,0.0f,0.0f,				//front bottom right
-					1.0f,0.0f,0.0f,				//back top right		//Right Face
-					1.0f,0.0f,0.0f,				//back bottom right
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top right		//Top Face
-					0.0f,1.0f,0.0f,				//front top left
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top left		//Top Face
-					0.0f,1.0f,0.0f,				//back top left
-
-					0.0f,0.0f,-1.0f,			//back top right
-					0.0f,0.0f,-1.0f,			//back top left			//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					//Front Bridge
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back bottom left		//Left Face
-					-1.0f,0.0f,0.0f,			//back top left
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom left		//Front Face
-					0.0f,0.0f,1.0f,				//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//front bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom right
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom right	//Front Face
-					0.0f,0.0f,1.0f,				//front bottom left
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back top left			//Left Face
-					-1.0f,0.0f,0.0f,			//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//back bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom left
-
-					0.0f,0.0f,-1.0f,			//back top left
-					0.0f,0.0f,-1.0f,			//back bottom left		//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					1.0f,0.0f,0.0f,				//back top right
-					1.0f,0.0f,0.0f,				//front bottom right	//Right Face
-					1.0f,0.0f,0.0f,				//front top right
-
-					1.0f,0.0f,0.0f,				//front bottom right
-					1.0f,0.0f,0.0f,				//back top right		//Right Face
-					1.0f,0.0f,0.0f,				//back bottom right
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top right		//Top Face
-					0.0f,1.0f,0.0f,				//front top left
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top left		//Top Face
-					0.0f,1.0f,0.0f,				//back top left
-
-					0.0f,0.0f,-1.0f,			//back top right
-					0.0f,0.0f,-1.0f,			//back top left			//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					//Right Bridge
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back bottom left		//Left Face
-					-1.0f,0.0f,0.0f,			//back top left
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom left		//Front Face
-					0.0f,0.0f,1.0f,				//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//front bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom right
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom right	//Front Face
-					0.0f,0.0f,1.0f,				//front bottom left
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back top left			//Left Face
-					-1.0f,0.0f,0.0f,			//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//back bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom left
-
-					0.0f,0.0f,-1.0f,			//back top left
-					0.0f,0.0f,-1.0f,			//back bottom left		//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					1.0f,0.0f,0.0f,				//back top right
-					1.0f,0.0f,0.0f,				//front bottom right	//Right Face
-					1.0f,0.0f,0.0f,				//front top right
-
-					1.0f,0.0f,0.0f,				//front bottom right
-					1.0f,0.0f,0.0f,				//back top right		//Right Face
-					1.0f,0.0f,0.0f,				//back bottom right
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top right		//Top Face
-					0.0f,1.0f,0.0f,				//front top left
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top left		//Top Face
-					0.0f,1.0f,0.0f,				//back top left
-
-					0.0f,0.0f,-1.0f,			//back top right
-					0.0f,0.0f,-1.0f,			//back top left			//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					//Back Bridge
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back bottom left		//Left Face
-					-1.0f,0.0f,0.0f,			//back top left
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom left		//Front Face
-					0.0f,0.0f,1.0f,				//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//front bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom right
-
-					0.0f,0.0f,1.0f,				//front top right
-					0.0f,0.0f,1.0f,				//front bottom right	//Front Face
-					0.0f,0.0f,1.0f,				//front bottom left
-
-					-1.0f,0.0f,0.0f,			//front bottom left
-					-1.0f,0.0f,0.0f,			//back top left			//Left Face
-					-1.0f,0.0f,0.0f,			//front top left
-
-					0.0f,-1.0f,0.0f,			//back bottom right
-					0.0f,-1.0f,0.0f,			//back bottom left		//Bottom Face
-					0.0f,-1.0f,0.0f,			//front bottom left
-
-					0.0f,0.0f,-1.0f,			//back top left
-					0.0f,0.0f,-1.0f,			//back bottom left		//Back Face
-					0.0f,0.0f,-1.0f,			//back bottom right
-
-					1.0f,0.0f,0.0f,				//back top right
-					1.0f,0.0f,0.0f,				//front bottom right	//Right Face
-					1.0f,0.0f,0.0f,				//front top right
-
-					1.0f,0.0f,0.0f,				//front bottom right
-					1.0f,0.0f,0.0f,				//back top right		//Right Face
-					1.0f,0.0f,0.0f,				//back bottom right
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top right		//Top Face
-					0.0f,1.0f,0.0f,				//front top left
-
-					0.0f,1.0f,0.0f,				//back top right
-					0.0f,1.0f,0.0f,				//front top left		//Top Face
-					0.0f,1.0f,0.0f,				//back top left
-
-					0.0f,0.0f,-1.0f,			//back top right
-					0.0f,0.0f,-1.0f,			//back top left			//Back Face
-					0.0f,0.0f,-1.0f				//back bottom right
-			};
-
-			glGenVertexArrays(1, &VertexArrayID);
-			glBindVertexArray(VertexArrayID);
-
-			glGenBuffers(1, &vertexbuffer);
-			glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
+void UMouseMove(int x, int y)
+{
+	// Modifiers can only be read inside the callback
+	InputEvent event = { INPUT_MOUSE_MOVE, x, y, 0, glutGetModifiers() == GLUT_ACTIVE_ALT, 0 };
+	inputQueue.push(event);
+}
 
-			glGenBuffers(1, &uvbuffer);
-			glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(g_uv_buffer_data), g_uv_buffer_data, GL_STATIC_DRAW);
+void UMouseButton(int button, int state, int x, int y)
+{
+	if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN)
+		return;
+	InputEvent event = { INPUT_MOUSE_CLICK, x, y, 0, false, 0 };
+	inputQueue.push(event);
+}
 
-			glGenBuffers(1, &normalbuffer);
-			glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(normal_buffer_data), normal_buffer_data, GL_STATIC_DRAW);
+/* Applies the input queued since the last frame, in order, on the render
+ * thread. Returns false when there was none. */
+bool UProcessInput()
+{
+	InputEvent event;
+	bool any = false;
+	while (inputQueue.pop(event)) {
+		any = true;
+		switch (event.type) {
+		case INPUT_KEY_DOWN:
+			inputLatency.inputEvent(event.time);
+			UApplyKey(event.key);
+			break;
+		case INPUT_KEY_UP:
+			//Takes note of when buttons are released
+			currentKey = '0';
+			break;
+		case INPUT_MOUSE_MOVE:
+			inputLatency.inputEvent(event.time);
+			UApplyMouse(event.x, event.y, event.alt);
+			break;
+		case INPUT_MOUSE_CLICK:
+			UPickAndReport(event.x, event.y);
+			break;
+		case INPUT_RESIZE:
+			UResizeWindow(event.x, event.y);
+			break;
+		case INPUT_REDISPLAY:
+			break;
+		}
+	}
+	return any;
 }
-void UKeyboard(unsigned char key, GLint x, GLint y)
+
+void UApplyKey(unsigned char key)
 {
 	//Takes input from the keyboard
 	currentKey = key;
@@ -1650,22 +2415,75 @@ void UKeyboard(unsigned char key, GLint x, GLint y)
 	case 'e':
 		lightPos.z++;
 		break;
+	case 'l':
+		// Locks the render scale where it is, or hands it back to the controller
+		dynamicResolution.locked = !dynamicResolution.locked;
+		dynamicResolution.lockedScale = dynamicResolution.scale;
+		break;
+	case '[':
+		dynamicResolution.lockedScale -= 0.05f;
+		if (dynamicResolution.lockedScale < dynamicResolution.minScale)
+			dynamicResolution.lockedScale = dynamicResolution.minScale;
+		break;
+	case ']':
+		dynamicResolution.lockedScale += 0.05f;
+		if (dynamicResolution.lockedScale > dynamicResolution.maxScale)
+			dynamicResolution.lockedScale = dynamicResolution.maxScale;
+		break;
+	case 'k':
+		// Switches between bilinear and edge-aware upscaling
+		upscaleSharpness = upscaleSharpness > 0.0f ? 0.0f : 0.5f;
+		break;
+	case 'p':
+		depthPrepass = !depthPrepass;
+		break;
+	case 'o':
+		sortFrontToBack = !sortFrontToBack;
+		break;
+	case 'm':
+		// Reports the latency of the current mode and starts measuring the other
+		inputLatency.print(lateLatch ? "late latch" : "GLUT order");
+		inputLatency.reset();
+		lateLatch = !lateLatch;
+		break;
+	case 't':
+		tableDimensions.legThickness = glm::min(tableDimensions.legThickness + 0.01f, 0.12f);
+		URebuildTable();
+		break;
+	case 'g':
+		tableDimensions.legThickness = glm::max(tableDimensions.legThickness - 0.01f, 0.02f);
+		URebuildTable();
+		break;
+	case 'i':
+		gpuResources.print();
+		break;
+	case 'n':
+		UToggleTrace();
+		break;
+	case 'b':
+		USetLayout((ViewLayout)((viewLayout + 1) % LAYOUT_COUNT));
+		break;
+	case 'u':
+		UMoveLeg(0.01f);
+		break;
+	case 'j':
+		UMoveLeg(-0.01f);
+		break;
+	case 'y':
+		tableDimensions.height = glm::min(tableDimensions.height + 0.05f, 1.6f);
+		URebuildTable();
+		break;
+	case 'h':
+		tableDimensions.height = glm::max(tableDimensions.height - 0.05f, 0.6f);
+		URebuildTable();
+		break;
 	default:
 		break;
 	}
-
-	glutPostRedisplay();
 }
 
-void UKeyReleased(unsigned char key, GLint x, GLint y)
-{
-	//Takes note of when buttons are released
-	currentKey = '0';
-
-	glutPostRedisplay();
-}
-
-void UMouseMove(int x, int y)
+/* Turns a new mouse position into camera movement, orbiting while Alt is held */
+void UApplyMouse(int x, int y, bool orbit)
 {
 	// Immediately replaces center locked coordinates with new mouse coordinates
 	if(mouseDetected)
@@ -1688,7 +2506,7 @@ void UMouseMove(int x, int y)
 	mouseYOffset *= sensitivity;
 
 	// Accumulates the yaw and pitch variables
-	if ((glutGetModifiers() == GLUT_ACTIVE_ALT)) {
+	if (orbit) {
 		camYaw += mouseXOffset;
 		if (camYaw > 1.57f)//Cannot rotate more than 90 degrees as per project requirements
 			camYaw = 1.57f;
@@ -1700,185 +2518,132 @@ void UMouseMove(int x, int y)
 		if (camPitch < -1.57f)
 			camPitch = -1.57f;
 	}
+	UOrbitCamera();
+}
+
+/* Places the camera on its orbit from the yaw and pitch */
+void UOrbitCamera()
+{
 	// Orbits around the center
 	front.x = 10.0f * cos(camYaw);
 	front.y = 10.0f * sin(camPitch);
 	front.z = sin(camYaw) * cos(camPitch) * 1.0f;
+}
 
-	glutPostRedisplay();
-}
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
-
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}else{
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-		getchar();
-		return 0;
-	}
-
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
-	}
-
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
-
-
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
+/* Finds the table part under a window position with the cameras of the last
+ * frame : the cursor is unprojected in the pane it is over, then the ray
+ * walks the scene graph bounds and the triangle BVH of every part it enters.
+ * Nothing is read back from the GPU. Returns false over the background. */
+bool UPick(int x, int y, PickResult & result)
+{
+	// The region is upscaled to the whole window, pane rectangles are
+	// fractions of both. Window y goes down.
+	glm::vec2 cursor((x + 0.5f) / WindowWidth, 1.0f - (y + 0.5f) / WindowHeight);
+	GLint pane = 0;
+	while (pane < viewPaneCount - 1) {
+		const glm::vec4 & rect = viewPanes[pane].rect;
+		if (cursor.x >= rect.x && cursor.x < rect.x + rect.z && cursor.y >= rect.y && cursor.y < rect.y + rect.w)
+			break;
+		pane++;
 	}
+	const glm::vec4 & rect = viewPanes[pane].rect;
+	glm::vec2 ndc((cursor.x - rect.x) / rect.z * 2.0f - 1.0f, (cursor.y - rect.y) / rect.w * 2.0f - 1.0f);
+	glm::vec3 origin, direction;
+	rayFromClip(paneProjections[pane] * paneViews[pane], ndc, origin, direction);
+
+	// The parts are tested in their mesh space, where t is the same
+	int hitIndex = -1, hitTriangle = -1;
+	float distance = sceneGraph.raycast(origin, direction, 1.0f, [&](int index, float nearest) {
+		const MeshBVH * bvh = UPartBVH(index);
+		if (!bvh)
+			return nearest;
+		glm::mat4 toMesh = glm::inverse(sceneGraph.worldAt(index));
+		glm::vec3 meshOrigin = glm::vec3(toMesh * glm::vec4(origin, 1.0f));
+		glm::vec3 meshDirection = glm::vec3(toMesh * glm::vec4(direction, 0.0f));
+		int triangle;
+		if (!bvh->intersect(meshOrigin, meshDirection, nearest, triangle))
+			return nearest;
+		hitIndex = index;
+		hitTriangle = triangle;
+		return nearest;
+	});
+	if (hitIndex < 0)
+		return false;
+
+	int part = nodeParts[sceneGraph.nodeAt(hitIndex)];
+	result.table = part / TABLE_PART_COUNT;
+	result.part = part % TABLE_PART_COUNT;
+	result.triangle = hitTriangle;
+	result.point = origin + direction * distance;
+	return true;
+}
 
-
-
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
-
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
+/* Picks under a click and prints what was hit */
+void UPickAndReport(int x, int y)
+{
+	TRACE_SCOPE("UPick");
+	ALLOCATION_SCOPE("UPick");
+	PickResult result;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool hit = UPick(x, y, result);
+	double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	if (!hit) {
+		printf("Picked nothing at %d, %d (%.1f us)\n", x, y, us);
+		return;
 	}
+	printf("Picked table %d (row %d, column %d), %s, triangle %d at (%.3f, %.3f, %.3f) in %.1f us\n",
+		result.table, result.table / showroomSize, result.table % showroomSize, tablePartNames[result.part],
+		result.triangle, result.point.x, result.point.y, result.point.z, us);
+}
 
-
-
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
-
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-		printf("%s\n", &ProgramErrorMessage[0]);
+/* Takes the newest mouse position right before the camera goes into the
+ * frame uniforms. On Windows it is read straight from the window system;
+ * elsewhere the mouse moves queued since the frame started are applied. */
+void ULatchInput()
+{
+#ifdef _WIN32
+	HWND window = WindowFromDC(wglGetCurrentDC());
+	POINT cursor;
+	RECT client;
+	if (!window || !GetCursorPos(&cursor) || !ScreenToClient(window, &cursor) || !GetClientRect(window, &client))
+		return;
+
+	// Like the passive motion callback, ignore the mouse outside the window
+	if (cursor.x < client.left || cursor.x >= client.right || cursor.y < client.top || cursor.y >= client.bottom)
+		return;
+	if (cursor.x == lastMouseX && cursor.y == lastMouseY)
+		return;
+
+	inputLatency.inputEvent();
+	UApplyMouse(cursor.x, cursor.y, (GetAsyncKeyState(VK_MENU) & 0x8000) != 0);
+#else
+	// Stops at any other event : keys and resizes wait for the next frame,
+	// in order, since they may change what this frame already culled
+	InputEvent event;
+	while (inputQueue.peek(event) && event.type == INPUT_MOUSE_MOVE) {
+		inputQueue.pop(event);
+		inputLatency.inputEvent(event.time);
+		UApplyMouse(event.x, event.y, event.alt);
 	}
-
-
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
-
-	return ProgramID;
+#endif
 }
-
-GLuint loadBMP_custom(const char * imagepath){
-
-	printf("Reading image %s\n", imagepath);
-
-	// Data read from the header of the BMP file
-	unsigned char header[54];
-	unsigned int dataPos;
-	unsigned int imageSize;
-	unsigned int width, height;
-	// Actual RGB data
-	unsigned char * data;
-
-	// Open the file
-	FILE * file = fopen(imagepath,"rb");
-	if (!file){
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
-		getchar();
+/* Reads, compiles and links a program right away, waiting for the driver.
+ * Startup goes through a StartupLoader instead; this is for the shader
+ * variants compiled on first use. Returns 0 if anything failed. */
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char * defines){
+	TRACE_SCOPE("LoadShaders");
+	ALLOCATION_SCOPE("LoadShaders");
+
+	std::string VertexShaderCode, FragmentShaderCode;
+	if (!readShaderSource(vertex_file_path, defines, VertexShaderCode) || !readShaderSource(fragment_file_path, defines, FragmentShaderCode))
 		return 0;
-	}
 
-	// Read the header, i.e. the 54 first bytes
-
-	// If less than 54 bytes are read, problem
-	if ( fread(header, 1, 54, file)!=54 ){
-		printf("Not a correct BMP file\n");
-		fclose(file);
-		return 0;
-	}
-	// A BMP files always begins with "BM"
-	if ( header[0]!='B' || header[1]!='M' ){
-		printf("Not a correct BMP file\n");
-		fclose(file);
+	GLuint VertexShaderID = startShader(GL_VERTEX_SHADER, VertexShaderCode);
+	GLuint FragmentShaderID = startShader(GL_FRAGMENT_SHADER, FragmentShaderCode);
+	GLuint ProgramID = startProgram(VertexShaderID, FragmentShaderID, vertex_file_path);
+	if (!finishProgram(ProgramID, VertexShaderID, FragmentShaderID, vertex_file_path, fragment_file_path)) {
+		gpuResources.destroy(GPU_PROGRAM, ProgramID);
 		return 0;
 	}
-	// Make sure this is a 24bpp file
-	if ( *(int*)&(header[0x1E])!=0  )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
-	if ( *(int*)&(header[0x1C])!=24 )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
-
-	// Read the information about the image
-	dataPos    = *(int*)&(header[0x0A]);
-	imageSize  = *(int*)&(header[0x22]);
-	width      = *(int*)&(header[0x12]);
-	height     = *(int*)&(header[0x16]);
-
-	// Some BMP files are misformatted, guess missing information
-	if (imageSize==0)    imageSize=width*height*3; // 3 : one byte for each Red, Green and Blue component
-	if (dataPos==0)      dataPos=54; // The BMP header is done that way
-
-	// Create a buffer
-	data = new unsigned char [imageSize];
-
-	// Read the actual data from the file into the buffer
-	fread(data,1,imageSize,file);
-
-	// Everything is in memory now, the file can be closed.
-	fclose (file);
-
-	// Create one OpenGL texture
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-
-	// "Bind" the newly created texture : all future texture functions will modify this texture
-	glBindTexture(GL_TEXTURE_2D, textureID);
-
-	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-
-	// OpenGL has now copied the data. Free our own version
-	delete [] data;
-
-	//trilinear filtering ...
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	//...which requires mipmaps. Generate them automatically.
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	// Return the ID of the texture we just created
-	return textureID;
+	return ProgramID;
 }
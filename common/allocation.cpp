@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+
+#include "allocation.hpp"
+
+// Every thread's allocations. Relaxed : they are only ever read as totals.
+static std::atomic<long long> totalAllocations(0), totalBytes(0), totalFrees(0);
+
+// The calling thread's, read by the scopes it opens
+struct ThreadAllocations {
+	long long allocations, bytes, frees;
+};
+static thread_local ThreadAllocations threadAllocations = { 0, 0, 0 };
+
+// Registered by the first thread through each scope. A slot whose index is
+// taken but whose pointer is not stored yet reads NULL.
+static std::atomic<AllocationScopeCounter*> scopes[ALLOCATION_MAX_SCOPES];
+static std::atomic<int> scopeCount(0);
+
+static void * countedAllocate(size_t size)
+{
+	totalAllocations.fetch_add(1, std::memory_order_relaxed);
+	totalBytes.fetch_add((long long)size, std::memory_order_relaxed);
+	threadAllocations.allocations++;
+	threadAllocations.bytes += size;
+
+	if (size == 0)
+		size = 1;
+	for (;;) {
+		void * memory = malloc(size);
+		if (memory)
+			return memory;
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			return NULL;
+		handler();
+	}
+}
+
+static void countedFree(void * memory)
+{
+	if (!memory)
+		return;
+	totalFrees.fetch_add(1, std::memory_order_relaxed);
+	threadAllocations.frees++;
+	free(memory);
+}
+
+void * operator new(size_t size)
+{
+	void * memory = countedAllocate(size);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void * operator new[](size_t size)
+{
+	void * memory = countedAllocate(size);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	try {
+		return countedAllocate(size);
+	}
+	catch (...) {
+		// Thrown by a new handler
+		return NULL;
+	}
+}
+
+void * operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	try {
+		return countedAllocate(size);
+	}
+	catch (...) {
+		return NULL;
+	}
+}
+
+void operator delete(void * memory) noexcept
+{
+	countedFree(memory);
+}
+
+void operator delete[](void * memory) noexcept
+{
+	countedFree(memory);
+}
+
+void operator delete(void * memory, const std::nothrow_t &) noexcept
+{
+	countedFree(memory);
+}
+
+void operator delete[](void * memory, const std::nothrow_t &) noexcept
+{
+	countedFree(memory);
+}
+
+void operator delete(void * memory, size_t) noexcept
+{
+	countedFree(memory);
+}
+
+void operator delete[](void * memory, size_t) noexcept
+{
+	countedFree(memory);
+}
+
+AllocationCount allocationTotals()
+{
+	AllocationCount count = {
+		totalAllocations.load(std::memory_order_relaxed),
+		totalBytes.load(std::memory_order_relaxed),
+		totalFrees.load(std::memory_order_relaxed)
+	};
+	return count;
+}
+
+AllocationCount threadAllocationTotals()
+{
+	AllocationCount count = { threadAllocations.allocations, threadAllocations.bytes, threadAllocations.frees };
+	return count;
+}
+
+AllocationScopeCounter::AllocationScopeCounter(const char * name) : name(name), allocations(0), bytes(0), entries(0),
+	printedAllocations(0), printedBytes(0)
+{
+	int index = scopeCount.fetch_add(1);
+	if (index < ALLOCATION_MAX_SCOPES)
+		scopes[index].store(this, std::memory_order_release);
+	else
+		fprintf(stderr, "Allocations : more than %d scopes, \"%s\" is not reported\n", ALLOCATION_MAX_SCOPES, name);
+}
+
+void AllocationScopeCounter::add(const AllocationCount & count)
+{
+	entries.fetch_add(1, std::memory_order_relaxed);
+	if (count.allocations == 0)
+		return;
+	allocations.fetch_add(count.allocations, std::memory_order_relaxed);
+	bytes.fetch_add(count.bytes, std::memory_order_relaxed);
+}
+
+void allocationPrintScopes(bool sinceLastPrint)
+{
+	int count = scopeCount.load();
+	if (count > ALLOCATION_MAX_SCOPES)
+		count = ALLOCATION_MAX_SCOPES;
+	for (int i = 0; i < count; i++) {
+		AllocationScopeCounter * registered = scopes[i].load(std::memory_order_acquire);
+		if (!registered)
+			continue;
+		AllocationScopeCounter & scope = *registered;
+		long long allocations = scope.allocations.load(std::memory_order_relaxed);
+		long long bytes = scope.bytes.load(std::memory_order_relaxed);
+		long long shownAllocations = sinceLastPrint ? allocations - scope.printedAllocations : allocations;
+		long long shownBytes = sinceLastPrint ? bytes - scope.printedBytes : bytes;
+		scope.printedAllocations = allocations;
+		scope.printedBytes = bytes;
+		if (shownAllocations == 0)
+			continue;
+		printf("  %s : %lld allocations, %.1f KB, %lld times through\n", scope.name, shownAllocations, shownBytes / 1024.0,
+			scope.entries.load(std::memory_order_relaxed));
+	}
+}
+
+void allocationMarkScopes()
+{
+	int count = scopeCount.load();
+	if (count > ALLOCATION_MAX_SCOPES)
+		count = ALLOCATION_MAX_SCOPES;
+	for (int i = 0; i < count; i++) {
+		AllocationScopeCounter * scope = scopes[i].load(std::memory_order_acquire);
+		if (!scope)
+			continue;
+		scope->printedAllocations = scope->allocations.load(std::memory_order_relaxed);
+		scope->printedBytes = scope->bytes.load(std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef ALLOCATION_HPP
+#define ALLOCATION_HPP
+
+#include <atomic>
+
+// Named scopes the allocation counters can tell apart
+#define ALLOCATION_MAX_SCOPES 64
+
+struct AllocationCount {
+	long long allocations;
+	long long bytes;       // Requested, not counting the heap's overhead
+	long long frees;
+};
+
+inline AllocationCount operator-(const AllocationCount & a, const AllocationCount & b)
+{
+	AllocationCount result = { a.allocations - b.allocations, a.bytes - b.bytes, a.frees - b.frees };
+	return result;
+}
+
+// Heap allocations, counted by the replacements of the global operator new
+// and delete in allocation.cpp : every new, including the containers', on
+// every thread. Calls to malloc are not seen.
+//
+// The totals of all threads give the allocations of a frame; the calling
+// thread's totals give those of a scope, which other threads do not disturb.
+AllocationCount allocationTotals();
+AllocationCount threadAllocationTotals();
+
+// Allocations made inside one named scope, summed over every time any thread
+// went through it. Nested scopes count in their parents as well.
+class AllocationScopeCounter {
+public:
+	explicit AllocationScopeCounter(const char * name);
+
+	void add(const AllocationCount & count);
+
+	const char * name;
+	std::atomic<long long> allocations, bytes;
+	std::atomic<long long> entries;
+	long long printedAllocations, printedBytes; // Totals when last printed
+};
+
+class AllocationScope {
+public:
+	explicit AllocationScope(AllocationScopeCounter & counter) : counter(counter), start(threadAllocationTotals()) {}
+	~AllocationScope() { counter.add(threadAllocationTotals() - start); }
+
+private:
+	AllocationScopeCounter & counter;
+	AllocationCount start;
+};
+
+// Prints the scopes that allocated, since the last call when sinceLastPrint
+// is set, since the start otherwise
+void allocationPrintScopes(bool sinceLastPrint);
+// Starts the next allocationPrintScopes(true) from now, printing nothing
+void allocationMarkScopes();
+
+#define ALLOCATION_CONCAT_INNER(a, b) a##b
+#define ALLOCATION_CONCAT(a, b) ALLOCATION_CONCAT_INNER(a, b)
+// Counts the allocations made until the end of the enclosing block. name
+// must be a string literal; the counter is created the first time through.
+#define ALLOCATION_SCOPE(name) \
+	static AllocationScopeCounter ALLOCATION_CONCAT(allocationCounter, __LINE__)(name); \
+	AllocationScope ALLOCATION_CONCAT(allocationScope, __LINE__)(ALLOCATION_CONCAT(allocationCounter, __LINE__))
+
+#endif
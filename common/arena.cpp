@@ -0,0 +1,75 @@
+#include <stddef.h>
+#include <new>
+#include <vector>
+#include <type_traits>
+
+#include "arena.hpp"
+
+// Smallest block an arena starts with once it has been used
+#define ARENA_MIN_BLOCK 4096
+
+static char * alignPointer(char * pointer, size_t alignment)
+{
+	return (char*)(((size_t)pointer + alignment - 1) & ~(alignment - 1));
+}
+
+FrameArena::FrameArena() : block(NULL), blockSize(0), offset(0), overflow(NULL), usedBytes(0), peakBytes(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+	destroy();
+}
+
+void FrameArena::destroy()
+{
+	reset();
+	::operator delete(block);
+	block = NULL;
+	blockSize = 0;
+	peakBytes = 0;
+}
+
+void * FrameArena::allocate(size_t bytes, size_t alignment)
+{
+	// The blocks come from operator new, so the allocation counters see an
+	// arena that grows
+	if (block) {
+		char * start = alignPointer(block + offset, alignment);
+		if (start + bytes <= block + blockSize) {
+			usedBytes += start + bytes - (block + offset);
+			offset = start + bytes - block;
+			return start;
+		}
+	}
+
+	char * memory = (char*)::operator new(sizeof(Overflow) + alignment + bytes);
+	Overflow * header = (Overflow*)memory;
+	header->next = overflow;
+	overflow = header;
+	usedBytes += bytes + alignment;
+	return alignPointer(memory + sizeof(Overflow), alignment);
+}
+
+void FrameArena::reset()
+{
+	if (usedBytes > peakBytes)
+		peakBytes = usedBytes;
+	while (overflow) {
+		Overflow * next = overflow->next;
+		::operator delete(overflow);
+		overflow = next;
+	}
+	if (peakBytes > blockSize) {
+		// Half again as much, so a frame a little bigger still fits
+		size_t size = peakBytes + peakBytes / 2;
+		if (size < ARENA_MIN_BLOCK)
+			size = ARENA_MIN_BLOCK;
+		::operator delete(block);
+		block = (char*)::operator new(size);
+		blockSize = size;
+	}
+	offset = 0;
+	usedBytes = 0;
+}
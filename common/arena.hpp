@@ -0,0 +1,153 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+#include <type_traits>
+
+// Objects an ObjectPool creates at once when it runs out
+#define OBJECT_POOL_CHUNK 16
+
+// Linear allocator for data that lives for one frame : allocate() bumps an
+// offset into one block, reset() drops everything at once. Nothing is ever
+// destroyed, only trivially destructible types go in.
+//
+// A frame that needs more than the block takes extra blocks from the heap;
+// the next reset() frees them and grows the block to the most a frame has
+// used, so after the first frames of a new workload an arena no longer
+// allocates at all.
+class FrameArena {
+public:
+	FrameArena();
+	~FrameArena();
+
+	void destroy();
+
+	// alignment is a power of two
+	void * allocate(size_t bytes, size_t alignment = 16);
+
+	// Uninitialized storage for count objects
+	template <typename T>
+	T * allocateArray(size_t count);
+
+	// A copy of value in the arena, like a lambda to call later this frame
+	template <typename T>
+	T * copy(const T & value);
+
+	void reset();
+
+	size_t used() const { return usedBytes; }
+	size_t capacity() const { return blockSize; }
+	// Most bytes used by one frame so far
+	size_t peak() const { return peakBytes; }
+
+private:
+	FrameArena(const FrameArena &);
+	FrameArena & operator=(const FrameArena &);
+
+	struct Overflow {
+		Overflow * next;
+	};
+
+	char * block;
+	size_t blockSize;
+	size_t offset;
+	Overflow * overflow; // Blocks taken this frame once the block was full
+	size_t usedBytes, peakBytes;
+};
+
+template <typename T>
+T * FrameArena::allocateArray(size_t count)
+{
+	static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+	return (T*)allocate(count * sizeof(T), std::alignment_of<T>::value);
+}
+
+template <typename T>
+T * FrameArena::copy(const T & value)
+{
+	static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+	return new (allocate(sizeof(T), std::alignment_of<T>::value)) T(value);
+}
+
+// Recycles objects of one type through a free list. A released object is not
+// destroyed : acquire() hands it back as it was left, so the containers in it
+// keep their capacity and refilling them does not allocate. The objects are
+// created OBJECT_POOL_CHUNK at a time and destroyed with the pool.
+//
+// Not thread safe, acquire and release from one thread.
+template <typename T>
+class ObjectPool {
+public:
+	ObjectPool() {}
+	~ObjectPool();
+
+	T * acquire();
+	void release(T * object) { freeObjects.push_back(object); }
+
+	int size() const { return (int)chunks.size() * OBJECT_POOL_CHUNK; }
+	int available() const { return (int)freeObjects.size(); }
+
+private:
+	ObjectPool(const ObjectPool &);
+	ObjectPool & operator=(const ObjectPool &);
+
+	std::vector<T*> chunks;
+	std::vector<T*> freeObjects;
+};
+
+template <typename T>
+ObjectPool<T>::~ObjectPool()
+{
+	for (size_t i = 0; i < chunks.size(); i++)
+		delete[] chunks[i];
+}
+
+template <typename T>
+T * ObjectPool<T>::acquire()
+{
+	if (freeObjects.empty()) {
+		T * chunk = new T[OBJECT_POOL_CHUNK];
+		chunks.push_back(chunk);
+		// Room for every object, release() never allocates
+		freeObjects.reserve(chunks.size() * OBJECT_POOL_CHUNK);
+		for (int i = OBJECT_POOL_CHUNK - 1; i >= 0; i--)
+			freeObjects.push_back(&chunk[i]);
+	}
+	T * object = freeObjects.back();
+	freeObjects.pop_back();
+	return object;
+}
+
+// Vector of at most N elements stored inline, for small per-frame lists that
+// must not allocate. push_back() returns false when it is full.
+template <typename T, int N>
+class FixedVector {
+public:
+	FixedVector() : count(0) {}
+
+	bool push_back(const T & value)
+	{
+		if (count == N)
+			return false;
+		items[count++] = value;
+		return true;
+	}
+	void clear() { count = 0; }
+
+	size_t size() const { return (size_t)count; }
+	bool empty() const { return count == 0; }
+	T & operator[](size_t index) { return items[index]; }
+	const T & operator[](size_t index) const { return items[index]; }
+	T * begin() { return items; }
+	T * end() { return items + count; }
+	const T * begin() const { return items; }
+	const T * end() const { return items + count; }
+
+private:
+	T items[N];
+	int count;
+};
+
+#endif
@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CAPTURE_SSE2 1
+#endif
+
+#include "gpuresources.hpp"
+#include "jobsystem.hpp"
+#include "trace.hpp"
+#include "capture.hpp"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define CAPTURE_PIPE_MODE "wb"
+#else
+#define CAPTURE_PIPE_MODE "w"
+#endif
+
+// How long one glClientWaitSync call may block, in nanoseconds
+#define CAPTURE_WAIT_SLICE 1000000
+
+// BT.601 limited range, in 8 bit fixed point
+static inline unsigned char lumaOf(int b, int g, int r)
+{
+	return (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static inline unsigned char blueDifferenceOf(int b, int g, int r)
+{
+	return (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static inline unsigned char redDifferenceOf(int b, int g, int r)
+{
+	return (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+#ifdef CAPTURE_SSE2
+// The channels of 8 BGRA pixels, one per 16 bit lane
+static inline void splitPixels(const unsigned char * pixels, __m128i & b, __m128i & g, __m128i & r)
+{
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	__m128i low = _mm_loadu_si128((const __m128i*)pixels);
+	__m128i high = _mm_loadu_si128((const __m128i*)(pixels + 16));
+	b = _mm_packs_epi32(_mm_and_si128(low, mask), _mm_and_si128(high, mask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(low, 8), mask), _mm_and_si128(_mm_srli_epi32(high, 8), mask));
+	r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(low, 16), mask), _mm_and_si128(_mm_srli_epi32(high, 16), mask));
+}
+
+// lumaOf on 8 lanes. The sum stays below 65536, so wrapping 16 bit products
+// and a logical shift give the exact result.
+static inline __m128i luma8(__m128i b, __m128i g, __m128i r)
+{
+	__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+		_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+}
+
+// Rounded averages of the 2x2 blocks of 16 pixels in two rows, 8 lanes
+static inline __m128i average2x2(__m128i top0, __m128i top1, __m128i bottom0, __m128i bottom1)
+{
+	const __m128i ones = _mm_set1_epi16(1);
+	__m128i sums = _mm_packs_epi32(_mm_madd_epi16(_mm_add_epi16(top0, bottom0), ones),
+		_mm_madd_epi16(_mm_add_epi16(top1, bottom1), ones));
+	return _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+}
+
+// The chroma sums stay within +-28688, arithmetic shifts match the scalar path
+static inline __m128i chroma8(__m128i b, __m128i g, __m128i r, short cb, short cg, short cr)
+{
+	__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg))),
+		_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(cb)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+}
+#endif
+
+void convertBgraToI420(const unsigned char * bgra, int width, int height, unsigned char * out_yuv)
+{
+	unsigned char * lumaPlane = out_yuv;
+	unsigned char * blueDifferencePlane = out_yuv + width * height;
+	unsigned char * redDifferencePlane = blueDifferencePlane + (width / 2) * (height / 2);
+	size_t stride = (size_t)width * 4;
+
+	for (int y = 0; y < height; y += 2) {
+		// The image is bottom up, the video top down
+		const unsigned char * top = bgra + (height - 1 - y) * stride;
+		const unsigned char * bottom = bgra + (height - 2 - y) * stride;
+		unsigned char * lumaTop = lumaPlane + y * width;
+		unsigned char * lumaBottom = lumaTop + width;
+		unsigned char * blueDifference = blueDifferencePlane + (y / 2) * (width / 2);
+		unsigned char * redDifference = redDifferencePlane + (y / 2) * (width / 2);
+
+		int x = 0;
+#ifdef CAPTURE_SSE2
+		for (; x + 16 <= width; x += 16) {
+			__m128i tb0, tg0, tr0, tb1, tg1, tr1, bb0, bg0, br0, bb1, bg1, br1;
+			splitPixels(top + x * 4, tb0, tg0, tr0);
+			splitPixels(top + x * 4 + 32, tb1, tg1, tr1);
+			splitPixels(bottom + x * 4, bb0, bg0, br0);
+			splitPixels(bottom + x * 4 + 32, bb1, bg1, br1);
+			_mm_storeu_si128((__m128i*)(lumaTop + x), _mm_packus_epi16(luma8(tb0, tg0, tr0), luma8(tb1, tg1, tr1)));
+			_mm_storeu_si128((__m128i*)(lumaBottom + x), _mm_packus_epi16(luma8(bb0, bg0, br0), luma8(bb1, bg1, br1)));
+
+			__m128i b = average2x2(tb0, tb1, bb0, bb1);
+			__m128i g = average2x2(tg0, tg1, bg0, bg1);
+			__m128i r = average2x2(tr0, tr1, br0, br1);
+			__m128i u = chroma8(b, g, r, 112, -74, -38);
+			__m128i v = chroma8(b, g, r, -18, -94, 112);
+			_mm_storel_epi64((__m128i*)(blueDifference + x / 2), _mm_packus_epi16(u, u));
+			_mm_storel_epi64((__m128i*)(redDifference + x / 2), _mm_packus_epi16(v, v));
+		}
+#endif
+		for (; x < width; x += 2) {
+			const unsigned char * t = top + x * 4;
+			const unsigned char * d = bottom + x * 4;
+			lumaTop[x] = lumaOf(t[0], t[1], t[2]);
+			lumaTop[x + 1] = lumaOf(t[4], t[5], t[6]);
+			lumaBottom[x] = lumaOf(d[0], d[1], d[2]);
+			lumaBottom[x + 1] = lumaOf(d[4], d[5], d[6]);
+			int b = (t[0] + t[4] + d[0] + d[4] + 2) >> 2;
+			int g = (t[1] + t[5] + d[1] + d[5] + 2) >> 2;
+			int r = (t[2] + t[6] + d[2] + d[6] + 2) >> 2;
+			blueDifference[x / 2] = blueDifferenceOf(b, g, r);
+			redDifference[x / 2] = redDifferenceOf(b, g, r);
+		}
+	}
+}
+
+FrameCapture::FrameCapture() : next(0), oldest(0), converting(-1), output(NULL), pipe(false), width(0), height(0),
+	jobSystem(NULL), writeFailed(false)
+{
+	for (int i = 0; i < CAPTURE_RING_FRAMES; i++) {
+		slots[i].buffer = 0;
+		slots[i].fence = 0;
+		slots[i].pixels = NULL;
+		slots[i].job = NULL;
+		slots[i].state = SLOT_FREE;
+	}
+	memset(&stats, 0, sizeof(stats));
+}
+
+FrameCapture::~FrameCapture()
+{
+	if (output)
+		close();
+}
+
+bool FrameCapture::open(const char * outputPath, int windowWidth, int windowHeight, int fps, JobSystem & jobs)
+{
+	width = windowWidth & ~1;
+	height = windowHeight & ~1;
+	if (width < 2 || height < 2) {
+		printf("Capture : the window is too small to record\n");
+		return false;
+	}
+	path = outputPath;
+	pipe = outputPath[0] == '|';
+	output = pipe ? popen(outputPath + 1, CAPTURE_PIPE_MODE) : fopen(outputPath, "wb");
+	if (!output) {
+		printf("Capture : %s could not be opened\n", outputPath);
+		return false;
+	}
+	if (fprintf(output, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", width, height, fps) < 0)
+		writeFailed = true;
+
+	jobSystem = &jobs;
+	yuv.resize((size_t)width * height * 3 / 2);
+	GLsizeiptr bytes = (GLsizeiptr)width * height * 4;
+	for (int i = 0; i < CAPTURE_RING_FRAMES; i++) {
+		slots[i].buffer = GPU_CREATE(GPU_BUFFER, GPU_MEMORY_STREAMING, "Capture readback");
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[i].buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+		gpuResources.setSize(GPU_BUFFER, slots[i].buffer, bytes, GL_NONE);
+		slots[i].state = SLOT_FREE;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	next = oldest = 0;
+	converting = -1;
+	memset(&stats, 0, sizeof(stats));
+	return true;
+}
+
+bool FrameCapture::capture(int windowWidth, int windowHeight)
+{
+	TRACE_SCOPE("Capture frame");
+	if (windowWidth < width || windowHeight < height)
+		return false;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// A full ring : wait rather than drop a frame
+	poll();
+	Slot & slot = slots[next];
+	if (slot.state.load(std::memory_order_acquire) != SLOT_FREE) {
+		while (slot.state.load(std::memory_order_acquire) != SLOT_FREE) {
+			waitForProgress();
+			poll();
+		}
+		stats.stalledFrames++;
+		stats.stallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.state.store(SLOT_READING, std::memory_order_relaxed);
+	next = (next + 1) % CAPTURE_RING_FRAMES;
+
+	stats.renderMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
+
+void FrameCapture::poll()
+{
+	for (;;) {
+		// The worker is done with the mapped pixels
+		if (converting >= 0) {
+			Slot & slot = slots[converting];
+			if (slot.state.load(std::memory_order_acquire) != SLOT_CONVERTED)
+				return;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			stats.frames++;
+			stats.convertMs += slot.convertMs;
+			stats.writeMs += slot.writeMs;
+			slot.pixels = NULL;
+			slot.job = NULL;
+			slot.state.store(SLOT_FREE, std::memory_order_relaxed);
+			converting = -1;
+		}
+
+		// Frames go to the worker one at a time, in the order they were captured
+		Slot & slot = slots[oldest];
+		if (slot.state.load(std::memory_order_relaxed) != SLOT_READING)
+			return;
+		GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+			return;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		slot.pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)width * height * 4, GL_MAP_READ_BIT);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		int index = oldest;
+		oldest = (oldest + 1) % CAPTURE_RING_FRAMES;
+		if (status == GL_WAIT_FAILED || !slot.pixels) {
+			// Lost, the video would skip a frame
+			printf("Capture : reading a frame back failed\n");
+			writeFailed = true;
+			if (slot.pixels) {
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			}
+			slot.pixels = NULL;
+			slot.state.store(SLOT_FREE, std::memory_order_relaxed);
+			continue;
+		}
+
+		converting = index;
+		slot.state.store(SLOT_CONVERTING, std::memory_order_relaxed);
+		if (jobSystem->threadCount() < 2) {
+			convert(index);
+			continue;
+		}
+		FrameCapture * self = this;
+		slot.job = jobSystem->createLambda(NULL, [self, index]() { self->convert(index); });
+		jobSystem->run(slot.job);
+		return;
+	}
+}
+
+// Runs jobs until the worker is done, or waits a little for the GPU
+void FrameCapture::waitForProgress()
+{
+	if (converting >= 0) {
+		Slot & slot = slots[converting];
+		if (slot.job && slot.state.load(std::memory_order_acquire) != SLOT_CONVERTED)
+			jobSystem->wait(slot.job);
+		return;
+	}
+	Slot & slot = slots[oldest];
+	if (slot.state.load(std::memory_order_relaxed) == SLOT_READING)
+		glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, CAPTURE_WAIT_SLICE);
+}
+
+void FrameCapture::convert(int index)
+{
+	TRACE_SCOPE("Capture convert");
+	Slot & slot = slots[index];
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	convertBgraToI420(slot.pixels, width, height, &yuv[0]);
+	std::chrono::steady_clock::time_point converted = std::chrono::steady_clock::now();
+
+	if (!writeFailed.load()) {
+		if (fwrite("FRAME\n", 1, 6, output) != 6 || fwrite(&yuv[0], 1, yuv.size(), output) != yuv.size())
+			writeFailed = true;
+	}
+	slot.convertMs = std::chrono::duration<double, std::milli>(converted - start).count();
+	slot.writeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - converted).count();
+	slot.state.store(SLOT_CONVERTED, std::memory_order_release);
+}
+
+void FrameCapture::close()
+{
+	if (!output)
+		return;
+	// Every frame in flight is written first
+	for (;;) {
+		poll();
+		bool busy = converting >= 0;
+		for (int i = 0; i < CAPTURE_RING_FRAMES; i++)
+			busy = busy || slots[i].state.load(std::memory_order_relaxed) == SLOT_READING;
+		if (!busy)
+			break;
+		waitForProgress();
+	}
+	for (int i = 0; i < CAPTURE_RING_FRAMES; i++)
+		gpuResources.destroy(GPU_BUFFER, slots[i].buffer);
+
+	if ((pipe ? pclose(output) : fclose(output)) != 0)
+		writeFailed = true;
+	output = NULL;
+	std::vector<unsigned char>().swap(yuv);
+}
+
+void FrameCapture::printStatistics() const
+{
+	if (stats.frames == 0) {
+		printf("Capture : no frame written to %s\n", path.c_str());
+		return;
+	}
+	double frames = (double)stats.frames;
+	printf("Capture : %lld frames of %dx%d %s %s%s\n", stats.frames, width, height, pipe ? "piped to" : "written to",
+		pipe ? path.c_str() + 1 : path.c_str(), writeFailed.load() ? ", writing FAILED" : "");
+	printf("Capture : per frame %.3f ms on the render thread, %.2f ms converting and %.2f ms writing on a worker; %d frames waited %.1f ms in all\n",
+		stats.renderMs / frames, stats.convertMs / frames, stats.writeMs / frames, stats.stalledFrames, stats.stallMs);
+}
@@ -0,0 +1,90 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+class JobSystem;
+struct Job;
+
+// Readbacks in flight. The render thread only waits for one when the GPU or
+// the worker is this many frames behind.
+#define CAPTURE_RING_FRAMES 4
+
+// Converts a bottom-up BGRA image to top-down planar YUV 4:2:0, BT.601
+// limited range : width x height luma, then the two half size chroma planes,
+// each chroma sample the average of its 2x2 pixels. width and height must be
+// even. Integer only, so SSE2 and the scalar path give the same bytes.
+void convertBgraToI420(const unsigned char * bgra, int width, int height, unsigned char * out_yuv);
+
+struct CaptureStatistics {
+	long long frames;   // Written out
+	int stalledFrames;  // capture() calls that waited for a free readback
+	double renderMs;    // Render thread time in capture(), summed
+	double stallMs;     // Part of it spent waiting
+	double convertMs;   // On the worker, summed
+	double writeMs;
+};
+
+// Records the window as a Y4M video without stalling the render thread.
+// capture() copies the back buffer into a pixel buffer object of a ring and
+// fences it; once the fence has passed, a worker converts the mapped pixels
+// to YUV and writes the frame out, one frame at a time in order. Every frame
+// is kept : when the ring is full the render thread waits instead of
+// dropping one, so the video holds exactly the frames captured.
+//
+// The output is a file, or a command started with popen that reads the
+// video on its standard input when the path starts with |. Must be used from
+// the thread that owns the GL context and started the job system.
+class FrameCapture {
+public:
+	FrameCapture();
+	~FrameCapture();
+
+	// width and height are rounded down to even sizes
+	bool open(const char * path, int width, int height, int fps, JobSystem & jobs);
+	// Reads back the lower left corner of the window's back buffer. False,
+	// and nothing is read, when the window is now smaller than the video.
+	bool capture(int windowWidth, int windowHeight);
+	// Hands the finished readbacks to the worker, never blocks
+	void poll();
+	// Waits for every frame to be written, then closes the output
+	void close();
+
+	bool isOpen() const { return output != NULL; }
+	bool failed() const { return writeFailed.load(); }
+	const CaptureStatistics & statistics() const { return stats; }
+	void printStatistics() const;
+
+private:
+	enum SlotState { SLOT_FREE, SLOT_READING, SLOT_CONVERTING, SLOT_CONVERTED };
+
+	struct Slot {
+		GLuint buffer;
+		GLsync fence;              // Set while SLOT_READING
+		const unsigned char * pixels; // Mapped while converting
+		Job * job;                 // NULL when converted inline
+		double convertMs, writeMs; // Written by the worker
+		std::atomic<int> state;    // SlotState, set to SLOT_CONVERTED by the worker
+	};
+
+	void convert(int index);
+	void waitForProgress();
+
+	Slot slots[CAPTURE_RING_FRAMES];
+	int next;                      // Slot the next capture() reads into
+	int oldest;                    // Oldest slot not handed to the worker
+	int converting;                // Slot with the worker, -1 when none
+	std::vector<unsigned char> yuv; // The frame being converted
+	FILE * output;
+	bool pipe;
+	std::string path;
+	int width, height;
+	JobSystem * jobSystem;
+	std::atomic<bool> writeFailed;
+	CaptureStatistics stats;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include <math.h>
+
+#include "dynres.hpp"
+
+// Only scale up once the frame is comfortably under budget, otherwise the
+// controller would oscillate around the budget line.
+#define DYNRES_HEADROOM 0.85f
+// Fraction of the measured error corrected per frame
+#define DYNRES_GAIN 0.25f
+// Weight of the newest frame in the smoothed frame time
+#define DYNRES_SMOOTHING 0.3f
+// Scales are snapped to this step to avoid resizing by a pixel every frame
+#define DYNRES_STEP (1.0f / 64.0f)
+
+static float clampScale(const DynamicResolution & dr, float s)
+{
+	if (s < dr.minScale) s = dr.minScale;
+	if (s > dr.maxScale) s = dr.maxScale;
+	return s;
+}
+
+void initDynamicResolution(DynamicResolution & dr, float minScale, float maxScale, float budgetMs)
+{
+	dr.minScale = minScale;
+	dr.maxScale = maxScale;
+	dr.budgetMs = budgetMs;
+	dr.scale = maxScale;
+	dr.locked = false;
+	dr.lockedScale = maxScale;
+	dr.smoothedMs = -1.0f;
+}
+
+float updateDynamicResolution(DynamicResolution & dr, double gpuMs, double cpuMs)
+{
+	if (dr.locked) {
+		dr.scale = clampScale(dr, dr.lockedScale);
+		return dr.scale;
+	}
+
+	// The slower of the two sides decides how long the frame took
+	double frameMs = gpuMs > cpuMs ? gpuMs : cpuMs;
+	if (frameMs <= 0.0)
+		return dr.scale;
+
+	if (dr.smoothedMs < 0.0f)
+		dr.smoothedMs = (float)frameMs;
+	else
+		dr.smoothedMs += DYNRES_SMOOTHING * ((float)frameMs - dr.smoothedMs);
+
+	// Pixel cost grows with the square of the scale, so the scale that would
+	// exactly hit the budget is the current one times sqrt(budget / time).
+	float ideal = dr.scale * sqrtf(dr.budgetMs / dr.smoothedMs);
+	if (ideal > dr.scale && dr.smoothedMs > dr.budgetMs * DYNRES_HEADROOM)
+		return dr.scale;
+
+	float next = dr.scale + DYNRES_GAIN * (ideal - dr.scale);
+	next = floorf(next / DYNRES_STEP + 0.5f) * DYNRES_STEP;
+	dr.scale = clampScale(dr, next);
+	return dr.scale;
+}
+
+void dynamicResolutionSize(const DynamicResolution & dr, int windowWidth, int windowHeight, int & width, int & height)
+{
+	width = (int)(windowWidth * dr.scale);
+	height = (int)(windowHeight * dr.scale);
+	if (width < 1) width = 1;
+	if (height < 1) height = 1;
+}
@@ -0,0 +1,26 @@
+#ifndef DYNRES_HPP
+#define DYNRES_HPP
+
+// Controls the fraction of the window resolution the scene is rendered at so
+// that the measured frame time stays inside a budget.
+struct DynamicResolution {
+	float scale;        // Current render scale, applied to width and height
+	float minScale;     // Lowest scale the controller may pick
+	float maxScale;     // Highest scale, also sizes the offscreen target
+	float budgetMs;     // Frame time the controller aims for
+	bool locked;        // Keeps scale fixed for benchmarking
+	float lockedScale;  // Scale used while locked
+
+	float smoothedMs;   // Filtered frame time the controller reacts to
+};
+
+void initDynamicResolution(DynamicResolution & dr, float minScale, float maxScale, float budgetMs);
+
+// Feeds one frame's timings to the controller and returns the scale for the
+// next frame. Negative timings mean "not measured" and are ignored.
+float updateDynamicResolution(DynamicResolution & dr, double gpuMs, double cpuMs);
+
+// Rounds the window size down to the render size for the current scale.
+void dynamicResolutionSize(const DynamicResolution & dr, int windowWidth, int windowHeight, int & width, int & height);
+
+#endif
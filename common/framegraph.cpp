@@ -0,0 +1,517 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "gpuresources.hpp"
+#include "arena.hpp"
+#include "framegraph.hpp"
+#include "trace.hpp"
+
+static bool isDepthFormat(GLenum internalFormat)
+{
+	switch (internalFormat) {
+	case GL_DEPTH_COMPONENT16:
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32:
+	case GL_DEPTH_COMPONENT32F:
+	case GL_DEPTH24_STENCIL8:
+	case GL_DEPTH32F_STENCIL8:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool hasStencil(GLenum internalFormat)
+{
+	return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+}
+
+int frameGraphBytesPerPixel(GLenum internalFormat)
+{
+	switch (internalFormat) {
+	case GL_R8:
+		return 1;
+	case GL_R16F:
+	case GL_RG8:
+	case GL_DEPTH_COMPONENT16:
+		return 2;
+	case GL_RGBA16F:
+	case GL_RG32F:
+	case GL_DEPTH32F_STENCIL8:
+		return 8;
+	case GL_RGBA32F:
+		return 16;
+	default:
+		// GL_RGBA8, GL_RGB10_A2, GL_R11F_G11F_B10F, GL_R32F, GL_RG16F and the
+		// 24 and 32 bit depth formats
+		return 4;
+	}
+}
+
+static bool sameDesc(const FrameGraphTextureDesc & a, const FrameGraphTextureDesc & b)
+{
+	return a.width == b.width && a.height == b.height && a.internalFormat == b.internalFormat;
+}
+
+static long long descBytes(const FrameGraphTextureDesc & desc)
+{
+	return (long long)desc.width * desc.height * frameGraphBytesPerPixel(desc.internalFormat);
+}
+
+FrameGraph::FrameGraph() : aliasing(true), frame(0), changed(false)
+{
+	clearColor[0] = clearColor[1] = clearColor[2] = clearColor[3] = 0.0f;
+	memset(&stats, 0, sizeof(stats));
+}
+
+void FrameGraph::destroy()
+{
+	releaseFramebuffers();
+	for (size_t i = 0; i < pool.size(); i++)
+		gpuResources.destroy(GPU_TEXTURE, pool[i].texture);
+	pool.clear();
+	resources.clear();
+	passes.clear();
+	order.clear();
+	arena.destroy();
+}
+
+void FrameGraph::reset()
+{
+	resources.clear();
+	passes.clear();
+	order.clear();
+	arena.reset();
+}
+
+FrameGraphResource FrameGraph::createTexture(const char * name, const FrameGraphTextureDesc & desc)
+{
+	Resource resource;
+	resource.name = name;
+	resource.desc = desc;
+	resource.imported = false;
+	resource.firstUse = resource.lastUse = -1;
+	resource.physical = -1;
+	resources.push_back(resource);
+	return (FrameGraphResource)resources.size() - 1;
+}
+
+FrameGraphResource FrameGraph::importBackbuffer(const char * name)
+{
+	FrameGraphTextureDesc desc = { 0, 0, GL_RGBA8 };
+	FrameGraphResource handle = createTexture(name, desc);
+	resources[handle].imported = true;
+	return handle;
+}
+
+int FrameGraph::addPassFunction(const char * name, PassFunction function, const void * closure)
+{
+	Pass pass;
+	pass.name = name;
+	pass.function = function;
+	pass.closure = closure;
+	pass.culled = false;
+	pass.kept = false;
+	pass.framebuffer = -1;
+	passes.push_back(pass);
+	return (int)passes.size() - 1;
+}
+
+void FrameGraph::read(int pass, FrameGraphResource resource)
+{
+	Access access = { resource, (int)resources[resource].writers.size(), false };
+	if (!passes[pass].reads.push_back(access))
+		printf("Frame graph : pass \"%s\" reads more than %d resources\n", passes[pass].name, FRAME_GRAPH_MAX_ACCESSES);
+}
+
+void FrameGraph::readAttachment(int pass, FrameGraphResource resource)
+{
+	Access access = { resource, (int)resources[resource].writers.size(), true };
+	if (!passes[pass].reads.push_back(access))
+		printf("Frame graph : pass \"%s\" reads more than %d resources\n", passes[pass].name, FRAME_GRAPH_MAX_ACCESSES);
+}
+
+void FrameGraph::write(int pass, FrameGraphResource resource)
+{
+	if (passes[pass].writes.size() == FRAME_GRAPH_MAX_ACCESSES) {
+		printf("Frame graph : pass \"%s\" writes more than %d resources\n", passes[pass].name, FRAME_GRAPH_MAX_ACCESSES);
+		return;
+	}
+	if (!resources[resource].writers.push_back(pass)) {
+		printf("Frame graph : \"%s\" is written more than %d times\n", resources[resource].name, FRAME_GRAPH_MAX_VERSIONS);
+		return;
+	}
+	Access access = { resource, (int)resources[resource].writers.size(), true };
+	passes[pass].writes.push_back(access);
+}
+
+void FrameGraph::setClearColor(float r, float g, float b, float a)
+{
+	clearColor[0] = r;
+	clearColor[1] = g;
+	clearColor[2] = b;
+	clearColor[3] = a;
+}
+
+int FrameGraph::writerOf(FrameGraphResource resource, int version) const
+{
+	return version > 0 ? resources[resource].writers[version - 1] : -1;
+}
+
+// Passes that must run before pass : the writers of what it reads, the
+// writer of the version it draws on top of, and the readers of that version,
+// which must see it before it is overwritten. Sets out_needed[other] to 1 for
+// each, the array has one entry per pass.
+void FrameGraph::dependencies(int pass, unsigned char * out_needed) const
+{
+	memset(out_needed, 0, passes.size());
+	const Pass & p = passes[pass];
+	for (size_t i = 0; i < p.reads.size(); i++) {
+		int writer = writerOf(p.reads[i].resource, p.reads[i].version);
+		if (writer >= 0)
+			out_needed[writer] = 1;
+	}
+	for (size_t i = 0; i < p.writes.size(); i++) {
+		int previous = p.writes[i].version - 1;
+		int writer = writerOf(p.writes[i].resource, previous);
+		if (writer >= 0)
+			out_needed[writer] = 1;
+		for (size_t other = 0; other < passes.size(); other++) {
+			if ((int)other == pass)
+				continue;
+			const FixedVector<Access, FRAME_GRAPH_MAX_ACCESSES> & reads = passes[other].reads;
+			for (size_t r = 0; r < reads.size(); r++) {
+				if (reads[r].resource == p.writes[i].resource && reads[r].version == previous)
+					out_needed[other] = 1;
+			}
+		}
+	}
+}
+
+void FrameGraph::cullPasses()
+{
+	// Passes that write the backbuffer are the results of the frame, as are
+	// the kept ones. Keep them and, going back through the writers of what
+	// they use, everything they depend on. A pass is marked kept when it is
+	// pushed, so the stack never holds more than every pass once.
+	int * stack = arena.allocateArray<int>(passes.size());
+	int depth = 0;
+	for (size_t p = 0; p < passes.size(); p++) {
+		bool result = passes[p].kept;
+		for (size_t w = 0; w < passes[p].writes.size(); w++) {
+			if (resources[passes[p].writes[w].resource].imported)
+				result = true;
+		}
+		passes[p].culled = !result;
+		if (result)
+			stack[depth++] = (int)p;
+	}
+
+	while (depth > 0) {
+		const Pass & pass = passes[stack[--depth]];
+		for (size_t r = 0; r < pass.reads.size(); r++) {
+			int writer = writerOf(pass.reads[r].resource, pass.reads[r].version);
+			if (writer >= 0 && passes[writer].culled) {
+				passes[writer].culled = false;
+				stack[depth++] = writer;
+			}
+		}
+		// Drawing on top of an earlier version needs that version
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			int writer = writerOf(pass.writes[w].resource, pass.writes[w].version - 1);
+			if (writer >= 0 && passes[writer].culled) {
+				passes[writer].culled = false;
+				stack[depth++] = writer;
+			}
+		}
+	}
+}
+
+void FrameGraph::orderPasses()
+{
+	// Kahn's algorithm, taking the earliest declared pass among the ready
+	// ones so the order only changes where the dependencies demand it. The
+	// dependencies are a matrix, row p holding the passes p needs.
+	size_t count = passes.size();
+	unsigned char * needs = arena.allocateArray<unsigned char>(count * count);
+	int * remaining = arena.allocateArray<int>(count);
+	bool * done = arena.allocateArray<bool>(count);
+	for (size_t p = 0; p < count; p++) {
+		remaining[p] = 0;
+		done[p] = false;
+		if (passes[p].culled)
+			continue;
+		unsigned char * row = needs + p * count;
+		dependencies((int)p, row);
+		for (size_t other = 0; other < count; other++) {
+			if (passes[other].culled)
+				row[other] = 0;
+			remaining[p] += row[other];
+		}
+	}
+
+	order.clear();
+	for (;;) {
+		int next = -1;
+		for (size_t p = 0; p < count && next < 0; p++) {
+			if (!passes[p].culled && !done[p] && remaining[p] == 0)
+				next = (int)p;
+		}
+		if (next < 0)
+			break;
+		done[next] = true;
+		order.push_back(next);
+		for (size_t p = 0; p < count; p++) {
+			if (!passes[p].culled && needs[p * count + next])
+				remaining[p]--;
+		}
+	}
+}
+
+int FrameGraph::acquireTexture(const FrameGraphTextureDesc & desc, int firstUse, int lastUse)
+{
+	// A texture of the same kind whose last user this frame runs before the
+	// first user of the new resource can be shared
+	for (size_t i = 0; i < pool.size(); i++) {
+		PooledTexture & pooled = pool[i];
+		if (!sameDesc(pooled.desc, desc))
+			continue;
+		bool free = pooled.lastUsedFrame != frame || (aliasing && pooled.lastUse < firstUse);
+		if (!free)
+			continue;
+		pooled.lastUsedFrame = frame;
+		pooled.lastUse = lastUse;
+		return (int)i;
+	}
+
+	PooledTexture pooled;
+	pooled.desc = desc;
+	pooled.lastUsedFrame = frame;
+	pooled.lastUse = lastUse;
+
+	bool depth = isDepthFormat(desc.internalFormat);
+	pooled.texture = GPU_CREATE(GPU_TEXTURE, GPU_MEMORY_RENDER_TARGET, "Frame graph target");
+	glBindTexture(GL_TEXTURE_2D, pooled.texture);
+	if (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage) {
+		glTexStorage2D(GL_TEXTURE_2D, 1, desc.internalFormat, desc.width, desc.height);
+	}
+	else {
+		GLenum format = depth ? (hasStencil(desc.internalFormat) ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT) : GL_RGBA;
+		GLenum type = hasStencil(desc.internalFormat) ? GL_UNSIGNED_INT_24_8 : GL_UNSIGNED_BYTE;
+		glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+	}
+	gpuResources.setSize(GPU_TEXTURE, pooled.texture, descBytes(desc), desc.internalFormat);
+	// Depth is not filtered, color is upscaled and blurred with bilinear taps
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	pool.push_back(pooled);
+	return (int)pool.size() - 1;
+}
+
+void FrameGraph::assignTextures()
+{
+	for (size_t r = 0; r < resources.size(); r++)
+		resources[r].firstUse = resources[r].lastUse = -1;
+	for (size_t position = 0; position < order.size(); position++) {
+		const Pass & pass = passes[order[position]];
+		for (int list = 0; list < 2; list++) {
+			const FixedVector<Access, FRAME_GRAPH_MAX_ACCESSES> & accesses = list == 0 ? pass.reads : pass.writes;
+			for (size_t a = 0; a < accesses.size(); a++) {
+				Resource & resource = resources[accesses[a].resource];
+				if (resource.firstUse < 0)
+					resource.firstUse = (int)position;
+				resource.lastUse = (int)position;
+			}
+		}
+	}
+
+	// Hand out textures in order of first use, then of declaration
+	int * transients = arena.allocateArray<int>(resources.size());
+	int transientCount = 0;
+	for (size_t r = 0; r < resources.size(); r++) {
+		if (!resources[r].imported && resources[r].firstUse >= 0)
+			transients[transientCount++] = (int)r;
+	}
+	std::sort(transients, transients + transientCount, [this](int a, int b) {
+		return resources[a].firstUse != resources[b].firstUse ? resources[a].firstUse < resources[b].firstUse : a < b;
+	});
+
+	FrameGraphStatistics previous = stats;
+	memset(&stats, 0, sizeof(stats));
+	for (int i = 0; i < transientCount; i++) {
+		Resource & resource = resources[transients[i]];
+		resource.physical = acquireTexture(resource.desc, resource.firstUse, resource.lastUse);
+		stats.transientBytes += descBytes(resource.desc);
+		stats.transientCount++;
+	}
+
+	// Release what has not been used for a while
+	for (size_t i = 0; i < pool.size(); ) {
+		if (frame - pool[i].lastUsedFrame > FRAME_GRAPH_RETIRE_FRAMES) {
+			releaseFramebuffers();
+			gpuResources.destroy(GPU_TEXTURE, pool[i].texture);
+			pool.erase(pool.begin() + i);
+			for (int r = 0; r < transientCount; r++) {
+				if (resources[transients[r]].physical > (int)i)
+					resources[transients[r]].physical--;
+			}
+		}
+		else {
+			if (pool[i].lastUsedFrame == frame) {
+				stats.aliasedBytes += descBytes(pool[i].desc);
+				stats.physicalCount++;
+			}
+			i++;
+		}
+	}
+
+	stats.passCount = (int)passes.size();
+	stats.culledPassCount = (int)(passes.size() - order.size());
+	changed = memcmp(&stats, &previous, sizeof(stats)) != 0;
+}
+
+void FrameGraph::compile()
+{
+	TRACE_SCOPE("Frame graph compile");
+	frame++;
+	cullPasses();
+	orderPasses();
+	assignTextures();
+
+	for (size_t position = 0; position < order.size(); position++) {
+		Pass & pass = passes[order[position]];
+		pass.framebuffer = framebufferFor(pass);
+		pass.clears.clear();
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			const Access & access = pass.writes[w];
+			if (access.version == 1 && !resources[access.resource].imported)
+				pass.clears.push_back(access.resource);
+		}
+	}
+}
+
+int FrameGraph::framebufferFor(Pass & pass)
+{
+	GLuint colors[FRAME_GRAPH_MAX_COLOR_TARGETS] = { 0 };
+	GLuint depth = 0;
+	GLenum depthFormat = GL_DEPTH_COMPONENT24;
+	bool backbuffer = false, any = false;
+	pass.colorTargets.clear();
+
+	for (int list = 0; list < 2; list++) {
+		const FixedVector<Access, FRAME_GRAPH_MAX_ACCESSES> & accesses = list == 0 ? pass.writes : pass.reads;
+		for (size_t a = 0; a < accesses.size(); a++) {
+			if (!accesses[a].attachment)
+				continue;
+			const Resource & resource = resources[accesses[a].resource];
+			any = true;
+			if (resource.imported)
+				backbuffer = true;
+			else if (isDepthFormat(resource.desc.internalFormat)) {
+				depth = pool[resource.physical].texture;
+				depthFormat = resource.desc.internalFormat;
+			}
+			else if (pass.colorTargets.size() < FRAME_GRAPH_MAX_COLOR_TARGETS) {
+				colors[pass.colorTargets.size()] = pool[resource.physical].texture;
+				pass.colorTargets.push_back(accesses[a].resource);
+			}
+		}
+	}
+	if (!any)
+		return -1;
+	if (backbuffer)
+		return 0;
+
+	for (size_t i = 0; i < framebuffers.size(); i++) {
+		if (framebuffers[i].depth == depth && memcmp(framebuffers[i].colors, colors, sizeof(colors)) == 0)
+			return (int)framebuffers[i].framebuffer;
+	}
+
+	CachedFramebuffer cached;
+	memcpy(cached.colors, colors, sizeof(colors));
+	cached.depth = depth;
+	cached.framebuffer = GPU_CREATE(GPU_FRAMEBUFFER, GPU_MEMORY_OTHER, pass.name);
+	glBindFramebuffer(GL_FRAMEBUFFER, cached.framebuffer);
+
+	GLenum drawBuffers[FRAME_GRAPH_MAX_COLOR_TARGETS];
+	for (size_t c = 0; c < pass.colorTargets.size(); c++) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum)c, GL_TEXTURE_2D, colors[c], 0);
+		drawBuffers[c] = GL_COLOR_ATTACHMENT0 + (GLenum)c;
+	}
+	if (pass.colorTargets.empty())
+		glDrawBuffer(GL_NONE);
+	else
+		glDrawBuffers((GLsizei)pass.colorTargets.size(), drawBuffers);
+
+	if (depth)
+		glFramebufferTexture2D(GL_FRAMEBUFFER, hasStencil(depthFormat) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		printf("Frame graph : framebuffer of pass \"%s\" is incomplete\n", pass.name);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	framebuffers.push_back(cached);
+	return (int)cached.framebuffer;
+}
+
+void FrameGraph::releaseFramebuffers()
+{
+	for (size_t i = 0; i < framebuffers.size(); i++)
+		gpuResources.destroy(GPU_FRAMEBUFFER, framebuffers[i].framebuffer);
+	framebuffers.clear();
+}
+
+void FrameGraph::execute()
+{
+	for (size_t position = 0; position < order.size(); position++) {
+		Pass & pass = passes[order[position]];
+		TRACE_SCOPE(pass.name);
+		TRACE_GPU_SCOPE(pass.name);
+		if (pass.framebuffer >= 0)
+			glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)pass.framebuffer);
+
+		// Transient content is undefined, another resource may have used the
+		// texture earlier in the frame
+		for (size_t c = 0; c < pass.clears.size(); c++) {
+			const Resource & resource = resources[pass.clears[c]];
+			if (isDepthFormat(resource.desc.internalFormat)) {
+				GLfloat one = 1.0f;
+				glDepthMask(GL_TRUE);
+				glClearBufferfv(GL_DEPTH, 0, &one);
+			}
+			else {
+				GLint drawBuffer = (GLint)(std::find(pass.colorTargets.begin(), pass.colorTargets.end(), pass.clears[c]) - pass.colorTargets.begin());
+				glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+				glClearBufferfv(GL_COLOR, drawBuffer, clearColor);
+			}
+		}
+
+		pass.function(pass.closure);
+	}
+}
+
+GLuint FrameGraph::texture(FrameGraphResource resource) const
+{
+	int physical = resources[resource].physical;
+	return physical >= 0 ? pool[physical].texture : 0;
+}
+
+void FrameGraph::printStatistics() const
+{
+	printf("Frame graph : %d passes (%d culled), %d transient textures in %d GL textures, %.2f MB without aliasing, %.2f MB with%s\n",
+		stats.passCount, stats.culledPassCount, stats.transientCount, stats.physicalCount,
+		stats.transientBytes / (1024.0 * 1024.0), stats.aliasedBytes / (1024.0 * 1024.0),
+		aliasing ? "" : " (aliasing disabled)");
+	for (size_t position = 0; position < order.size(); position++)
+		printf("  %d. %s\n", (int)position + 1, passes[order[position]].name);
+}
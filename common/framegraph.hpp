@@ -0,0 +1,169 @@
+#ifndef FRAMEGRAPH_HPP
+#define FRAMEGRAPH_HPP
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "arena.hpp"
+
+// Pooled textures unused for this many compiles are released
+#define FRAME_GRAPH_RETIRE_FRAMES 8
+
+// Most color targets one pass can write
+#define FRAME_GRAPH_MAX_COLOR_TARGETS 4
+
+// Most resources one pass can read and write each, and times one resource
+// can be written in a frame
+#define FRAME_GRAPH_MAX_ACCESSES 16
+#define FRAME_GRAPH_MAX_VERSIONS 32
+
+typedef int FrameGraphResource; // Handle returned by the graph, -1 is none
+
+struct FrameGraphTextureDesc {
+	GLsizei width;
+	GLsizei height;
+	GLenum internalFormat; // GL_RGBA8, GL_DEPTH_COMPONENT24, ...
+};
+
+struct FrameGraphStatistics {
+	int passCount;          // Declared passes
+	int culledPassCount;    // Passes whose results nothing used
+	int transientCount;     // Transient textures used by the remaining passes
+	int physicalCount;      // GL textures backing them
+	long long transientBytes; // Memory needed if every transient had its own texture
+	long long aliasedBytes;   // Memory actually used, transients sharing textures
+};
+
+// Describes one frame as passes that read and write textures. Every frame
+// the passes are declared again, then compile() drops the passes whose
+// results are never used, orders the rest by their dependencies and maps the
+// transient textures onto a pool of GL textures, letting textures whose
+// lifetimes do not overlap share one. execute() binds each pass's targets and
+// runs it.
+//
+// Each write creates a new version of a resource : a pass reading a resource
+// sees what the passes declared before it wrote.
+//
+// Declaring and compiling a frame does not allocate once the graph has seen
+// it before : the pass callbacks and the temporaries of compile() live in an
+// arena reset with the frame, the pass and resource lists keep their
+// capacity and hold fixed-size arrays.
+class FrameGraph {
+public:
+	FrameGraph();
+
+	void destroy();
+
+	// Starts declaring a new frame
+	void reset();
+
+	// A texture that only lives during the frame. Its content is cleared by
+	// the first pass that writes it.
+	FrameGraphResource createTexture(const char * name, const FrameGraphTextureDesc & desc);
+	// The default framebuffer. Writing it is a result of the frame.
+	FrameGraphResource importBackbuffer(const char * name);
+
+	// execute() is copied into the frame's arena, its captures must be
+	// trivially destructible
+	template <typename Lambda>
+	int addPass(const char * name, const Lambda & execute)
+	{
+		return addPassFunction(name, &invokePass<Lambda>, arena.copy(execute));
+	}
+	// Sampled by the pass
+	void read(int pass, FrameGraphResource resource);
+	// Bound as a target but not written, like a depth buffer tested with the
+	// depth mask off
+	void readAttachment(int pass, FrameGraphResource resource);
+	// Rendered to by the pass
+	void write(int pass, FrameGraphResource resource);
+	// The pass is a result of the frame even though nothing reads what it
+	// writes, like a pass that reads its target back to the CPU
+	void keep(int pass) { passes[pass].kept = true; }
+
+	// Transient textures get their own GL texture when aliasing is off
+	void setAliasing(bool enabled) { aliasing = enabled; }
+	bool aliasingEnabled() const { return aliasing; }
+	void setClearColor(float r, float g, float b, float a);
+
+	void compile();
+	void execute();
+
+	// GL texture behind a resource, valid after compile()
+	GLuint texture(FrameGraphResource resource) const;
+
+	const FrameGraphStatistics & statistics() const { return stats; }
+	// True when the last compile() produced different passes or memory use
+	// than the one before
+	bool layoutChanged() const { return changed; }
+	void printStatistics() const;
+
+private:
+	typedef void (*PassFunction)(const void * closure);
+	template <typename Lambda>
+	static void invokePass(const void * closure) { (*(const Lambda*)closure)(); }
+
+	struct Resource {
+		const char * name;
+		FrameGraphTextureDesc desc;
+		bool imported;
+		FixedVector<int, FRAME_GRAPH_MAX_VERSIONS> writers; // Pass that wrote each version, version n at n - 1
+		int firstUse, lastUse; // Positions in the pass order, -1 when unused
+		int physical;         // Index into the pool
+	};
+	struct Access {
+		FrameGraphResource resource;
+		int version;
+		bool attachment;
+	};
+	struct Pass {
+		const char * name;
+		PassFunction function;
+		const void * closure; // In the arena
+		FixedVector<Access, FRAME_GRAPH_MAX_ACCESSES> reads, writes;
+		bool culled;
+		bool kept;            // Never culled
+		int framebuffer;      // -1 when the pass renders to no target
+		FixedVector<FrameGraphResource, FRAME_GRAPH_MAX_COLOR_TARGETS> colorTargets; // In attachment order
+		FixedVector<FrameGraphResource, FRAME_GRAPH_MAX_ACCESSES> clears; // Transients first written here
+	};
+	struct PooledTexture {
+		FrameGraphTextureDesc desc;
+		GLuint texture;
+		int lastUsedFrame;
+		int lastUse; // Pass position of its last user this frame, -1 when free
+	};
+	struct CachedFramebuffer {
+		GLuint colors[FRAME_GRAPH_MAX_COLOR_TARGETS];
+		GLuint depth;
+		GLuint framebuffer;
+	};
+
+	int addPassFunction(const char * name, PassFunction function, const void * closure);
+	int writerOf(FrameGraphResource resource, int version) const;
+	void dependencies(int pass, unsigned char * out_needed) const;
+	void cullPasses();
+	void orderPasses();
+	void assignTextures();
+	int acquireTexture(const FrameGraphTextureDesc & desc, int firstUse, int lastUse);
+	int framebufferFor(Pass & pass);
+	void releaseFramebuffers();
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<int> order; // Passes to run, in order
+	std::vector<PooledTexture> pool;
+	std::vector<CachedFramebuffer> framebuffers;
+	FrameArena arena; // Reset with each frame
+	bool aliasing;
+	float clearColor[4];
+	int frame;
+	FrameGraphStatistics stats;
+	bool changed;
+};
+
+// Bytes per pixel of the internal formats the graph creates
+int frameGraphBytesPerPixel(GLenum internalFormat);
+
+#endif
@@ -0,0 +1,80 @@
+#include <stdio.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+// Include GLEW
+#include <GL/glew.h>
+
+#ifndef _WIN32
+#include <X11/Xlib.h>
+#include <GL/glx.h>
+#endif
+
+#include "glcontext.hpp"
+
+GLContext::GLContext() : display(NULL), context(NULL), drawable(0)
+{
+}
+
+void GLContext::initThreads()
+{
+#ifndef _WIN32
+	// Xlib is only safe from several threads once this ran first
+	XInitThreads();
+#endif
+}
+
+bool GLContext::detach()
+{
+#ifdef _WIN32
+	display = wglGetCurrentDC();
+	context = wglGetCurrentContext();
+	if (!display || !context)
+		return false;
+	wglMakeCurrent(NULL, NULL);
+#else
+	display = glXGetCurrentDisplay();
+	context = glXGetCurrentContext();
+	drawable = glXGetCurrentDrawable();
+	if (!display || !context)
+		return false;
+	glXMakeCurrent((Display*)display, None, NULL);
+#endif
+	return true;
+}
+
+bool GLContext::makeCurrent()
+{
+	bool current;
+#ifdef _WIN32
+	current = wglMakeCurrent((HDC)display, (HGLRC)context) != FALSE;
+#else
+	current = glXMakeCurrent((Display*)display, (GLXDrawable)drawable, (GLXContext)context) != False;
+#endif
+	if (!current)
+		printf("GL context : could not be made current\n");
+	return current;
+}
+
+void GLContext::release()
+{
+#ifdef _WIN32
+	wglMakeCurrent(NULL, NULL);
+#else
+	glXMakeCurrent((Display*)display, None, NULL);
+#endif
+}
+
+void GLContext::swapBuffers()
+{
+#ifdef _WIN32
+	SwapBuffers((HDC)display);
+#else
+	glXSwapBuffers((Display*)display, (GLXDrawable)drawable);
+#endif
+}
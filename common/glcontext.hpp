@@ -0,0 +1,30 @@
+#ifndef GLCONTEXT_HPP
+#define GLCONTEXT_HPP
+
+// Hands the window's GL context over to another thread. GLUT creates the
+// context current on its own thread; detach() records it there and releases
+// it, then the render thread makes it current and swaps the window itself.
+// A context is current on one thread at a time.
+//
+// WGL on Windows, GLX elsewhere.
+class GLContext {
+public:
+	GLContext();
+
+	// Lets the window system be called from several threads. Call before
+	// glutInit.
+	static void initThreads();
+
+	// Takes the context current on the calling thread and releases it
+	bool detach();
+	bool makeCurrent();
+	void release();
+	void swapBuffers();
+
+private:
+	void * display;  // HDC, or the X Display
+	void * context;  // HGLRC, or GLXContext
+	unsigned long drawable; // The X window, unused with WGL
+};
+
+#endif
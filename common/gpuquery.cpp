@@ -0,0 +1,69 @@
+// Include GLEW
+#include <GL/glew.h>
+
+#include "gpuresources.hpp"
+#include "gpuquery.hpp"
+
+GpuQuery::GpuQuery() : target(GL_TIME_ELAPSED), current(0), lastResult(-1)
+{
+	for (int i = 0; i < GPU_QUERY_LATENCY; i++) {
+		queries[i] = 0;
+		endQueries[i] = 0;
+		pending[i] = false;
+	}
+}
+
+void GpuQuery::create(GLenum queryTarget)
+{
+	target = queryTarget;
+	for (int i = 0; i < GPU_QUERY_LATENCY; i++) {
+		queries[i] = GPU_CREATE(GPU_QUERY, GPU_MEMORY_OTHER, "GPU query");
+		if (target == GL_TIMESTAMP)
+			endQueries[i] = GPU_CREATE(GPU_QUERY, GPU_MEMORY_OTHER, "GPU query");
+	}
+}
+
+void GpuQuery::destroy()
+{
+	for (int i = 0; i < GPU_QUERY_LATENCY; i++) {
+		gpuResources.destroy(GPU_QUERY, queries[i]);
+		gpuResources.destroy(GPU_QUERY, endQueries[i]);
+		pending[i] = false;
+	}
+}
+
+void GpuQuery::begin()
+{
+	// The slot we are about to reuse was issued GPU_QUERY_LATENCY frames ago,
+	// so its result is normally ready. If it is not, skip it rather than wait.
+	if (pending[current]) {
+		GLuint last = target == GL_TIMESTAMP ? endQueries[current] : queries[current];
+		GLint available = 0;
+		glGetQueryObjectiv(last, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 value = 0;
+			glGetQueryObjectui64v(last, GL_QUERY_RESULT, &value);
+			if (target == GL_TIMESTAMP) {
+				GLuint64 start = 0;
+				glGetQueryObjectui64v(queries[current], GL_QUERY_RESULT, &start);
+				value -= start;
+			}
+			lastResult = (GLint64)value;
+		}
+		pending[current] = false;
+	}
+	if (target == GL_TIMESTAMP)
+		glQueryCounter(queries[current], GL_TIMESTAMP);
+	else
+		glBeginQuery(target, queries[current]);
+}
+
+void GpuQuery::end()
+{
+	if (target == GL_TIMESTAMP)
+		glQueryCounter(endQueries[current], GL_TIMESTAMP);
+	else
+		glEndQuery(target);
+	pending[current] = true;
+	current = (current + 1) % GPU_QUERY_LATENCY;
+}
@@ -0,0 +1,40 @@
+#ifndef GPUQUERY_HPP
+#define GPUQUERY_HPP
+
+// Number of frames a query is kept in flight before its result is read.
+// Reading a query any sooner would make the CPU wait for the GPU to catch up.
+#define GPU_QUERY_LATENCY 3
+
+// Wraps a ring of GL query objects of one target (GL_TIME_ELAPSED,
+// GL_SAMPLES_PASSED, ...) measured between begin() and end(). Results are read
+// GPU_QUERY_LATENCY frames late so the pipeline never stalls.
+//
+// GL_TIMESTAMP measures the time between begin() and end() with a timestamp
+// at each. Unlike GL_TIME_ELAPSED it can run inside another timer query.
+class GpuQuery {
+public:
+	GpuQuery();
+
+	void create(GLenum target);
+	void destroy();
+
+	void begin();
+	void end();
+
+	// Most recent finished result, or a negative value when no query has
+	// completed yet.
+	GLint64 result() const { return lastResult; }
+
+	// Result of a GL_TIME_ELAPSED query in milliseconds
+	double milliseconds() const { return lastResult < 0 ? -1.0 : lastResult / 1000000.0; }
+
+private:
+	GLenum target;
+	GLuint queries[GPU_QUERY_LATENCY];
+	GLuint endQueries[GPU_QUERY_LATENCY]; // Second timestamps of GL_TIMESTAMP
+	bool pending[GPU_QUERY_LATENCY];
+	int current;
+	GLint64 lastResult;
+};
+
+#endif
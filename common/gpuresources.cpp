@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "gpuresources.hpp"
+
+GpuResourceRegistry gpuResources;
+
+static const char * typeNames[GPU_OBJECT_TYPE_COUNT] = {
+	"buffer", "texture", "vertex array", "framebuffer", "query", "program"
+};
+
+static const char * categoryNames[GPU_MEMORY_CATEGORY_COUNT] = {
+	"geometry", "streaming", "texture", "target", "other"
+};
+
+const char * gpuMemoryCategoryName(GpuMemoryCategory category)
+{
+	return categoryNames[category];
+}
+
+int gpuMemoryCategoryFromName(const char * name)
+{
+	for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++) {
+		if (strcmp(name, categoryNames[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+// Bytes in MB for printing
+static double megabytes(long long bytes)
+{
+	return bytes / (1024.0 * 1024.0);
+}
+
+GpuResourceRegistry::GpuResourceRegistry() : total(0), totalPeak(0)
+{
+	for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++) {
+		categoryBytes[i] = 0;
+		categoryHighWater[i] = 0;
+		budgets[i] = 0;
+		overBudget[i] = false;
+	}
+	for (int i = 0; i < GPU_OBJECT_TYPE_COUNT; i++)
+		objectCounts[i] = 0;
+}
+
+GLuint GpuResourceRegistry::create(GpuObjectType type, GpuMemoryCategory category, const char * label, const char * file, int line)
+{
+	GLuint id = 0;
+	switch (type) {
+	case GPU_BUFFER:       glGenBuffers(1, &id); break;
+	case GPU_TEXTURE:      glGenTextures(1, &id); break;
+	case GPU_VERTEX_ARRAY: glGenVertexArrays(1, &id); break;
+	case GPU_FRAMEBUFFER:  glGenFramebuffers(1, &id); break;
+	case GPU_QUERY:        glGenQueries(1, &id); break;
+	case GPU_PROGRAM:      id = glCreateProgram(); break;
+	default: break;
+	}
+	if (id == 0)
+		return 0;
+
+	Record record;
+	record.type = type;
+	record.category = category;
+	record.label = label;
+	record.file = file;
+	record.line = line;
+	record.bytes = 0;
+	record.format = GL_NONE;
+	records[key(type, id)] = record;
+	objectCounts[type]++;
+	return id;
+}
+
+void GpuResourceRegistry::setSize(GpuObjectType type, GLuint id, long long bytes, GLenum format)
+{
+	std::unordered_map<unsigned long long, Record>::iterator found = records.find(key(type, id));
+	if (found == records.end()) {
+		printf("GPU resources : size given to unregistered %s %u\n", typeNames[type], id);
+		return;
+	}
+	Record & record = found->second;
+	long long change = bytes - record.bytes;
+	record.bytes = bytes;
+	record.format = format;
+	account(record, change);
+}
+
+void GpuResourceRegistry::destroy(GpuObjectType type, GLuint & id)
+{
+	if (id == 0)
+		return;
+
+	switch (type) {
+	case GPU_BUFFER:       glDeleteBuffers(1, &id); break;
+	case GPU_TEXTURE:      glDeleteTextures(1, &id); break;
+	case GPU_VERTEX_ARRAY: glDeleteVertexArrays(1, &id); break;
+	case GPU_FRAMEBUFFER:  glDeleteFramebuffers(1, &id); break;
+	case GPU_QUERY:        glDeleteQueries(1, &id); break;
+	case GPU_PROGRAM:      glDeleteProgram(id); break;
+	default: break;
+	}
+
+	std::unordered_map<unsigned long long, Record>::iterator found = records.find(key(type, id));
+	if (found != records.end()) {
+		account(found->second, -found->second.bytes);
+		objectCounts[type]--;
+		records.erase(found);
+	}
+	else {
+		printf("GPU resources : deleted unregistered %s %u\n", typeNames[type], id);
+	}
+	id = 0;
+}
+
+void GpuResourceRegistry::account(const Record & record, long long change)
+{
+	int category = record.category;
+	categoryBytes[category] += change;
+	total += change;
+	categoryHighWater[category] = std::max(categoryHighWater[category], categoryBytes[category]);
+	totalPeak = std::max(totalPeak, total);
+
+	// Warn once each time the budget is crossed
+	if (budgets[category] > 0) {
+		if (categoryBytes[category] > budgets[category] && !overBudget[category]) {
+			printf("GPU resources : %s over budget, %.2f of %.2f MB after %s \"%s\" (%s:%d)\n",
+				categoryNames[category], megabytes(categoryBytes[category]), megabytes(budgets[category]),
+				typeNames[record.type], record.label.c_str(), record.file, record.line);
+			overBudget[category] = true;
+		}
+		else if (categoryBytes[category] <= budgets[category]) {
+			overBudget[category] = false;
+		}
+	}
+}
+
+void GpuResourceRegistry::setBudget(GpuMemoryCategory category, long long bytes)
+{
+	budgets[category] = bytes;
+	overBudget[category] = false;
+}
+
+void GpuResourceRegistry::print() const
+{
+	printf("GPU resources : %.2f MB, high water %.2f MB\n", megabytes(total), megabytes(totalPeak));
+	for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++) {
+		printf("  %-10s %8.2f MB  high water %8.2f MB", categoryNames[i], megabytes(categoryBytes[i]), megabytes(categoryHighWater[i]));
+		if (budgets[i] > 0)
+			printf("  budget %8.2f MB%s", megabytes(budgets[i]), categoryBytes[i] > budgets[i] ? " EXCEEDED" : "");
+		printf("\n");
+	}
+	printf(" ");
+	for (int i = 0; i < GPU_OBJECT_TYPE_COUNT; i++)
+		printf(" %d %s%s", objectCounts[i], typeNames[i], i + 1 < GPU_OBJECT_TYPE_COUNT ? "," : "\n");
+}
+
+int GpuResourceRegistry::reportLeaks() const
+{
+	if (records.empty()) {
+		printf("GPU resources : no leaks\n");
+		return 0;
+	}
+
+	// Biggest first, then by creation site so the dump is stable
+	std::vector<const Record*> leaked;
+	for (std::unordered_map<unsigned long long, Record>::const_iterator i = records.begin(); i != records.end(); ++i)
+		leaked.push_back(&i->second);
+	std::sort(leaked.begin(), leaked.end(), [](const Record * a, const Record * b) {
+		if (a->bytes != b->bytes)
+			return a->bytes > b->bytes;
+		int file = strcmp(a->file, b->file);
+		return file != 0 ? file < 0 : a->line < b->line;
+	});
+
+	printf("GPU resources : %d objects leaked, %.2f MB\n", (int)leaked.size(), megabytes(total));
+	for (size_t i = 0; i < leaked.size(); i++) {
+		const Record & record = *leaked[i];
+		printf("  %-12s %-9s %10lld bytes", typeNames[record.type], categoryNames[record.category], record.bytes);
+		if (record.format != GL_NONE)
+			printf(" format 0x%04X", record.format);
+		printf("  \"%s\" %s:%d\n", record.label.c_str(), record.file, record.line);
+	}
+	return (int)leaked.size();
+}
@@ -0,0 +1,92 @@
+#ifndef GPURESOURCES_HPP
+#define GPURESOURCES_HPP
+
+#include <string>
+#include <unordered_map>
+
+enum GpuObjectType {
+	GPU_BUFFER,
+	GPU_TEXTURE,
+	GPU_VERTEX_ARRAY,
+	GPU_FRAMEBUFFER,
+	GPU_QUERY,
+	GPU_PROGRAM,
+	GPU_OBJECT_TYPE_COUNT
+};
+
+// What the memory is used for. Budgets are set per category.
+enum GpuMemoryCategory {
+	GPU_MEMORY_GEOMETRY,      // Static vertex and index buffers
+	GPU_MEMORY_STREAMING,     // Buffers rewritten every frame
+	GPU_MEMORY_TEXTURE,       // Loaded images
+	GPU_MEMORY_RENDER_TARGET, // Textures rendered to
+	GPU_MEMORY_OTHER,         // Objects without storage of their own
+	GPU_MEMORY_CATEGORY_COUNT
+};
+
+// Records every GL object the application creates : what it is, what it is
+// for, how much memory it holds and where it was created. Objects are
+// created and deleted through the registry so the totals follow the GL
+// state exactly; whatever is still registered at shutdown was leaked.
+//
+// Sizes are what the application asked for. Drivers pad and may keep extra
+// copies, so the real use is somewhat higher.
+class GpuResourceRegistry {
+public:
+	GpuResourceRegistry();
+
+	// Generates one object. label is copied.
+	GLuint create(GpuObjectType type, GpuMemoryCategory category, const char * label, const char * file, int line);
+	// Records the storage given to an object, replacing what it had
+	void setSize(GpuObjectType type, GLuint id, long long bytes, GLenum format);
+	// Deletes the object and sets id to 0. Deleting 0 does nothing.
+	void destroy(GpuObjectType type, GLuint & id);
+
+	long long bytes(GpuMemoryCategory category) const { return categoryBytes[category]; }
+	long long highWater(GpuMemoryCategory category) const { return categoryHighWater[category]; }
+	long long totalBytes() const { return total; }
+	long long totalHighWater() const { return totalPeak; }
+	int objectCount(GpuObjectType type) const { return objectCounts[type]; }
+
+	// A warning is printed whenever the category grows past bytes. 0 turns
+	// the budget off.
+	void setBudget(GpuMemoryCategory category, long long bytes);
+
+	void print() const;
+	// Prints every object still alive, returns how many there were
+	int reportLeaks() const;
+
+private:
+	struct Record {
+		GpuObjectType type;
+		GpuMemoryCategory category;
+		std::string label;
+		const char * file;
+		int line;
+		long long bytes;
+		GLenum format;
+	};
+
+	static unsigned long long key(GpuObjectType type, GLuint id) { return ((unsigned long long)type << 32) | id; }
+	void account(const Record & record, long long change);
+
+	std::unordered_map<unsigned long long, Record> records;
+	long long categoryBytes[GPU_MEMORY_CATEGORY_COUNT];
+	long long categoryHighWater[GPU_MEMORY_CATEGORY_COUNT];
+	long long budgets[GPU_MEMORY_CATEGORY_COUNT];
+	bool overBudget[GPU_MEMORY_CATEGORY_COUNT];
+	long long total, totalPeak;
+	int objectCounts[GPU_OBJECT_TYPE_COUNT];
+};
+
+// Every module registers its objects here
+extern GpuResourceRegistry gpuResources;
+
+// Creates an object recorded with the calling file and line
+#define GPU_CREATE(type, category, label) gpuResources.create(type, category, label, __FILE__, __LINE__)
+
+const char * gpuMemoryCategoryName(GpuMemoryCategory category);
+// Category from its name, as used on the command line. -1 when unknown.
+int gpuMemoryCategoryFromName(const char * name);
+
+#endif
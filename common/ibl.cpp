@@ -0,0 +1,584 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "gpuresources.hpp"
+#include "jobsystem.hpp"
+#include "trace.hpp"
+#include "ibl.hpp"
+
+// Bumped whenever the precomputation changes, so older caches are not used
+#define IBL_CACHE_VERSION 1
+#define IBL_PI 3.14159265358979f
+
+// One level of the equirectangular environment : rows from +Z down to -Z,
+// columns from -X around through +Y. Linear RGB.
+struct EquirectLevel {
+	int width, height;
+	std::vector<glm::vec3> texels;
+};
+
+// What starts a cache file. The data follows : the coefficients, the cube
+// levels, then the BRDF table, all as floats.
+struct IblCacheHeader {
+	char magic[4];
+	int version;
+	unsigned long long key;
+	int cubeSize, mipCount, brdfSize;
+};
+
+static int cubeFloats()
+{
+	int floats = 0;
+	for (int mip = 0; mip < IBL_MIP_COUNT; mip++)
+		floats += 6 * (IBL_CUBE_SIZE >> mip) * (IBL_CUBE_SIZE >> mip) * 3;
+	return floats;
+}
+
+// FNV-1a, 64 bits
+static unsigned long long hashBytes(const void * data, size_t size, unsigned long long hash)
+{
+	const unsigned char * bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool readFile(const char * path, std::vector<unsigned char> & bytes)
+{
+	FILE * file = fopen(path, "rb");
+	if (!file)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bytes.resize(size > 0 ? size : 0);
+	bool read = size > 0 && fread(&bytes[0], 1, size, file) == (size_t)size;
+	fclose(file);
+	return read;
+}
+
+// 24 bit, bottom-up rows padded to 4 bytes. The colors are sRGB.
+static bool decodeBmp(const std::vector<unsigned char> & file, EquirectLevel & image)
+{
+	if (file.size() < 54 || file[0] != 'B' || file[1] != 'M')
+		return false;
+	int dataPos, width, height, bits, compression;
+	memcpy(&dataPos, &file[0x0A], 4);
+	memcpy(&width, &file[0x12], 4);
+	memcpy(&height, &file[0x16], 4);
+	bits = file[0x1C] | (file[0x1D] << 8);
+	memcpy(&compression, &file[0x1E], 4);
+	if (bits != 24 || compression != 0 || width <= 0 || height <= 0)
+		return false;
+	if (dataPos == 0)
+		dataPos = 54;
+	size_t stride = ((size_t)width * 3 + 3) & ~(size_t)3;
+	if ((size_t)dataPos + stride * height > file.size())
+		return false;
+
+	float toLinear[256];
+	for (int i = 0; i < 256; i++)
+		toLinear[i] = powf(i / 255.0f, 2.2f);
+
+	image.width = width;
+	image.height = height;
+	image.texels.resize((size_t)width * height);
+	for (int y = 0; y < height; y++) {
+		const unsigned char * row = &file[dataPos + stride * (height - 1 - y)];
+		for (int x = 0; x < width; x++)
+			image.texels[(size_t)y * width + x] = glm::vec3(toLinear[row[x * 3 + 2]], toLinear[row[x * 3 + 1]], toLinear[row[x * 3]]);
+	}
+	return true;
+}
+
+// Radiance RGBE, flat or with run-length encoded scanlines, -Y H +X W only
+static bool decodeHdr(const std::vector<unsigned char> & file, EquirectLevel & image)
+{
+	if (file.size() < 2 || file[0] != '#' || file[1] != '?')
+		return false;
+
+	// Header lines up to an empty one, then the resolution line
+	size_t pos = 0;
+	bool emptyLine = false;
+	while (pos < file.size() && !emptyLine) {
+		size_t end = pos;
+		while (end < file.size() && file[end] != '\n')
+			end++;
+		emptyLine = end == pos;
+		pos = end + 1;
+	}
+	char resolution[64] = "";
+	size_t length = 0;
+	while (pos < file.size() && file[pos] != '\n' && length < sizeof(resolution) - 1)
+		resolution[length++] = (char)file[pos++];
+	pos++;
+	int width, height;
+	if (sscanf(resolution, "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0)
+		return false;
+
+	image.width = width;
+	image.height = height;
+	image.texels.resize((size_t)width * height);
+	std::vector<unsigned char> scanline((size_t)width * 4);
+	for (int y = 0; y < height; y++) {
+		if (pos + 4 > file.size())
+			return false;
+		bool rle = width >= 8 && width < 0x8000 && file[pos] == 2 && file[pos + 1] == 2
+			&& ((file[pos + 2] << 8) | file[pos + 3]) == width;
+		if (rle) {
+			// Each channel separately, as runs and literal spans
+			pos += 4;
+			for (int channel = 0; channel < 4; channel++) {
+				int x = 0;
+				while (x < width) {
+					if (pos >= file.size())
+						return false;
+					int count = file[pos++];
+					if (count > 128) {
+						count -= 128;
+						if (x + count > width || pos >= file.size())
+							return false;
+						unsigned char value = file[pos++];
+						for (int i = 0; i < count; i++)
+							scanline[(x++) * 4 + channel] = value;
+					}
+					else {
+						if (count == 0 || x + count > width || pos + count > file.size())
+							return false;
+						for (int i = 0; i < count; i++)
+							scanline[(x++) * 4 + channel] = file[pos++];
+					}
+				}
+			}
+		}
+		else {
+			if (pos + scanline.size() > file.size())
+				return false;
+			memcpy(&scanline[0], &file[pos], scanline.size());
+			pos += scanline.size();
+		}
+
+		for (int x = 0; x < width; x++) {
+			const unsigned char * rgbe = &scanline[x * 4];
+			float scale = rgbe[3] ? ldexpf(1.0f, rgbe[3] - (128 + 8)) : 0.0f;
+			image.texels[(size_t)y * width + x] = glm::vec3(rgbe[0] * scale, rgbe[1] * scale, rgbe[2] * scale);
+		}
+	}
+	return true;
+}
+
+// Direction of the center of a texel of the equirectangular image
+static glm::vec3 equirectDirection(const EquirectLevel & image, int x, int y)
+{
+	float phi = ((x + 0.5f) / image.width - 0.5f) * 2.0f * IBL_PI;
+	float theta = (y + 0.5f) / image.height * IBL_PI;
+	return glm::vec3(sinf(theta) * cosf(phi), sinf(theta) * sinf(phi), cosf(theta));
+}
+
+// Blue sky over a brown ground, with a sun in the direction of the scene's
+// light. Bright enough in the sun to light the scene on its own.
+static void proceduralSky(EquirectLevel & image)
+{
+	image.width = 512;
+	image.height = 256;
+	image.texels.resize((size_t)image.width * image.height);
+	const glm::vec3 sun = glm::normalize(glm::vec3(4.0f, 4.0f, 4.0f));
+	const glm::vec3 zenith(0.15f, 0.3f, 0.8f), horizon(0.7f, 0.8f, 0.9f), ground(0.2f, 0.15f, 0.1f);
+	const float sunCos = cosf(2.0f * IBL_PI / 180.0f);
+	for (int y = 0; y < image.height; y++) {
+		for (int x = 0; x < image.width; x++) {
+			glm::vec3 direction = equirectDirection(image, x, y);
+			glm::vec3 color = direction.z > 0.0f
+				? glm::mix(horizon, zenith, powf(direction.z, 0.5f))
+				: glm::mix(horizon * 0.5f, ground, glm::min(-direction.z * 8.0f, 1.0f));
+			if (glm::dot(direction, sun) > sunCos)
+				color += glm::vec3(400.0f, 380.0f, 340.0f);
+			image.texels[(size_t)y * image.width + x] = color;
+		}
+	}
+}
+
+// Halves the image until it is a few texels across, averaging 2x2 blocks
+static void buildPyramid(std::vector<EquirectLevel> & levels)
+{
+	while (levels.back().width > 8 && levels.back().height > 4) {
+		const EquirectLevel & source = levels.back();
+		EquirectLevel level;
+		level.width = source.width / 2;
+		level.height = source.height / 2;
+		level.texels.resize((size_t)level.width * level.height);
+		for (int y = 0; y < level.height; y++) {
+			for (int x = 0; x < level.width; x++) {
+				const glm::vec3 * top = &source.texels[(size_t)(y * 2) * source.width + x * 2];
+				const glm::vec3 * bottom = top + source.width;
+				level.texels[(size_t)y * level.width + x] = (top[0] + top[1] + bottom[0] + bottom[1]) * 0.25f;
+			}
+		}
+		levels.push_back(level);
+	}
+}
+
+// Bilinear, wrapping around horizontally
+static glm::vec3 sampleLevel(const EquirectLevel & level, const glm::vec3 & direction)
+{
+	float u = atan2f(direction.y, direction.x) * (0.5f / IBL_PI) + 0.5f;
+	float v = acosf(glm::clamp(direction.z, -1.0f, 1.0f)) / IBL_PI;
+	float x = u * level.width - 0.5f, y = v * level.height - 0.5f;
+	int x0 = (int)floorf(x), y0 = (int)floorf(y);
+	float fx = x - x0, fy = y - y0;
+	int x1 = ((x0 + 1) % level.width + level.width) % level.width;
+	x0 = (x0 % level.width + level.width) % level.width;
+	int y1 = glm::clamp(y0 + 1, 0, level.height - 1);
+	y0 = glm::clamp(y0, 0, level.height - 1);
+	const glm::vec3 * row0 = &level.texels[(size_t)y0 * level.width];
+	const glm::vec3 * row1 = &level.texels[(size_t)y1 * level.width];
+	return glm::mix(glm::mix(row0[x0], row0[x1], fx), glm::mix(row1[x0], row1[x1], fx), fy);
+}
+
+static glm::vec3 samplePyramid(const std::vector<EquirectLevel> & levels, const glm::vec3 & direction, float lod)
+{
+	lod = glm::clamp(lod, 0.0f, (float)(levels.size() - 1));
+	int level = (int)lod;
+	if (level + 1 >= (int)levels.size())
+		return sampleLevel(levels[level], direction);
+	return glm::mix(sampleLevel(levels[level], direction), sampleLevel(levels[level + 1], direction), lod - level);
+}
+
+// Direction through a texel of a cube face, in the GL face order and layout
+static glm::vec3 cubeDirection(int face, int x, int y, int size)
+{
+	float s = 2.0f * (x + 0.5f) / size - 1.0f;
+	float t = 2.0f * (y + 0.5f) / size - 1.0f;
+	glm::vec3 direction;
+	switch (face) {
+	case 0: direction = glm::vec3(1.0f, -t, -s); break;
+	case 1: direction = glm::vec3(-1.0f, -t, s); break;
+	case 2: direction = glm::vec3(s, 1.0f, t); break;
+	case 3: direction = glm::vec3(s, -1.0f, -t); break;
+	case 4: direction = glm::vec3(s, -t, 1.0f); break;
+	default: direction = glm::vec3(-s, -t, -1.0f); break;
+	}
+	return glm::normalize(direction);
+}
+
+// Second coordinate of the Hammersley point set
+static float radicalInverse(unsigned int bits)
+{
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+	bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+	bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+	bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+	return bits * 2.3283064365386963e-10f;
+}
+
+// Half vector around n drawn with the GGX distribution of the given alpha
+static glm::vec3 sampleGgx(unsigned int i, unsigned int count, float alpha, const glm::vec3 & n)
+{
+	float phi = 2.0f * IBL_PI * (i + 0.5f) / count;
+	float u = radicalInverse(i);
+	float cosTheta = sqrtf((1.0f - u) / (1.0f + (alpha * alpha - 1.0f) * u));
+	float sinTheta = sqrtf(glm::max(1.0f - cosTheta * cosTheta, 0.0f));
+	glm::vec3 up = fabsf(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+	glm::vec3 tangentX = glm::normalize(glm::cross(up, n));
+	glm::vec3 tangentY = glm::cross(n, tangentX);
+	return tangentX * (sinTheta * cosf(phi)) + tangentY * (sinTheta * sinf(phi)) + n * cosTheta;
+}
+
+// Every level of the specular cube. The view is taken along the normal, as
+// the split sum does; each sample reads the environment level whose texels
+// cover about the solid angle the sample stands for, so few samples are
+// enough without bright texels turning into speckles.
+static void prefilterSpecular(const std::vector<EquirectLevel> & levels, JobSystem & jobs, std::vector<float> & cube)
+{
+	TRACE_SCOPE("Prefilter specular");
+	const float texelSolidAngle = 4.0f * IBL_PI / ((float)levels[0].width * levels[0].height);
+	size_t offset = 0;
+	for (int mip = 0; mip < IBL_MIP_COUNT; mip++) {
+		int size = IBL_CUBE_SIZE >> mip;
+		float roughness = (float)mip / (IBL_MIP_COUNT - 1);
+		float alpha = roughness * roughness;
+		float * out = &cube[offset];
+
+		jobs.parallelFor(6 * (size_t)size, 4, [&](size_t begin, size_t end) {
+			for (size_t row = begin; row < end; row++) {
+				int face = (int)row / size, y = (int)row % size;
+				for (int x = 0; x < size; x++) {
+					glm::vec3 n = cubeDirection(face, x, y, size);
+					glm::vec3 color;
+					if (mip == 0)
+						color = sampleLevel(levels[0], n);
+					else {
+						glm::vec3 sum(0.0f);
+						float weight = 0.0f;
+						for (unsigned int i = 0; i < IBL_SPECULAR_SAMPLES; i++) {
+							glm::vec3 h = sampleGgx(i, IBL_SPECULAR_SAMPLES, alpha, n);
+							float nDotH = glm::dot(n, h);
+							glm::vec3 l = h * (2.0f * nDotH) - n;
+							float nDotL = glm::dot(n, l);
+							if (nDotL <= 0.0f)
+								continue;
+							// With the view along n the pdf of l is D / 4
+							float d = alpha * alpha / (IBL_PI * powf(nDotH * nDotH * (alpha * alpha - 1.0f) + 1.0f, 2.0f));
+							float sampleSolidAngle = 4.0f / (IBL_SPECULAR_SAMPLES * d);
+							float lod = 0.5f * log2f(sampleSolidAngle / texelSolidAngle) + 1.0f;
+							sum += samplePyramid(levels, l, lod) * nDotL;
+							weight += nDotL;
+						}
+						color = weight > 0.0f ? sum / weight : glm::vec3(0.0f);
+					}
+					float * texel = out + (row * size + x) * 3;
+					texel[0] = color.x;
+					texel[1] = color.y;
+					texel[2] = color.z;
+				}
+			}
+		});
+		offset += 6 * (size_t)size * size * 3;
+	}
+}
+
+// Projects the environment on the first 9 spherical harmonics, then
+// convolves with the clamped cosine. The result is divided by pi so the
+// shader multiplies it with the albedo directly.
+static void projectIrradiance(const std::vector<EquirectLevel> & levels, JobSystem & jobs, glm::vec3 sh[IBL_SH_COEFFICIENTS])
+{
+	TRACE_SCOPE("Project irradiance");
+	// Band 2 needs no detail, a small level is as good as the full image
+	size_t levelIndex = 0;
+	while (levelIndex + 1 < levels.size() && levels[levelIndex].width > 256)
+		levelIndex++;
+	const EquirectLevel & level = levels[levelIndex];
+
+	// One sum per row, added up in order afterwards so the result does not
+	// depend on the thread count
+	std::vector<glm::vec3> rowSums((size_t)level.height * IBL_SH_COEFFICIENTS);
+	jobs.parallelFor(level.height, 8, [&](size_t begin, size_t end) {
+		for (size_t y = begin; y < end; y++) {
+			float theta = (y + 0.5f) / level.height * IBL_PI;
+			float solidAngle = (2.0f * IBL_PI / level.width) * (IBL_PI / level.height) * sinf(theta);
+			glm::vec3 * sums = &rowSums[y * IBL_SH_COEFFICIENTS];
+			for (int x = 0; x < level.width; x++) {
+				glm::vec3 d = equirectDirection(level, x, (int)y);
+				glm::vec3 radiance = level.texels[y * level.width + x] * solidAngle;
+				sums[0] += radiance * 0.282095f;
+				sums[1] += radiance * (0.488603f * d.y);
+				sums[2] += radiance * (0.488603f * d.z);
+				sums[3] += radiance * (0.488603f * d.x);
+				sums[4] += radiance * (1.092548f * d.x * d.y);
+				sums[5] += radiance * (1.092548f * d.y * d.z);
+				sums[6] += radiance * (0.315392f * (3.0f * d.z * d.z - 1.0f));
+				sums[7] += radiance * (1.092548f * d.x * d.z);
+				sums[8] += radiance * (0.546274f * (d.x * d.x - d.y * d.y));
+			}
+		}
+	});
+
+	// Cosine lobe per band : pi, 2 pi / 3, pi / 4, then the 1 / pi
+	const float band[3] = { 1.0f, 2.0f / 3.0f, 0.25f };
+	for (int i = 0; i < IBL_SH_COEFFICIENTS; i++) {
+		sh[i] = glm::vec3(0.0f);
+		for (int y = 0; y < level.height; y++)
+			sh[i] += rowSums[(size_t)y * IBL_SH_COEFFICIENTS + i];
+		sh[i] *= band[i == 0 ? 0 : (i < 4 ? 1 : 2)];
+	}
+}
+
+// Scale and bias of F0 in the split-sum specular integral, for NdotV along
+// x and roughness along y
+static void integrateBrdf(JobSystem & jobs, std::vector<float> & table)
+{
+	TRACE_SCOPE("Integrate BRDF");
+	jobs.parallelFor(IBL_BRDF_SIZE, 4, [&](size_t begin, size_t end) {
+		for (size_t y = begin; y < end; y++) {
+			float roughness = (y + 0.5f) / IBL_BRDF_SIZE;
+			float alpha = roughness * roughness;
+			float k = alpha * 0.5f; // Schlick-Smith for image lighting
+			for (int x = 0; x < IBL_BRDF_SIZE; x++) {
+				float nDotV = (x + 0.5f) / IBL_BRDF_SIZE;
+				glm::vec3 v(sqrtf(1.0f - nDotV * nDotV), 0.0f, nDotV);
+				float scale = 0.0f, bias = 0.0f;
+				for (unsigned int i = 0; i < IBL_BRDF_SAMPLES; i++) {
+					glm::vec3 h = sampleGgx(i, IBL_BRDF_SAMPLES, alpha, glm::vec3(0.0f, 0.0f, 1.0f));
+					float vDotH = glm::dot(v, h);
+					glm::vec3 l = h * (2.0f * vDotH) - v;
+					if (l.z <= 0.0f)
+						continue;
+					float g = (nDotV / (nDotV * (1.0f - k) + k)) * (l.z / (l.z * (1.0f - k) + k));
+					float visibility = g * vDotH / (h.z * nDotV);
+					float fresnel = powf(1.0f - vDotH, 5.0f);
+					scale += (1.0f - fresnel) * visibility;
+					bias += fresnel * visibility;
+				}
+				table[(y * IBL_BRDF_SIZE + x) * 2] = scale / IBL_BRDF_SAMPLES;
+				table[(y * IBL_BRDF_SIZE + x) * 2 + 1] = bias / IBL_BRDF_SAMPLES;
+			}
+		}
+	});
+}
+
+EnvironmentLighting::EnvironmentLighting() : specular(0), brdf(0)
+{
+	for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+		sh[i] = glm::vec3(0.0f);
+}
+
+bool EnvironmentLighting::load(const char * path, JobSystem & jobs)
+{
+	if (!prepare(path, jobs))
+		return false;
+	upload();
+	return true;
+}
+
+bool EnvironmentLighting::prepare(const char * path, JobSystem & jobs)
+{
+	TRACE_SCOPE("EnvironmentLighting::prepare");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<unsigned char> file;
+	if (path && !readFile(path, file)) {
+		printf("Environment : %s could not be read\n", path);
+		return false;
+	}
+
+	// The source and every setting that shapes the result
+	const int settings[] = { IBL_CACHE_VERSION, IBL_CUBE_SIZE, IBL_MIP_COUNT, IBL_SPECULAR_SAMPLES, IBL_BRDF_SIZE, IBL_BRDF_SAMPLES };
+	unsigned long long key = 14695981039346656037ULL;
+	key = path ? hashBytes(&file[0], file.size(), key) : hashBytes("procedural sky", 14, key);
+	key = hashBytes(settings, sizeof(settings), key);
+	char cachePath[64];
+	snprintf(cachePath, sizeof(cachePath), "ibl-%016llx.cache", key);
+	const char * name = path ? path : "procedural sky";
+
+	if (readCache(cachePath, key)) {
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		printf("Environment : %s read from %s in %.1f ms\n", name, cachePath, ms);
+	}
+	else {
+		std::vector<EquirectLevel> levels(1);
+		if (!path)
+			proceduralSky(levels[0]);
+		else if (!decodeBmp(file, levels[0]) && !decodeHdr(file, levels[0])) {
+			printf("Environment : %s is neither a 24 bit BMP nor a Radiance HDR\n", path);
+			return false;
+		}
+		file.clear();
+		buildPyramid(levels);
+
+		cube.resize(cubeFloats());
+		brdfTable.resize(IBL_BRDF_SIZE * IBL_BRDF_SIZE * 2);
+		prefilterSpecular(levels, jobs, cube);
+		projectIrradiance(levels, jobs, sh);
+		integrateBrdf(jobs, brdfTable);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		printf("Environment : %s (%dx%d) prefiltered on %d threads in %.1f ms, cached in %s\n",
+			name, levels[0].width, levels[0].height, jobs.threadCount(), ms, cachePath);
+		writeCache(cachePath, key);
+	}
+	return true;
+}
+
+bool EnvironmentLighting::readCache(const char * path, unsigned long long key)
+{
+	FILE * file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	IblCacheHeader header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "IBL ", 4) == 0
+		&& header.version == IBL_CACHE_VERSION && header.key == key && header.cubeSize == IBL_CUBE_SIZE
+		&& header.mipCount == IBL_MIP_COUNT && header.brdfSize == IBL_BRDF_SIZE;
+	if (valid) {
+		cube.resize(cubeFloats());
+		brdfTable.resize(IBL_BRDF_SIZE * IBL_BRDF_SIZE * 2);
+		valid = fread(sh, sizeof(sh), 1, file) == 1
+			&& fread(&cube[0], sizeof(float), cube.size(), file) == cube.size()
+			&& fread(&brdfTable[0], sizeof(float), brdfTable.size(), file) == brdfTable.size();
+	}
+	fclose(file);
+	if (!valid)
+		printf("Environment : ignoring %s, it is incomplete or out of date\n", path);
+	return valid;
+}
+
+void EnvironmentLighting::writeCache(const char * path, unsigned long long key) const
+{
+	IblCacheHeader header;
+	memcpy(header.magic, "IBL ", 4);
+	header.version = IBL_CACHE_VERSION;
+	header.key = key;
+	header.cubeSize = IBL_CUBE_SIZE;
+	header.mipCount = IBL_MIP_COUNT;
+	header.brdfSize = IBL_BRDF_SIZE;
+
+	FILE * file = fopen(path, "wb");
+	bool written = file
+		&& fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(sh, sizeof(sh), 1, file) == 1
+		&& fwrite(&cube[0], sizeof(float), cube.size(), file) == cube.size()
+		&& fwrite(&brdfTable[0], sizeof(float), brdfTable.size(), file) == brdfTable.size();
+	if (file)
+		fclose(file);
+	// Leave no partial file behind
+	if (!written) {
+		printf("Environment : %s could not be written\n", path);
+		remove(path);
+	}
+}
+
+void EnvironmentLighting::upload()
+{
+	// Half floats on the GPU; the CPU copies are not needed afterwards
+	specular = GPU_CREATE(GPU_TEXTURE, GPU_MEMORY_TEXTURE, "Environment specular");
+	glBindTexture(GL_TEXTURE_CUBE_MAP, specular);
+	size_t offset = 0;
+	long long bytes = 0;
+	for (int mip = 0; mip < IBL_MIP_COUNT; mip++) {
+		int size = IBL_CUBE_SIZE >> mip;
+		for (int face = 0; face < 6; face++) {
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGB16F, size, size, 0, GL_RGB, GL_FLOAT, &cube[offset]);
+			offset += (size_t)size * size * 3;
+			bytes += (long long)size * size * 6;
+		}
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, IBL_MIP_COUNT - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	gpuResources.setSize(GPU_TEXTURE, specular, bytes, GL_RGB16F);
+	// The small rough levels would show the face edges otherwise
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	brdf = GPU_CREATE(GPU_TEXTURE, GPU_MEMORY_TEXTURE, "Environment BRDF");
+	glBindTexture(GL_TEXTURE_2D, brdf);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, IBL_BRDF_SIZE, IBL_BRDF_SIZE, 0, GL_RG, GL_FLOAT, &brdfTable[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	gpuResources.setSize(GPU_TEXTURE, brdf, (long long)IBL_BRDF_SIZE * IBL_BRDF_SIZE * 4, GL_RG16F);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	std::vector<float>().swap(cube);
+	std::vector<float>().swap(brdfTable);
+}
+
+void EnvironmentLighting::destroy()
+{
+	gpuResources.destroy(GPU_TEXTURE, specular);
+	gpuResources.destroy(GPU_TEXTURE, brdf);
+}
@@ -0,0 +1,59 @@
+#ifndef IBL_HPP
+#define IBL_HPP
+
+#include <vector>
+
+// Sizes of the precomputed data. Changing any of them changes the cache key.
+#define IBL_CUBE_SIZE 128        // Faces of the sharpest specular level
+#define IBL_MIP_COUNT 6          // Roughness 0 to 1, one level each, 128 to 4 texels
+#define IBL_SPECULAR_SAMPLES 128 // GGX samples per texel of the rough levels
+#define IBL_BRDF_SIZE 64         // The BRDF table is IBL_BRDF_SIZE squared
+#define IBL_BRDF_SAMPLES 256
+#define IBL_SH_COEFFICIENTS 9    // Spherical harmonics up to band 2
+
+class JobSystem;
+
+// Image-based lighting from an environment map, for the split-sum
+// approximation of physically based shading :
+//  - a cubemap of the environment prefiltered with the GGX lobe, one mip
+//    level per roughness
+//  - the diffuse irradiance as 9 spherical harmonics coefficients
+//  - a table of the specular BRDF integral, scale and bias of F0 by NdotV
+//    along x and roughness along y
+//
+// The environment is an equirectangular image, a 24 bit BMP or a Radiance
+// .hdr, with +Z up. Without one a procedural sky is used.
+//
+// The precomputation runs on the job system once per environment and is
+// written to ibl-<hash>.cache in the working directory, keyed by a hash of
+// the source file and of the sizes above. Later runs only read the cache.
+class EnvironmentLighting {
+public:
+	EnvironmentLighting();
+
+	// Loads or precomputes the data, then creates the textures. path may be
+	// NULL for the procedural sky. Returns false if the image is unusable.
+	bool load(const char * path, JobSystem & jobs);
+	// load() in two steps : the CPU work, which may run inside a job, then
+	// the textures, on the GL thread
+	bool prepare(const char * path, JobSystem & jobs);
+	void upload();
+	void destroy();
+
+	GLuint specularTexture() const { return specular; } // GL_TEXTURE_CUBE_MAP
+	GLuint brdfTexture() const { return brdf; }         // GL_TEXTURE_2D, RG
+	// Irradiance divided by pi, ready to multiply the albedo with
+	const glm::vec3 * irradianceSH() const { return sh; }
+	GLfloat maxLod() const { return (GLfloat)(IBL_MIP_COUNT - 1); }
+
+private:
+	bool readCache(const char * path, unsigned long long key);
+	void writeCache(const char * path, unsigned long long key) const;
+
+	glm::vec3 sh[IBL_SH_COEFFICIENTS];
+	std::vector<float> cube;      // RGB, every level from the sharpest, +X -X +Y -Y +Z -Z
+	std::vector<float> brdfTable; // RG
+	GLuint specular, brdf;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include <chrono>
+#include <atomic>
+
+#include "inputqueue.hpp"
+
+InputQueue::InputQueue() : head(0), tail(0), droppedEvents(0)
+{
+}
+
+long long InputQueue::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool InputQueue::push(InputEvent event)
+{
+	event.time = now();
+	unsigned int t = tail.load(std::memory_order_relaxed);
+	if (t - head.load(std::memory_order_acquire) >= INPUT_QUEUE_SIZE) {
+		droppedEvents.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	events[t & (INPUT_QUEUE_SIZE - 1)] = event;
+	// Publishes the event, the consumer's acquire of tail sees it complete
+	tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+bool InputQueue::pop(InputEvent & event)
+{
+	unsigned int h = head.load(std::memory_order_relaxed);
+	if (h == tail.load(std::memory_order_acquire))
+		return false;
+	event = events[h & (INPUT_QUEUE_SIZE - 1)];
+	// Hands the slot back once it has been read
+	head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+bool InputQueue::peek(InputEvent & event) const
+{
+	unsigned int h = head.load(std::memory_order_relaxed);
+	if (h == tail.load(std::memory_order_acquire))
+		return false;
+	event = events[h & (INPUT_QUEUE_SIZE - 1)];
+	return true;
+}
@@ -0,0 +1,57 @@
+#ifndef INPUTQUEUE_HPP
+#define INPUTQUEUE_HPP
+
+#include <atomic>
+
+// Events the queue holds at once, a power of two. Events pushed while it is
+// full are dropped.
+#define INPUT_QUEUE_SIZE 1024
+
+enum InputEventType {
+	INPUT_KEY_DOWN,
+	INPUT_KEY_UP,
+	INPUT_MOUSE_MOVE,
+	INPUT_MOUSE_CLICK, // Left button pressed at x, y
+	INPUT_RESIZE,    // x and y are the new window size
+	INPUT_REDISPLAY  // The window system asked for a frame
+};
+
+struct InputEvent {
+	InputEventType type;
+	int x, y;
+	unsigned char key;
+	bool alt;       // Alt was held, for mouse moves
+	long long time; // When the window system reported it, CPU ns
+};
+
+// Bounded single-producer, single-consumer queue carrying input from the
+// window system thread to the render thread. Neither side ever waits : a
+// full queue drops the event, an empty one returns false.
+class InputQueue {
+public:
+	InputQueue();
+
+	// Producer only. Stamps the event with the current time.
+	bool push(InputEvent event);
+	// Consumer only
+	bool pop(InputEvent & event);
+	// Consumer only. Copies the next event without removing it.
+	bool peek(InputEvent & event) const;
+
+	int dropped() const { return droppedEvents.load(std::memory_order_relaxed); }
+
+	// The clock the events are stamped with, in ns
+	static long long now();
+
+private:
+	// Each index is written by one side only, keep them on separate lines.
+	// Padded rather than aligned, like the job queues.
+	std::atomic<unsigned int> head; // Next event to pop
+	char padding[64 - sizeof(std::atomic<unsigned int>)];
+	std::atomic<unsigned int> tail; // Next free slot
+	char padding2[64 - sizeof(std::atomic<unsigned int>)];
+	std::atomic<int> droppedEvents;
+	InputEvent events[INPUT_QUEUE_SIZE];
+};
+
+#endif
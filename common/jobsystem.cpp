@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "jobsystem.hpp"
+#include "workstealingqueue.hpp"
+#include "trace.hpp"
+
+// Failed steal attempts before an idle worker goes to sleep
+#define JOB_IDLE_SPINS 64
+
+struct JobThread {
+	WorkStealingQueue queue;
+	Job * pool;
+	void * poolMemory;
+	unsigned int allocated;
+	unsigned int random; // xorshift state for picking victims
+	std::thread thread;
+};
+
+// Index of the calling thread in the running job system, 0 for the thread
+// that started it
+static thread_local int jobThreadIndex = 0;
+
+static std::mutex sleepMutex;
+static std::condition_variable wakeUp;
+
+JobSystem::JobSystem() : threadData(NULL), threads(0), running(false), sleeping(0), epoch(0)
+{
+}
+
+void JobSystem::start(int threadCount)
+{
+	if (threadCount <= 0)
+		threadCount = (int)std::thread::hardware_concurrency();
+	if (threadCount <= 0)
+		threadCount = 1;
+
+	threads = threadCount;
+	threadData = new JobThread*[threads];
+	for (int i = 0; i < threads; i++) {
+		JobThread * data = new JobThread();
+		// Jobs start on cache line boundaries so two threads never share one
+		data->poolMemory = malloc(JOB_POOL_SIZE * sizeof(Job) + 64);
+		data->pool = (Job*)(((size_t)data->poolMemory + 63) & ~(size_t)63);
+		data->allocated = 0;
+		data->random = 0x9E3779B9u * (i + 1);
+		threadData[i] = data;
+	}
+
+	jobThreadIndex = 0;
+	mainThread.store(std::this_thread::get_id());
+	running = true;
+	for (int i = 1; i < threads; i++)
+		threadData[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+}
+
+void JobSystem::stop()
+{
+	if (!threadData)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		running = false;
+		epoch++;
+	}
+	wakeUp.notify_all();
+
+	// Workers still running may steal from any queue, free none before all joined
+	for (int i = 0; i < threads; i++) {
+		if (threadData[i]->thread.joinable())
+			threadData[i]->thread.join();
+	}
+	for (int i = 0; i < threads; i++) {
+		free(threadData[i]->poolMemory);
+		delete threadData[i];
+	}
+	delete[] threadData;
+	threadData = NULL;
+	threads = 0;
+}
+
+void JobSystem::takeMainThread()
+{
+	mainThread.store(std::this_thread::get_id());
+}
+
+// Workers own their index, any other thread is thread 0 and must be the one
+// holding it
+bool JobSystem::ownsThreadIndex() const
+{
+	return jobThreadIndex != 0 || mainThread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+Job * JobSystem::allocate()
+{
+	assert(ownsThreadIndex());
+	JobThread & thread = *threadData[jobThreadIndex];
+	Job * job = &thread.pool[thread.allocated++ & (JOB_POOL_SIZE - 1)];
+	job->parent = NULL;
+	job->unfinished.store(1, std::memory_order_relaxed);
+	job->continuationCount.store(0, std::memory_order_relaxed);
+	return job;
+}
+
+Job * JobSystem::create(JobFunction function)
+{
+	Job * job = allocate();
+	job->function = function;
+	return job;
+}
+
+Job * JobSystem::createChild(Job * parent, JobFunction function)
+{
+	parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+	Job * job = allocate();
+	job->function = function;
+	job->parent = parent;
+	return job;
+}
+
+bool JobSystem::addContinuation(Job * ancestor, Job * continuation)
+{
+	int index = ancestor->continuationCount.fetch_add(1, std::memory_order_relaxed);
+	if (index >= JOB_MAX_CONTINUATIONS) {
+		ancestor->continuationCount.fetch_sub(1, std::memory_order_relaxed);
+		return false;
+	}
+	ancestor->continuations[index] = continuation;
+	return true;
+}
+
+void JobSystem::run(Job * job)
+{
+	assert(ownsThreadIndex());
+	if (!threadData[jobThreadIndex]->queue.push(job)) {
+		execute(job);
+		return;
+	}
+
+	epoch.fetch_add(1);
+	if (sleeping.load() > 0) {
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeUp.notify_one();
+	}
+}
+
+void JobSystem::wait(const Job * job)
+{
+	assert(ownsThreadIndex());
+	while (job->unfinished.load(std::memory_order_acquire) > 0) {
+		Job * next = getJob();
+		if (next)
+			execute(next);
+		else
+			std::this_thread::yield();
+	}
+}
+
+bool JobSystem::localQueueEmpty() const
+{
+	return threadData[jobThreadIndex]->queue.empty();
+}
+
+Job * JobSystem::getJob()
+{
+	JobThread & self = *threadData[jobThreadIndex];
+	Job * job = self.queue.pop();
+	if (job || threads < 2)
+		return job;
+
+	// Try every other thread once, starting at a random one
+	self.random ^= self.random << 13;
+	self.random ^= self.random >> 17;
+	self.random ^= self.random << 5;
+	int first = (int)(self.random % threads);
+	for (int i = 0; i < threads; i++) {
+		int victim = (first + i) % threads;
+		if (victim == jobThreadIndex)
+			continue;
+		job = threadData[victim]->queue.steal();
+		if (job)
+			return job;
+	}
+	return NULL;
+}
+
+void JobSystem::execute(Job * job)
+{
+	job->function(job, job->data);
+	finish(job);
+}
+
+void JobSystem::finish(Job * job)
+{
+	if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	int continuations = job->continuationCount.load(std::memory_order_relaxed);
+	for (int i = 0; i < continuations; i++)
+		run(job->continuations[i]);
+	if (job->parent)
+		finish(job->parent);
+}
+
+void JobSystem::workerLoop(int index)
+{
+	jobThreadIndex = index;
+	char name[16];
+	snprintf(name, sizeof(name), "Worker %d", index);
+	traceThreadName(name);
+	int idle = 0;
+
+	while (running.load(std::memory_order_relaxed)) {
+		unsigned int seen = epoch.load();
+		Job * job = getJob();
+		if (job) {
+			execute(job);
+			idle = 0;
+			continue;
+		}
+		if (++idle < JOB_IDLE_SPINS) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Sleep until a job is queued. A job queued since the epoch was read
+		// changed it, so there is no missed wake-up.
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleeping++;
+		while (epoch.load() == seen && running.load())
+			wakeUp.wait(lock);
+		sleeping--;
+		idle = 0;
+	}
+}
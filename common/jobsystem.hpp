@@ -0,0 +1,166 @@
+#ifndef JOBSYSTEM_HPP
+#define JOBSYSTEM_HPP
+
+#include <atomic>
+#include <thread>
+#include <new>
+#include <string.h>
+#include <type_traits>
+
+// Jobs are fixed size, the payload is what is left after the header
+#define JOB_SIZE 128
+#define JOB_MAX_CONTINUATIONS 4
+
+// Jobs one thread can have in flight. The job pools are rings, a thread that
+// creates more jobs than this before the oldest finished overwrites them.
+#define JOB_POOL_SIZE 4096
+
+// Capacity of each thread's deque, a power of two. A job that does not fit is
+// run right away instead.
+#define JOB_QUEUE_SIZE 4096
+
+struct Job;
+typedef void (*JobFunction)(Job * job, const void * data);
+
+struct Job {
+	JobFunction function;
+	Job * parent;
+	std::atomic<int> unfinished;        // The job itself and its unfinished children
+	std::atomic<int> continuationCount;
+	Job * continuations[JOB_MAX_CONTINUATIONS]; // Run once the job and its children are done
+	char data[JOB_SIZE - sizeof(JobFunction) - sizeof(Job*) - 2 * sizeof(std::atomic<int>) - JOB_MAX_CONTINUATIONS * sizeof(Job*)];
+};
+
+struct JobThread;
+
+// Work-stealing scheduler. Every thread owns a lock-free deque (Chase-Lev) :
+// it pushes and pops jobs at the bottom, idle threads steal from the top of
+// the others. The thread that calls start() is thread 0 and takes part in
+// the work whenever it waits.
+//
+// Jobs may only be created, run and waited for from thread 0 or from inside
+// jobs. Thread 0 can be handed over once with takeMainThread() : the main
+// thread loads the startup files on the jobs, then the render thread takes
+// thread 0 for the per-frame work and the main thread no longer touches the
+// job system until stop(). Debug builds assert that the caller owns its
+// thread index.
+class JobSystem {
+public:
+	JobSystem();
+
+	// Starts threadCount - 1 worker threads. 0 starts one per hardware thread.
+	void start(int threadCount);
+	void stop();
+	int threadCount() const { return threads; }
+	// Makes the calling thread thread 0, with its deque and job pool. The
+	// thread that had it must have no job in flight left.
+	void takeMainThread();
+
+	Job * create(JobFunction function);
+	// The parent only finishes once the child has
+	Job * createChild(Job * parent, JobFunction function);
+	// continuation is run once ancestor and its children finished. Must be
+	// added before ancestor is run; returns false when it has no room left.
+	bool addContinuation(Job * ancestor, Job * continuation);
+
+	void run(Job * job);
+	// Runs other jobs until job has finished
+	void wait(const Job * job);
+
+	// A job calling lambda(), which is copied into the job's payload
+	template <typename Lambda>
+	Job * createLambda(Job * parent, const Lambda & lambda);
+
+	// Calls body(begin, end) over [0, count). The range is split in halves
+	// only while the current thread has no queued work left for others to
+	// steal, so the chunks adapt to how busy the threads are; minChunk is the
+	// smallest piece handed out.
+	template <typename Body>
+	void parallelFor(size_t count, size_t minChunk, const Body & body);
+
+	// True when the calling thread's deque is empty
+	bool localQueueEmpty() const;
+
+private:
+	template <typename Lambda>
+	static void invokeLambda(Job *, const void * data) { (*(const Lambda*)data)(); }
+
+	template <typename Body>
+	struct ParallelForRange {
+		const Body * body;
+		size_t begin, end, minChunk;
+		JobSystem * system;
+	};
+	template <typename Body>
+	static void parallelForJob(Job * job, const void * data);
+
+	bool ownsThreadIndex() const;
+	Job * allocate();
+	Job * getJob();
+	void execute(Job * job);
+	void finish(Job * job);
+	void workerLoop(int index);
+
+	JobThread ** threadData;
+	int threads;
+	std::atomic<std::thread::id> mainThread; // The thread that is thread 0
+	std::atomic<bool> running;
+	std::atomic<int> sleeping;
+	std::atomic<unsigned int> epoch; // Bumped whenever a job is queued
+};
+
+template <typename Lambda>
+Job * JobSystem::createLambda(Job * parent, const Lambda & lambda)
+{
+	static_assert(sizeof(Lambda) <= sizeof(((Job*)0)->data), "Lambda captures too much for a job");
+	static_assert(std::is_trivially_destructible<Lambda>::value, "Job lambdas are never destroyed");
+	Job * job = parent ? createChild(parent, &invokeLambda<Lambda>) : create(&invokeLambda<Lambda>);
+	new (job->data) Lambda(lambda);
+	return job;
+}
+
+template <typename Body>
+void JobSystem::parallelForJob(Job * job, const void * data)
+{
+	ParallelForRange<Body> range = *(const ParallelForRange<Body>*)data;
+	JobSystem & system = *range.system;
+
+	while (range.end - range.begin > range.minChunk) {
+		if (system.localQueueEmpty()) {
+			// Nothing left for a thief here : offer the upper half
+			ParallelForRange<Body> upper = range;
+			upper.begin = range.begin + (range.end - range.begin) / 2;
+			range.end = upper.begin;
+			Job * child = system.createChild(job, &parallelForJob<Body>);
+			memcpy(child->data, &upper, sizeof(upper));
+			system.run(child);
+		}
+		else {
+			// The offered half is still there, keep working in small steps
+			(*range.body)(range.begin, range.begin + range.minChunk);
+			range.begin += range.minChunk;
+		}
+	}
+	if (range.begin < range.end)
+		(*range.body)(range.begin, range.end);
+}
+
+template <typename Body>
+void JobSystem::parallelFor(size_t count, size_t minChunk, const Body & body)
+{
+	if (minChunk == 0)
+		minChunk = 1;
+	if (threads < 2 || count <= minChunk) {
+		if (count > 0)
+			body((size_t)0, count);
+		return;
+	}
+
+	ParallelForRange<Body> range = { &body, 0, count, minChunk, this };
+	Job * root = create(&parallelForJob<Body>);
+	memcpy(root->data, &range, sizeof(range));
+	run(root);
+	wait(root);
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <chrono>
+#include <algorithm>
+#include <string.h>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "gpuresources.hpp"
+#include "latency.hpp"
+#include "trace.hpp"
+
+// How often the GPU clock is matched with the CPU clock again, in ns
+#define LATENCY_CALIBRATION_PERIOD 1000000000LL
+
+static long long cpuNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LatencyTracker::LatencyTracker() : current(0), timestamps(false), pendingInput(0), latchedInput(0),
+	gpuToCpu(0), lastCalibration(0), sampleTotal(0)
+{
+	for (int i = 0; i < LATENCY_FRAMES; i++) {
+		frames[i].fence = 0;
+		frames[i].query = 0;
+		frames[i].inputTime = 0;
+	}
+}
+
+void LatencyTracker::create()
+{
+	// Without timer queries the completion time is when poll() first sees the
+	// fence signaled, which is late by up to a frame
+	timestamps = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	if (timestamps) {
+		for (int i = 0; i < LATENCY_FRAMES; i++)
+			frames[i].query = GPU_CREATE(GPU_QUERY, GPU_MEMORY_OTHER, "Swap timestamp");
+		calibrate();
+	}
+}
+
+void LatencyTracker::destroy()
+{
+	for (int i = 0; i < LATENCY_FRAMES; i++) {
+		if (frames[i].fence)
+			glDeleteSync(frames[i].fence);
+		gpuResources.destroy(GPU_QUERY, frames[i].query);
+		frames[i].fence = 0;
+	}
+}
+
+void LatencyTracker::inputEvent(long long time)
+{
+	if (pendingInput == 0)
+		pendingInput = time != 0 ? time : cpuNanoseconds();
+}
+
+void LatencyTracker::inputLatched()
+{
+	if (latchedInput == 0)
+		latchedInput = pendingInput;
+	pendingInput = 0;
+}
+
+void LatencyTracker::frameSwapped()
+{
+	Frame & frame = frames[current];
+	if (frame.fence) {
+		glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		finish(frame);
+	}
+
+	if (timestamps && latchedInput != 0)
+		glQueryCounter(frame.query, GL_TIMESTAMP);
+	frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame.inputTime = latchedInput;
+	latchedInput = 0;
+	current = (current + 1) % LATENCY_FRAMES;
+}
+
+void LatencyTracker::poll()
+{
+	if (timestamps && cpuNanoseconds() - lastCalibration > LATENCY_CALIBRATION_PERIOD)
+		calibrate();
+
+	// Oldest first, stop at the first frame still in flight
+	for (int i = 0; i < LATENCY_FRAMES; i++) {
+		Frame & frame = frames[(current + i) % LATENCY_FRAMES];
+		if (!frame.fence)
+			continue;
+		if (glClientWaitSync(frame.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			break;
+		finish(frame);
+	}
+}
+
+double LatencyTracker::waitForPreviousFrame()
+{
+	Frame & frame = frames[(current + LATENCY_FRAMES - 1) % LATENCY_FRAMES];
+	if (!frame.fence)
+		return 0.0;
+
+	TRACE_SCOPE("Late latch wait");
+	long long start = cpuNanoseconds();
+	while (glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+		;
+	double waited = (cpuNanoseconds() - start) / 1000000.0;
+	poll();
+	return waited;
+}
+
+void LatencyTracker::finish(Frame & frame)
+{
+	if (frame.inputTime != 0) {
+		long long completed = cpuNanoseconds();
+		GLint available = 0;
+		if (timestamps)
+			glGetQueryObjectiv(frame.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLint64 gpuTime = 0;
+			glGetQueryObjecti64v(frame.query, GL_QUERY_RESULT, &gpuTime);
+			completed = std::min(completed, gpuTime + gpuToCpu);
+		}
+		samples[sampleTotal % LATENCY_HISTORY] = (completed - frame.inputTime) / 1000000.0;
+		sampleTotal++;
+	}
+
+	glDeleteSync(frame.fence);
+	frame.fence = 0;
+	frame.inputTime = 0;
+}
+
+void LatencyTracker::calibrate()
+{
+	GLint64 gpuTime = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+	lastCalibration = cpuNanoseconds();
+	gpuToCpu = lastCalibration - gpuTime;
+}
+
+void LatencyTracker::reset()
+{
+	sampleTotal = 0;
+}
+
+double LatencyTracker::percentile(double p) const
+{
+	int count = sampleCount();
+	if (count == 0)
+		return -1.0;
+
+	// On the stack, the window title asks for percentiles while rendering
+	double sorted[LATENCY_HISTORY];
+	memcpy(sorted, samples, count * sizeof(double));
+	size_t rank = (size_t)(p * (count - 1) + 0.5);
+	std::nth_element(sorted, sorted + rank, sorted + count);
+	return sorted[rank];
+}
+
+void LatencyTracker::print(const char * label) const
+{
+	if (sampleCount() == 0) {
+		printf("Input latency (%s) : no samples\n", label);
+		return;
+	}
+	printf("Input latency (%s) : %d samples, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n", label,
+		sampleCount(), percentile(0.5), percentile(0.9), percentile(0.99), percentile(1.0));
+}
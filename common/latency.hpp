@@ -0,0 +1,65 @@
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+// Frames whose completion is tracked at once. A slot still busy when it comes
+// around again is waited for.
+#define LATENCY_FRAMES 8
+
+// Latency samples the percentiles are computed over
+#define LATENCY_HISTORY 512
+
+// Measures input-to-photon latency : the time from an input event to the
+// moment the GPU has finished the first frame that reflects it. A fence and
+// a GL_TIMESTAMP query follow each swap; the GPU clock is mapped onto the CPU
+// clock by sampling both now and then. Scan-out adds up to one refresh on
+// top, which GL cannot see.
+class LatencyTracker {
+public:
+	LatencyTracker();
+
+	void create();
+	void destroy();
+
+	// Called for each input event with the time it happened, CPU ns on the
+	// steady clock. 0 is now.
+	void inputEvent(long long time = 0);
+	// Called where the frame reads the input state. The oldest event since the
+	// previous frame is the one this frame answers.
+	void inputLatched();
+	// Called right after the swap
+	void frameSwapped();
+	// Collects the frames the GPU has finished, never blocks
+	void poll();
+
+	// Blocks until the GPU has finished the previous frame, so the input read
+	// next does not wait behind a queue of frames. Returns the wait in ms.
+	double waitForPreviousFrame();
+
+	void reset();
+	int sampleCount() const { return sampleTotal < LATENCY_HISTORY ? sampleTotal : LATENCY_HISTORY; }
+	// p in [0, 1], in milliseconds, negative without samples
+	double percentile(double p) const;
+	void print(const char * label) const;
+
+private:
+	struct Frame {
+		GLsync fence;
+		GLuint query;
+		long long inputTime; // CPU ns, 0 when the frame answered no input
+	};
+
+	void finish(Frame & frame);
+	void calibrate();
+
+	Frame frames[LATENCY_FRAMES];
+	int current;
+	bool timestamps;           // GL_TIMESTAMP queries are available
+	long long pendingInput;    // Oldest event not read by a frame yet
+	long long latchedInput;    // Oldest event read by the frame being built
+	long long gpuToCpu;        // Add to a GPU timestamp to get CPU time
+	long long lastCalibration;
+	double samples[LATENCY_HISTORY];
+	int sampleTotal;
+};
+
+#endif
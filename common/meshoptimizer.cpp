@@ -0,0 +1,447 @@
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <float.h>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "meshpool.hpp"
+#include "meshoptimizer.hpp"
+
+// Resolution of the views the overdraw is measured from
+#define OVERDRAW_VIEWPORT 256
+
+// Vertex fetch is simulated with a FIFO of this many 64 byte cache lines
+#define FETCH_CACHE_LINE 64
+#define FETCH_CACHE_LINES 64
+
+// FIFO cache of vertex indices. A vertex is in the cache while fewer than
+// size misses happened since it was loaded.
+struct VertexCacheSimulator {
+	std::vector<unsigned int> loadedAt;
+	unsigned int time;
+	unsigned int size;
+
+	VertexCacheSimulator(size_t vertexCount, unsigned int cacheSize)
+		: loadedAt(vertexCount, 0), time(cacheSize + 1), size(cacheSize) {}
+
+	// Returns true on a miss
+	bool access(unsigned int v) {
+		if (time - loadedAt[v] <= size)
+			return false;
+		loadedAt[v] = time++;
+		return true;
+	}
+
+	void flush() { time += size + 1; }
+};
+
+static glm::vec3 trianglePosition(const std::vector<unsigned int> & indices, const std::vector<MeshVertex> & vertices, size_t t, int corner)
+{
+	return vertices[indices[t * 3 + corner]].position;
+}
+
+/* Post-transform cache */
+
+static void analyzeVertexCache(const std::vector<unsigned int> & indices, size_t vertexCount, MeshStatistics & statistics)
+{
+	VertexCacheSimulator cache(vertexCount, VERTEX_CACHE_SIZE);
+	size_t misses = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+		misses += cache.access(indices[i]);
+
+	// Only the vertices the index buffer uses count
+	std::vector<char> used(vertexCount, 0);
+	size_t usedCount = 0;
+	for (size_t i = 0; i < indices.size(); i++) {
+		if (!used[indices[i]]) {
+			used[indices[i]] = 1;
+			usedCount++;
+		}
+	}
+
+	statistics.acmr = indices.empty() ? 0.0f : (float)misses / (indices.size() / 3);
+	statistics.atvr = usedCount == 0 ? 0.0f : (float)misses / usedCount;
+}
+
+/* Vertex fetch */
+
+static float analyzeVertexFetch(const std::vector<unsigned int> & indices, size_t vertexCount, size_t vertexSize)
+{
+	VertexCacheSimulator cache(vertexCount, VERTEX_CACHE_SIZE);
+	std::vector<size_t> lines; // FIFO, oldest first
+	size_t fetched = 0;
+
+	for (size_t i = 0; i < indices.size(); i++) {
+		// Only vertices that miss the post-transform cache are fetched
+		if (!cache.access(indices[i]))
+			continue;
+
+		size_t first = indices[i] * vertexSize / FETCH_CACHE_LINE;
+		size_t last = ((indices[i] + 1) * vertexSize - 1) / FETCH_CACHE_LINE;
+		for (size_t line = first; line <= last; line++) {
+			if (std::find(lines.begin(), lines.end(), line) != lines.end())
+				continue;
+			fetched += FETCH_CACHE_LINE;
+			if (lines.size() == FETCH_CACHE_LINES)
+				lines.erase(lines.begin());
+			lines.push_back(line);
+		}
+	}
+
+	return vertexCount == 0 ? 0.0f : (float)fetched / (vertexCount * vertexSize);
+}
+
+/* Overdraw */
+
+// Edge function, positive when p is left of a->b
+static float edge(const glm::vec2 & a, const glm::vec2 & b, const glm::vec2 & p)
+{
+	return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+// Top-left fill rule for counter-clockwise triangles, so pixels on an edge
+// shared by two triangles are only rasterized once
+static bool topLeft(const glm::vec2 & a, const glm::vec2 & b)
+{
+	return b.y < a.y || (b.y == a.y && b.x < a.x);
+}
+
+static float analyzeOverdraw(const std::vector<unsigned int> & indices, const std::vector<MeshVertex> & vertices)
+{
+	if (indices.empty())
+		return 0.0f;
+
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	for (size_t i = 0; i < indices.size(); i++) {
+		boundsMin = glm::min(boundsMin, vertices[indices[i]].position);
+		boundsMax = glm::max(boundsMax, vertices[indices[i]].position);
+	}
+	glm::vec3 extents = boundsMax - boundsMin;
+	float extent = std::max(extents.x, std::max(extents.y, extents.z));
+	if (extent <= 0.0f)
+		return 0.0f;
+	float scale = (OVERDRAW_VIEWPORT - 1) / extent;
+
+	std::vector<float> depth(OVERDRAW_VIEWPORT * OVERDRAW_VIEWPORT);
+	size_t covered = 0, shaded = 0;
+
+	// Look down each axis from both sides, with back faces culled
+	for (int view = 0; view < 6; view++) {
+		int axis = view / 2;
+		float direction = view % 2 ? 1.0f : -1.0f; // Viewing direction along the axis
+		int u = (axis + 1) % 3, v = (axis + 2) % 3;
+		std::fill(depth.begin(), depth.end(), FLT_MAX);
+
+		for (size_t t = 0; t < indices.size() / 3; t++) {
+			glm::vec2 p[3];
+			float z[3];
+			for (int c = 0; c < 3; c++) {
+				glm::vec3 position = (trianglePosition(indices, vertices, t, c) - boundsMin) * scale;
+				p[c] = glm::vec2(position[u], position[v]);
+				z[c] = position[axis] * direction;
+			}
+
+			// u x v is the axis, so the 2D area has the sign of the normal along it
+			float area = edge(p[0], p[1], p[2]);
+			if (area * direction >= 0.0f)
+				continue;
+			if (area < 0.0f) {
+				std::swap(p[1], p[2]);
+				std::swap(z[1], z[2]);
+				area = -area;
+			}
+
+			int x0 = std::max(0, (int)std::min(p[0].x, std::min(p[1].x, p[2].x)));
+			int x1 = std::min(OVERDRAW_VIEWPORT - 1, (int)std::max(p[0].x, std::max(p[1].x, p[2].x)) + 1);
+			int y0 = std::max(0, (int)std::min(p[0].y, std::min(p[1].y, p[2].y)));
+			int y1 = std::min(OVERDRAW_VIEWPORT - 1, (int)std::max(p[0].y, std::max(p[1].y, p[2].y)) + 1);
+
+			for (int y = y0; y <= y1; y++) {
+				for (int x = x0; x <= x1; x++) {
+					glm::vec2 center(x + 0.5f, y + 0.5f);
+					float w0 = edge(p[1], p[2], center);
+					float w1 = edge(p[2], p[0], center);
+					float w2 = edge(p[0], p[1], center);
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+						continue;
+					if ((w0 == 0.0f && !topLeft(p[1], p[2])) || (w1 == 0.0f && !topLeft(p[2], p[0])) || (w2 == 0.0f && !topLeft(p[0], p[1])))
+						continue;
+
+					float fragmentDepth = (w0 * z[0] + w1 * z[1] + w2 * z[2]) / area;
+					float & stored = depth[y * OVERDRAW_VIEWPORT + x];
+					if (fragmentDepth < stored) {
+						if (stored == FLT_MAX)
+							covered++;
+						stored = fragmentDepth;
+						shaded++;
+					}
+				}
+			}
+		}
+	}
+
+	return covered == 0 ? 0.0f : (float)shaded / covered;
+}
+
+MeshStatistics analyzeMesh(
+	const std::vector<unsigned int> & indices,
+	const std::vector<MeshVertex> & vertices
+){
+	MeshStatistics statistics;
+	analyzeVertexCache(indices, vertices.size(), statistics);
+	statistics.overdraw = analyzeOverdraw(indices, vertices);
+	statistics.overfetch = analyzeVertexFetch(indices, vertices.size(), sizeof(MeshVertex));
+	return statistics;
+}
+
+void printMeshStatistics(const char * label, const MeshStatistics & statistics)
+{
+	printf("%-8s ACMR %.3f  ATVR %.3f  overdraw %.3f  overfetch %.3f\n", label,
+		statistics.acmr, statistics.atvr, statistics.overdraw, statistics.overfetch);
+}
+
+/* Tipsify */
+
+void optimizeVertexCache(
+	std::vector<unsigned int> & indices,
+	size_t vertexCount,
+	std::vector<unsigned int> * out_clusters
+){
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Triangles around each vertex
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		liveTriangles[indices[i]]++;
+	std::vector<unsigned int> firstAdjacent(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		firstAdjacent[v + 1] = firstAdjacent[v] + liveTriangles[v];
+	std::vector<unsigned int> adjacent(triangleCount * 3);
+	std::vector<unsigned int> filled(firstAdjacent.begin(), firstAdjacent.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		adjacent[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<unsigned int> deadEnds, candidates;
+	std::vector<unsigned int> result;
+	result.reserve(triangleCount * 3);
+
+	unsigned int time = VERTEX_CACHE_SIZE + 1;
+	size_t cursor = 0;
+	long fanning = indices[0];
+	bool newCluster = true;
+
+	while (fanning >= 0) {
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (unsigned int a = firstAdjacent[fanning]; a < firstAdjacent[fanning + 1]; a++) {
+			unsigned int t = adjacent[a];
+			if (emitted[t])
+				continue;
+			if (newCluster && out_clusters)
+				out_clusters->push_back((unsigned int)(result.size() / 3));
+			newCluster = false;
+
+			for (int c = 0; c < 3; c++) {
+				unsigned int v = indices[t * 3 + c];
+				result.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > VERTEX_CACHE_SIZE)
+					cacheTime[v] = time++;
+			}
+			emitted[t] = 1;
+		}
+
+		// Next fanning vertex : the oldest candidate that will still be in the
+		// cache once its remaining triangles are emitted
+		long next = -1;
+		int bestPriority = -1;
+		for (size_t i = 0; i < candidates.size(); i++) {
+			unsigned int v = candidates[i];
+			if (liveTriangles[v] == 0)
+				continue;
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= VERTEX_CACHE_SIZE)
+				priority = time - cacheTime[v];
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		// Dead end : go back to a recent vertex that still has triangles, or
+		// failing that to any vertex that does
+		if (next < 0) {
+			newCluster = true;
+			while (!deadEnds.empty() && next < 0) {
+				unsigned int v = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveTriangles[v] > 0)
+					next = v;
+			}
+			while (next < 0 && cursor < vertexCount) {
+				if (liveTriangles[cursor] > 0)
+					next = (long)cursor;
+				else
+					cursor++;
+			}
+		}
+		fanning = next;
+	}
+
+	indices.swap(result);
+}
+
+/* Overdraw */
+
+struct Cluster {
+	unsigned int firstTriangle, triangleCount;
+	float sortKey;
+};
+
+void optimizeOverdraw(
+	std::vector<unsigned int> & indices,
+	const std::vector<MeshVertex> & vertices,
+	const std::vector<unsigned int> & clusters,
+	float threshold
+){
+	unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+	if (triangleCount == 0)
+		return;
+
+	std::vector<unsigned int> hard(clusters);
+	if (hard.empty() || hard[0] != 0)
+		hard.insert(hard.begin(), 0);
+	hard.push_back(triangleCount);
+
+	// Cut each cluster wherever the triangles so far transform about as few
+	// vertices per triangle as the whole cluster : reordering the pieces then
+	// costs next to nothing in cache efficiency
+	std::vector<Cluster> pieces;
+	VertexCacheSimulator cache(vertices.size(), VERTEX_CACHE_SIZE);
+	for (size_t h = 0; h + 1 < hard.size(); h++) {
+		unsigned int begin = hard[h], end = hard[h + 1];
+		if (begin == end)
+			continue;
+
+		cache.flush();
+		unsigned int misses = 0;
+		for (unsigned int i = begin * 3; i < end * 3; i++)
+			misses += cache.access(indices[i]);
+		float clusterAcmr = (float)misses / (end - begin);
+
+		cache.flush();
+		Cluster piece = { begin, 0, 0.0f };
+		misses = 0;
+		for (unsigned int t = begin; t < end; t++) {
+			for (int c = 0; c < 3; c++)
+				misses += cache.access(indices[t * 3 + c]);
+			piece.triangleCount++;
+			if (t + 1 < end && misses <= threshold * clusterAcmr * piece.triangleCount) {
+				pieces.push_back(piece);
+				piece.firstTriangle = t + 1;
+				piece.triangleCount = 0;
+				misses = 0;
+				cache.flush();
+			}
+		}
+		pieces.push_back(piece);
+	}
+
+	// Area weighted center of the mesh
+	glm::vec3 meshCenter(0.0f);
+	float meshArea = 0.0f;
+	for (unsigned int t = 0; t < triangleCount; t++) {
+		glm::vec3 a = trianglePosition(indices, vertices, t, 0);
+		glm::vec3 b = trianglePosition(indices, vertices, t, 1);
+		glm::vec3 c = trianglePosition(indices, vertices, t, 2);
+		float area = glm::length(glm::cross(b - a, c - a));
+		meshCenter += (a + b + c) * (area / 3.0f);
+		meshArea += area;
+	}
+	if (meshArea > 0.0f)
+		meshCenter /= meshArea;
+
+	// Clusters whose average normal points away from the center go first
+	for (size_t p = 0; p < pieces.size(); p++) {
+		glm::vec3 center(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (unsigned int t = pieces[p].firstTriangle; t < pieces[p].firstTriangle + pieces[p].triangleCount; t++) {
+			glm::vec3 a = trianglePosition(indices, vertices, t, 0);
+			glm::vec3 b = trianglePosition(indices, vertices, t, 1);
+			glm::vec3 c = trianglePosition(indices, vertices, t, 2);
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float triangleArea = glm::length(n);
+			center += (a + b + c) * (triangleArea / 3.0f);
+			normal += n;
+			area += triangleArea;
+		}
+		if (area > 0.0f)
+			center /= area;
+		float length = glm::length(normal);
+		pieces[p].sortKey = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+	}
+
+	std::stable_sort(pieces.begin(), pieces.end(), [](const Cluster & a, const Cluster & b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t p = 0; p < pieces.size(); p++) {
+		result.insert(result.end(), indices.begin() + pieces[p].firstTriangle * 3,
+			indices.begin() + (pieces[p].firstTriangle + pieces[p].triangleCount) * 3);
+	}
+	indices.swap(result);
+}
+
+/* Vertex fetch */
+
+void optimizeVertexFetch(
+	std::vector<unsigned int> & indices,
+	std::vector<MeshVertex> & vertices
+){
+	const unsigned int unused = ~0u;
+	std::vector<unsigned int> remap(vertices.size(), unused);
+	std::vector<MeshVertex> result;
+	result.reserve(vertices.size());
+
+	for (size_t i = 0; i < indices.size(); i++) {
+		unsigned int & newIndex = remap[indices[i]];
+		if (newIndex == unused) {
+			newIndex = (unsigned int)result.size();
+			result.push_back(vertices[indices[i]]);
+		}
+		indices[i] = newIndex;
+	}
+
+	// Vertices no triangle uses are dropped
+	vertices.swap(result);
+}
+
+void optimizeMesh(
+	std::vector<unsigned int> & indices,
+	std::vector<MeshVertex> & vertices,
+	MeshStatistics * out_before,
+	MeshStatistics * out_after
+){
+	if (out_before)
+		*out_before = analyzeMesh(indices, vertices);
+
+	std::vector<unsigned int> clusters;
+	optimizeVertexCache(indices, vertices.size(), &clusters);
+	optimizeOverdraw(indices, vertices, clusters, OVERDRAW_CACHE_THRESHOLD);
+	optimizeVertexFetch(indices, vertices);
+
+	if (out_after)
+		*out_after = analyzeMesh(indices, vertices);
+}
@@ -0,0 +1,64 @@
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+// Size of the FIFO post-transform cache the optimizer targets and simulates
+#define VERTEX_CACHE_SIZE 16
+
+// How much worse than the whole cluster's ACMR a piece of a cluster may be
+// before the overdraw pass stops cutting it into smaller clusters
+#define OVERDRAW_CACHE_THRESHOLD 1.05f
+
+// How well a mesh's triangle and vertex order suit the GPU
+struct MeshStatistics {
+	float acmr;      // Vertices transformed per triangle, lower is better
+	float atvr;      // Vertices transformed per vertex, 1 is ideal
+	float overdraw;  // Fragments shaded per covered pixel, 1 is ideal
+	float overfetch; // Vertex bytes fetched per byte of vertex data, 1 is ideal
+};
+
+// Simulates the post-transform cache, the vertex fetch cache and a depth
+// tested rasterization of the mesh from the six axis directions.
+MeshStatistics analyzeMesh(
+	const std::vector<unsigned int> & indices,
+	const std::vector<MeshVertex> & vertices
+);
+
+void printMeshStatistics(const char * label, const MeshStatistics & statistics);
+
+// Reorders the triangles for post-transform cache reuse with Tipsify (Sander,
+// Nehab and Barczak 2007). Every time Tipsify reaches a dead end the cache is
+// cold again; the triangle where each of those clusters starts is appended to
+// out_clusters when it is not NULL.
+void optimizeVertexCache(
+	std::vector<unsigned int> & indices,
+	size_t vertexCount,
+	std::vector<unsigned int> * out_clusters
+);
+
+// Cuts the clusters of optimizeVertexCache() where the cache has warmed up
+// again, then draws the clusters that face away from the center of the mesh
+// first, since they are the most likely to hide the rest of it.
+void optimizeOverdraw(
+	std::vector<unsigned int> & indices,
+	const std::vector<MeshVertex> & vertices,
+	const std::vector<unsigned int> & clusters,
+	float threshold
+);
+
+// Renumbers the vertices in the order the triangles first use them, so that
+// vertex fetch walks through memory instead of jumping around.
+void optimizeVertexFetch(
+	std::vector<unsigned int> & indices,
+	std::vector<MeshVertex> & vertices
+);
+
+// Runs the three passes above. out_before and out_after receive the
+// statistics when they are not NULL.
+void optimizeMesh(
+	std::vector<unsigned int> & indices,
+	std::vector<MeshVertex> & vertices,
+	MeshStatistics * out_before,
+	MeshStatistics * out_after
+);
+
+#endif
@@ -0,0 +1,179 @@
+#include <vector>
+#include <stddef.h> // for offsetof
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "gpuresources.hpp"
+#include "meshpool.hpp"
+
+MeshPool::MeshPool() : vao(0), vertexBuffer(0), indexBuffer(0),
+	vertexCapacity(0), indexCapacity(0), vertexCount(0), indexCount(0)
+{
+}
+
+void MeshPool::create(GLsizeiptr vertices, GLsizeiptr indices)
+{
+	vertexCapacity = vertices;
+	indexCapacity = indices;
+
+	vao = GPU_CREATE(GPU_VERTEX_ARRAY, GPU_MEMORY_OTHER, "Mesh pool");
+	glBindVertexArray(vao);
+
+	vertexBuffer = GPU_CREATE(GPU_BUFFER, GPU_MEMORY_GEOMETRY, "Mesh vertices");
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(MeshVertex), NULL, GL_STATIC_DRAW);
+	gpuResources.setSize(GPU_BUFFER, vertexBuffer, vertexCapacity * sizeof(MeshVertex), GL_NONE);
+
+	// The element buffer binding is part of the vertex array state
+	indexBuffer = GPU_CREATE(GPU_BUFFER, GPU_MEMORY_GEOMETRY, "Mesh indices");
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+	gpuResources.setSize(GPU_BUFFER, indexBuffer, indexCapacity * sizeof(unsigned int), GL_NONE);
+
+	glEnableVertexAttribArray(MESH_POSITION_ATTRIBUTE);
+	glVertexAttribPointer(MESH_POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, position));
+	glEnableVertexAttribArray(MESH_UV_ATTRIBUTE);
+	glVertexAttribPointer(MESH_UV_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, uv));
+	glEnableVertexAttribArray(MESH_NORMAL_ATTRIBUTE);
+	glVertexAttribPointer(MESH_NORMAL_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, normal));
+	glEnableVertexAttribArray(MESH_TANGENT_ATTRIBUTE);
+	glVertexAttribPointer(MESH_TANGENT_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, tangent));
+
+	// Per-object attributes advance once per instance, and the draw's base
+	// instance picks which object a draw reads
+	for (int column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(OBJECT_MODEL_ATTRIBUTE + column);
+		glVertexAttribDivisor(OBJECT_MODEL_ATTRIBUTE + column, 1);
+	}
+	glEnableVertexAttribArray(OBJECT_MATERIAL_ATTRIBUTE);
+	glVertexAttribDivisor(OBJECT_MATERIAL_ATTRIBUTE, 1);
+
+	glBindVertexArray(0);
+}
+
+void MeshPool::destroy()
+{
+	gpuResources.destroy(GPU_BUFFER, vertexBuffer);
+	gpuResources.destroy(GPU_BUFFER, indexBuffer);
+	gpuResources.destroy(GPU_VERTEX_ARRAY, vao);
+	vertexCount = indexCount = 0;
+	meshes.clear();
+}
+
+void MeshPool::grow(GLuint & buffer, GLenum target, GLsizeiptr usedBytes, GLsizeiptr & capacityBytes, GLsizeiptr neededBytes)
+{
+	// A pool created empty starts from what is needed
+	GLsizeiptr newCapacity = capacityBytes > 0 ? capacityBytes * 2 : neededBytes;
+	while (newCapacity < neededBytes)
+		newCapacity *= 2;
+
+	// Move what was already uploaded into the bigger buffer on the GPU
+	GLuint newBuffer = GPU_CREATE(GPU_BUFFER, GPU_MEMORY_GEOMETRY, target == GL_ARRAY_BUFFER ? "Mesh vertices" : "Mesh indices");
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, NULL, GL_STATIC_DRAW);
+	gpuResources.setSize(GPU_BUFFER, newBuffer, newCapacity, GL_NONE);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+	gpuResources.destroy(GPU_BUFFER, buffer);
+	buffer = newBuffer;
+	capacityBytes = newCapacity;
+
+	glBindVertexArray(vao);
+	if (target == GL_ARRAY_BUFFER) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glVertexAttribPointer(MESH_POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, position));
+		glVertexAttribPointer(MESH_UV_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, uv));
+		glVertexAttribPointer(MESH_NORMAL_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, normal));
+		glVertexAttribPointer(MESH_TANGENT_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, tangent));
+	}
+	else {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+	}
+	glBindVertexArray(0);
+}
+
+static void computeBounds(const std::vector<MeshVertex> & vertices, MeshRange & range)
+{
+	range.boundsMin = range.boundsMax = vertices.empty() ? glm::vec3(0.0f) : vertices[0].position;
+	for (size_t i = 1; i < vertices.size(); i++) {
+		range.boundsMin = glm::min(range.boundsMin, vertices[i].position);
+		range.boundsMax = glm::max(range.boundsMax, vertices[i].position);
+	}
+}
+
+int MeshPool::addMesh(const std::vector<MeshVertex> & vertices, const std::vector<unsigned int> & indices)
+{
+	if (vertexCount + (GLsizeiptr)vertices.size() > vertexCapacity) {
+		GLsizeiptr capacityBytes = vertexCapacity * sizeof(MeshVertex);
+		grow(vertexBuffer, GL_ARRAY_BUFFER, vertexCount * sizeof(MeshVertex), capacityBytes, (vertexCount + vertices.size()) * sizeof(MeshVertex));
+		vertexCapacity = capacityBytes / sizeof(MeshVertex);
+	}
+	if (indexCount + (GLsizeiptr)indices.size() > indexCapacity) {
+		GLsizeiptr capacityBytes = indexCapacity * sizeof(unsigned int);
+		grow(indexBuffer, GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), capacityBytes, (indexCount + indices.size()) * sizeof(unsigned int));
+		indexCapacity = capacityBytes / sizeof(unsigned int);
+	}
+
+	MeshRange range;
+	range.firstIndex = (GLuint)indexCount;
+	range.indexCount = (GLuint)indices.size();
+	range.baseVertex = (GLint)vertexCount;
+	range.vertexCount = (GLuint)vertices.size();
+	computeBounds(vertices, range);
+
+	// Indices stay relative to the mesh, baseVertex offsets them at draw time
+	if (!vertices.empty()) {
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, vertexCount * sizeof(MeshVertex), vertices.size() * sizeof(MeshVertex), vertices.data());
+	}
+	if (!indices.empty()) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+	}
+
+	vertexCount += vertices.size();
+	indexCount += indices.size();
+	meshes.push_back(range);
+	return (int)meshes.size() - 1;
+}
+
+bool MeshPool::updateMesh(int id, const std::vector<MeshVertex> & vertices, const std::vector<unsigned int> & indices)
+{
+	MeshRange & range = meshes[id];
+	if (vertices.empty() || vertices.size() != range.vertexCount || indices.size() != range.indexCount)
+		return false;
+
+	computeBounds(vertices, range);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, range.baseVertex * sizeof(MeshVertex), vertices.size() * sizeof(MeshVertex), vertices.data());
+	if (!indices.empty()) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstIndex * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+	}
+	return true;
+}
+
+void MeshPool::setObjectDivisor(GLuint instancesPerObject)
+{
+	glBindVertexArray(vao);
+	for (int column = 0; column < 4; column++)
+		glVertexAttribDivisor(OBJECT_MODEL_ATTRIBUTE + column, instancesPerObject);
+	glVertexAttribDivisor(OBJECT_MATERIAL_ATTRIBUTE, instancesPerObject);
+	glBindVertexArray(0);
+}
+
+void MeshPool::bindObjectBuffer(GLuint objectBuffer, GLintptr offset)
+{
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, objectBuffer);
+	for (int column = 0; column < 4; column++) {
+		glVertexAttribPointer(OBJECT_MODEL_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(ObjectData),
+			(void*)(offset + offsetof(ObjectData, model) + column * sizeof(glm::vec4)));
+	}
+	glVertexAttribPointer(OBJECT_MATERIAL_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(ObjectData),
+		(void*)(offset + offsetof(ObjectData, material)));
+	glBindVertexArray(0);
+}
@@ -0,0 +1,82 @@
+#ifndef MESHPOOL_HPP
+#define MESHPOOL_HPP
+
+// Vertex layout shared by every mesh in the pool
+struct MeshVertex {
+	glm::vec3 position;
+	glm::vec2 uv;
+	glm::vec3 normal;
+	glm::vec4 tangent; // w is the bitangent handedness
+};
+
+// Where a mesh lives inside the shared buffers
+struct MeshRange {
+	GLuint firstIndex;
+	GLuint indexCount;
+	GLint baseVertex;
+	GLuint vertexCount;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
+// Layout of GL_DRAW_INDIRECT_BUFFER entries for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Per-object data fetched through the draw's base instance
+struct ObjectData {
+	glm::mat4 model;
+	glm::vec4 material; // rgb : specular color, a : specular exponent
+};
+
+// Attribute locations, matching StandardShading.vertexshader
+#define MESH_POSITION_ATTRIBUTE 0
+#define MESH_UV_ATTRIBUTE 1
+#define MESH_NORMAL_ATTRIBUTE 2
+#define OBJECT_MODEL_ATTRIBUTE 3 // A mat4 takes locations 3 to 6
+#define OBJECT_MATERIAL_ATTRIBUTE 7
+#define MESH_TANGENT_ATTRIBUTE 8
+
+// Sub-allocates static meshes into one vertex buffer and one index buffer so
+// that any set of them can be drawn with a single indirect multi-draw.
+class MeshPool {
+public:
+	MeshPool();
+
+	void create(GLsizeiptr vertexCapacity, GLsizeiptr indexCapacity);
+	void destroy();
+
+	// Copies a mesh into the shared buffers and returns its id
+	int addMesh(const std::vector<MeshVertex> & vertices, const std::vector<unsigned int> & indices);
+	// Overwrites a mesh in place. Returns false, leaving the mesh untouched,
+	// when the vertex or index count differs from the one it was added with.
+	bool updateMesh(int id, const std::vector<MeshVertex> & vertices, const std::vector<unsigned int> & indices);
+	const MeshRange & mesh(int id) const { return meshes[id]; }
+	int meshCount() const { return (int)meshes.size(); }
+
+	// Points the per-object attributes of the pool's vertex array at
+	// objectBuffer, starting at byte offset. Called whenever the per-object
+	// data moves.
+	void bindObjectBuffer(GLuint objectBuffer, GLintptr offset);
+	// Instances that share one object's data. Drawing every object once per
+	// viewport pane uses one instance per pane, all reading the same object.
+	void setObjectDivisor(GLuint instancesPerObject);
+
+	GLuint vertexArray() const { return vao; }
+
+private:
+	void grow(GLuint & buffer, GLenum target, GLsizeiptr usedBytes, GLsizeiptr & capacityBytes, GLsizeiptr neededBytes);
+
+	GLuint vao;
+	GLuint vertexBuffer, indexBuffer;
+	GLsizeiptr vertexCapacity, indexCapacity; // In elements
+	GLsizeiptr vertexCount, indexCount;       // In elements
+	std::vector<MeshRange> meshes;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include <vector>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "meshpool.hpp"
+#include "meshoptimizer.hpp"
+#include "tangentspace.hpp"
+#include "vboindexer.hpp"
+#include "meshprocess.hpp"
+
+void processMesh(
+	const std::vector<glm::vec3> & corners,
+	std::vector<glm::vec2> & uvs,
+	float creaseAngle,
+	std::vector<MeshVertex> & out_vertices,
+	std::vector<unsigned int> & out_indices,
+	MeshStatistics * out_before,
+	MeshStatistics * out_after,
+	JobSystem * jobs
+){
+	std::vector<glm::vec3> normals;
+	computeSmoothNormals(corners, creaseAngle, NORMAL_WEIGHT_ANGLE, normals, jobs);
+
+	std::vector<glm::vec3> in_vertices(corners);
+	std::vector<glm::vec3> indexed_vertices, indexed_normals;
+	std::vector<glm::vec2> indexed_uvs;
+	out_indices.clear();
+	indexVBO(in_vertices, uvs, normals, out_indices, indexed_vertices, indexed_uvs, indexed_normals);
+
+	std::vector<glm::vec4> tangents;
+	computeTangents(out_indices, indexed_vertices, indexed_uvs, indexed_normals, tangents, jobs);
+
+	out_vertices.resize(indexed_vertices.size());
+	for (size_t v = 0; v < indexed_vertices.size(); v++) {
+		out_vertices[v].position = indexed_vertices[v];
+		out_vertices[v].uv = indexed_uvs[v];
+		out_vertices[v].normal = indexed_normals[v];
+		out_vertices[v].tangent = tangents[v];
+	}
+
+	optimizeMesh(out_indices, out_vertices, out_before, out_after);
+}
+
+void processIndexedMesh(
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	std::vector<unsigned int> & indices,
+	std::vector<MeshVertex> & out_vertices
+){
+	// Vertices split by the tangents are appended to the copies
+	std::vector<glm::vec3> positions(vertices), splitNormals(normals);
+	std::vector<glm::vec2> splitUVs(uvs);
+	std::vector<glm::vec4> tangents;
+	computeTangents(indices, positions, splitUVs, splitNormals, tangents);
+
+	out_vertices.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); i++) {
+		out_vertices[i].position = positions[i];
+		out_vertices[i].uv = splitUVs[i];
+		out_vertices[i].normal = splitNormals[i];
+		out_vertices[i].tangent = tangents[i];
+	}
+
+	optimizeMesh(indices, out_vertices, NULL, NULL);
+}
@@ -0,0 +1,37 @@
+#ifndef MESHPROCESS_HPP
+#define MESHPROCESS_HPP
+
+class JobSystem;
+
+// Edges sharper than this stay hard when normals are generated
+#define DEFAULT_CREASE_ANGLE 30.0f
+
+// Turns an unindexed, counter-clockwise triangle list with UVs into an
+// indexed mesh ready for the mesh pool : smooth normals with hard edges past
+// creaseAngle (degrees), identical vertices merged, tangents for normal
+// mapping, and triangles and vertices reordered by optimizeMesh().
+// out_before and out_after receive the optimizer statistics when not NULL.
+// Large meshes are processed on the job system's threads when one is given.
+void processMesh(
+	const std::vector<glm::vec3> & corners,
+	std::vector<glm::vec2> & uvs,
+	float creaseAngle,
+	std::vector<MeshVertex> & out_vertices,
+	std::vector<unsigned int> & out_indices,
+	MeshStatistics * out_before,
+	MeshStatistics * out_after,
+	JobSystem * jobs = NULL
+);
+
+// Same as processMesh() for a mesh that is already indexed and has its
+// normals : only the tangents are generated, which may split vertices along
+// UV seams. indices are reordered in place.
+void processIndexedMesh(
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	std::vector<unsigned int> & indices,
+	std::vector<MeshVertex> & out_vertices
+);
+
+#endif
@@ -0,0 +1,114 @@
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "meshpool.hpp"
+#include "objloader.hpp"
+
+// Turns a 1-based or negative (relative to the end) OBJ index into a 0-based
+// one, or -1 when it is out of range
+static int objIndex(int index, size_t count)
+{
+	if (index > 0 && (size_t)index <= count)
+		return index - 1;
+	if (index < 0 && (size_t)-index <= count)
+		return (int)count + index;
+	return -1;
+}
+
+bool loadOBJ(
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs
+){
+	printf("Loading OBJ file %s...\n", path);
+
+	FILE * file = fopen(path, "r");
+	if( file == NULL ){
+		printf("Impossible to open %s.\n", path);
+		return false;
+	}
+
+	std::vector<glm::vec3> temp_vertices;
+	std::vector<glm::vec2> temp_uvs;
+	char line[1024];
+	int lineNumber = 0;
+
+	while( fgets(line, sizeof(line), file) != NULL ){
+		lineNumber++;
+
+		if ( strncmp(line, "v ", 2) == 0 ){
+			glm::vec3 vertex;
+			sscanf(line + 2, "%f %f %f", &vertex.x, &vertex.y, &vertex.z);
+			temp_vertices.push_back(vertex);
+		}else if ( strncmp(line, "vt ", 3) == 0 ){
+			glm::vec2 uv;
+			sscanf(line + 3, "%f %f", &uv.x, &uv.y);
+			temp_uvs.push_back(uv);
+		}else if ( strncmp(line, "f ", 2) == 0 ){
+			// Each corner is v, v/vt, v//vn or v/vt/vn
+			int vertexIndices[64], uvIndices[64];
+			int cornerCount = 0;
+			char * token = strtok(line + 2, " \t\r\n");
+			while( token != NULL && cornerCount < 64 ){
+				int v = 0, vt = 0;
+				if ( sscanf(token, "%d/%d", &v, &vt) < 1 )
+					break;
+				vertexIndices[cornerCount] = objIndex(v, temp_vertices.size());
+				uvIndices[cornerCount] = objIndex(vt, temp_uvs.size());
+				if ( vertexIndices[cornerCount] < 0 ){
+					printf("%s:%d : vertex index out of range\n", path, lineNumber);
+					fclose(file);
+					return false;
+				}
+				cornerCount++;
+				token = strtok(NULL, " \t\r\n");
+			}
+
+			for( int i = 2; i < cornerCount; i++ ){
+				int corners[3] = { 0, i - 1, i };
+				for( int c = 0; c < 3; c++ ){
+					out_vertices.push_back(temp_vertices[vertexIndices[corners[c]]]);
+					out_uvs.push_back(uvIndices[corners[c]] >= 0 ? temp_uvs[uvIndices[corners[c]]] : glm::vec2(0.0f));
+				}
+			}
+		}
+		// Anything else (normals, groups, materials, comments) is skipped
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool saveOBJ(
+	const char * path,
+	const std::vector<MeshVertex> & vertices,
+	const std::vector<unsigned int> & indices
+){
+	FILE * file = fopen(path, "w");
+	if( file == NULL ){
+		printf("Impossible to write %s.\n", path);
+		return false;
+	}
+
+	for( size_t i = 0; i < vertices.size(); i++ )
+		fprintf(file, "v %f %f %f\n", vertices[i].position.x, vertices[i].position.y, vertices[i].position.z);
+	for( size_t i = 0; i < vertices.size(); i++ )
+		fprintf(file, "vt %f %f\n", vertices[i].uv.x, vertices[i].uv.y);
+	for( size_t i = 0; i < vertices.size(); i++ )
+		fprintf(file, "vn %f %f %f\n", vertices[i].normal.x, vertices[i].normal.y, vertices[i].normal.z);
+	for( size_t i = 0; i + 2 < indices.size(); i += 3 ){
+		fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n",
+			indices[i] + 1, indices[i] + 1, indices[i] + 1,
+			indices[i + 1] + 1, indices[i + 1] + 1, indices[i + 1] + 1,
+			indices[i + 2] + 1, indices[i + 2] + 1, indices[i + 2] + 1);
+	}
+
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,20 @@
+#ifndef OBJLOADER_HPP
+#define OBJLOADER_HPP
+
+// Reads the v, vt and f lines of a Wavefront OBJ file into an unindexed
+// triangle list. Polygons are split into fans and UVs missing from the file
+// are zero. Normals are not read, the mesh processing generates them.
+bool loadOBJ(
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs
+);
+
+// Writes an indexed mesh, keeping its vertex and triangle order
+bool saveOBJ(
+	const char * path,
+	const std::vector<MeshVertex> & vertices,
+	const std::vector<unsigned int> & indices
+);
+
+#endif
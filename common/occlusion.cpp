@@ -0,0 +1,285 @@
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "gpuresources.hpp"
+#include "trace.hpp"
+#include "occlusion.hpp"
+
+// Texels of level 0 covered by a pane, [x0, x1) x [y0, y1)
+static void paneTexels(const glm::vec4 & rect, int & x0, int & y0, int & x1, int & y1)
+{
+	x0 = (int)floorf(rect.x * HIZ_WIDTH + 0.5f);
+	y0 = (int)floorf(rect.y * HIZ_HEIGHT + 0.5f);
+	x1 = (int)floorf((rect.x + rect.z) * HIZ_WIDTH + 0.5f);
+	y1 = (int)floorf((rect.y + rect.w) * HIZ_HEIGHT + 0.5f);
+}
+
+static bool samePanes(const glm::vec4 * a, const glm::vec4 * b, int count)
+{
+	return memcmp(a, b, count * sizeof(glm::vec4)) == 0;
+}
+
+OcclusionCuller::OcclusionCuller() : current(0), frame(0), hasSource(false), paneCount(0), ready(false), prepareMs(0.0), age(0)
+{
+	for (int i = 0; i < HIZ_READBACK_FRAMES; i++) {
+		slots[i].buffer = 0;
+		slots[i].fence = 0;
+	}
+}
+
+void OcclusionCuller::create()
+{
+	for (int i = 0; i < HIZ_READBACK_FRAMES; i++) {
+		slots[i].buffer = GPU_CREATE(GPU_BUFFER, GPU_MEMORY_STREAMING, "Occlusion readback");
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[i].buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, HIZ_WIDTH * HIZ_HEIGHT * sizeof(float), NULL, GL_STREAM_READ);
+		gpuResources.setSize(GPU_BUFFER, slots[i].buffer, HIZ_WIDTH * HIZ_HEIGHT * sizeof(float), GL_NONE);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	source.resize(HIZ_WIDTH * HIZ_HEIGHT);
+
+	// Halved, rounding up, down to a single texel
+	Level level = { HIZ_WIDTH, HIZ_HEIGHT, std::vector<float>() };
+	levels.clear();
+	while (true) {
+		level.depth.resize(level.width * level.height);
+		levels.push_back(level);
+		if (level.width == 1 && level.height == 1)
+			break;
+		level.width = (level.width + 1) / 2;
+		level.height = (level.height + 1) / 2;
+	}
+}
+
+void OcclusionCuller::destroy()
+{
+	for (int i = 0; i < HIZ_READBACK_FRAMES; i++) {
+		if (slots[i].fence)
+			glDeleteSync(slots[i].fence);
+		slots[i].fence = 0;
+		gpuResources.destroy(GPU_BUFFER, slots[i].buffer);
+	}
+	hasSource = false;
+	ready = false;
+}
+
+void OcclusionCuller::capture(const glm::mat4 * cameras, const glm::vec4 * paneRects, int count)
+{
+	Readback & slot = slots[current];
+	// Still not collected a whole ring later : the GPU is far behind, drop it
+	if (slot.fence)
+		glDeleteSync(slot.fence);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glReadPixels(0, 0, HIZ_WIDTH, HIZ_HEIGHT, GL_RED, GL_FLOAT, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	slot.frame = frame++;
+	slot.paneCount = count < HIZ_MAX_PANES ? count : HIZ_MAX_PANES;
+	for (int pane = 0; pane < slot.paneCount; pane++) {
+		slot.viewProjections[pane] = cameras[pane];
+		slot.rects[pane] = paneRects[pane];
+	}
+	current = (current + 1) % HIZ_READBACK_FRAMES;
+}
+
+void OcclusionCuller::collect()
+{
+	// From the newest readback to the oldest, the first finished one wins and
+	// the ones before it are stale
+	bool found = false;
+	for (int back = 1; back <= HIZ_READBACK_FRAMES; back++) {
+		Readback & slot = slots[(current - back + HIZ_READBACK_FRAMES) % HIZ_READBACK_FRAMES];
+		if (!slot.fence)
+			continue;
+		if (found) {
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+			continue;
+		}
+		GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+			continue;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+		if (status == GL_WAIT_FAILED)
+			continue;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		const float * depth = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, HIZ_WIDTH * HIZ_HEIGHT * sizeof(float), GL_MAP_READ_BIT);
+		if (depth) {
+			memcpy(&source[0], depth, HIZ_WIDTH * HIZ_HEIGHT * sizeof(float));
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			sourceInfo = slot;
+			hasSource = true;
+			found = true;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+}
+
+bool OcclusionCuller::prepare(const glm::mat4 * cameras, const glm::vec4 * paneRects, int count)
+{
+	TRACE_SCOPE("Occlusion prepare");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	collect();
+	paneCount = count < HIZ_MAX_PANES ? count : HIZ_MAX_PANES;
+	for (int pane = 0; pane < paneCount; pane++) {
+		viewProjections[pane] = cameras[pane];
+		rects[pane] = paneRects[pane];
+	}
+	// A different layout drew the old depth
+	ready = hasSource && sourceInfo.paneCount == paneCount && samePanes(sourceInfo.rects, rects, paneCount);
+	if (ready) {
+		reproject();
+		buildPyramid();
+		age = frame - sourceInfo.frame;
+	}
+
+	prepareMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return ready;
+}
+
+void OcclusionCuller::reproject()
+{
+	// -1 marks texels nothing landed on
+	std::vector<float> & target = levels[0].depth;
+	std::fill(target.begin(), target.end(), -1.0f);
+
+	for (int pane = 0; pane < paneCount; pane++) {
+		const glm::vec4 & rect = rects[pane];
+		int x0, y0, x1, y1;
+		paneTexels(rect, x0, y0, x1, y1);
+		// From the old normalized device coordinates straight to the new clip space
+		glm::mat4 reprojection = viewProjections[pane] * glm::inverse(sourceInfo.viewProjections[pane]);
+		float toTexelX = rect.z * HIZ_WIDTH * 0.5f, toTexelY = rect.w * HIZ_HEIGHT * 0.5f;
+
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				float depth = source[y * HIZ_WIDTH + x];
+				float z = depth * 2.0f - 1.0f;
+
+				// Where the texel's corners land now, at the texel's depth
+				float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, farthest = -1e30f;
+				bool behind = false;
+				for (int corner = 0; corner < 4; corner++) {
+					float cornerX = (float)(x + (corner & 1)) - x0, cornerY = (float)(y + (corner >> 1)) - y0;
+					glm::vec4 clip = reprojection * glm::vec4(cornerX / toTexelX - 1.0f, cornerY / toTexelY - 1.0f, z, 1.0f);
+					if (clip.w <= 1e-5f) {
+						behind = true;
+						break;
+					}
+					glm::vec3 ndc = glm::vec3(clip) / clip.w;
+					minX = glm::min(minX, ndc.x);
+					maxX = glm::max(maxX, ndc.x);
+					minY = glm::min(minY, ndc.y);
+					maxY = glm::max(maxY, ndc.y);
+					farthest = glm::max(farthest, ndc.z);
+				}
+				// Behind the new camera, the texel says nothing about what is seen now
+				if (behind)
+					continue;
+
+				// Texels of the pane the rectangle overlaps, edges excluded
+				int tx0 = glm::max(x0, x0 + (int)floorf((minX + 1.0f) * toTexelX + 1e-3f));
+				int tx1 = glm::min(x1 - 1, x0 + (int)ceilf((maxX + 1.0f) * toTexelX - 1e-3f) - 1);
+				int ty0 = glm::max(y0, y0 + (int)floorf((minY + 1.0f) * toTexelY + 1e-3f));
+				int ty1 = glm::min(y1 - 1, y0 + (int)ceilf((maxY + 1.0f) * toTexelY - 1e-3f) - 1);
+				// Stretched across much of the view, a grazing surface : leave it out
+				if (tx1 - tx0 > HIZ_WIDTH / 4 || ty1 - ty0 > HIZ_HEIGHT / 4)
+					continue;
+				float value = glm::clamp(farthest * 0.5f + 0.5f, 0.0f, 1.0f);
+				for (int ty = ty0; ty <= ty1; ty++) {
+					float * row = &target[ty * HIZ_WIDTH];
+					for (int tx = tx0; tx <= tx1; tx++)
+						row[tx] = glm::max(row[tx], value);
+				}
+			}
+		}
+	}
+
+	// Holes are empty, nothing hides behind them
+	for (size_t i = 0; i < target.size(); i++) {
+		if (target[i] < 0.0f)
+			target[i] = 1.0f;
+	}
+}
+
+void OcclusionCuller::buildPyramid()
+{
+	for (size_t l = 1; l < levels.size(); l++) {
+		const Level & fine = levels[l - 1];
+		Level & coarse = levels[l];
+		for (int y = 0; y < coarse.height; y++) {
+			const float * row0 = &fine.depth[(y * 2) * fine.width];
+			const float * row1 = &fine.depth[glm::min(y * 2 + 1, fine.height - 1) * fine.width];
+			for (int x = 0; x < coarse.width; x++) {
+				int x0 = x * 2, x1 = glm::min(x * 2 + 1, fine.width - 1);
+				coarse.depth[y * coarse.width + x] = glm::max(glm::max(row0[x0], row0[x1]), glm::max(row1[x0], row1[x1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::occluded(int pane, const glm::vec3 & boxMin, const glm::vec3 & boxMax, float * out_coverage) const
+{
+	if (out_coverage)
+		*out_coverage = 0.0f;
+	if (!ready || pane >= paneCount)
+		return false;
+
+	float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1e30f;
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 position((corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z);
+		glm::vec4 clip = viewProjections[pane] * glm::vec4(position, 1.0f);
+		// Reaches behind the camera
+		if (clip.w <= 1e-5f)
+			return false;
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		minX = glm::min(minX, ndc.x);
+		maxX = glm::max(maxX, ndc.x);
+		minY = glm::min(minY, ndc.y);
+		maxY = glm::max(maxY, ndc.y);
+		nearest = glm::min(nearest, ndc.z);
+	}
+	minX = glm::max(minX, -1.0f);
+	minY = glm::max(minY, -1.0f);
+	maxX = glm::min(maxX, 1.0f);
+	maxY = glm::min(maxY, 1.0f);
+	if (minX >= maxX || minY >= maxY)
+		return false;
+	if (out_coverage)
+		*out_coverage = (maxX - minX) * (maxY - minY) * 0.25f;
+
+	const glm::vec4 & rect = rects[pane];
+	int x0, y0, x1, y1;
+	paneTexels(rect, x0, y0, x1, y1);
+	float toTexelX = rect.z * HIZ_WIDTH * 0.5f, toTexelY = rect.w * HIZ_HEIGHT * 0.5f;
+	int tx0 = glm::max(x0, x0 + (int)floorf((minX + 1.0f) * toTexelX));
+	int tx1 = glm::min(x1 - 1, x0 + (int)floorf((maxX + 1.0f) * toTexelX));
+	int ty0 = glm::max(y0, y0 + (int)floorf((minY + 1.0f) * toTexelY));
+	int ty1 = glm::min(y1 - 1, y0 + (int)floorf((maxY + 1.0f) * toTexelY));
+
+	// The level where the rectangle spans at most two texels each way
+	int span = glm::max(tx1 - tx0, ty1 - ty0) + 1;
+	int l = 0;
+	while ((1 << l) < span && l + 1 < (int)levels.size())
+		l++;
+	const Level & level = levels[l];
+	float farthest = 0.0f;
+	for (int y = ty0 >> l; y <= (ty1 >> l); y++) {
+		for (int x = tx0 >> l; x <= (tx1 >> l); x++)
+			farthest = glm::max(farthest, level.depth[y * level.width + x]);
+	}
+	return nearest * 0.5f + 0.5f > farthest;
+}
@@ -0,0 +1,93 @@
+#ifndef OCCLUSION_HPP
+#define OCCLUSION_HPP
+
+#include <vector>
+
+// Size of the depth the culler reads back. Each texel holds the farthest
+// depth of the scene pixels under it; pane edges at halves of the region
+// fall on texel edges.
+#define HIZ_WIDTH 128
+#define HIZ_HEIGHT 80
+
+// Frames a readback stays in flight before its result is used, so the CPU
+// never waits for the GPU
+#define HIZ_READBACK_FRAMES 3
+#define HIZ_MAX_PANES 4
+
+// Occlusion culling against the depth buffer of a past frame. After the
+// scene is drawn, a reduced copy of its depth is read back asynchronously.
+// A few frames later, prepare() reprojects that depth into the current
+// cameras and builds a max-depth pyramid from it; occluded() then tests a
+// box against the pyramid level where its screen rectangle covers at most
+// 2x2 texels.
+//
+// The test is conservative : each texel of the old depth is splatted over
+// the rectangle its corners reproject to, keeping the farthest depth, and
+// whatever no texel lands on counts as empty, as do the parts of the view
+// the old frame did not see. An object can only be hidden by what was drawn
+// a few frames ago, so one that was culled wrongly reappears once the depth
+// catches up.
+//
+// Panes are rectangles of the region, as fractions of it; each pane is
+// reprojected with its own camera.
+class OcclusionCuller {
+public:
+	OcclusionCuller();
+
+	void create();
+	void destroy();
+
+	// Queues the readback of the HIZ_WIDTH x HIZ_HEIGHT single float color
+	// target bound for reading. The cameras are those the depth was drawn with.
+	void capture(const glm::mat4 * viewProjections, const glm::vec4 * paneRects, int paneCount);
+
+	// Takes the newest readback the GPU has finished, without waiting, and
+	// reprojects it into the given cameras. Returns false, and nothing is
+	// occluded, until a readback with the same panes arrived.
+	bool prepare(const glm::mat4 * viewProjections, const glm::vec4 * paneRects, int paneCount);
+
+	// True when the world space box is hidden in the pane. out_coverage, when
+	// not NULL, receives the part of the pane the box's screen rectangle covers.
+	bool occluded(int pane, const glm::vec3 & boxMin, const glm::vec3 & boxMax, float * out_coverage) const;
+
+	// Time prepare() took, and frames between the depth used and this one
+	double prepareMilliseconds() const { return prepareMs; }
+	int depthAge() const { return age; }
+
+private:
+	struct Readback {
+		GLuint buffer;
+		GLsync fence; // 0 when nothing is in flight
+		int frame;
+		glm::mat4 viewProjections[HIZ_MAX_PANES];
+		glm::vec4 rects[HIZ_MAX_PANES];
+		int paneCount;
+	};
+	struct Level {
+		int width, height;
+		std::vector<float> depth;
+	};
+
+	void collect();
+	void reproject();
+	void buildPyramid();
+
+	Readback slots[HIZ_READBACK_FRAMES];
+	int current, frame;
+
+	// Newest depth read back, and the cameras it was drawn with
+	std::vector<float> source;
+	Readback sourceInfo;
+	bool hasSource;
+
+	// Cameras of the last prepare() and the pyramid built for them
+	glm::mat4 viewProjections[HIZ_MAX_PANES];
+	glm::vec4 rects[HIZ_MAX_PANES];
+	int paneCount;
+	std::vector<Level> levels;
+	bool ready;
+	double prepareMs;
+	int age;
+};
+
+#endif
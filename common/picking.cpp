@@ -0,0 +1,221 @@
+#include <vector>
+#include <algorithm>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PICKING_SSE2 1
+#endif
+
+#include "scenegraph.hpp"
+#include "picking.hpp"
+
+// Deeper than any tree of a mesh that fits in 32 bit indices
+#define BVH_STACK_SIZE 64
+
+// Smallest determinant of a triangle still tested, the ray is parallel below
+#define PICKING_EPSILON 1e-12f
+
+void rayFromClip(const glm::mat4 & viewProjection, const glm::vec2 & ndc, glm::vec3 & out_origin, glm::vec3 & out_direction)
+{
+	glm::mat4 inverse = glm::inverse(viewProjection);
+	glm::vec4 nearPoint = inverse * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverse * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+	out_origin = glm::vec3(nearPoint) / nearPoint.w;
+	out_direction = glm::vec3(farPoint) / farPoint.w - out_origin;
+}
+
+MeshBVH::MeshBVH() : triangles(0)
+{
+}
+
+void MeshBVH::build(const std::vector<glm::vec3> & positions, const std::vector<unsigned int> & indices)
+{
+	triangles = (int)(indices.size() / 3);
+	nodes.clear();
+	packets.clear();
+	if (triangles == 0)
+		return;
+	nodes.reserve(triangles * 2 / BVH_LEAF_TRIANGLES + 1);
+	packets.reserve(triangles / BVH_LEAF_TRIANGLES + 1);
+
+	std::vector<int> order(triangles);
+	std::vector<glm::vec3> centers(triangles);
+	for (int t = 0; t < triangles; t++) {
+		order[t] = t;
+		centers[t] = (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) / 3.0f;
+	}
+	buildNode(positions, indices, order, centers, 0, triangles);
+}
+
+int MeshBVH::buildNode(const std::vector<glm::vec3> & positions, const std::vector<unsigned int> & indices,
+	std::vector<int> & order, const std::vector<glm::vec3> & centers, int begin, int end)
+{
+	int index = (int)nodes.size();
+	nodes.push_back(Node());
+
+	glm::vec3 boundsMin(SCENE_EMPTY_BOUNDS), boundsMax(-SCENE_EMPTY_BOUNDS);
+	glm::vec3 centerMin(SCENE_EMPTY_BOUNDS), centerMax(-SCENE_EMPTY_BOUNDS);
+	for (int i = begin; i < end; i++) {
+		for (int corner = 0; corner < 3; corner++) {
+			const glm::vec3 & p = positions[indices[order[i] * 3 + corner]];
+			boundsMin = glm::min(boundsMin, p);
+			boundsMax = glm::max(boundsMax, p);
+		}
+		centerMin = glm::min(centerMin, centers[order[i]]);
+		centerMax = glm::max(centerMax, centers[order[i]]);
+	}
+	nodes[index].boundsMin = boundsMin;
+	nodes[index].boundsMax = boundsMax;
+
+	if (end - begin <= BVH_LEAF_TRIANGLES) {
+		Packet packet;
+		for (int lane = 0; lane < BVH_LEAF_TRIANGLES; lane++) {
+			glm::vec3 v0(0.0f), e1(0.0f), e2(0.0f);
+			int triangle = -1;
+			if (begin + lane < end) {
+				triangle = order[begin + lane];
+				v0 = positions[indices[triangle * 3]];
+				e1 = positions[indices[triangle * 3 + 1]] - v0;
+				e2 = positions[indices[triangle * 3 + 2]] - v0;
+			}
+			packet.v0x[lane] = v0.x; packet.v0y[lane] = v0.y; packet.v0z[lane] = v0.z;
+			packet.e1x[lane] = e1.x; packet.e1y[lane] = e1.y; packet.e1z[lane] = e1.z;
+			packet.e2x[lane] = e2.x; packet.e2y[lane] = e2.y; packet.e2z[lane] = e2.z;
+			packet.triangle[lane] = triangle;
+		}
+		nodes[index].second = (int)packets.size();
+		nodes[index].leaf = 1;
+		packets.push_back(packet);
+		return index;
+	}
+
+	// Median split along the longest extent of the centers
+	glm::vec3 extent = centerMax - centerMin;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	int middle = (begin + end) / 2;
+	std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+		[&centers, axis](int a, int b) { return centers[a][axis] < centers[b][axis]; });
+
+	buildNode(positions, indices, order, centers, begin, middle);
+	int second = buildNode(positions, indices, order, centers, middle, end);
+	nodes[index].second = second;
+	nodes[index].leaf = 0;
+	return index;
+}
+
+bool MeshBVH::intersect(const glm::vec3 & origin, const glm::vec3 & direction, float & inout_distance, int & out_triangle) const
+{
+	if (nodes.empty())
+		return false;
+
+	glm::vec3 inverseDirection = glm::vec3(1.0f) / direction;
+	float nearest = inout_distance;
+	int hitTriangle = -1;
+
+#ifdef PICKING_SSE2
+	__m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+	__m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	const __m128 epsilon = _mm_set1_ps(PICKING_EPSILON), signBit = _mm_set1_ps(-0.0f);
+#endif
+
+	int stack[BVH_STACK_SIZE];
+	int depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0) {
+		const Node & node = nodes[stack[--depth]];
+		if (rayBoxEntry(origin, inverseDirection, node.boundsMin, node.boundsMax, nearest) < 0.0f)
+			continue;
+
+		if (!node.leaf) {
+			// Visit the nearer child first so the other is more often skipped
+			int first = (int)(&node - &nodes[0]) + 1, second = node.second;
+			float firstEntry = rayBoxEntry(origin, inverseDirection, nodes[first].boundsMin, nodes[first].boundsMax, nearest);
+			float secondEntry = rayBoxEntry(origin, inverseDirection, nodes[second].boundsMin, nodes[second].boundsMax, nearest);
+			if (secondEntry >= 0.0f && (firstEntry < 0.0f || secondEntry < firstEntry)) {
+				std::swap(first, second);
+				std::swap(firstEntry, secondEntry);
+			}
+			if (secondEntry >= 0.0f)
+				stack[depth++] = second;
+			if (firstEntry >= 0.0f)
+				stack[depth++] = first;
+			continue;
+		}
+
+		// Moller-Trumbore on the whole packet
+		const Packet & p = packets[node.second];
+#ifdef PICKING_SSE2
+		__m128 e1x = _mm_loadu_ps(p.e1x), e1y = _mm_loadu_ps(p.e1y), e1z = _mm_loadu_ps(p.e1z);
+		__m128 e2x = _mm_loadu_ps(p.e2x), e2y = _mm_loadu_ps(p.e2y), e2z = _mm_loadu_ps(p.e2z);
+
+		// pvec = direction x e2, det = e1 . pvec
+		__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+		__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+		__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		__m128 valid = _mm_cmpgt_ps(_mm_andnot_ps(signBit, det), epsilon);
+		__m128 inverseDet = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(valid, det), _mm_andnot_ps(valid, one)));
+
+		// u = tvec . pvec, with tvec from the first corner to the origin
+		__m128 tx = _mm_sub_ps(ox, _mm_loadu_ps(p.v0x));
+		__m128 ty = _mm_sub_ps(oy, _mm_loadu_ps(p.v0y));
+		__m128 tz = _mm_sub_ps(oz, _mm_loadu_ps(p.v0z));
+		__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inverseDet);
+
+		// qvec = tvec x e1, v = direction . qvec, t = e2 . qvec
+		__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+		__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+		__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+		__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDet);
+		__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDet);
+
+		valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+		valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+		valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+		valid = _mm_and_ps(valid, _mm_cmpge_ps(t, zero));
+		valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(nearest)));
+		int mask = _mm_movemask_ps(valid);
+		if (!mask)
+			continue;
+
+		float distances[BVH_LEAF_TRIANGLES];
+		_mm_storeu_ps(distances, t);
+		for (int lane = 0; lane < BVH_LEAF_TRIANGLES; lane++) {
+			if ((mask & (1 << lane)) && distances[lane] < nearest) {
+				nearest = distances[lane];
+				hitTriangle = p.triangle[lane];
+			}
+		}
+#else
+		for (int lane = 0; lane < BVH_LEAF_TRIANGLES; lane++) {
+			glm::vec3 e1(p.e1x[lane], p.e1y[lane], p.e1z[lane]), e2(p.e2x[lane], p.e2y[lane], p.e2z[lane]);
+			glm::vec3 pvec = glm::cross(direction, e2);
+			float det = glm::dot(e1, pvec);
+			if (glm::abs(det) <= PICKING_EPSILON)
+				continue;
+			float inverseDet = 1.0f / det;
+			glm::vec3 tvec = origin - glm::vec3(p.v0x[lane], p.v0y[lane], p.v0z[lane]);
+			float u = glm::dot(tvec, pvec) * inverseDet;
+			glm::vec3 qvec = glm::cross(tvec, e1);
+			float v = glm::dot(direction, qvec) * inverseDet;
+			float t = glm::dot(e2, qvec) * inverseDet;
+			if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < nearest) {
+				nearest = t;
+				hitTriangle = p.triangle[lane];
+			}
+		}
+#endif
+	}
+
+	if (hitTriangle < 0)
+		return false;
+	inout_distance = nearest;
+	out_triangle = hitTriangle;
+	return true;
+}
@@ -0,0 +1,59 @@
+#ifndef PICKING_HPP
+#define PICKING_HPP
+
+#include <vector>
+
+// Triangles per BVH leaf, tested together by one SIMD ray-triangle test
+#define BVH_LEAF_TRIANGLES 4
+
+// Ray through a point of a camera's clip space, from its near plane to its
+// far plane : origin + t * direction for t from 0 to 1. ndc is in -1..1.
+void rayFromClip(const glm::mat4 & viewProjection, const glm::vec2 & ndc, glm::vec3 & out_origin, glm::vec3 & out_direction);
+
+// Bounding volume hierarchy over the triangles of one mesh, in mesh space,
+// for picking on the CPU without reading anything back from the GPU.
+//
+// The nodes are stored depth first, each inner node followed by its first
+// child. Leaves hold up to BVH_LEAF_TRIANGLES triangles as one packet of
+// corner and edge coordinates, one array per coordinate, so that a ray is
+// tested against all of them with SSE at once. Triangles are split at the
+// median of their centers along the longest axis of the node.
+class MeshBVH {
+public:
+	MeshBVH();
+
+	void build(const std::vector<glm::vec3> & positions, const std::vector<unsigned int> & indices);
+
+	// Nearest triangle the ray crosses, from either side, with t in
+	// [0, inout_distance). On a hit, inout_distance becomes its t and
+	// out_triangle its index in the index list, divided by 3.
+	bool intersect(const glm::vec3 & origin, const glm::vec3 & direction, float & inout_distance, int & out_triangle) const;
+
+	int triangleCount() const { return triangles; }
+	int nodeCount() const { return (int)nodes.size(); }
+	size_t memoryBytes() const { return sizeof(MeshBVH) + nodes.capacity() * sizeof(Node) + packets.capacity() * sizeof(Packet); }
+
+private:
+	struct Node {
+		glm::vec3 boundsMin;
+		int second;  // Inner nodes : index of the second child. Leaves : packet index
+		glm::vec3 boundsMax;
+		int leaf;    // 1 for leaves
+	};
+	// Unused lanes have null edges and never hit
+	struct Packet {
+		float v0x[BVH_LEAF_TRIANGLES], v0y[BVH_LEAF_TRIANGLES], v0z[BVH_LEAF_TRIANGLES];
+		float e1x[BVH_LEAF_TRIANGLES], e1y[BVH_LEAF_TRIANGLES], e1z[BVH_LEAF_TRIANGLES];
+		float e2x[BVH_LEAF_TRIANGLES], e2y[BVH_LEAF_TRIANGLES], e2z[BVH_LEAF_TRIANGLES];
+		int triangle[BVH_LEAF_TRIANGLES];
+	};
+
+	int buildNode(const std::vector<glm::vec3> & positions, const std::vector<unsigned int> & indices,
+		std::vector<int> & order, const std::vector<glm::vec3> & centers, int begin, int end);
+
+	std::vector<Node> nodes;
+	std::vector<Packet> packets;
+	int triangles;
+};
+
+#endif
@@ -0,0 +1,616 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <afunix.h> // AF_UNIX, Windows 10 1803 and later
+typedef SOCKET SocketHandle;
+#define closeSocket closesocket
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+typedef int SocketHandle;
+#define INVALID_SOCKET (-1)
+#define closeSocket close
+#endif
+
+// A client that went away is an error to handle, not a signal
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "trace.hpp"
+#include "capture.hpp"
+#include "renderserver.hpp"
+
+// Longest the socket thread sleeps in select before it looks for finished
+// frames again, in microseconds
+#define RENDER_SERVER_POLL_US 1000
+#define BMP_HEADER_SIZE 54
+
+static long long steadyNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool initSockets()
+{
+#ifdef _WIN32
+	static bool started = false;
+	WSADATA data;
+	if (!started)
+		started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	return started;
+#else
+	return true;
+#endif
+}
+
+static bool setNonBlocking(SocketHandle socket)
+{
+#ifdef _WIN32
+	u_long on = 1;
+	return ioctlsocket(socket, FIONBIO, &on) == 0;
+#else
+	int flags = fcntl(socket, F_GETFL, 0);
+	return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+// The last socket call failed only because it would have blocked
+static bool wouldBlock()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static bool socketAddress(const char * path, sockaddr_un & out_address)
+{
+	memset(&out_address, 0, sizeof(out_address));
+	out_address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(out_address.sun_path))
+		return false;
+	strcpy(out_address.sun_path, path);
+	return true;
+}
+
+static void putField(unsigned char * bytes, int offset, unsigned int value)
+{
+	bytes[offset] = (unsigned char)value;
+	bytes[offset + 1] = (unsigned char)(value >> 8);
+	bytes[offset + 2] = (unsigned char)(value >> 16);
+	bytes[offset + 3] = (unsigned char)(value >> 24);
+}
+
+// A 32 bit uncompressed BMP, whose rows are bottom up like glReadPixels'
+static void writeBmpHeader(unsigned char * header, int width, int height)
+{
+	unsigned int imageBytes = (unsigned int)width * height * 4;
+	memset(header, 0, BMP_HEADER_SIZE);
+	header[0] = 'B';
+	header[1] = 'M';
+	putField(header, 0x02, BMP_HEADER_SIZE + imageBytes);
+	putField(header, 0x0A, BMP_HEADER_SIZE);
+	putField(header, 0x0E, 40);
+	putField(header, 0x12, width);
+	putField(header, 0x16, height);
+	header[0x1A] = 1;  // Planes
+	header[0x1C] = 32; // Bits per pixel, no compression
+	putField(header, 0x22, imageBytes);
+	putField(header, 0x26, 2835); // 72 DPI
+	putField(header, 0x2A, 2835);
+}
+
+static unsigned int imageBytes(int format, int width, int height)
+{
+	if (format == RENDER_IMAGE_I420)
+		return (unsigned int)width * height * 3 / 2;
+	return BMP_HEADER_SIZE + (unsigned int)width * height * 4;
+}
+
+bool RenderServer::TicketRing::push(int item)
+{
+	unsigned int t = tail.load(std::memory_order_relaxed);
+	if (t - head.load(std::memory_order_acquire) >= RENDER_SERVER_SLOTS)
+		return false;
+	items[t & (RENDER_SERVER_SLOTS - 1)] = item;
+	tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+bool RenderServer::TicketRing::pop(int & item)
+{
+	unsigned int h = head.load(std::memory_order_relaxed);
+	if (h == tail.load(std::memory_order_acquire))
+		return false;
+	item = items[h & (RENDER_SERVER_SLOTS - 1)];
+	head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+RenderServer::RenderServer() : freeCount(RENDER_SERVER_SLOTS), inFlight(0), connectionSerial(0), listener(-1),
+	maxWidth(0), maxHeight(0), stopping(false), shutdown(false), shutdownPending(false), sampleTotal(0),
+	served(0), rejected(0), badRequests(0), failures(0), batchSizeTotal(0), servedAtReport(0), queueMsTotal(0.0), lastReport(0)
+{
+	for (int i = 0; i < RENDER_SERVER_SLOTS; i++)
+		freeTickets[i] = RENDER_SERVER_SLOTS - 1 - i;
+	queued.head = queued.tail = 0;
+	finished.head = finished.tail = 0;
+	for (int i = 0; i < RENDER_SERVER_MAX_CLIENTS; i++) {
+		clients[i].socket = -1;
+		clients[i].connection = 0;
+		clients[i].inputBytes = 0;
+		clients[i].outputSent = 0;
+	}
+}
+
+RenderServer::~RenderServer()
+{
+	stop();
+}
+
+bool RenderServer::start(const char * socketPath, int width, int height)
+{
+	sockaddr_un address;
+	if (!initSockets()) {
+		printf("Render server : sockets are not available\n");
+		return false;
+	}
+	if (!socketAddress(socketPath, address)) {
+		printf("Render server : the socket path %s is too long\n", socketPath);
+		return false;
+	}
+	SocketHandle socketHandle = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (socketHandle == INVALID_SOCKET) {
+		printf("Render server : could not create a socket\n");
+		return false;
+	}
+	// The file of a server that did not stop cleanly keeps bind from working
+	remove(socketPath);
+	if (bind(socketHandle, (const sockaddr*)&address, sizeof(address)) != 0 || listen(socketHandle, RENDER_SERVER_MAX_CLIENTS) != 0
+		|| !setNonBlocking(socketHandle)) {
+		printf("Render server : could not listen on %s\n", socketPath);
+		closeSocket(socketHandle);
+		return false;
+	}
+
+	listener = (intptr_t)socketHandle;
+	path = socketPath;
+	maxWidth = width;
+	maxHeight = height;
+	stopping = false;
+	shutdown = false;
+	shutdownPending = false;
+	lastReport = steadyNanoseconds();
+	thread = std::thread(&RenderServer::networkLoop, this);
+	printf("Render server : listening on %s, frames up to %dx%d, %d requests in flight at most\n",
+		socketPath, maxWidth, maxHeight, RENDER_SERVER_SLOTS);
+	return true;
+}
+
+void RenderServer::stop()
+{
+	if (!thread.joinable())
+		return;
+	stopping = true;
+	thread.join();
+	for (int i = 0; i < RENDER_SERVER_MAX_CLIENTS; i++)
+		closeClient(i);
+	closeSocket((SocketHandle)listener);
+	listener = -1;
+	remove(path.c_str());
+	report(true);
+}
+
+int RenderServer::takeRequests(int * out_tickets, int maxCount)
+{
+	int count = 0, index;
+	long long now = steadyNanoseconds();
+	while (count < maxCount && queued.pop(index)) {
+		tickets[index].taken = now;
+		out_tickets[count++] = index;
+	}
+	for (int i = 0; i < count; i++)
+		tickets[out_tickets[i]].batchSize = count;
+	return count;
+}
+
+void RenderServer::finishRequest(int index)
+{
+	finished.push(index);
+}
+
+void RenderServer::networkLoop()
+{
+	traceThreadName("Render server");
+	while (!stopping.load()) {
+		fd_set readable, writable;
+		FD_ZERO(&readable);
+		FD_ZERO(&writable);
+		SocketHandle highest = (SocketHandle)listener;
+		FD_SET((SocketHandle)listener, &readable);
+		for (int i = 0; i < RENDER_SERVER_MAX_CLIENTS; i++) {
+			const Client & client = clients[i];
+			if (client.socket == -1)
+				continue;
+			SocketHandle socketHandle = (SocketHandle)client.socket;
+			if (client.output.size() - client.outputSent < RENDER_SERVER_OUTPUT_LIMIT)
+				FD_SET(socketHandle, &readable);
+			if (client.outputSent < client.output.size())
+				FD_SET(socketHandle, &writable);
+			if (socketHandle > highest)
+				highest = socketHandle;
+		}
+
+		timeval timeout = { 0, RENDER_SERVER_POLL_US };
+		int ready = select((int)highest + 1, &readable, &writable, NULL, &timeout);
+		if (ready > 0) {
+			if (FD_ISSET((SocketHandle)listener, &readable))
+				acceptClients();
+			for (int i = 0; i < RENDER_SERVER_MAX_CLIENTS; i++) {
+				if (clients[i].socket == -1)
+					continue;
+				SocketHandle socketHandle = (SocketHandle)clients[i].socket;
+				if (FD_ISSET(socketHandle, &writable) && !sendClient(i)) {
+					closeClient(i);
+					continue;
+				}
+				if (FD_ISSET(socketHandle, &readable) && !readClient(i))
+					closeClient(i);
+			}
+		}
+		else if (ready < 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(RENDER_SERVER_POLL_US));
+
+		// Frames the render thread is done with. Those of a client that left
+		// meanwhile are dropped.
+		int index;
+		while (finished.pop(index)) {
+			const RenderTicket & ticket = tickets[index];
+			const Client & client = clients[ticket.client];
+			if (client.socket != -1 && client.connection == ticket.connection)
+				answer(ticket.client, ticket.request, ticket.status, &ticket);
+			freeTickets[freeCount++] = index;
+			inFlight--;
+		}
+
+		if (shutdownPending && inFlight == 0 && !shutdown.load()) {
+			bool sent = true;
+			for (int i = 0; i < RENDER_SERVER_MAX_CLIENTS; i++)
+				sent = sent && (clients[i].socket == -1 || clients[i].outputSent == clients[i].output.size());
+			if (sent) {
+				printf("Render server : shutting down as a client asked\n");
+				shutdown = true;
+			}
+		}
+		report(false);
+	}
+}
+
+void RenderServer::acceptClients()
+{
+	for (;;) {
+		SocketHandle socketHandle = accept((SocketHandle)listener, NULL, NULL);
+		if (socketHandle == INVALID_SOCKET)
+			return;
+		int free = -1;
+		for (int i = 0; i < RENDER_SERVER_MAX_CLIENTS && free < 0; i++) {
+			if (clients[i].socket == -1)
+				free = i;
+		}
+		if (free < 0 || !setNonBlocking(socketHandle)) {
+			printf("Render server : more than %d clients, one was turned away\n", RENDER_SERVER_MAX_CLIENTS);
+			closeSocket(socketHandle);
+			continue;
+		}
+		Client & client = clients[free];
+		client.socket = (intptr_t)socketHandle;
+		client.connection = ++connectionSerial;
+		client.inputBytes = 0;
+		client.output.clear();
+		client.outputSent = 0;
+	}
+}
+
+bool RenderServer::readClient(int index)
+{
+	Client & client = clients[index];
+	while (client.output.size() - client.outputSent < RENDER_SERVER_OUTPUT_LIMIT) {
+		int received = recv((SocketHandle)client.socket, (char*)client.input + client.inputBytes,
+			(int)(sizeof(client.input) - client.inputBytes), 0);
+		if (received == 0)
+			return false;
+		if (received < 0)
+			return wouldBlock();
+		client.inputBytes += received;
+		if (client.inputBytes < sizeof(client.input))
+			continue;
+
+		RenderRequestMessage request;
+		memcpy(&request, client.input, sizeof(request));
+		client.inputBytes = 0;
+		if (request.magic != RENDER_REQUEST_MAGIC) {
+			// Whatever follows cannot be found in the stream again
+			printf("Render server : a client sent something else than a request, closing it\n");
+			badRequests++;
+			return false;
+		}
+		handleRequest(index, request);
+		if (client.socket == -1)
+			return true;
+	}
+	return true;
+}
+
+bool RenderServer::sendClient(int index)
+{
+	Client & client = clients[index];
+	while (client.outputSent < client.output.size()) {
+		size_t remaining = client.output.size() - client.outputSent;
+		int sent = send((SocketHandle)client.socket, (const char*)&client.output[client.outputSent],
+			(int)std::min(remaining, (size_t)(1 << 20)), SEND_FLAGS);
+		if (sent < 0)
+			return wouldBlock();
+		client.outputSent += sent;
+	}
+	// Keeps the capacity for the next answers
+	client.output.clear();
+	client.outputSent = 0;
+	return true;
+}
+
+void RenderServer::closeClient(int index)
+{
+	Client & client = clients[index];
+	if (client.socket == -1)
+		return;
+	closeSocket((SocketHandle)client.socket);
+	client.socket = -1;
+	client.output.clear();
+	client.outputSent = 0;
+	client.inputBytes = 0;
+}
+
+void RenderServer::handleRequest(int index, const RenderRequestMessage & request)
+{
+	if (request.type == RENDER_MESSAGE_SHUTDOWN) {
+		shutdownPending = true;
+		return;
+	}
+	bool knownFormat = request.format == RENDER_IMAGE_BMP || request.format == RENDER_IMAGE_I420;
+	bool evenSize = (request.width % 2) == 0 && (request.height % 2) == 0;
+	if (request.type != RENDER_MESSAGE_FRAME || request.width < 1 || request.height < 1 || request.width > maxWidth
+		|| request.height > maxHeight || !knownFormat || (request.format == RENDER_IMAGE_I420 && !evenSize)) {
+		badRequests++;
+		answer(index, request, RENDER_BAD_REQUEST, NULL);
+		return;
+	}
+	if (shutdownPending || freeCount == 0) {
+		rejected++;
+		answer(index, request, RENDER_BUSY, NULL);
+		return;
+	}
+
+	int ticketIndex = freeTickets[--freeCount];
+	inFlight++;
+	RenderTicket & ticket = tickets[ticketIndex];
+	ticket.request = request;
+	ticket.client = index;
+	ticket.connection = clients[index].connection;
+	ticket.arrival = steadyNanoseconds();
+	ticket.taken = 0;
+	ticket.batchSize = 0;
+	ticket.status = RENDER_OK;
+	queued.push(ticketIndex);
+}
+
+void RenderServer::answer(int index, const RenderRequestMessage & request, int status, const RenderTicket * ticket)
+{
+	Client & client = clients[index];
+	RenderResponseHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = RENDER_RESPONSE_MAGIC;
+	header.id = request.id;
+	header.status = status;
+	header.width = request.width;
+	header.height = request.height;
+	header.format = request.format;
+	// Only a rendered frame carries an image and counts in the latency
+	bool image = ticket && status == RENDER_OK;
+	header.bytes = image ? imageBytes(request.format, request.width, request.height) : 0;
+	if (ticket && !image)
+		failures++;
+
+	size_t start = client.output.size();
+	client.output.resize(start + sizeof(header) + header.bytes);
+	if (image) {
+		TRACE_SCOPE("Encode frame");
+		unsigned char * encoded = &client.output[start + sizeof(header)];
+		if (request.format == RENDER_IMAGE_I420)
+			convertBgraToI420(&ticket->pixels[0], request.width, request.height, encoded);
+		else {
+			writeBmpHeader(encoded, request.width, request.height);
+			memcpy(encoded + BMP_HEADER_SIZE, &ticket->pixels[0], (size_t)request.width * request.height * 4);
+		}
+		header.queueMs = (float)((ticket->taken - ticket->arrival) / 1e6);
+		header.serverMs = (float)((steadyNanoseconds() - ticket->arrival) / 1e6);
+		samples[sampleTotal++ % RENDER_SERVER_HISTORY] = header.serverMs;
+		served++;
+		batchSizeTotal += ticket->batchSize;
+		queueMsTotal += header.queueMs;
+	}
+	memcpy(&client.output[start], &header, sizeof(header));
+	if (!sendClient(index))
+		closeClient(index);
+}
+
+double RenderServer::percentile(double p) const
+{
+	int count = sampleTotal < RENDER_SERVER_HISTORY ? sampleTotal : RENDER_SERVER_HISTORY;
+	if (count == 0)
+		return -1.0;
+	double sorted[RENDER_SERVER_HISTORY];
+	memcpy(sorted, samples, count * sizeof(double));
+	size_t rank = (size_t)(p * (count - 1) + 0.5);
+	std::nth_element(sorted, sorted + rank, sorted + count);
+	return sorted[rank];
+}
+
+void RenderServer::report(bool final)
+{
+	long long now = steadyNanoseconds();
+	if (!final && (now - lastReport < RENDER_SERVER_REPORT_MS * 1000000LL || served == servedAtReport))
+		return;
+	lastReport = now;
+	servedAtReport = served;
+	if (served == 0) {
+		printf("Render server : no frame served, %lld requests answered busy, %lld bad, %lld failed\n", rejected, badRequests, failures);
+		return;
+	}
+	printf("Render server : %lld frames served, %lld answered busy, %lld bad, %lld failed; latency p50 %.1f ms p99 %.1f ms, %.1f ms queued on average, %.2f frames per GPU submission\n",
+		served, rejected, badRequests, failures, percentile(0.5), percentile(0.99), queueMsTotal / served, (double)batchSizeTotal / served);
+}
+
+static bool sendAll(SocketHandle socketHandle, const void * data, size_t bytes)
+{
+	const char * next = (const char*)data;
+	while (bytes > 0) {
+		int sent = send(socketHandle, next, (int)std::min(bytes, (size_t)(1 << 20)), SEND_FLAGS);
+		if (sent <= 0)
+			return false;
+		next += sent;
+		bytes -= sent;
+	}
+	return true;
+}
+
+static bool receiveAll(SocketHandle socketHandle, void * data, size_t bytes)
+{
+	char * next = (char*)data;
+	while (bytes > 0) {
+		int received = recv(socketHandle, next, (int)std::min(bytes, (size_t)(1 << 20)), 0);
+		if (received <= 0)
+			return false;
+		next += received;
+		bytes -= received;
+	}
+	return true;
+}
+
+static SocketHandle connectTo(const char * path)
+{
+	sockaddr_un address;
+	if (!initSockets() || !socketAddress(path, address))
+		return INVALID_SOCKET;
+	SocketHandle socketHandle = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (socketHandle == INVALID_SOCKET)
+		return INVALID_SOCKET;
+	if (connect(socketHandle, (const sockaddr*)&address, sizeof(address)) != 0) {
+		closeSocket(socketHandle);
+		return INVALID_SOCKET;
+	}
+	return socketHandle;
+}
+
+int runRenderClient(const char * path, int count, int connections, int width, int height, int format,
+	const char * outputFile, bool shutdownAfter)
+{
+	if (connections < 1) connections = 1;
+	std::atomic<int> nextRequest(0), images(0), busy(0), failed(0);
+	std::vector<std::vector<double> > roundTrips(connections);
+	std::vector<std::thread> threads;
+	long long start = steadyNanoseconds();
+
+	for (int c = 0; c < connections; c++) {
+		threads.push_back(std::thread([&, c]() {
+			SocketHandle socketHandle = connectTo(path);
+			if (socketHandle == INVALID_SOCKET) {
+				printf("Render client : could not connect to %s\n", path);
+				return;
+			}
+			std::vector<unsigned char> image;
+			for (int id = nextRequest++; id < count; id = nextRequest++) {
+				// The camera swings around the showroom from one request to the next
+				RenderRequestMessage request = { RENDER_REQUEST_MAGIC, RENDER_MESSAGE_FRAME, (unsigned int)id, width, height, format,
+					1.5f * sinf(id * 0.37f), 0.3f, { 4.0f, 4.0f, 4.0f }, { 1.0f, 1.0f, 1.0f }, 50.0f };
+				RenderResponseHeader header;
+				long long sent = steadyNanoseconds();
+				if (!sendAll(socketHandle, &request, sizeof(request)) || !receiveAll(socketHandle, &header, sizeof(header))
+					|| header.magic != RENDER_RESPONSE_MAGIC || header.id != request.id) {
+					failed++;
+					break;
+				}
+				image.resize(header.bytes);
+				if (header.bytes > 0 && !receiveAll(socketHandle, &image[0], header.bytes)) {
+					failed++;
+					break;
+				}
+				roundTrips[c].push_back((steadyNanoseconds() - sent) / 1e6);
+				if (header.status == RENDER_BUSY)
+					busy++;
+				else if (header.status != RENDER_OK)
+					failed++;
+				else {
+					images++;
+					if (id == 0 && outputFile) {
+						FILE * file = fopen(outputFile, "wb");
+						if (file) {
+							fwrite(&image[0], 1, image.size(), file);
+							fclose(file);
+						}
+						else
+							printf("Render client : %s could not be written\n", outputFile);
+					}
+				}
+			}
+			closeSocket(socketHandle);
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	double seconds = (steadyNanoseconds() - start) / 1e9;
+
+	std::vector<double> all;
+	for (int c = 0; c < connections; c++)
+		all.insert(all.end(), roundTrips[c].begin(), roundTrips[c].end());
+	std::sort(all.begin(), all.end());
+	double p50 = all.empty() ? -1.0 : all[(size_t)(0.5 * (all.size() - 1) + 0.5)];
+	double p99 = all.empty() ? -1.0 : all[(size_t)(0.99 * (all.size() - 1) + 0.5)];
+	printf("Render client : %d requests of %dx%d over %d connections in %.2f s, %.1f frames/s; %d images, %d busy, %d failed; round trip p50 %.1f ms p99 %.1f ms\n",
+		count, width, height, connections, seconds, images.load() / seconds, images.load(), busy.load(), failed.load(), p50, p99);
+
+	if (shutdownAfter) {
+		SocketHandle socketHandle = connectTo(path);
+		RenderRequestMessage request;
+		memset(&request, 0, sizeof(request));
+		request.magic = RENDER_REQUEST_MAGIC;
+		request.type = RENDER_MESSAGE_SHUTDOWN;
+		if (socketHandle == INVALID_SOCKET || !sendAll(socketHandle, &request, sizeof(request)))
+			printf("Render client : could not ask %s to shut down\n", path);
+		if (socketHandle != INVALID_SOCKET)
+			closeSocket(socketHandle);
+	}
+	return images.load() == count ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+#ifndef RENDERSERVER_HPP
+#define RENDERSERVER_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Requests queued or rendering at once. A request that finds them all taken
+// is answered RENDER_BUSY right away.
+#define RENDER_SERVER_SLOTS 32
+#define RENDER_SERVER_MAX_CLIENTS 16
+// A client whose answers pile up beyond this is not read from until it has
+// taken them, so a slow reader only slows itself down
+#define RENDER_SERVER_OUTPUT_LIMIT (32 * 1024 * 1024)
+// Latency samples the percentiles are computed over
+#define RENDER_SERVER_HISTORY 1024
+#define RENDER_SERVER_REPORT_MS 5000
+
+#define RENDER_REQUEST_MAGIC 0x51525446  // "FTRQ"
+#define RENDER_RESPONSE_MAGIC 0x53525446 // "FTRS"
+
+enum RenderMessageType {
+	RENDER_MESSAGE_FRAME,
+	RENDER_MESSAGE_SHUTDOWN // Stops the server once the queued frames are answered
+};
+
+enum RenderImageFormat {
+	RENDER_IMAGE_BMP,  // 32 bit BMP file, rows bottom up
+	RENDER_IMAGE_I420  // Planar YUV 4:2:0, see convertBgraToI420. Even sizes only.
+};
+
+enum RenderStatus {
+	RENDER_OK,
+	RENDER_BUSY,        // The queue was full, try again later
+	RENDER_BAD_REQUEST,
+	RENDER_FAILED       // The frame could not be rendered or read back, no image follows
+};
+
+// What a client sends. The socket is local, so the fields are in the
+// machine's own layout and byte order.
+struct RenderRequestMessage {
+	unsigned int magic;
+	unsigned int type;     // RenderMessageType
+	unsigned int id;       // Echoed in the response
+	int width, height;     // Pixels, at most the server's size
+	int format;            // RenderImageFormat
+	float yaw, pitch;      // Of the orbit camera, radians
+	float lightPosition[3];
+	float lightColor[3];
+	float lightPower;
+};
+
+// Followed by bytes of image
+struct RenderResponseHeader {
+	unsigned int magic;
+	unsigned int id;
+	int status;            // RenderStatus
+	int width, height, format;
+	unsigned int bytes;
+	float queueMs;         // From arrival until the render thread took it
+	float serverMs;        // From arrival until the answer was ready to send
+};
+
+// A request between the socket thread and the render thread
+struct RenderTicket {
+	RenderRequestMessage request;
+	int client;
+	unsigned int connection;  // Serial of the client's connection, answers to a closed one are dropped
+	long long arrival;        // ns on the steady clock
+	long long taken;
+	int batchSize;            // Requests drawn in the same submission
+	int status;               // Set by the render thread, RENDER_OK when pixels hold the image
+	std::vector<unsigned char> pixels; // BGRA, rows bottom up, written by the render thread
+};
+
+// Serves frames over a Unix domain socket (AF_UNIX, afunix.h on Windows 10
+// and later). A thread of its own accepts the clients, reads their requests
+// into a fixed set of tickets and queues them for the render thread, which
+// takes them in arrival order, draws them and hands them back; the socket
+// thread then encodes each image and sends it. The sockets are non-blocking
+// and polled, so neither thread ever waits on the other.
+//
+// Backpressure : when every ticket is taken a request is answered busy at
+// once instead of queueing without bound, and a client is not read from
+// while too many answer bytes wait for it.
+//
+// The latency reported is from the arrival of a request to its answer being
+// ready to send, for the requests answered with an image.
+class RenderServer {
+public:
+	RenderServer();
+	~RenderServer();
+
+	// Listens on path, removing a stale socket file first. maxWidth and
+	// maxHeight bound the requested sizes.
+	bool start(const char * path, int maxWidth, int maxHeight);
+	// Closes every connection, then prints the statistics
+	void stop();
+	bool running() const { return thread.joinable(); }
+	// A client asked to shut down and every frame before was answered
+	bool shutdownRequested() const { return shutdown.load(); }
+
+	// Render thread only. Takes up to maxCount queued tickets, returns the count.
+	int takeRequests(int * out_tickets, int maxCount);
+	RenderTicket & ticket(int index) { return tickets[index]; }
+	// The pixels are written, or the status says why not. The ticket goes
+	// back to the socket thread.
+	void finishRequest(int index);
+
+private:
+	// Single producer, single consumer ring of ticket indices
+	struct TicketRing {
+		std::atomic<unsigned int> head, tail;
+		int items[RENDER_SERVER_SLOTS];
+		bool push(int item);
+		bool pop(int & item);
+	};
+	struct Client {
+		intptr_t socket;      // -1 when the slot is free
+		unsigned int connection;
+		unsigned char input[sizeof(RenderRequestMessage)];
+		size_t inputBytes;
+		std::vector<unsigned char> output;
+		size_t outputSent;
+	};
+
+	void networkLoop();
+	void acceptClients();
+	bool readClient(int client);
+	bool sendClient(int client);
+	void closeClient(int client);
+	void handleRequest(int client, const RenderRequestMessage & request);
+	void answer(int client, const RenderRequestMessage & request, int status, const RenderTicket * ticket);
+	void report(bool final);
+	double percentile(double p) const;
+
+	RenderTicket tickets[RENDER_SERVER_SLOTS];
+	int freeTickets[RENDER_SERVER_SLOTS]; // Socket thread only
+	int freeCount;
+	TicketRing queued;   // To the render thread
+	TicketRing finished; // Back to the socket thread
+	int inFlight;        // Tickets not free, socket thread only
+
+	Client clients[RENDER_SERVER_MAX_CLIENTS];
+	unsigned int connectionSerial;
+	intptr_t listener;
+	std::string path;
+	int maxWidth, maxHeight;
+	std::thread thread;
+	std::atomic<bool> stopping, shutdown;
+	bool shutdownPending; // Asked for, waiting for the tickets to drain
+
+	// Socket thread only
+	double samples[RENDER_SERVER_HISTORY];
+	int sampleTotal;
+	long long served, rejected, badRequests, failures;
+	long long batchSizeTotal; // Summed over the served requests
+	long long servedAtReport;
+	double queueMsTotal;
+	long long lastReport;
+};
+
+// Sends count frame requests of width x height over connections sockets at
+// once, each connection waiting for its answer before the next request, and
+// prints the round trip percentiles. The first image is written to
+// outputFile when given. Asks the server to shut down afterwards when
+// shutdownAfter is set. Returns 0 when every request got an image.
+int runRenderClient(const char * path, int count, int connections, int width, int height, int format,
+	const char * outputFile, bool shutdownAfter);
+
+#endif
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <chrono>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "gpuresources.hpp"
+#include "ringbuffer.hpp"
+#include "trace.hpp"
+
+// How long one glClientWaitSync call may block, in nanoseconds
+#define RING_BUFFER_WAIT_SLICE 1000000
+
+RingBuffer::RingBuffer() : bufferID(0), sectionSize(0), persistentPointer(NULL), sectionPointer(NULL),
+	section(0), used(0), persistentMapping(false), lastStall(0.0), totalStall(0.0), stallCount(0)
+{
+	for (int i = 0; i < RING_BUFFER_FRAMES; i++)
+		fences[i] = 0;
+}
+
+void RingBuffer::create(GLsizeiptr bytesPerFrame)
+{
+	persistentMapping = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+	allocateStorage(bytesPerFrame);
+	printf("Per-frame ring buffer : %d x %ld bytes, %s\n", RING_BUFFER_FRAMES, (long)sectionSize,
+		persistentMapping ? "persistent mapping" : "unsynchronized mapping");
+}
+
+void RingBuffer::destroy()
+{
+	for (int i = 0; i < RING_BUFFER_FRAMES; i++)
+		waitForSection(i);
+	releaseStorage();
+}
+
+void RingBuffer::allocateStorage(GLsizeiptr bytesPerFrame)
+{
+	// Keep every section start aligned for any binding target
+	sectionSize = (bytesPerFrame + 255) & ~(GLsizeiptr)255;
+
+	bufferID = GPU_CREATE(GPU_BUFFER, GPU_MEMORY_STREAMING, "Frame ring");
+	glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+	if (persistentMapping) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, sectionSize * RING_BUFFER_FRAMES, NULL, flags);
+		persistentPointer = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, sectionSize * RING_BUFFER_FRAMES, flags);
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, sectionSize * RING_BUFFER_FRAMES, NULL, GL_STREAM_DRAW);
+	}
+	gpuResources.setSize(GPU_BUFFER, bufferID, sectionSize * RING_BUFFER_FRAMES, GL_NONE);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void RingBuffer::releaseStorage()
+{
+	if (bufferID == 0)
+		return;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+	if (persistentPointer || sectionPointer)
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	gpuResources.destroy(GPU_BUFFER, bufferID);
+	persistentPointer = NULL;
+	sectionPointer = NULL;
+}
+
+double RingBuffer::waitForSection(int index)
+{
+	GLsync fence = fences[index];
+	if (!fence)
+		return 0.0;
+	fences[index] = 0;
+
+	// Fast path : the GPU finished with this section long ago
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	double stall = 0.0;
+	if (status == GL_TIMEOUT_EXPIRED) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		do {
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, RING_BUFFER_WAIT_SLICE);
+		} while (status == GL_TIMEOUT_EXPIRED);
+		stall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	glDeleteSync(fence);
+	return stall;
+}
+
+void RingBuffer::beginFrame(GLsizeiptr bytesNeeded)
+{
+	TRACE_SCOPE("Ring buffer wait");
+	double stall = 0.0;
+
+	if (bytesNeeded > sectionSize) {
+		// Everything in flight has to retire before the storage can go away
+		for (int i = 0; i < RING_BUFFER_FRAMES; i++)
+			stall += waitForSection(i);
+		releaseStorage();
+		GLsizeiptr newSize = sectionSize;
+		while (newSize < bytesNeeded)
+			newSize *= 2;
+		allocateStorage(newSize);
+		section = 0;
+	}
+	else {
+		section = (section + 1) % RING_BUFFER_FRAMES;
+		stall += waitForSection(section);
+	}
+
+	lastStall = stall;
+	totalStall += stall;
+	if (stall > 0.0)
+		stallCount++;
+
+	used = 0;
+	if (persistentMapping) {
+		sectionPointer = persistentPointer + section * sectionSize;
+	}
+	else {
+		// The fence already guarantees the GPU is done with this range
+		glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+		sectionPointer = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, section * sectionSize, sectionSize,
+			GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+}
+
+void * RingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr & offset)
+{
+	GLsizeiptr start = (used + alignment - 1) / alignment * alignment;
+	if (!sectionPointer || start + size > sectionSize)
+		return NULL;
+	used = start + size;
+	offset = section * sectionSize + start;
+	return sectionPointer + start;
+}
+
+void RingBuffer::finishWrites()
+{
+	// Coherent persistent memory is visible to the GPU as soon as it is written
+	if (persistentMapping || !sectionPointer)
+		return;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	sectionPointer = NULL;
+}
+
+void RingBuffer::endFrame()
+{
+	fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,65 @@
+#ifndef RINGBUFFER_HPP
+#define RINGBUFFER_HPP
+
+// Frames of per-frame data kept alive at once. The CPU writes frame N while
+// the GPU may still be reading frames N-1 and N-2.
+#define RING_BUFFER_FRAMES 3
+
+// Allocator for data that is rewritten every frame (per-object data, draw
+// commands, uniform blocks). The buffer is split in RING_BUFFER_FRAMES
+// sections; each frame sub-allocates from the next section and writes
+// straight into mapped memory. A fence per section tells when the GPU is done
+// with it, so there is neither a driver copy nor an implicit synchronization.
+//
+// With GL 4.4 / ARB_buffer_storage the buffer stays mapped with
+// GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT. Older drivers map each section
+// unsynchronized for the time of the writes instead.
+class RingBuffer {
+public:
+	RingBuffer();
+
+	void create(GLsizeiptr bytesPerFrame);
+	void destroy();
+
+	// Waits until the GPU has released the next section, growing the buffer
+	// first if a frame needs more than bytesNeeded.
+	void beginFrame(GLsizeiptr bytesNeeded);
+
+	// Returns a pointer to write size bytes to, and their byte offset in
+	// buffer() for binding. Returns NULL when the frame's section is full.
+	void * allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr & offset);
+
+	// Must be called after the last write and before the GPU reads the data
+	void finishWrites();
+
+	// Fences the section after the last command that reads it
+	void endFrame();
+
+	GLuint buffer() const { return bufferID; }
+	bool persistent() const { return persistentMapping; }
+
+	// Time the CPU spent waiting on fences, in milliseconds
+	double lastStallMs() const { return lastStall; }
+	double totalStallMs() const { return totalStall; }
+	unsigned int stalledFrames() const { return stallCount; }
+
+private:
+	void allocateStorage(GLsizeiptr bytesPerFrame);
+	void releaseStorage();
+	double waitForSection(int index);
+
+	GLuint bufferID;
+	GLsizeiptr sectionSize;
+	unsigned char * persistentPointer; // Whole buffer, persistent mapping only
+	unsigned char * sectionPointer;    // Current section while it is writable
+	GLsync fences[RING_BUFFER_FRAMES];
+	int section;
+	GLsizeiptr used;
+	bool persistentMapping;
+
+	double lastStall;
+	double totalStall;
+	unsigned int stallCount;
+};
+
+#endif
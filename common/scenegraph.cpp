@@ -0,0 +1,298 @@
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "scenegraph.hpp"
+
+#define NODE_DIRTY 1 // The world matrix needs recomputing
+#define NODE_REFIT 2 // The subtree bounds need recomputing
+
+Frustum frustumFromMatrix(const glm::mat4 & m)
+{
+	// Gribb and Hartmann : the planes are sums of the matrix rows
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; r++)
+		rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0]; // Left
+	frustum.planes[1] = rows[3] - rows[0]; // Right
+	frustum.planes[2] = rows[3] + rows[1]; // Bottom
+	frustum.planes[3] = rows[3] - rows[1]; // Top
+	frustum.planes[4] = rows[3] + rows[2]; // Near
+	frustum.planes[5] = rows[3] - rows[2]; // Far
+	return frustum;
+}
+
+static void mergeBox(glm::vec3 & boxMin, glm::vec3 & boxMax, const glm::vec3 & otherMin, const glm::vec3 & otherMax)
+{
+	boxMin = glm::min(boxMin, otherMin);
+	boxMax = glm::max(boxMax, otherMax);
+}
+
+SceneGraph::SceneGraph() : structureChanged(false), depthFirst(true)
+{
+	stats.updatedNodes = 0;
+	stats.refitNodes = 0;
+	stats.rebuilt = false;
+}
+
+void SceneGraph::clear()
+{
+	parents.clear();
+	subtreeSizes.clear();
+	locals.clear();
+	worlds.clear();
+	localMin.clear();
+	localMax.clear();
+	worldMin.clear();
+	worldMax.clear();
+	subtreeMin.clear();
+	subtreeMax.clear();
+	meshes.clear();
+	nodes.clear();
+	flags.clear();
+	indices.clear();
+	dirtyNodes.clear();
+	structureChanged = false;
+	depthFirst = true;
+}
+
+void SceneGraph::reserve(int count)
+{
+	parents.reserve(count);
+	subtreeSizes.reserve(count);
+	locals.reserve(count);
+	worlds.reserve(count);
+	localMin.reserve(count);
+	localMax.reserve(count);
+	worldMin.reserve(count);
+	worldMax.reserve(count);
+	subtreeMin.reserve(count);
+	subtreeMax.reserve(count);
+	meshes.reserve(count);
+	nodes.reserve(count);
+	flags.reserve(count);
+	indices.reserve(count);
+}
+
+SceneNode SceneGraph::createNode(SceneNode parent, const glm::mat4 & local, int mesh)
+{
+	SceneNode node = (SceneNode)indices.size();
+	int index = (int)parents.size();
+	int parentIndex = parent >= 0 ? indices[parent] : -1;
+
+	if (depthFirst && parentIndex >= 0) {
+		// Appending keeps the order only if the parent's range ends here
+		if (parentIndex + subtreeSizes[parentIndex] == index) {
+			for (int p = parentIndex; p >= 0; p = parents[p])
+				subtreeSizes[p]++;
+		}
+		else
+			depthFirst = false;
+	}
+
+	glm::vec3 empty(SCENE_EMPTY_BOUNDS), emptyMax(-SCENE_EMPTY_BOUNDS);
+	parents.push_back(parentIndex);
+	subtreeSizes.push_back(1);
+	locals.push_back(local);
+	worlds.push_back(local);
+	localMin.push_back(empty);
+	localMax.push_back(emptyMax);
+	worldMin.push_back(empty);
+	worldMax.push_back(emptyMax);
+	subtreeMin.push_back(empty);
+	subtreeMax.push_back(emptyMax);
+	meshes.push_back(mesh);
+	nodes.push_back(node);
+	flags.push_back(0);
+	indices.push_back(index);
+
+	structureChanged = true;
+	return node;
+}
+
+void SceneGraph::setLocalTransform(SceneNode node, const glm::mat4 & local)
+{
+	int index = indices[node];
+	locals[index] = local;
+	markDirty(index);
+}
+
+void SceneGraph::setLocalBounds(SceneNode node, const glm::vec3 & boundsMin, const glm::vec3 & boundsMax)
+{
+	int index = indices[node];
+	localMin[index] = boundsMin;
+	localMax[index] = boundsMax;
+	markDirty(index);
+}
+
+void SceneGraph::markDirty(int index)
+{
+	if (flags[index] & NODE_DIRTY)
+		return;
+	flags[index] |= NODE_DIRTY;
+	// Handles, the indices may change before the next update
+	dirtyNodes.push_back(nodes[index]);
+}
+
+void SceneGraph::update()
+{
+	stats.updatedNodes = 0;
+	stats.refitNodes = 0;
+	stats.rebuilt = false;
+
+	if (structureChanged) {
+		if (!depthFirst)
+			sortNodes();
+		updateRange(0, size());
+		dirtyNodes.clear();
+		structureChanged = false;
+		depthFirst = true;
+		stats.updatedNodes = size();
+		stats.rebuilt = true;
+		return;
+	}
+	if (dirtyNodes.empty())
+		return;
+
+	dirtyIndices.clear();
+	for (size_t i = 0; i < dirtyNodes.size(); i++)
+		dirtyIndices.push_back(indices[dirtyNodes[i]]);
+	dirtyNodes.clear();
+	std::sort(dirtyIndices.begin(), dirtyIndices.end());
+
+	// Ancestors come first, so a dirty node inside a subtree already updated
+	// is skipped
+	refitNodes.clear();
+	int updatedEnd = 0;
+	for (size_t i = 0; i < dirtyIndices.size(); i++) {
+		int index = dirtyIndices[i];
+		if (index < updatedEnd)
+			continue;
+		updatedEnd = index + subtreeSizes[index];
+		updateRange(index, updatedEnd);
+		stats.updatedNodes += subtreeSizes[index];
+
+		for (int p = parents[index]; p >= 0 && !(flags[p] & NODE_REFIT); p = parents[p]) {
+			flags[p] |= NODE_REFIT;
+			refitNodes.push_back(p);
+		}
+	}
+
+	// Descendants have higher indices, refit them before their ancestors
+	std::sort(refitNodes.begin(), refitNodes.end(), std::greater<int>());
+	for (size_t i = 0; i < refitNodes.size(); i++) {
+		refit(refitNodes[i]);
+		flags[refitNodes[i]] &= ~NODE_REFIT;
+	}
+	stats.refitNodes = (int)refitNodes.size();
+}
+
+void SceneGraph::updateRange(int begin, int end)
+{
+	for (int i = begin; i < end; i++) {
+		int parent = parents[i];
+		worlds[i] = parent >= 0 ? worlds[parent] * locals[i] : locals[i];
+		flags[i] &= ~NODE_DIRTY;
+
+		if (localMin[i].x > localMax[i].x) {
+			worldMin[i] = glm::vec3(SCENE_EMPTY_BOUNDS);
+			worldMax[i] = glm::vec3(-SCENE_EMPTY_BOUNDS);
+		}
+		else {
+			// Box of the transformed box, from its center and half extent
+			const glm::mat4 & world = worlds[i];
+			glm::vec3 center = glm::vec3(world * glm::vec4((localMin[i] + localMax[i]) * 0.5f, 1.0f));
+			glm::vec3 extent = (localMax[i] - localMin[i]) * 0.5f;
+			glm::vec3 worldExtent = glm::abs(glm::vec3(world[0])) * extent.x
+				+ glm::abs(glm::vec3(world[1])) * extent.y
+				+ glm::abs(glm::vec3(world[2])) * extent.z;
+			worldMin[i] = center - worldExtent;
+			worldMax[i] = center + worldExtent;
+		}
+		subtreeMin[i] = worldMin[i];
+		subtreeMax[i] = worldMax[i];
+	}
+
+	// Children after parents : walking backwards merges each subtree into its
+	// parent once it is complete
+	for (int i = end - 1; i > begin; i--) {
+		int parent = parents[i];
+		if (parent >= begin)
+			mergeBox(subtreeMin[parent], subtreeMax[parent], subtreeMin[i], subtreeMax[i]);
+	}
+}
+
+void SceneGraph::refit(int index)
+{
+	subtreeMin[index] = worldMin[index];
+	subtreeMax[index] = worldMax[index];
+	int end = index + subtreeSizes[index];
+	for (int child = index + 1; child < end; child += subtreeSizes[child])
+		mergeBox(subtreeMin[index], subtreeMax[index], subtreeMin[child], subtreeMax[child]);
+}
+
+void SceneGraph::sortNodes()
+{
+	int count = size();
+
+	// Children of each node, in creation order
+	std::vector<int> childStart(count + 1, 0), children(count);
+	for (int i = 0; i < count; i++)
+		if (parents[i] >= 0)
+			childStart[parents[i] + 1]++;
+	for (int i = 0; i < count; i++)
+		childStart[i + 1] += childStart[i];
+	std::vector<int> fill(childStart.begin(), childStart.end() - 1);
+	for (int i = 0; i < count; i++)
+		if (parents[i] >= 0)
+			children[fill[parents[i]]++] = i;
+
+	// Depth-first order. Roots and children are pushed in reverse so they
+	// come out in creation order.
+	std::vector<int> order, stack;
+	order.reserve(count);
+	for (int i = count - 1; i >= 0; i--)
+		if (parents[i] < 0)
+			stack.push_back(i);
+	while (!stack.empty()) {
+		int index = stack.back();
+		stack.pop_back();
+		order.push_back(index);
+		for (int c = childStart[index + 1] - 1; c >= childStart[index]; c--)
+			stack.push_back(children[c]);
+	}
+
+	std::vector<int> newIndex(count);
+	for (int i = 0; i < count; i++)
+		newIndex[order[i]] = i;
+
+	std::vector<int> oldParents = parents;
+	std::vector<glm::mat4> oldLocals = locals;
+	std::vector<glm::vec3> oldMin = localMin, oldMax = localMax;
+	std::vector<int> oldMeshes = meshes;
+	std::vector<SceneNode> oldNodes = nodes;
+	for (int i = 0; i < count; i++) {
+		int old = order[i];
+		parents[i] = oldParents[old] >= 0 ? newIndex[oldParents[old]] : -1;
+		locals[i] = oldLocals[old];
+		localMin[i] = oldMin[old];
+		localMax[i] = oldMax[old];
+		meshes[i] = oldMeshes[old];
+		nodes[i] = oldNodes[old];
+		indices[nodes[i]] = i;
+		flags[i] = 0;
+	}
+
+	for (int i = 0; i < count; i++)
+		subtreeSizes[i] = 1;
+	for (int i = count - 1; i >= 0; i--)
+		if (parents[i] >= 0)
+			subtreeSizes[parents[i]] += subtreeSizes[i];
+}
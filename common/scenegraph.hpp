@@ -0,0 +1,170 @@
+#ifndef SCENEGRAPH_HPP
+#define SCENEGRAPH_HPP
+
+typedef int SceneNode; // Handle returned by the graph, stays valid when nodes move. -1 is none
+
+// Corner value of an empty box, min above max. Finite so that the frustum
+// test below stays free of infinities.
+#define SCENE_EMPTY_BOUNDS 1e30f
+
+// View frustum as six planes, xyz pointing inside
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+// Planes of the clip volume of a view-projection matrix
+Frustum frustumFromMatrix(const glm::mat4 & viewProjection);
+
+// True when the box is entirely behind one of the planes
+inline bool boxOutsideFrustum(const Frustum & frustum, const glm::vec3 & boxMin, const glm::vec3 & boxMax)
+{
+	glm::vec3 center = (boxMin + boxMax) * 0.5f;
+	glm::vec3 extent = (boxMax - boxMin) * 0.5f;
+	for (int i = 0; i < 6; i++) {
+		glm::vec3 normal = glm::vec3(frustum.planes[i]);
+		if (glm::dot(normal, center) + frustum.planes[i].w + glm::dot(glm::abs(normal), extent) < 0.0f)
+			return true;
+	}
+	return false;
+}
+
+// Distance along the ray where it enters the box, origin + t * direction,
+// or a negative value when it misses the box or only enters past maxDistance.
+// inverseDirection is 1 / direction per axis.
+inline float rayBoxEntry(const glm::vec3 & origin, const glm::vec3 & inverseDirection,
+	const glm::vec3 & boxMin, const glm::vec3 & boxMax, float maxDistance)
+{
+	if (boxMin.x > boxMax.x)
+		return -1.0f;
+	glm::vec3 t0 = (boxMin - origin) * inverseDirection;
+	glm::vec3 t1 = (boxMax - origin) * inverseDirection;
+	glm::vec3 entries = glm::min(t0, t1), exits = glm::max(t0, t1);
+	float entry = glm::max(glm::max(entries.x, entries.y), glm::max(entries.z, 0.0f));
+	float leave = glm::min(glm::min(exits.x, exits.y), glm::min(exits.z, maxDistance));
+	return entry <= leave ? entry : -1.0f;
+}
+
+struct SceneGraphStatistics {
+	int updatedNodes; // World matrices recomputed by the last update()
+	int refitNodes;   // Ancestors whose subtree bounds were recomputed
+	bool rebuilt;     // The nodes were reordered, everything was recomputed
+};
+
+// Transform hierarchy stored as flat arrays in depth-first order : a parent
+// comes before its children and every subtree is the contiguous range
+// [index, index + subtree size). Walking the arrays in order visits parents
+// first, so world matrices are one multiply per node without recursion.
+//
+// Changing a node marks it dirty; update() recomputes the world matrices of
+// the dirty subtrees only, then refits the bounds of their ancestors, which
+// costs the subtree plus the siblings along the path to the root. Adding
+// nodes recomputes everything on the next update(), and reorders the arrays
+// first when the nodes were not added depth first.
+//
+// Every node has a local box, empty for nodes without geometry, its world
+// box, and the box of its whole subtree for hierarchical culling.
+class SceneGraph {
+public:
+	SceneGraph();
+
+	void clear();
+	void reserve(int nodes);
+
+	// parent is -1 for a root. mesh is a user value, -1 for none.
+	SceneNode createNode(SceneNode parent, const glm::mat4 & local, int mesh);
+	void setLocalTransform(SceneNode node, const glm::mat4 & local);
+	void setLocalBounds(SceneNode node, const glm::vec3 & boundsMin, const glm::vec3 & boundsMax);
+
+	const glm::mat4 & localTransform(SceneNode node) const { return locals[indices[node]]; }
+	const glm::mat4 & worldTransform(SceneNode node) const { return worlds[indices[node]]; }
+	int mesh(SceneNode node) const { return meshes[indices[node]]; }
+
+	// Brings world matrices and bounds up to date
+	void update();
+
+	// Calls visit(index) for every node with a mesh whose world box touches
+	// the frustum, skipping subtrees whose bounds are outside. Nodes are
+	// visited in depth-first order.
+	template <typename Visit>
+	int cull(const Frustum & frustum, const Visit & visit) const;
+
+	// Calls hit(index, nearest) for every node with a mesh whose world box the
+	// ray enters before nearest, skipping subtrees it misses. hit returns the
+	// distance of what it found in the node, or nearest when nothing closer.
+	// Returns the nearest distance, maxDistance if nothing was hit.
+	template <typename Hit>
+	float raycast(const glm::vec3 & origin, const glm::vec3 & direction, float maxDistance, const Hit & hit) const;
+
+	// Depth-first arrays, valid after update()
+	int size() const { return (int)parents.size(); }
+	SceneNode nodeAt(int index) const { return nodes[index]; }
+	int meshAt(int index) const { return meshes[index]; }
+	const glm::mat4 & worldAt(int index) const { return worlds[index]; }
+	const glm::vec3 & worldMinAt(int index) const { return worldMin[index]; }
+	const glm::vec3 & worldMaxAt(int index) const { return worldMax[index]; }
+
+	const SceneGraphStatistics & statistics() const { return stats; }
+
+private:
+	void markDirty(int index);
+	void sortNodes();
+	void updateRange(int begin, int end);
+	void refit(int index);
+
+	// Indexed by position in depth-first order
+	std::vector<int> parents;       // Index of the parent, -1 for roots
+	std::vector<int> subtreeSizes;  // The node and all its descendants
+	std::vector<glm::mat4> locals, worlds;
+	std::vector<glm::vec3> localMin, localMax;
+	std::vector<glm::vec3> worldMin, worldMax;
+	std::vector<glm::vec3> subtreeMin, subtreeMax;
+	std::vector<int> meshes;
+	std::vector<SceneNode> nodes;   // Handle of the node at each index
+	std::vector<unsigned char> flags;
+
+	std::vector<int> indices;       // Index of each handle
+	std::vector<SceneNode> dirtyNodes;
+	std::vector<int> dirtyIndices, refitNodes; // Kept to avoid allocating in update()
+	bool structureChanged;
+	bool depthFirst; // False once a node was added outside its parent's range
+	SceneGraphStatistics stats;
+};
+
+template <typename Visit>
+int SceneGraph::cull(const Frustum & frustum, const Visit & visit) const
+{
+	int visible = 0;
+	int count = size();
+	for (int i = 0; i < count; ) {
+		if (boxOutsideFrustum(frustum, subtreeMin[i], subtreeMax[i])) {
+			i += subtreeSizes[i];
+			continue;
+		}
+		if (meshes[i] >= 0 && !boxOutsideFrustum(frustum, worldMin[i], worldMax[i])) {
+			visit(i);
+			visible++;
+		}
+		i++;
+	}
+	return visible;
+}
+
+template <typename Hit>
+float SceneGraph::raycast(const glm::vec3 & origin, const glm::vec3 & direction, float maxDistance, const Hit & hit) const
+{
+	glm::vec3 inverseDirection = glm::vec3(1.0f) / direction;
+	float nearest = maxDistance;
+	int count = size();
+	for (int i = 0; i < count; ) {
+		if (rayBoxEntry(origin, inverseDirection, subtreeMin[i], subtreeMax[i], nearest) < 0.0f) {
+			i += subtreeSizes[i];
+			continue;
+		}
+		if (meshes[i] >= 0 && rayBoxEntry(origin, inverseDirection, worldMin[i], worldMax[i], nearest) >= 0.0f)
+			nearest = glm::min(nearest, hit(i, nearest));
+		i++;
+	}
+	return nearest;
+}
+
+#endif
@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "gpuresources.hpp"
+#include "jobsystem.hpp"
+#include "trace.hpp"
+#include "startup.hpp"
+
+static long long steadyNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool readShaderSource(const char * path, const char * defines, std::string & out_code)
+{
+	std::ifstream stream(path, std::ios::in);
+	if (!stream.is_open()) {
+		printf("Impossible to open %s. Are you in the right directory ?\n", path);
+		return false;
+	}
+	std::stringstream text;
+	text << stream.rdbuf();
+	out_code = text.str();
+	injectShaderDefines(out_code, defines);
+	return true;
+}
+
+/* Puts the #define lines right after the #version line, which has to come
+ * first, and numbers the lines after them as in the file */
+void injectShaderDefines(std::string & code, const char * defines)
+{
+	if (!defines || !defines[0])
+		return;
+	size_t version = code.find("#version");
+	size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+	if (lineEnd == std::string::npos) {
+		code = std::string(defines) + "#line 1\n" + code;
+		return;
+	}
+	int lineNumber = (int)std::count(code.begin(), code.begin() + lineEnd, '\n') + 2;
+	code.insert(lineEnd + 1, std::string(defines) + "#line " + std::to_string(lineNumber) + "\n");
+}
+
+GLuint startShader(GLenum type, const std::string & code)
+{
+	GLuint shader = glCreateShader(type);
+	const char * source = code.c_str();
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	return shader;
+}
+
+GLuint startProgram(GLuint vertexShader, GLuint fragmentShader, const char * name)
+{
+	GLuint program = GPU_CREATE(GPU_PROGRAM, GPU_MEMORY_OTHER, name);
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	glLinkProgram(program);
+	return program;
+}
+
+// Prints the compile log of a shader, if any. False when it did not compile.
+static bool checkShader(GLuint shader, const char * path)
+{
+	GLint result = GL_FALSE, logLength = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+	if (logLength > 1) {
+		std::vector<char> log(logLength + 1);
+		glGetShaderInfoLog(shader, logLength, NULL, &log[0]);
+		printf("%s :\n%s\n", path, &log[0]);
+	}
+	if (result != GL_TRUE)
+		printf("Compiling %s failed\n", path);
+	return result == GL_TRUE;
+}
+
+bool finishProgram(GLuint program, GLuint vertexShader, GLuint fragmentShader, const char * vertexPath, const char * fragmentPath)
+{
+	bool compiled = checkShader(vertexShader, vertexPath);
+	compiled = checkShader(fragmentShader, fragmentPath) && compiled;
+
+	GLint linked = GL_FALSE, logLength = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+	if (logLength > 1) {
+		std::vector<char> log(logLength + 1);
+		glGetProgramInfoLog(program, logLength, NULL, &log[0]);
+		printf("%s + %s :\n%s\n", vertexPath, fragmentPath, &log[0]);
+	}
+	if (compiled && linked != GL_TRUE)
+		printf("Linking %s and %s failed\n", vertexPath, fragmentPath);
+
+	glDetachShader(program, vertexShader);
+	glDetachShader(program, fragmentShader);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	return compiled && linked == GL_TRUE;
+}
+
+// Little endian field of a BMP header, which is not aligned
+static unsigned int headerField(const unsigned char * header, int offset)
+{
+	return header[offset] | (header[offset + 1] << 8) | (header[offset + 2] << 16) | ((unsigned int)header[offset + 3] << 24);
+}
+
+bool decodeBmpFile(const char * path, StartupImage & out_image)
+{
+	FILE * file = fopen(path, "rb");
+	if (!file) {
+		printf("%s could not be opened. Are you in the right directory ?\n", path);
+		return false;
+	}
+
+	// A 24 bit uncompressed BMP, whose header is 54 bytes and starts with "BM"
+	unsigned char header[54];
+	bool valid = fread(header, 1, 54, file) == 54 && header[0] == 'B' && header[1] == 'M'
+		&& headerField(header, 0x1E) == 0 && (header[0x1C] | (header[0x1D] << 8)) == 24;
+	int width = valid ? (int)headerField(header, 0x12) : 0;
+	int height = valid ? (int)headerField(header, 0x16) : 0;
+	if (width <= 0 || height <= 0)
+		valid = false;
+
+	if (valid) {
+		unsigned int dataPos = headerField(header, 0x0A);
+		unsigned int imageSize = headerField(header, 0x22);
+		// Some BMP files are misformatted, guess missing information
+		if (imageSize == 0)
+			imageSize = (unsigned int)width * height * 3;
+		if (dataPos == 0)
+			dataPos = 54;
+		out_image.pixels.resize(imageSize);
+		valid = fseek(file, dataPos, SEEK_SET) == 0 && fread(&out_image.pixels[0], 1, imageSize, file) == imageSize
+			&& imageSize >= (unsigned int)width * height * 3;
+		out_image.width = width;
+		out_image.height = height;
+	}
+	fclose(file);
+	if (!valid)
+		printf("%s is not a correct BMP file\n", path);
+	return valid;
+}
+
+GLuint uploadImage(const StartupImage & image, const char * name)
+{
+	GLuint texture = GPU_CREATE(GPU_TEXTURE, GPU_MEMORY_TEXTURE, name);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, GL_BGR, GL_UNSIGNED_BYTE, &image.pixels[0]);
+
+	// Trilinear filtering, with mipmaps generated by the driver
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// The mipmaps add a third to the base level
+	long long baseBytes = (long long)image.width * image.height * 3;
+	gpuResources.setSize(GPU_TEXTURE, texture, baseBytes + baseBytes / 3, GL_RGB8);
+	return texture;
+}
+
+StartupLoader::StartupLoader() : states(NULL), jobSystem(NULL), parallelCompile(false), failed(false), cancelled(false), glMs(0.0), startTime(0)
+{
+}
+
+StartupLoader::~StartupLoader()
+{
+	delete[] states;
+}
+
+int StartupLoader::addSource(int kind, const char * path)
+{
+	// Shader files shared by several programs are read once
+	if (kind == SOURCE_TEXT) {
+		for (size_t i = 0; i < sources.size(); i++) {
+			if (sources[i].kind == SOURCE_TEXT && sources[i].path == path)
+				return (int)i;
+		}
+	}
+	Source source;
+	source.kind = kind;
+	source.path = path;
+	source.image.width = source.image.height = 0;
+	source.work = source.upload = NULL;
+	source.data = NULL;
+	source.job = NULL;
+	source.workMs = 0.0;
+	source.collected = false;
+	source.succeeded = false;
+	source.texture = 0;
+	sources.push_back(source);
+	return (int)sources.size() - 1;
+}
+
+int StartupLoader::addProgram(const char * vertexPath, const char * fragmentPath, const char * defines)
+{
+	Program program;
+	program.vertexSource = addSource(SOURCE_TEXT, vertexPath);
+	program.fragmentSource = addSource(SOURCE_TEXT, fragmentPath);
+	program.defines = defines ? defines : "";
+	program.program = program.vertexShader = program.fragmentShader = 0;
+	program.stage = PROGRAM_WAITING;
+	programs.push_back(program);
+	return (int)programs.size() - 1;
+}
+
+int StartupLoader::addTexture(const char * path)
+{
+	return addSource(SOURCE_IMAGE, path);
+}
+
+int StartupLoader::addTask(const char * name, StartupFunction work, StartupFunction upload, void * data)
+{
+	int index = addSource(SOURCE_TASK, name);
+	sources[index].work = work;
+	sources[index].upload = upload;
+	sources[index].data = data;
+	return index;
+}
+
+void StartupLoader::start(JobSystem & jobs)
+{
+	TRACE_SCOPE("StartupLoader::start");
+	jobSystem = &jobs;
+	startTime = steadyNanoseconds();
+	parallelCompile = GLEW_ARB_parallel_shader_compile;
+	if (parallelCompile)
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFFu); // As many as the driver wants
+
+	states = new std::atomic<int>[sources.size()];
+	for (size_t i = 0; i < sources.size(); i++)
+		states[i].store(SOURCE_PENDING, std::memory_order_relaxed);
+
+	// The tasks first, they take the longest
+	for (int tasks = 1; tasks >= 0; tasks--) {
+		for (size_t i = 0; i < sources.size(); i++) {
+			if ((sources[i].kind == SOURCE_TASK) != (tasks == 1))
+				continue;
+			int index = (int)i;
+			if (jobs.threadCount() < 2) {
+				// Nothing would run the job until the first wait
+				work(index);
+				continue;
+			}
+			StartupLoader * self = this;
+			sources[i].job = jobs.createLambda(NULL, [self, index]() { self->work(index); });
+			jobs.run(sources[i].job);
+		}
+	}
+}
+
+void StartupLoader::work(int index)
+{
+	if (cancelled.load(std::memory_order_relaxed)) {
+		// finish() gave up, nobody collects the result
+		states[index].store(SOURCE_FAILED, std::memory_order_release);
+		return;
+	}
+
+	Source & source = sources[index];
+	long long start = steadyNanoseconds();
+	bool succeeded = false;
+	if (source.kind == SOURCE_TEXT) {
+		TRACE_SCOPE("Read shader");
+		succeeded = readShaderSource(source.path.c_str(), NULL, source.text);
+	}
+	else if (source.kind == SOURCE_IMAGE) {
+		TRACE_SCOPE("Decode image");
+		succeeded = decodeBmpFile(source.path.c_str(), source.image);
+	}
+	else {
+		TRACE_SCOPE("Startup task");
+		succeeded = source.work(source.data);
+	}
+	source.workMs = (steadyNanoseconds() - start) / 1e6;
+	// Publishes the result to the context thread
+	states[index].store(succeeded ? SOURCE_READY : SOURCE_FAILED, std::memory_order_release);
+}
+
+void StartupLoader::collectSources()
+{
+	for (size_t i = 0; i < sources.size(); i++) {
+		Source & source = sources[i];
+		if (source.collected)
+			continue;
+		int state = states[i].load(std::memory_order_acquire);
+		if (state == SOURCE_PENDING)
+			continue;
+		source.collected = true;
+		if (state == SOURCE_FAILED) {
+			// Shader files fail their programs, reported when those start
+			if (source.kind == SOURCE_IMAGE)
+				printf("Startup : texture %s left out\n", source.path.c_str());
+			else if (source.kind == SOURCE_TASK)
+				printf("Startup : %s failed\n", source.path.c_str());
+			continue;
+		}
+
+		long long start = steadyNanoseconds();
+		if (source.kind == SOURCE_IMAGE) {
+			TRACE_SCOPE("Upload image");
+			source.texture = uploadImage(source.image, source.path.c_str());
+			std::vector<unsigned char>().swap(source.image.pixels);
+			source.succeeded = true;
+		}
+		else if (source.kind == SOURCE_TASK) {
+			TRACE_SCOPE("Upload task");
+			source.succeeded = !source.upload || source.upload(source.data);
+		}
+		else
+			source.succeeded = true;
+		glMs += (steadyNanoseconds() - start) / 1e6;
+	}
+}
+
+void StartupLoader::startPrograms()
+{
+	for (size_t i = 0; i < programs.size(); i++) {
+		Program & program = programs[i];
+		if (program.stage != PROGRAM_WAITING)
+			continue;
+		const Source & vertex = sources[program.vertexSource];
+		const Source & fragment = sources[program.fragmentSource];
+		if (!vertex.collected || !fragment.collected)
+			continue;
+		if (!vertex.succeeded || !fragment.succeeded) {
+			program.stage = PROGRAM_FAILED;
+			failed = true;
+			continue;
+		}
+
+		TRACE_SCOPE("Start program");
+		long long start = steadyNanoseconds();
+		std::string vertexCode = vertex.text, fragmentCode = fragment.text;
+		injectShaderDefines(vertexCode, program.defines.c_str());
+		injectShaderDefines(fragmentCode, program.defines.c_str());
+		program.vertexShader = startShader(GL_VERTEX_SHADER, vertexCode);
+		program.fragmentShader = startShader(GL_FRAGMENT_SHADER, fragmentCode);
+		program.program = startProgram(program.vertexShader, program.fragmentShader, vertex.path.c_str());
+		program.stage = PROGRAM_LINKING;
+		glMs += (steadyNanoseconds() - start) / 1e6;
+	}
+}
+
+void StartupLoader::finishPrograms(bool block)
+{
+	for (size_t i = 0; i < programs.size(); i++) {
+		Program & program = programs[i];
+		if (program.stage != PROGRAM_LINKING)
+			continue;
+		if (!block) {
+			// Without the extension asking for the result would wait for it
+			if (!parallelCompile)
+				continue;
+			GLint completed = GL_FALSE;
+			glGetProgramiv(program.program, GL_COMPLETION_STATUS_ARB, &completed);
+			if (!completed)
+				continue;
+		}
+
+		TRACE_SCOPE("Finish program");
+		long long start = steadyNanoseconds();
+		if (finishProgram(program.program, program.vertexShader, program.fragmentShader,
+			sources[program.vertexSource].path.c_str(), sources[program.fragmentSource].path.c_str()))
+			program.stage = PROGRAM_DONE;
+		else {
+			gpuResources.destroy(GPU_PROGRAM, program.program);
+			program.program = 0;
+			program.stage = PROGRAM_FAILED;
+			failed = true;
+		}
+		program.vertexShader = program.fragmentShader = 0;
+		glMs += (steadyNanoseconds() - start) / 1e6;
+	}
+}
+
+int StartupLoader::pendingCount() const
+{
+	int pending = 0;
+	for (size_t i = 0; i < sources.size(); i++) {
+		if (!sources[i].collected)
+			pending++;
+	}
+	for (size_t i = 0; i < programs.size(); i++) {
+		if (programs[i].stage == PROGRAM_WAITING || programs[i].stage == PROGRAM_LINKING)
+			pending++;
+	}
+	return pending;
+}
+
+int StartupLoader::poll()
+{
+	collectSources();
+	startPrograms();
+	finishPrograms(false);
+	return pendingCount();
+}
+
+bool StartupLoader::finish()
+{
+	TRACE_SCOPE("StartupLoader::finish");
+	while (poll() > 0 && !failed) {
+		// Shaders first, then the programs, then the textures and tasks, so
+		// that a program that fails is known before waiting for the rest
+		int waiting = -1;
+		for (int kind = SOURCE_TEXT; kind <= SOURCE_TASK && waiting < 0; kind++) {
+			if (kind == SOURCE_IMAGE) {
+				bool programsLeft = false;
+				for (size_t i = 0; i < programs.size(); i++)
+					programsLeft = programsLeft || programs[i].stage == PROGRAM_WAITING || programs[i].stage == PROGRAM_LINKING;
+				if (programsLeft)
+					break;
+			}
+			for (size_t i = 0; i < sources.size() && waiting < 0; i++) {
+				if (sources[i].kind == kind && states[i].load(std::memory_order_acquire) == SOURCE_PENDING)
+					waiting = (int)i;
+			}
+		}
+		if (waiting >= 0)
+			jobSystem->wait(sources[waiting].job);
+		else {
+			collectSources();
+			startPrograms();
+			finishPrograms(true);
+		}
+	}
+
+	// A failed program fails the startup, what is still out is not worth
+	// waiting for
+	if (failed) {
+		cancelled.store(true, std::memory_order_relaxed);
+		printf("Startup : stopped at the first failure after %.1f ms, %d items left\n",
+			(steadyNanoseconds() - startTime) / 1e6, pendingCount());
+		return false;
+	}
+
+	int textures = 0, tasks = 0;
+	double workMs = 0.0;
+	for (size_t i = 0; i < sources.size(); i++) {
+		workMs += sources[i].workMs;
+		textures += sources[i].kind == SOURCE_IMAGE;
+		tasks += sources[i].kind == SOURCE_TASK;
+	}
+	printf("Startup : %d programs, %d textures and %d tasks ready in %.1f ms, %.1f ms of reads, decodes and tasks on %d threads, %.1f ms of GL calls%s\n",
+		(int)programs.size(), textures, tasks, (steadyNanoseconds() - startTime) / 1e6, workMs, jobSystem->threadCount(), glMs,
+		parallelCompile ? ", shaders compiled in parallel by the driver" : "");
+	return true;
+}
@@ -0,0 +1,116 @@
+#ifndef STARTUP_HPP
+#define STARTUP_HPP
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+class JobSystem;
+struct Job;
+
+// CPU work of a startup task, run on a worker, and its GL work, run on the
+// context thread once the first has returned true
+typedef bool (*StartupFunction)(void * data);
+
+// Image decoded from a 24 bit BMP, rows bottom up, BGR
+struct StartupImage {
+	std::vector<unsigned char> pixels;
+	int width, height;
+};
+
+// Reads a shader and puts the #define lines of defines, which may be NULL,
+// right after its #version line. Prints why on failure.
+bool readShaderSource(const char * path, const char * defines, std::string & out_code);
+void injectShaderDefines(std::string & code, const char * defines);
+// Compiles and links without waiting for the result
+GLuint startShader(GLenum type, const std::string & code);
+GLuint startProgram(GLuint vertexShader, GLuint fragmentShader, const char * name);
+// Waits for a program started above, prints the logs and deletes the shaders.
+// False when a shader or the link failed.
+bool finishProgram(GLuint program, GLuint vertexShader, GLuint fragmentShader, const char * vertexPath, const char * fragmentPath);
+
+bool decodeBmpFile(const char * path, StartupImage & out_image);
+// Texture with mipmaps and trilinear filtering, repeating
+GLuint uploadImage(const StartupImage & image, const char * name);
+
+// Loads what the first frame needs as a small task graph. Every file read,
+// image decode and CPU task runs on the job system; the context thread
+// meanwhile compiles each program as soon as both of its sources have
+// arrived and uploads each texture as soon as it is decoded, in batches of
+// whatever is ready when it polls. The GL work is only started, not waited
+// for : with ARB_parallel_shader_compile the driver compiles on threads of
+// its own, and without it most drivers defer the work to the first query of
+// the result, which finish() makes last.
+//
+// A shader file used by several programs is read once. Items are added
+// before start(), which must be called from the thread that started the job
+// system, with the GL context current.
+class StartupLoader {
+public:
+	StartupLoader();
+	~StartupLoader();
+
+	// Returns the index of the item, for program(), texture() and succeeded()
+	int addProgram(const char * vertexPath, const char * fragmentPath, const char * defines = NULL);
+	int addTexture(const char * path);
+	int addTask(const char * name, StartupFunction work, StartupFunction upload, void * data);
+
+	void start(JobSystem & jobs);
+	// Compiles and uploads what has arrived, never blocks. Returns the count
+	// of items not finished.
+	int poll();
+	// Waits for every item, running jobs meanwhile. A texture or task that
+	// failed is reported and left out. Returns false as soon as a program
+	// fails : the jobs still queued then skip their work, and the job system
+	// must be stopped before the loader is destroyed.
+	bool finish();
+
+	GLuint program(int index) const { return programs[index].program; }
+	GLuint texture(int index) const { return sources[index].texture; }
+	bool succeeded(int index) const { return sources[index].succeeded; }
+
+private:
+	enum SourceKind { SOURCE_TEXT, SOURCE_IMAGE, SOURCE_TASK };
+	enum SourceState { SOURCE_PENDING, SOURCE_READY, SOURCE_FAILED };
+	enum ProgramStage { PROGRAM_WAITING, PROGRAM_LINKING, PROGRAM_DONE, PROGRAM_FAILED };
+
+	// What a worker produces
+	struct Source {
+		int kind;
+		std::string path;      // Name of a task
+		std::string text;
+		StartupImage image;
+		StartupFunction work, upload;
+		void * data;
+		Job * job;             // NULL when run inline
+		double workMs;         // On the worker
+		bool collected;        // Uploaded, or its failure counted
+		bool succeeded;
+		GLuint texture;
+	};
+	struct Program {
+		int vertexSource, fragmentSource;
+		std::string defines;
+		GLuint program, vertexShader, fragmentShader;
+		int stage;
+	};
+
+	int addSource(int kind, const char * path);
+	void work(int index);
+	void collectSources();
+	void startPrograms();
+	void finishPrograms(bool block);
+	int pendingCount() const;
+
+	std::vector<Source> sources;
+	std::vector<Program> programs;
+	std::atomic<int> * states; // SourceState per source, written by the workers
+	JobSystem * jobSystem;
+	bool parallelCompile;      // ARB_parallel_shader_compile
+	bool failed;               // A program failed
+	std::atomic<bool> cancelled; // finish() gave up, workers skip what is left
+	double glMs;               // Spent in GL calls on the context thread
+	long long startTime;       // ns on the steady clock
+};
+
+#endif
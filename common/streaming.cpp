@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "meshpool.hpp"
+#include "picking.hpp"
+#include "jobsystem.hpp"
+#include "trace.hpp"
+#include "arena.hpp"
+#include "allocation.hpp"
+#include "streaming.hpp"
+
+// Bytes a loaded cell keeps on the CPU
+static size_t contentBytes(const CellContent & content)
+{
+	size_t bytes = sizeof(CellContent);
+	for (size_t i = 0; i < content.vertices.size(); i++) {
+		bytes += content.vertices[i].capacity() * sizeof(MeshVertex) + content.indices[i].capacity() * sizeof(unsigned int);
+		bytes += content.bvhs[i].memoryBytes();
+	}
+	return bytes;
+}
+
+CellStreamer::CellStreamer() : loadStates(NULL), loadsInFlight(0), loader(NULL), cellGpuBytes(0), frame(0)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void CellStreamer::create(int cellCount, CellLoader cellLoader, size_t cpuBudget, size_t gpuBudget)
+{
+	destroy();
+	loader = cellLoader;
+	cells.resize(cellCount);
+	for (int i = 0; i < cellCount; i++) {
+		Cell & cell = cells[i];
+		cell.content = NULL;
+		cell.cpuBytes = 0;
+		cell.slot = -1;
+		cell.requested = -1;
+		cell.visible = -1;
+		cell.distance = 0.0f;
+		cell.discard = false;
+	}
+	loadStates = new std::atomic<int>[cellCount];
+	for (int i = 0; i < cellCount; i++)
+		loadStates[i].store(CELL_UNLOADED, std::memory_order_relaxed);
+	requests.reserve(cellCount);
+
+	memset(&stats, 0, sizeof(stats));
+	stats.cpuBudget = cpuBudget;
+	stats.gpuBudget = gpuBudget;
+}
+
+void CellStreamer::waitForLoads()
+{
+	while (loadsInFlight.load(std::memory_order_acquire) > 0)
+		std::this_thread::yield();
+	collectLoads();
+}
+
+void CellStreamer::destroy()
+{
+	if (!loadStates)
+		return;
+	clear();
+	delete[] loadStates;
+	loadStates = NULL;
+	cells.clear();
+	slots.clear();
+	requests.clear();
+}
+
+void CellStreamer::clear()
+{
+	for (size_t i = 0; i < loadingCells.size(); i++)
+		cells[loadingCells[i]].discard = true;
+	waitForLoads();
+
+	changed.clear();
+	for (size_t i = 0; i < cells.size(); i++) {
+		Cell & cell = cells[i];
+		if (cell.content)
+			contents.release(cell.content);
+		cell.content = NULL;
+		cell.cpuBytes = 0;
+		if (cell.slot >= 0) {
+			slots[cell.slot].cell = -1;
+			cell.slot = -1;
+			changed.push_back((int)i);
+		}
+		loadStates[i].store(CELL_UNLOADED, std::memory_order_relaxed);
+	}
+	stats.cpuBytes = stats.gpuBytes = 0;
+	stats.cpuCells = stats.gpuCells = 0;
+}
+
+void CellStreamer::request(int cell, float distance, bool visible)
+{
+	Cell & c = cells[cell];
+	if (c.requested != frame) {
+		c.requested = frame;
+		c.distance = distance;
+		requests.push_back(cell);
+	}
+	else
+		c.distance = glm::min(c.distance, distance);
+	if (visible)
+		c.visible = frame;
+}
+
+void CellStreamer::load(int index)
+{
+	TRACE_SCOPE("Load cell");
+	ALLOCATION_SCOPE("Load cell");
+	// A recycled content still holds an evicted cell, the loader overwrites it
+	CellContent & content = *cells[index].content;
+	loader(index, content);
+	cells[index].cpuBytes = contentBytes(content);
+	// Publishes the content to the GL thread
+	loadStates[index].store(CELL_LOADED, std::memory_order_release);
+	loadsInFlight.fetch_sub(1, std::memory_order_release);
+}
+
+void CellStreamer::collectLoads()
+{
+	for (size_t i = 0; i < loadingCells.size(); ) {
+		int index = loadingCells[i];
+		if (loadStates[index].load(std::memory_order_acquire) != CELL_LOADED) {
+			i++;
+			continue;
+		}
+		Cell & cell = cells[index];
+		if (cell.discard) {
+			contents.release(cell.content);
+			cell.content = NULL;
+			cell.cpuBytes = 0;
+			cell.discard = false;
+			loadStates[index].store(CELL_UNLOADED, std::memory_order_relaxed);
+		}
+		else {
+			stats.cpuBytes += cell.cpuBytes;
+			stats.cpuCells++;
+			stats.loads++;
+		}
+		loadingCells[i] = loadingCells.back();
+		loadingCells.pop_back();
+	}
+}
+
+bool CellStreamer::upload(MeshPool & pool, int index)
+{
+	Cell & cell = cells[index];
+	const CellContent & content = *cell.content;
+	if (cellGpuBytes == 0) {
+		// The first cell sets the size of every slot
+		for (size_t i = 0; i < content.vertices.size(); i++)
+			cellGpuBytes += content.vertices[i].size() * sizeof(MeshVertex) + content.indices[i].size() * sizeof(unsigned int);
+		stats.gpuSlots = (int)glm::max(stats.gpuBudget / glm::max(cellGpuBytes, (size_t)1), (size_t)1);
+		printf("Streaming : %d cells fit in the GPU budget, %.1f KB each\n", stats.gpuSlots, cellGpuBytes / 1024.0);
+	}
+
+	// A free slot, or the one of the cell visible the longest time ago
+	int slot = -1;
+	for (size_t s = 0; s < slots.size(); s++) {
+		if (slots[s].cell < 0) {
+			slot = (int)s;
+			break;
+		}
+	}
+	if (slot < 0 && (int)slots.size() < stats.gpuSlots) {
+		slot = (int)slots.size();
+		slots.push_back(Slot());
+		slots[slot].cell = -1;
+	}
+	if (slot < 0) {
+		long long oldest = frame;
+		for (size_t s = 0; s < slots.size(); s++) {
+			long long visible = cells[slots[s].cell].visible;
+			if (visible < oldest) {
+				oldest = visible;
+				slot = (int)s;
+			}
+		}
+		if (slot < 0)
+			return false; // Everything resident is in view
+		cells[slots[slot].cell].slot = -1;
+		changed.push_back(slots[slot].cell);
+		slots[slot].cell = -1;
+		stats.gpuEvictions++;
+		stats.gpuCells--;
+		stats.gpuBytes -= cellGpuBytes;
+	}
+
+	Slot & target = slots[slot];
+	if (target.meshes.empty()) {
+		for (size_t i = 0; i < content.vertices.size(); i++)
+			target.meshes.push_back(pool.addMesh(content.vertices[i], content.indices[i]));
+	}
+	else {
+		for (size_t i = 0; i < content.vertices.size(); i++) {
+			if (!pool.updateMesh(target.meshes[i], content.vertices[i], content.indices[i])) {
+				fprintf(stderr, "Streaming : cell %d does not match the size of the slots\n", index);
+				return false;
+			}
+		}
+	}
+	target.bvhs = content.bvhs;
+	target.cell = index;
+	cell.slot = slot;
+	changed.push_back(index);
+	stats.uploads++;
+	stats.gpuCells++;
+	stats.gpuBytes += cellGpuBytes;
+	return true;
+}
+
+void CellStreamer::evictCpu()
+{
+	while (stats.cpuBytes > stats.cpuBudget) {
+		int oldest = -1;
+		for (size_t i = 0; i < cells.size(); i++) {
+			const Cell & cell = cells[i];
+			if (cell.content && cell.requested < frame && loadStates[i].load(std::memory_order_relaxed) == CELL_LOADED
+				&& (oldest < 0 || cell.requested < cells[oldest].requested))
+				oldest = (int)i;
+		}
+		if (oldest < 0)
+			return; // Everything loaded was asked for this frame
+		Cell & cell = cells[oldest];
+		stats.cpuBytes -= cell.cpuBytes;
+		stats.cpuCells--;
+		stats.cpuEvictions++;
+		contents.release(cell.content);
+		cell.content = NULL;
+		cell.cpuBytes = 0;
+		loadStates[oldest].store(CELL_UNLOADED, std::memory_order_relaxed);
+	}
+}
+
+void CellStreamer::update(MeshPool & pool, JobSystem & jobs)
+{
+	TRACE_SCOPE("Streaming update");
+	changed.clear();
+	collectLoads();
+
+	// Visible cells first, nearest first
+	std::sort(requests.begin(), requests.end(), [this](int a, int b) {
+		bool visibleA = cells[a].visible == frame, visibleB = cells[b].visible == frame;
+		if (visibleA != visibleB)
+			return visibleA;
+		return cells[a].distance < cells[b].distance;
+	});
+
+	int uploads = 0;
+	stats.queued = 0;
+	for (size_t i = 0; i < requests.size(); i++) {
+		int index = requests[i];
+		Cell & cell = cells[index];
+		int state = loadStates[index].load(std::memory_order_relaxed);
+		if (state == CELL_UNLOADED) {
+			// Evicted from the CPU but still drawn from its GPU slot, the copy
+			// would only be needed to upload it again
+			if (cell.slot >= 0)
+				continue;
+			if (loadsInFlight.load(std::memory_order_relaxed) >= STREAM_MAX_LOADS) {
+				stats.queued++;
+				continue;
+			}
+			loadStates[index].store(CELL_LOADING, std::memory_order_relaxed);
+			cell.content = contents.acquire();
+			loadingCells.push_back(index);
+			if (jobs.threadCount() < 2) {
+				// Nothing would run the job until the next wait
+				loadsInFlight.fetch_add(1, std::memory_order_relaxed);
+				load(index);
+				collectLoads();
+			}
+			else {
+				loadsInFlight.fetch_add(1, std::memory_order_relaxed);
+				CellStreamer * self = this;
+				jobs.run(jobs.createLambda(NULL, [self, index]() { self->load(index); }));
+			}
+		}
+		else if (state == CELL_LOADED && cell.visible == frame && cell.slot < 0 && uploads < STREAM_UPLOADS_PER_FRAME) {
+			if (upload(pool, index))
+				uploads++;
+		}
+	}
+	stats.loading = (int)loadingCells.size();
+
+	evictCpu();
+	requests.clear();
+	frame++;
+}
@@ -0,0 +1,122 @@
+#ifndef STREAMING_HPP
+#define STREAMING_HPP
+
+#include <vector>
+#include <atomic>
+
+// Loads running on the job system at once, and cells copied into the mesh
+// pool per frame, so neither the workers nor a frame take a spike
+#define STREAM_MAX_LOADS 4
+#define STREAM_UPLOADS_PER_FRAME 4
+
+class JobSystem;
+class MeshPool;
+
+// What one cell holds once loaded : its meshes, ready for the mesh pool,
+// and their triangle BVHs for picking
+struct CellContent {
+	std::vector<std::vector<MeshVertex> > vertices;
+	std::vector<std::vector<unsigned int> > indices;
+	std::vector<MeshBVH> bvhs;
+};
+
+// Fills the content of a cell. Runs on a worker thread.
+typedef void (*CellLoader)(int cell, CellContent & out_content);
+
+struct StreamingStatistics {
+	size_t cpuBytes, gpuBytes;   // Resident now
+	size_t cpuBudget, gpuBudget;
+	int cpuCells, gpuCells;      // Cells resident on each side
+	int gpuSlots;                // Cells the GPU budget has room for, 0 until the first upload
+	int queued;                  // Requested cells neither loaded nor loading
+	int loading;
+	long long loads, uploads;
+	long long cpuEvictions, gpuEvictions;
+};
+
+// Streams the content of the cells of a spatial grid in and out within fixed
+// CPU and GPU memory budgets.
+//
+// Every frame the renderer requests the cells it wants, with their distance
+// to the camera : the visible cells, which need their meshes on the GPU, and
+// the cells around the camera, which are only loaded ahead of time. update()
+// then starts the nearest missing loads on the job system, copies the nearest
+// loaded visible cells into the mesh pool and evicts what went over budget,
+// least recently requested first. Until a cell is resident the renderer
+// draws a placeholder of its own.
+//
+// GPU memory is a fixed number of slots in the mesh pool, as many as the
+// budget holds cells; a cell moving in overwrites the meshes of the one it
+// evicts. Every cell must therefore have the same number of meshes, with the
+// same vertex and index counts. The CPU copies are a cache of their own :
+// a cell evicted from the GPU moves back in without loading again while its
+// copy is still resident. The copies come from a pool : a cell loading into
+// one another cell left keeps its vectors' capacity.
+class CellStreamer {
+public:
+	CellStreamer();
+
+	void create(int cellCount, CellLoader loader, size_t cpuBudget, size_t gpuBudget);
+	// Waits for the loads in flight, then drops all content
+	void destroy();
+	// Drops all content, for when the loader's output changed. Waits for the
+	// loads in flight. The slots stay allocated.
+	void clear();
+
+	// Asks for a cell this frame. Requesting it again keeps the nearest
+	// distance; visible once means visible for the frame.
+	void request(int cell, float distance, bool visible);
+
+	// Applies the requests since the last call. On the GL thread, which must
+	// be the one the job system was started from.
+	void update(MeshPool & pool, JobSystem & jobs);
+
+	bool resident(int cell) const { return cells[cell].slot >= 0; }
+	// Mesh pool id of a resident cell's mesh, and its triangle BVH
+	int mesh(int cell, int index) const { return slots[cells[cell].slot].meshes[index]; }
+	const MeshBVH & meshBVH(int cell, int index) const { return slots[cells[cell].slot].bvhs[index]; }
+
+	// Cells that moved in or out of the GPU in the last update()
+	const std::vector<int> & changedCells() const { return changed; }
+
+	const StreamingStatistics & statistics() const { return stats; }
+
+private:
+	enum LoadState { CELL_UNLOADED, CELL_LOADING, CELL_LOADED };
+
+	struct Cell {
+		CellContent * content; // From contents while loading or loaded, NULL otherwise
+		size_t cpuBytes;
+		int slot;              // -1 when not on the GPU
+		long long requested;   // Frame of the last request, -1 never
+		long long visible;     // Frame it was last requested as visible
+		float distance;
+		bool discard;          // Dropped by clear() while loading
+	};
+	struct Slot {
+		int cell;              // -1 when free
+		std::vector<int> meshes;
+		std::vector<MeshBVH> bvhs;
+	};
+
+	void load(int cell);
+	void collectLoads();
+	bool upload(MeshPool & pool, int cell);
+	void evictCpu();
+	void waitForLoads();
+
+	std::vector<Cell> cells;
+	ObjectPool<CellContent> contents; // Evicted contents, refilled without allocating much
+	std::atomic<int> * loadStates; // Per cell, LoadState, written by the loading worker
+	std::vector<Slot> slots;
+	std::vector<int> requests;      // Cells requested since the last update
+	std::vector<int> loadingCells;
+	std::vector<int> changed;
+	std::atomic<int> loadsInFlight;
+	CellLoader loader;
+	size_t cellGpuBytes;
+	long long frame;
+	StreamingStatistics stats;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef TABLEGEN_HPP
+#define TABLEGEN_HPP
+
+// Geometry generator for furniture built out of boxes. Everything here is
+// constexpr, so a fixed assembly is generated by the compiler and costs
+// nothing at runtime, while the same functions rebuild an edited assembly at
+// runtime in a few microseconds.
+
+#define BOX_FACE_COUNT 6
+#define BOX_VERTEX_COUNT 24 // 4 per face, faces do not share normals or UVs
+#define BOX_INDEX_COUNT 36
+
+// An axis aligned box, in model space
+struct Box {
+	float min[3];
+	float max[3];
+};
+
+template <int BOXES>
+struct BoxAssembly {
+	Box boxes[BOXES];
+
+	constexpr BoxAssembly() : boxes() {}
+};
+
+// Counter-clockwise triangles with outward normals. Box b owns vertices
+// [b * BOX_VERTEX_COUNT, (b + 1) * BOX_VERTEX_COUNT) and indices
+// [b * BOX_INDEX_COUNT, (b + 1) * BOX_INDEX_COUNT). Indices are relative to
+// the box's first vertex, so every box can be used as a mesh of its own.
+template <int BOXES>
+struct AssemblyGeometry {
+	static const int VERTEX_COUNT = BOXES * BOX_VERTEX_COUNT;
+	static const int INDEX_COUNT = BOXES * BOX_INDEX_COUNT;
+
+	float positions[VERTEX_COUNT * 3];
+	float uvs[VERTEX_COUNT * 2];
+	float normals[VERTEX_COUNT * 3];
+	unsigned int indices[INDEX_COUNT];
+
+	constexpr AssemblyGeometry() : positions(), uvs(), normals(), indices() {}
+};
+
+// Writes the 4 vertices and 6 indices of one face. The face is perpendicular
+// to axis and faces the positive direction when positive is true. u and v are
+// the two other axes, ordered so that u x v points out of the box.
+template <int BOXES>
+constexpr void emitBoxFace(AssemblyGeometry<BOXES> & g, const Box & box, int firstVertex, int firstIndex, int axis, bool positive)
+{
+	int u = positive ? (axis + 1) % 3 : (axis + 2) % 3;
+	int v = positive ? (axis + 2) % 3 : (axis + 1) % 3;
+	float plane = positive ? box.max[axis] : box.min[axis];
+	float extentU = box.max[u] - box.min[u];
+	float extentV = box.max[v] - box.min[v];
+
+	const int corners[4][2] = { {0, 0}, {1, 0}, {1, 1}, {0, 1} };
+	for (int c = 0; c < 4; c++) {
+		int vertex = firstVertex + c;
+		int cu = corners[c][0], cv = corners[c][1];
+
+		float position[3] = { 0.0f, 0.0f, 0.0f };
+		position[axis] = plane;
+		position[u] = cu ? box.max[u] : box.min[u];
+		position[v] = cv ? box.max[v] : box.min[v];
+		for (int k = 0; k < 3; k++) {
+			g.positions[vertex * 3 + k] = position[k];
+			g.normals[vertex * 3 + k] = k == axis ? (positive ? 1.0f : -1.0f) : 0.0f;
+		}
+
+		// The wood grain (texture V) runs along the face's long side, and the
+		// short side takes the matching fraction of the texture width so the
+		// grain is never stretched
+		if (extentV >= extentU) {
+			g.uvs[vertex * 2] = cu * (extentV > 0.0f ? extentU / extentV : 0.0f);
+			g.uvs[vertex * 2 + 1] = (float)cv;
+		}
+		else {
+			g.uvs[vertex * 2] = cv * (extentU > 0.0f ? extentV / extentU : 0.0f);
+			g.uvs[vertex * 2 + 1] = (float)cu;
+		}
+	}
+
+	int local = firstVertex % BOX_VERTEX_COUNT;
+	const int order[6] = { 0, 1, 2, 0, 2, 3 };
+	for (int i = 0; i < 6; i++)
+		g.indices[firstIndex + i] = (unsigned int)(local + order[i]);
+}
+
+template <int BOXES>
+constexpr AssemblyGeometry<BOXES> buildAssemblyGeometry(const BoxAssembly<BOXES> & assembly)
+{
+	AssemblyGeometry<BOXES> g;
+	for (int b = 0; b < BOXES; b++) {
+		for (int face = 0; face < BOX_FACE_COUNT; face++) {
+			emitBoxFace(g, assembly.boxes[b],
+				b * BOX_VERTEX_COUNT + face * 4,
+				b * BOX_INDEX_COUNT + face * 6,
+				face / 2, face % 2 == 1);
+		}
+	}
+	return g;
+}
+
+// Parts of the table, in the order buildTableAssembly() emits them
+enum TablePart {
+	TABLE_LEG_FRONT_LEFT,
+	TABLE_LEG_FRONT_RIGHT,
+	TABLE_LEG_BACK_LEFT,
+	TABLE_LEG_BACK_RIGHT,
+	TABLE_TOP,
+	TABLE_BRIDGE_LEFT,
+	TABLE_BRIDGE_FRONT,
+	TABLE_BRIDGE_RIGHT,
+	TABLE_BRIDGE_BACK,
+	TABLE_PART_COUNT
+};
+
+// What a configurator can change. X is width, Y depth and Z height; the table
+// is centered on the origin.
+struct TableDimensions {
+	float topWidth;
+	float topDepth;
+	float topThickness;
+	float height;          // Floor to top surface
+	float legThickness;
+	float legInset;        // From the edge of the top to the outside of the legs
+	float bridgeHeight;    // Floor to the underside of the bridges
+	float bridgeThickness;
+};
+
+// The table of the original model
+constexpr TableDimensions DEFAULT_TABLE_DIMENSIONS = {
+	0.51f, 0.51f, 0.03f, 1.25f, 0.07f, 0.02f, 0.30f, 0.07f
+};
+
+typedef BoxAssembly<TABLE_PART_COUNT> TableAssembly;
+typedef AssemblyGeometry<TABLE_PART_COUNT> TableGeometry;
+
+constexpr Box makeBox(float x0, float y0, float z0, float x1, float y1, float z1)
+{
+	Box box = { { x0, y0, z0 }, { x1, y1, z1 } };
+	return box;
+}
+
+constexpr TableAssembly buildTableAssembly(const TableDimensions & d)
+{
+	float floor = -d.height * 0.5f;
+	float underTop = d.height * 0.5f - d.topThickness;
+	float legX = d.topWidth * 0.5f - d.legInset; // Outside of the legs
+	float legY = d.topDepth * 0.5f - d.legInset;
+	float innerX = legX - d.legThickness;        // Inside of the legs
+	float innerY = legY - d.legThickness;
+	float bridgeBottom = floor + d.bridgeHeight;
+	float bridgeTop = bridgeBottom + d.bridgeThickness;
+
+	TableAssembly a;
+	a.boxes[TABLE_LEG_FRONT_LEFT] = makeBox(-legX, -legY, floor, -innerX, -innerY, underTop);
+	a.boxes[TABLE_LEG_FRONT_RIGHT] = makeBox(innerX, -legY, floor, legX, -innerY, underTop);
+	a.boxes[TABLE_LEG_BACK_LEFT] = makeBox(-legX, innerY, floor, -innerX, legY, underTop);
+	a.boxes[TABLE_LEG_BACK_RIGHT] = makeBox(innerX, innerY, floor, legX, legY, underTop);
+	a.boxes[TABLE_TOP] = makeBox(-d.topWidth * 0.5f, -d.topDepth * 0.5f, underTop, d.topWidth * 0.5f, d.topDepth * 0.5f, d.height * 0.5f);
+	a.boxes[TABLE_BRIDGE_LEFT] = makeBox(-legX, -innerY, bridgeBottom, -innerX, innerY, bridgeTop);
+	a.boxes[TABLE_BRIDGE_FRONT] = makeBox(-innerX, -legY, bridgeBottom, innerX, -innerY, bridgeTop);
+	a.boxes[TABLE_BRIDGE_RIGHT] = makeBox(innerX, -innerY, bridgeBottom, legX, innerY, bridgeTop);
+	a.boxes[TABLE_BRIDGE_BACK] = makeBox(-innerX, innerY, bridgeBottom, innerX, legY, bridgeTop);
+	return a;
+}
+
+constexpr TableGeometry buildTableGeometry(const TableDimensions & d)
+{
+	return buildAssemblyGeometry(buildTableAssembly(d));
+}
+
+// Low detail stand-in for a table : one box around all of its parts
+constexpr BoxAssembly<1> buildTableBlock(const TableDimensions & d)
+{
+	BoxAssembly<1> a;
+	a.boxes[0] = makeBox(-d.topWidth * 0.5f, -d.topDepth * 0.5f, -d.height * 0.5f, d.topWidth * 0.5f, d.topDepth * 0.5f, d.height * 0.5f);
+	return a;
+}
+
+#endif
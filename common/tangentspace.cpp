@@ -0,0 +1,506 @@
+#include <vector>
+#include <unordered_map>
+#include <math.h>
+#include <string.h>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TANGENTSPACE_SSE2 1
+#endif
+
+#include "jobsystem.hpp"
+#include "tangentspace.hpp"
+
+// Ranges of triangles, corners or vertices shorter than this are not worth
+// splitting into jobs
+#define TANGENTSPACE_PARALLEL_THRESHOLD 32768
+// Smallest range of triangles, corners or vertices one job takes
+#define TANGENTSPACE_CHUNK 4096
+// Frames a vertex is split into at most. A corner that would start one more
+// joins a group of its handedness.
+#define TANGENT_MAX_GROUPS 8
+// Corners of a vertex whose tangents are further apart than 90 degrees get
+// a vertex of their own
+#define TANGENT_SPLIT_COS 0.0f
+
+// Runs body(begin, end) over [0, count), on the threads of the job system
+// for large counts. Safe from inside jobs : the calling thread works along
+// instead of starting threads of its own.
+template <typename Body>
+static void parallelRange(JobSystem * jobs, size_t count, const Body & body)
+{
+	if (jobs && count >= TANGENTSPACE_PARALLEL_THRESHOLD)
+		jobs->parallelFor(count, TANGENTSPACE_CHUNK, body);
+	else if (count > 0)
+		body((size_t)0, count);
+}
+
+// Positions of every triangle's three corners, one array per coordinate
+struct TriangleSoA {
+	std::vector<float> ax, ay, az, bx, by, bz, cx, cy, cz;
+
+	void resize(size_t n) {
+		ax.resize(n); ay.resize(n); az.resize(n);
+		bx.resize(n); by.resize(n); bz.resize(n);
+		cx.resize(n); cy.resize(n); cz.resize(n);
+	}
+};
+
+// Face data written by the SIMD pass
+struct FaceData {
+	std::vector<float> nx, ny, nz;   // Unit face normal
+	std::vector<float> area;         // Twice the triangle area
+	std::vector<float> angleA, angleB, angleC; // Corner angles in radians
+
+	void resize(size_t n) {
+		nx.resize(n); ny.resize(n); nz.resize(n); area.resize(n);
+		angleA.resize(n); angleB.resize(n); angleC.resize(n);
+	}
+};
+
+static float scalarAngle(float ux, float uy, float uz, float vx, float vy, float vz)
+{
+	float lengths = sqrtf((ux*ux + uy*uy + uz*uz) * (vx*vx + vy*vy + vz*vz));
+	if (lengths <= 0.0f)
+		return 0.0f;
+	float c = (ux*vx + uy*vy + uz*vz) / lengths;
+	if (c > 1.0f) c = 1.0f;
+	if (c < -1.0f) c = -1.0f;
+	return acosf(c);
+}
+
+static void scalarFaces(const TriangleSoA & t, FaceData & f, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++) {
+		float e1x = t.bx[i] - t.ax[i], e1y = t.by[i] - t.ay[i], e1z = t.bz[i] - t.az[i];
+		float e2x = t.cx[i] - t.ax[i], e2y = t.cy[i] - t.ay[i], e2z = t.cz[i] - t.az[i];
+		float e3x = t.cx[i] - t.bx[i], e3y = t.cy[i] - t.by[i], e3z = t.cz[i] - t.bz[i];
+		float nx = e1y*e2z - e1z*e2y, ny = e1z*e2x - e1x*e2z, nz = e1x*e2y - e1y*e2x;
+		float length = sqrtf(nx*nx + ny*ny + nz*nz);
+		float inverse = length > 0.0f ? 1.0f / length : 0.0f;
+		f.nx[i] = nx * inverse; f.ny[i] = ny * inverse; f.nz[i] = nz * inverse;
+		f.area[i] = length;
+		f.angleA[i] = scalarAngle(e1x, e1y, e1z, e2x, e2y, e2z);
+		f.angleB[i] = scalarAngle(-e1x, -e1y, -e1z, e3x, e3y, e3z);
+		f.angleC[i] = scalarAngle(-e2x, -e2y, -e2z, -e3x, -e3y, -e3z);
+	}
+}
+
+#ifdef TANGENTSPACE_SSE2
+// acos with an absolute error below 1e-4, plenty for weights
+// (Abramowitz and Stegun 4.4.45)
+static inline __m128 acos_ps(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128 negative = _mm_cmplt_ps(x, _mm_setzero_ps());
+	__m128 a = _mm_min_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), x), one);
+	__m128 p = _mm_set1_ps(-0.0187293f);
+	p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(0.0742610f));
+	p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(-0.2121144f));
+	p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(1.5707288f));
+	__m128 r = _mm_mul_ps(p, _mm_sqrt_ps(_mm_sub_ps(one, a)));
+	__m128 mirrored = _mm_sub_ps(_mm_set1_ps(3.14159265f), r);
+	return _mm_or_ps(_mm_and_ps(negative, mirrored), _mm_andnot_ps(negative, r));
+}
+
+static inline __m128 angle_ps(__m128 ux, __m128 uy, __m128 uz, __m128 vx, __m128 vy, __m128 vz)
+{
+	__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ux, vx), _mm_mul_ps(uy, vy)), _mm_mul_ps(uz, vz));
+	__m128 uu = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ux, ux), _mm_mul_ps(uy, uy)), _mm_mul_ps(uz, uz));
+	__m128 vv = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+	__m128 lengths = _mm_sqrt_ps(_mm_mul_ps(uu, vv));
+	__m128 valid = _mm_cmpgt_ps(lengths, _mm_setzero_ps());
+	__m128 c = _mm_div_ps(dot, _mm_or_ps(_mm_and_ps(valid, lengths), _mm_andnot_ps(valid, _mm_set1_ps(1.0f))));
+	c = _mm_max_ps(_mm_min_ps(c, _mm_set1_ps(1.0f)), _mm_set1_ps(-1.0f));
+	return _mm_and_ps(valid, acos_ps(c));
+}
+
+// Four triangles per iteration, the tail goes through the scalar path
+static void simdFaces(const TriangleSoA & t, FaceData & f, size_t begin, size_t end)
+{
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 ax = _mm_loadu_ps(&t.ax[i]), ay = _mm_loadu_ps(&t.ay[i]), az = _mm_loadu_ps(&t.az[i]);
+		__m128 bx = _mm_loadu_ps(&t.bx[i]), by = _mm_loadu_ps(&t.by[i]), bz = _mm_loadu_ps(&t.bz[i]);
+		__m128 cx = _mm_loadu_ps(&t.cx[i]), cy = _mm_loadu_ps(&t.cy[i]), cz = _mm_loadu_ps(&t.cz[i]);
+
+		__m128 e1x = _mm_sub_ps(bx, ax), e1y = _mm_sub_ps(by, ay), e1z = _mm_sub_ps(bz, az);
+		__m128 e2x = _mm_sub_ps(cx, ax), e2y = _mm_sub_ps(cy, ay), e2z = _mm_sub_ps(cz, az);
+		__m128 e3x = _mm_sub_ps(cx, bx), e3y = _mm_sub_ps(cy, by), e3z = _mm_sub_ps(cz, bz);
+
+		__m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+		__m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+		__m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+		__m128 valid = _mm_cmpgt_ps(length, _mm_setzero_ps());
+		__m128 inverse = _mm_and_ps(valid, _mm_div_ps(_mm_set1_ps(1.0f), length));
+
+		_mm_storeu_ps(&f.nx[i], _mm_mul_ps(nx, inverse));
+		_mm_storeu_ps(&f.ny[i], _mm_mul_ps(ny, inverse));
+		_mm_storeu_ps(&f.nz[i], _mm_mul_ps(nz, inverse));
+		_mm_storeu_ps(&f.area[i], length);
+
+		__m128 zero = _mm_setzero_ps();
+		_mm_storeu_ps(&f.angleA[i], angle_ps(e1x, e1y, e1z, e2x, e2y, e2z));
+		_mm_storeu_ps(&f.angleB[i], angle_ps(_mm_sub_ps(zero, e1x), _mm_sub_ps(zero, e1y), _mm_sub_ps(zero, e1z), e3x, e3y, e3z));
+		_mm_storeu_ps(&f.angleC[i], angle_ps(_mm_sub_ps(zero, e2x), _mm_sub_ps(zero, e2y), _mm_sub_ps(zero, e2z),
+			_mm_sub_ps(zero, e3x), _mm_sub_ps(zero, e3y), _mm_sub_ps(zero, e3z)));
+	}
+	scalarFaces(t, f, i, end);
+}
+#endif
+
+// Hash of a position's exact bit pattern, used to weld identical corners
+struct PositionKey {
+	float x, y, z;
+	bool operator==(const PositionKey & o) const { return x == o.x && y == o.y && z == o.z; }
+};
+struct PositionKeyHash {
+	size_t operator()(const PositionKey & k) const {
+		unsigned int bits[3];
+		memcpy(bits, &k, sizeof(bits));
+		return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+	}
+};
+
+void computeSmoothNormals(
+	const std::vector<glm::vec3> & corners,
+	float creaseAngle,
+	NormalWeighting weighting,
+	std::vector<glm::vec3> & out_normals,
+	JobSystem * jobs
+){
+	size_t triangleCount = corners.size() / 3;
+	out_normals.resize(triangleCount * 3);
+	if (triangleCount == 0)
+		return;
+
+	// Structure-of-arrays copy of the corner positions
+	TriangleSoA soa;
+	soa.resize(triangleCount);
+	for (size_t i = 0; i < triangleCount; i++) {
+		soa.ax[i] = corners[i*3  ].x; soa.ay[i] = corners[i*3  ].y; soa.az[i] = corners[i*3  ].z;
+		soa.bx[i] = corners[i*3+1].x; soa.by[i] = corners[i*3+1].y; soa.bz[i] = corners[i*3+1].z;
+		soa.cx[i] = corners[i*3+2].x; soa.cy[i] = corners[i*3+2].y; soa.cz[i] = corners[i*3+2].z;
+	}
+
+	FaceData faces;
+	faces.resize(triangleCount);
+	parallelRange(jobs, triangleCount, [&](size_t begin, size_t end) {
+#ifdef TANGENTSPACE_SSE2
+		simdFaces(soa, faces, begin, end);
+#else
+		scalarFaces(soa, faces, begin, end);
+#endif
+	});
+
+	// Weld corners by position and list the corners around each position
+	std::unordered_map<PositionKey, unsigned int, PositionKeyHash> welded;
+	welded.reserve(corners.size());
+	std::vector<unsigned int> positionOfCorner(corners.size());
+	for (size_t c = 0; c < corners.size(); c++) {
+		PositionKey key = {corners[c].x, corners[c].y, corners[c].z};
+		std::pair<std::unordered_map<PositionKey, unsigned int, PositionKeyHash>::iterator, bool> inserted =
+			welded.insert(std::make_pair(key, (unsigned int)welded.size()));
+		positionOfCorner[c] = inserted.first->second;
+	}
+	std::vector<unsigned int> firstCorner(welded.size() + 1, 0);
+	for (size_t c = 0; c < corners.size(); c++)
+		firstCorner[positionOfCorner[c] + 1]++;
+	for (size_t p = 0; p < welded.size(); p++)
+		firstCorner[p + 1] += firstCorner[p];
+	std::vector<unsigned int> cornersAround(corners.size());
+	std::vector<unsigned int> fill(firstCorner.begin(), firstCorner.end() - 1);
+	for (size_t c = 0; c < corners.size(); c++)
+		cornersAround[fill[positionOfCorner[c]]++] = (unsigned int)c;
+
+	const float cosCrease = cosf(creaseAngle * 3.14159265f / 180.0f);
+	const float * angles[3] = { &faces.angleA[0], &faces.angleB[0], &faces.angleC[0] };
+
+	// Every corner only reads shared data, so corners are independent
+	parallelRange(jobs, corners.size(), [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; c++) {
+			size_t own = c / 3;
+			float ox = faces.nx[own], oy = faces.ny[own], oz = faces.nz[own];
+			float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+
+			unsigned int p = positionOfCorner[c];
+			for (unsigned int k = firstCorner[p]; k < firstCorner[p + 1]; k++) {
+				unsigned int other = cornersAround[k];
+				size_t face = other / 3;
+				float fx = faces.nx[face], fy = faces.ny[face], fz = faces.nz[face];
+				if (fx*ox + fy*oy + fz*oz < cosCrease)
+					continue; // Across a crease, keep the edge hard
+				float weight = weighting == NORMAL_WEIGHT_ANGLE ? angles[other % 3][face] : faces.area[face];
+				sx += fx * weight; sy += fy * weight; sz += fz * weight;
+			}
+
+			float length = sqrtf(sx*sx + sy*sy + sz*sz);
+			if (length > 0.0f)
+				out_normals[c] = glm::vec3(sx / length, sy / length, sz / length);
+			else
+				out_normals[c] = glm::vec3(ox, oy, oz);
+		}
+	});
+}
+
+// UVs of every triangle's three corners, one array per coordinate
+struct TriangleUVSoA {
+	std::vector<float> au, av, bu, bv, cu, cv;
+
+	void resize(size_t n) {
+		au.resize(n); av.resize(n);
+		bu.resize(n); bv.resize(n);
+		cu.resize(n); cv.resize(n);
+	}
+};
+
+// UV frame of every triangle, written by the SIMD pass. Tangent and
+// bitangent are unit length, or zero when the UVs have no gradient.
+struct TriangleFrames {
+	std::vector<float> tx, ty, tz, bx, by, bz;
+	std::vector<float> angleA, angleB, angleC; // Corner angles in radians
+
+	void resize(size_t n) {
+		tx.resize(n); ty.resize(n); tz.resize(n);
+		bx.resize(n); by.resize(n); bz.resize(n);
+		angleA.resize(n); angleB.resize(n); angleC.resize(n);
+	}
+};
+
+static void scalarFrames(const TriangleSoA & t, const TriangleUVSoA & uv, TriangleFrames & f, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++) {
+		float e1x = t.bx[i] - t.ax[i], e1y = t.by[i] - t.ay[i], e1z = t.bz[i] - t.az[i];
+		float e2x = t.cx[i] - t.ax[i], e2y = t.cy[i] - t.ay[i], e2z = t.cz[i] - t.az[i];
+		float e3x = t.cx[i] - t.bx[i], e3y = t.cy[i] - t.by[i], e3z = t.cz[i] - t.bz[i];
+		float du1 = uv.bu[i] - uv.au[i], dv1 = uv.bv[i] - uv.av[i];
+		float du2 = uv.cu[i] - uv.au[i], dv2 = uv.cv[i] - uv.av[i];
+
+		float determinant = du1 * dv2 - dv1 * du2;
+		float r = fabsf(determinant) >= 1e-12f ? 1.0f / determinant : 0.0f;
+		float tx = (e1x * dv2 - e2x * dv1) * r, ty = (e1y * dv2 - e2y * dv1) * r, tz = (e1z * dv2 - e2z * dv1) * r;
+		float bx = (e2x * du1 - e1x * du2) * r, by = (e2y * du1 - e1y * du2) * r, bz = (e2z * du1 - e1z * du2) * r;
+
+		// MikkTSpace weighs each face by its corner angle, and only by the
+		// direction of the gradients, not their magnitude
+		float tangentLength = sqrtf(tx*tx + ty*ty + tz*tz), bitangentLength = sqrtf(bx*bx + by*by + bz*bz);
+		float tangentInverse = tangentLength > 0.0f ? 1.0f / tangentLength : 0.0f;
+		float bitangentInverse = bitangentLength > 0.0f ? 1.0f / bitangentLength : 0.0f;
+		f.tx[i] = tx * tangentInverse; f.ty[i] = ty * tangentInverse; f.tz[i] = tz * tangentInverse;
+		f.bx[i] = bx * bitangentInverse; f.by[i] = by * bitangentInverse; f.bz[i] = bz * bitangentInverse;
+
+		f.angleA[i] = scalarAngle(e1x, e1y, e1z, e2x, e2y, e2z);
+		f.angleB[i] = scalarAngle(-e1x, -e1y, -e1z, e3x, e3y, e3z);
+		f.angleC[i] = scalarAngle(-e2x, -e2y, -e2z, -e3x, -e3y, -e3z);
+	}
+}
+
+#ifdef TANGENTSPACE_SSE2
+// Scales (x, y, z) to unit length, or to zero when it is zero
+static inline void normalize_ps(__m128 & x, __m128 & y, __m128 & z)
+{
+	__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+	__m128 inverse = _mm_and_ps(_mm_cmpgt_ps(length, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), length));
+	x = _mm_mul_ps(x, inverse);
+	y = _mm_mul_ps(y, inverse);
+	z = _mm_mul_ps(z, inverse);
+}
+
+// Four triangles per iteration, the tail goes through the scalar path
+static void simdFrames(const TriangleSoA & t, const TriangleUVSoA & uv, TriangleFrames & f, size_t begin, size_t end)
+{
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 ax = _mm_loadu_ps(&t.ax[i]), ay = _mm_loadu_ps(&t.ay[i]), az = _mm_loadu_ps(&t.az[i]);
+		__m128 bx = _mm_loadu_ps(&t.bx[i]), by = _mm_loadu_ps(&t.by[i]), bz = _mm_loadu_ps(&t.bz[i]);
+		__m128 cx = _mm_loadu_ps(&t.cx[i]), cy = _mm_loadu_ps(&t.cy[i]), cz = _mm_loadu_ps(&t.cz[i]);
+		__m128 au = _mm_loadu_ps(&uv.au[i]), av = _mm_loadu_ps(&uv.av[i]);
+
+		__m128 e1x = _mm_sub_ps(bx, ax), e1y = _mm_sub_ps(by, ay), e1z = _mm_sub_ps(bz, az);
+		__m128 e2x = _mm_sub_ps(cx, ax), e2y = _mm_sub_ps(cy, ay), e2z = _mm_sub_ps(cz, az);
+		__m128 e3x = _mm_sub_ps(cx, bx), e3y = _mm_sub_ps(cy, by), e3z = _mm_sub_ps(cz, bz);
+		__m128 du1 = _mm_sub_ps(_mm_loadu_ps(&uv.bu[i]), au), dv1 = _mm_sub_ps(_mm_loadu_ps(&uv.bv[i]), av);
+		__m128 du2 = _mm_sub_ps(_mm_loadu_ps(&uv.cu[i]), au), dv2 = _mm_sub_ps(_mm_loadu_ps(&uv.cv[i]), av);
+
+		__m128 determinant = _mm_sub_ps(_mm_mul_ps(du1, dv2), _mm_mul_ps(dv1, du2));
+		__m128 magnitude = _mm_andnot_ps(_mm_set1_ps(-0.0f), determinant);
+		__m128 r = _mm_and_ps(_mm_cmpge_ps(magnitude, _mm_set1_ps(1e-12f)), _mm_div_ps(_mm_set1_ps(1.0f), determinant));
+
+		__m128 tx = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1x, dv2), _mm_mul_ps(e2x, dv1)), r);
+		__m128 ty = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1y, dv2), _mm_mul_ps(e2y, dv1)), r);
+		__m128 tz = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1z, dv2), _mm_mul_ps(e2z, dv1)), r);
+		__m128 sx = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2x, du1), _mm_mul_ps(e1x, du2)), r);
+		__m128 sy = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2y, du1), _mm_mul_ps(e1y, du2)), r);
+		__m128 sz = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2z, du1), _mm_mul_ps(e1z, du2)), r);
+		normalize_ps(tx, ty, tz);
+		normalize_ps(sx, sy, sz);
+		_mm_storeu_ps(&f.tx[i], tx); _mm_storeu_ps(&f.ty[i], ty); _mm_storeu_ps(&f.tz[i], tz);
+		_mm_storeu_ps(&f.bx[i], sx); _mm_storeu_ps(&f.by[i], sy); _mm_storeu_ps(&f.bz[i], sz);
+
+		__m128 zero = _mm_setzero_ps();
+		_mm_storeu_ps(&f.angleA[i], angle_ps(e1x, e1y, e1z, e2x, e2y, e2z));
+		_mm_storeu_ps(&f.angleB[i], angle_ps(_mm_sub_ps(zero, e1x), _mm_sub_ps(zero, e1y), _mm_sub_ps(zero, e1z), e3x, e3y, e3z));
+		_mm_storeu_ps(&f.angleC[i], angle_ps(_mm_sub_ps(zero, e2x), _mm_sub_ps(zero, e2y), _mm_sub_ps(zero, e2z),
+			_mm_sub_ps(zero, e3x), _mm_sub_ps(zero, e3y), _mm_sub_ps(zero, e3z)));
+	}
+	scalarFrames(t, uv, f, i, end);
+}
+#endif
+
+// The tangent of a triangle projected on the plane of a vertex normal, and
+// the handedness of its frame there. False when the triangle gives the
+// vertex no tangent direction.
+static bool cornerFrame(const TriangleFrames & f, size_t triangle, const glm::vec3 & n, glm::vec3 & out_tangent, float & out_sign)
+{
+	glm::vec3 t(f.tx[triangle], f.ty[triangle], f.tz[triangle]);
+	glm::vec3 b(f.bx[triangle], f.by[triangle], f.bz[triangle]);
+	t = t - n * glm::dot(n, t);
+	float length = glm::length(t);
+	if (length < 1e-6f)
+		return false;
+	out_tangent = t / length;
+	out_sign = glm::dot(glm::cross(n, out_tangent), b) < 0.0f ? -1.0f : 1.0f;
+	return true;
+}
+
+void computeTangents(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	std::vector<glm::vec4> & out_tangents,
+	JobSystem * jobs
+){
+	size_t vertexCount = vertices.size();
+	size_t triangleCount = indices.size() / 3;
+	size_t cornerCount = triangleCount * 3;
+
+	// Structure-of-arrays copy of the corners
+	TriangleSoA soa;
+	TriangleUVSoA soaUV;
+	soa.resize(triangleCount);
+	soaUV.resize(triangleCount);
+	for (size_t i = 0; i < triangleCount; i++) {
+		const glm::vec3 & a = vertices[indices[i*3]], & b = vertices[indices[i*3+1]], & c = vertices[indices[i*3+2]];
+		const glm::vec2 & ua = uvs[indices[i*3]], & ub = uvs[indices[i*3+1]], & uc = uvs[indices[i*3+2]];
+		soa.ax[i] = a.x; soa.ay[i] = a.y; soa.az[i] = a.z;
+		soa.bx[i] = b.x; soa.by[i] = b.y; soa.bz[i] = b.z;
+		soa.cx[i] = c.x; soa.cy[i] = c.y; soa.cz[i] = c.z;
+		soaUV.au[i] = ua.x; soaUV.av[i] = ua.y;
+		soaUV.bu[i] = ub.x; soaUV.bv[i] = ub.y;
+		soaUV.cu[i] = uc.x; soaUV.cv[i] = uc.y;
+	}
+
+	TriangleFrames frames;
+	frames.resize(triangleCount);
+	parallelRange(jobs, triangleCount, [&](size_t begin, size_t end) {
+#ifdef TANGENTSPACE_SSE2
+		simdFrames(soa, soaUV, frames, begin, end);
+#else
+		scalarFrames(soa, soaUV, frames, begin, end);
+#endif
+	});
+
+	// List the corners around each vertex
+	std::vector<unsigned int> firstCorner(vertexCount + 1, 0);
+	for (size_t c = 0; c < cornerCount; c++)
+		firstCorner[indices[c] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		firstCorner[v + 1] += firstCorner[v];
+	std::vector<unsigned int> cornersAround(cornerCount);
+	std::vector<unsigned int> fill(firstCorner.begin(), firstCorner.end() - 1);
+	for (size_t c = 0; c < cornerCount; c++)
+		cornersAround[fill[indices[c]]++] = (unsigned int)c;
+
+	// Group the corners of each vertex by frame : a corner joins the first
+	// group of its handedness whose tangent is close to its own, otherwise it
+	// starts a group. Corners without a tangent direction join group 0.
+	std::vector<unsigned char> cornerGroup(cornerCount, 0);
+	std::vector<unsigned int> groupCount(vertexCount, 1);
+	parallelRange(jobs, vertexCount, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; v++) {
+			glm::vec3 groupTangent[TANGENT_MAX_GROUPS];
+			float groupSign[TANGENT_MAX_GROUPS];
+			unsigned int groups = 0;
+			for (unsigned int k = firstCorner[v]; k < firstCorner[v + 1]; k++) {
+				unsigned int c = cornersAround[k];
+				glm::vec3 tangent;
+				float sign;
+				if (!cornerFrame(frames, c / 3, normals[v], tangent, sign))
+					continue;
+				unsigned int group = groups, sameSign = groups;
+				for (unsigned int g = 0; g < groups && group == groups; g++) {
+					if (groupSign[g] != sign)
+						continue;
+					if (sameSign == groups)
+						sameSign = g;
+					if (glm::dot(groupTangent[g], tangent) >= TANGENT_SPLIT_COS)
+						group = g;
+				}
+				if (group == groups && groups == TANGENT_MAX_GROUPS)
+					group = sameSign < groups ? sameSign : 0;
+				if (group == groups) {
+					groupTangent[groups] = tangent;
+					groupSign[groups] = sign;
+					groups++;
+				}
+				cornerGroup[c] = (unsigned char)group;
+			}
+			groupCount[v] = groups > 0 ? groups : 1;
+		}
+	});
+
+	// Every group past the first gets a copy of the vertex, appended
+	std::vector<unsigned int> firstCopy(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		firstCopy[v + 1] = firstCopy[v] + groupCount[v] - 1;
+	size_t totalCount = vertexCount + firstCopy[vertexCount];
+	vertices.resize(totalCount);
+	uvs.resize(totalCount);
+	normals.resize(totalCount);
+	out_tangents.resize(totalCount);
+
+	const float * angles[3] = { frames.angleA.data(), frames.angleB.data(), frames.angleC.data() };
+	parallelRange(jobs, vertexCount, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; v++) {
+			glm::vec3 tangents[TANGENT_MAX_GROUPS], bitangents[TANGENT_MAX_GROUPS];
+			for (unsigned int g = 0; g < groupCount[v]; g++)
+				tangents[g] = bitangents[g] = glm::vec3(0.0f);
+
+			for (unsigned int k = firstCorner[v]; k < firstCorner[v + 1]; k++) {
+				unsigned int c = cornersAround[k], face = c / 3, group = cornerGroup[c];
+				float angle = angles[c % 3][face];
+				tangents[group] += glm::vec3(frames.tx[face], frames.ty[face], frames.tz[face]) * angle;
+				bitangents[group] += glm::vec3(frames.bx[face], frames.by[face], frames.bz[face]) * angle;
+				if (group > 0)
+					indices[c] = (unsigned int)(vertexCount + firstCopy[v] + group - 1);
+			}
+
+			const glm::vec3 n = normals[v];
+			for (unsigned int g = 0; g < groupCount[v]; g++) {
+				// Gram-Schmidt orthogonalize
+				glm::vec3 t = tangents[g] - n * glm::dot(n, tangents[g]);
+				float length = glm::length(t);
+				if (length < 1e-12f) {
+					// Any vector perpendicular to the normal will do
+					t = fabsf(n.x) < 0.9f ? glm::cross(n, glm::vec3(1, 0, 0)) : glm::cross(n, glm::vec3(0, 1, 0));
+					length = glm::length(t);
+				}
+				t = t / length;
+
+				// Calculate handedness
+				float w = glm::dot(glm::cross(n, t), bitangents[g]) < 0.0f ? -1.0f : 1.0f;
+				size_t target = g == 0 ? v : vertexCount + firstCopy[v] + g - 1;
+				out_tangents[target] = glm::vec4(t, w);
+				if (g > 0) {
+					vertices[target] = vertices[v];
+					uvs[target] = uvs[v];
+					normals[target] = n;
+				}
+			}
+		}
+	});
+}
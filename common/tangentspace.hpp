@@ -0,0 +1,46 @@
+#ifndef TANGENTSPACE_HPP
+#define TANGENTSPACE_HPP
+
+class JobSystem;
+
+// How the faces around a vertex contribute to its smooth normal
+enum NormalWeighting {
+	NORMAL_WEIGHT_AREA,  // Larger faces pull harder
+	NORMAL_WEIGHT_ANGLE  // Each face counts by the angle of its corner at the vertex
+};
+
+// Computes one normal per corner of an unindexed, counter-clockwise triangle
+// list. Faces sharing a position are smoothed together unless the angle
+// between them is larger than creaseAngle (in degrees), in which case the
+// edge stays hard. Face normals are computed with SIMD over a
+// structure-of-arrays copy of the positions; large meshes are split into
+// parallel-for jobs when a job system is given. Callable from inside jobs.
+void computeSmoothNormals(
+	const std::vector<glm::vec3> & corners,
+	float creaseAngle,
+	NormalWeighting weighting,
+	std::vector<glm::vec3> & out_normals,
+	JobSystem * jobs = NULL
+);
+
+// Computes per-vertex tangents of an indexed mesh in the manner of
+// MikkTSpace, though not bit for bit like its reference code : per-triangle
+// tangents from the UV gradients (SIMD over structure-of-arrays corners),
+// angle-weighted and summed per vertex, orthogonalized against the normal,
+// with the bitangent handedness in w (bitangent = w * cross(normal, tangent)).
+//
+// Where the corners of a vertex disagree, across a mirrored UV seam (opposite
+// handedness) or where their tangents are more than 90 degrees apart, the
+// vertex is split : each further frame gets a copy of the vertex appended to
+// vertices, uvs and normals, and the indices of its corners are rewritten.
+// Large meshes are split into parallel-for jobs when a job system is given.
+void computeTangents(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	std::vector<glm::vec4> & out_tangents,
+	JobSystem * jobs = NULL
+);
+
+#endif
@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "gpuresources.hpp"
+#include "trace.hpp"
+
+std::atomic<bool> traceEnabled(false);
+bool traceDebugGroups = false;
+
+struct TraceEvent {
+	const char * name;
+	long long start, end; // CPU ns
+};
+
+// Events of one thread. Only the owner writes; the writer publishes count
+// after the event, so a reader sees complete events only.
+struct TraceThread {
+	TraceEvent events[TRACE_THREAD_EVENTS];
+	std::atomic<int> count;
+	std::atomic<int> generation; // Trace the events belong to
+	std::atomic<int> dropped;
+	char name[32]; // Copied, threads may end before the trace is written
+};
+
+static std::atomic<TraceThread*> traceThreads[TRACE_MAX_THREADS];
+static std::atomic<int> traceThreadCount(0);
+static std::atomic<int> traceGeneration(0);
+static long long traceStartTime = 0;
+
+static thread_local TraceThread * currentThread = NULL;
+static thread_local bool currentThreadFull = false; // No buffer left for the thread
+static thread_local const char * currentThreadName = NULL;
+
+static long long cpuNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void setName(TraceThread * thread, const char * name)
+{
+	snprintf(thread->name, sizeof(thread->name), "%s", name ? name : "");
+}
+
+// A new buffer, visible to traceWrite() once registered
+static TraceThread * registerThread(const char * name)
+{
+	int index = traceThreadCount.fetch_add(1);
+	if (index >= TRACE_MAX_THREADS)
+		return NULL;
+
+	TraceThread * thread = new TraceThread();
+	thread->count.store(0);
+	thread->generation.store(traceGeneration.load());
+	thread->dropped.store(0);
+	setName(thread, name);
+	traceThreads[index].store(thread, std::memory_order_release);
+	return thread;
+}
+
+// Appends to a buffer, emptying it first if it holds an older trace
+static void record(TraceThread * thread, const char * name, long long start, long long end)
+{
+	int generation = traceGeneration.load(std::memory_order_acquire);
+	if (thread->generation.load(std::memory_order_relaxed) != generation) {
+		thread->count.store(0, std::memory_order_relaxed);
+		thread->dropped.store(0, std::memory_order_relaxed);
+		thread->generation.store(generation, std::memory_order_release);
+	}
+
+	int index = thread->count.load(std::memory_order_relaxed);
+	if (index >= TRACE_THREAD_EVENTS) {
+		thread->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	TraceEvent & event = thread->events[index];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+	thread->count.store(index + 1, std::memory_order_release);
+}
+
+void traceStart()
+{
+	traceStartTime = cpuNanoseconds();
+	traceGeneration.fetch_add(1, std::memory_order_acq_rel);
+	traceEnabled.store(true);
+}
+
+void traceStop()
+{
+	traceEnabled.store(false);
+}
+
+void traceThreadName(const char * name)
+{
+	currentThreadName = name;
+	if (currentThread)
+		setName(currentThread, name);
+}
+
+long long traceBegin()
+{
+	return cpuNanoseconds();
+}
+
+void traceEnd(const char * name, long long start)
+{
+	long long end = cpuNanoseconds();
+	if (!currentThread) {
+		if (currentThreadFull)
+			return;
+		currentThread = registerThread(currentThreadName);
+		currentThreadFull = currentThread == NULL;
+		if (!currentThread)
+			return;
+	}
+	record(currentThread, name, start, end);
+}
+
+//GPU scopes, only touched by the GL thread
+struct GpuTraceSlot {
+	const char * name;
+	GLuint queries[2]; // Timestamps at the start and the end
+	bool grouped;      // A debug group was pushed
+};
+static GpuTraceSlot gpuSlots[TRACE_GPU_SCOPES];
+static std::vector<int> freeGpuSlots;
+static std::vector<int> pendingGpuSlots; // Ended, in the order they were issued
+static bool gpuSlotsCreated = false;
+static TraceThread * gpuTrack = NULL;
+static long long gpuToCpu = 0;       // Add to a GPU timestamp to get CPU time
+static long long lastCalibration = 0;
+
+static bool timerQueries()
+{
+	return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+}
+
+static bool debugGroups()
+{
+	return GLEW_VERSION_4_3 || GLEW_KHR_debug;
+}
+
+static void calibrateGpu()
+{
+	GLint64 gpuTime = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+	lastCalibration = cpuNanoseconds();
+	gpuToCpu = lastCalibration - gpuTime;
+}
+
+int traceGpuBegin(const char * name)
+{
+	// Only the group when not tracing or out of slots
+	int scope = TRACE_GPU_SCOPES;
+	bool grouped = false;
+	if (debugGroups()) {
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+		grouped = true;
+	}
+
+	if (traceEnabled.load(std::memory_order_relaxed) && timerQueries()) {
+		if (!gpuSlotsCreated) {
+			for (int i = TRACE_GPU_SCOPES - 1; i >= 0; i--) {
+				gpuSlots[i].queries[0] = GPU_CREATE(GPU_QUERY, GPU_MEMORY_OTHER, "Trace timestamp");
+				gpuSlots[i].queries[1] = GPU_CREATE(GPU_QUERY, GPU_MEMORY_OTHER, "Trace timestamp");
+				freeGpuSlots.push_back(i);
+			}
+			gpuSlotsCreated = true;
+			calibrateGpu();
+		}
+		if (!freeGpuSlots.empty()) {
+			scope = freeGpuSlots.back();
+			freeGpuSlots.pop_back();
+			gpuSlots[scope].name = name;
+			gpuSlots[scope].grouped = grouped;
+			glQueryCounter(gpuSlots[scope].queries[0], GL_TIMESTAMP);
+			return scope;
+		}
+	}
+	return grouped ? scope : -1;
+}
+
+void traceGpuEnd(int scope)
+{
+	if (scope == TRACE_GPU_SCOPES) {
+		glPopDebugGroup();
+		return;
+	}
+	glQueryCounter(gpuSlots[scope].queries[1], GL_TIMESTAMP);
+	pendingGpuSlots.push_back(scope);
+	if (gpuSlots[scope].grouped)
+		glPopDebugGroup();
+}
+
+void traceCollectGpu()
+{
+	if (pendingGpuSlots.empty())
+		return;
+
+	// The clocks drift apart slowly, measure the offset again now and then
+	if (cpuNanoseconds() - lastCalibration > 1000000000LL)
+		calibrateGpu();
+	if (!gpuTrack)
+		gpuTrack = registerThread("GPU");
+
+	// The GPU finishes scopes in the order they were issued
+	size_t done = 0;
+	for (; done < pendingGpuSlots.size(); done++) {
+		GpuTraceSlot & slot = gpuSlots[pendingGpuSlots[done]];
+		GLint available = 0;
+		glGetQueryObjectiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end);
+		if (gpuTrack)
+			record(gpuTrack, slot.name, (long long)start + gpuToCpu, (long long)end + gpuToCpu);
+		freeGpuSlots.push_back(pendingGpuSlots[done]);
+	}
+	pendingGpuSlots.erase(pendingGpuSlots.begin(), pendingGpuSlots.begin() + done);
+}
+
+void traceDestroyGpu()
+{
+	if (!gpuSlotsCreated)
+		return;
+	for (int i = 0; i < TRACE_GPU_SCOPES; i++) {
+		gpuResources.destroy(GPU_QUERY, gpuSlots[i].queries[0]);
+		gpuResources.destroy(GPU_QUERY, gpuSlots[i].queries[1]);
+	}
+	freeGpuSlots.clear();
+	pendingGpuSlots.clear();
+	gpuSlotsCreated = false;
+}
+
+// Writes s as a JSON string
+static void writeString(FILE * file, const char * s)
+{
+	fputc('"', file);
+	for (; s && *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fputc('\\', file);
+		if ((unsigned char)*s >= 0x20)
+			fputc(*s, file);
+	}
+	fputc('"', file);
+}
+
+bool traceWrite(const char * path)
+{
+	FILE * file = fopen(path, "w");
+	if (!file) {
+		printf("Trace : %s could not be opened\n", path);
+		return false;
+	}
+
+	int generation = traceGeneration.load(std::memory_order_acquire);
+	int threads = traceThreadCount.load();
+	if (threads > TRACE_MAX_THREADS)
+		threads = TRACE_MAX_THREADS;
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"FinalTable\"}}");
+	int events = 0, dropped = 0;
+	for (int t = 0; t < threads; t++) {
+		TraceThread * thread = traceThreads[t].load(std::memory_order_acquire);
+		if (!thread || thread->generation.load(std::memory_order_acquire) != generation)
+			continue;
+
+		char fallback[32];
+		snprintf(fallback, sizeof(fallback), "Thread %d", t);
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", t);
+		writeString(file, thread->name[0] ? thread->name : fallback);
+		fprintf(file, "}}");
+
+		int count = thread->count.load(std::memory_order_acquire);
+		for (int e = 0; e < count; e++) {
+			const TraceEvent & event = thread->events[e];
+			fprintf(file, ",\n{\"name\":");
+			writeString(file, event.name);
+			fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", t,
+				(event.start - traceStartTime) / 1000.0, (event.end - event.start) / 1000.0);
+		}
+		events += count;
+		dropped += thread->dropped.load(std::memory_order_relaxed);
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(file);
+
+	printf("Trace : %d events written to %s", events, path);
+	if (dropped > 0)
+		printf(", %d dropped", dropped);
+	printf("\n");
+	return true;
+}
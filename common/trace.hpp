@@ -0,0 +1,95 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+
+// Events each thread can record between two starts of the trace. Events
+// past this are dropped and counted.
+#define TRACE_THREAD_EVENTS 65536
+#define TRACE_MAX_THREADS 64
+
+// GPU scopes waiting for their timer queries
+#define TRACE_GPU_SCOPES 256
+
+// Timeline of CPU scopes from every thread and GPU scopes measured with
+// timestamp queries, written as Chrome trace JSON (chrome://tracing, or
+// ui.perfetto.dev).
+//
+// Each thread appends to its own buffer without locks. A disabled scope
+// costs one relaxed load; defining DISABLE_TRACING compiles them out.
+//
+// Scope names are not copied : use string literals or names that outlive
+// the trace.
+
+extern std::atomic<bool> traceEnabled;
+// Wraps GPU scopes in KHR_debug groups even while not tracing, for graphics
+// debuggers
+extern bool traceDebugGroups;
+
+// Starts a new trace, dropping what the last one recorded
+void traceStart();
+void traceStop();
+// Writes what was recorded. Call with the trace stopped, or from the GL
+// thread between frames.
+bool traceWrite(const char * path);
+
+// Name of the calling thread in the trace. name must live until the thread
+// records its first event.
+void traceThreadName(const char * name);
+
+// Adds the GPU scopes whose queries have completed to the trace. Call once
+// per frame from the GL thread.
+void traceCollectGpu();
+// Deletes the timestamp queries, with the context still current
+void traceDestroyGpu();
+
+// Start time of a scope, passed back to traceEnd() with its name
+long long traceBegin();
+void traceEnd(const char * name, long long start);
+int traceGpuBegin(const char * name);
+void traceGpuEnd(int scope);
+
+class TraceScope {
+public:
+	explicit TraceScope(const char * scopeName) : name(NULL), start(0) {
+		if (traceEnabled.load(std::memory_order_relaxed)) {
+			name = scopeName;
+			start = traceBegin();
+		}
+	}
+	~TraceScope() {
+		if (name)
+			traceEnd(name, start);
+	}
+
+private:
+	const char * name; // NULL when the trace was off at the start of the scope
+	long long start;
+};
+
+// Measures the GL commands issued inside the scope. GL thread only.
+class GpuTraceScope {
+public:
+	explicit GpuTraceScope(const char * name)
+		: scope(traceEnabled.load(std::memory_order_relaxed) || traceDebugGroups ? traceGpuBegin(name) : -1) {}
+	~GpuTraceScope() {
+		if (scope >= 0)
+			traceGpuEnd(scope);
+	}
+
+private:
+	int scope; // -1 when nothing was started
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifndef DISABLE_TRACING
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_GPU_SCOPE(name) GpuTraceScope TRACE_CONCAT(gpuTraceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_GPU_SCOPE(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef VBOINDEXER_HPP
+#define VBOINDEXER_HPP
+
+// Merges identical position/uv/normal triplets of an unindexed triangle list
+// and returns an index buffer into the unique vertices.
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef WORKSTEALINGQUEUE_HPP
+#define WORKSTEALINGQUEUE_HPP
+
+#include <atomic>
+
+#include "jobsystem.hpp"
+
+// Chase-Lev deque, with the memory orderings of Le, Pop, Cohen and Zappa
+// Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models"
+class WorkStealingQueue {
+public:
+	WorkStealingQueue() : top(0), bottom(0) {
+		for (int i = 0; i < JOB_QUEUE_SIZE; i++)
+			buffer[i].store(NULL, std::memory_order_relaxed);
+	}
+
+	// Owner only
+	bool push(Job * job) {
+		long b = bottom.load(std::memory_order_relaxed);
+		long t = top.load(std::memory_order_acquire);
+		if (b - t >= JOB_QUEUE_SIZE)
+			return false;
+		buffer[b & (JOB_QUEUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Owner only
+	Job * pop() {
+		long b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long t = top.load(std::memory_order_relaxed);
+
+		if (t > b) {
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return NULL;
+		}
+		Job * job = buffer[b & (JOB_QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+		if (t == b) {
+			// Last job, race the thieves for it
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job = NULL;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	// Any thread
+	Job * steal() {
+		long t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return NULL;
+		Job * job = buffer[t & (JOB_QUEUE_SIZE - 1)].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return NULL;
+		return job;
+	}
+
+	bool empty() const {
+		return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+	}
+
+private:
+	// Owner and thieves write different ends, keep them on separate lines.
+	// Padded rather than aligned, the queues are allocated with plain new.
+	std::atomic<long> top;
+	char padding[64 - sizeof(std::atomic<long>)];
+	std::atomic<long> bottom;
+	char padding2[64 - sizeof(std::atomic<long>)];
+	std::atomic<Job*> buffer[JOB_QUEUE_SIZE];
+};
+
+#endif
@@ -0,0 +1,130 @@
+// Sources : tests/arena_test.cpp common/arena.cpp common/allocation.cpp
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "tests/test.hpp"
+#include "common/arena.hpp"
+#include "common/allocation.hpp"
+
+// Allocations honor their alignment and do not overlap
+static void testAlignment()
+{
+	FrameArena arena;
+	for (int frame = 0; frame < 2; frame++) {
+		char * memory[100];
+		bool aligned = true, intact = true;
+		for (int i = 0; i < 100; i++) {
+			size_t alignment = (size_t)1 << (i % 7);
+			memory[i] = (char*)arena.allocate(1 + i % 13, alignment);
+			aligned = aligned && ((uintptr_t)memory[i] & (alignment - 1)) == 0;
+			memset(memory[i], i, 1 + i % 13);
+		}
+		for (int i = 0; i < 100; i++) {
+			for (int b = 0; b < 1 + i % 13; b++)
+				intact = intact && memory[i][b] == (char)i;
+		}
+		TEST_CHECK(aligned);
+		TEST_CHECK(intact);
+		double * values = arena.allocateArray<double>(3);
+		TEST_CHECK(((uintptr_t)values & (std::alignment_of<double>::value - 1)) == 0);
+		// The first frame overflowed, the second fits the grown block
+		arena.reset();
+	}
+}
+
+// A frame bigger than the block overflows to the heap, the next reset grows
+// the block, and from then on the same frame allocates nothing
+static void testGrowth()
+{
+	FrameArena arena;
+	TEST_CHECK(arena.capacity() == 0);
+	for (int i = 0; i < 100; i++)
+		arena.allocate(100);
+	size_t used = arena.used();
+	TEST_CHECK(used >= 100 * 100);
+	arena.reset();
+	TEST_CHECK(arena.used() == 0);
+	TEST_CHECK(arena.peak() == used);
+	TEST_CHECK(arena.capacity() >= used);
+
+	AllocationCount before = threadAllocationTotals();
+	for (int frame = 0; frame < 10; frame++) {
+		for (int i = 0; i < 100; i++)
+			arena.allocate(100);
+		arena.reset();
+	}
+	AllocationCount during = threadAllocationTotals() - before;
+	TEST_CHECK(during.allocations == 0 && during.frees == 0);
+}
+
+// Copies live in the arena until the reset
+static void testCopy()
+{
+	FrameArena arena;
+	struct Capture { int a; float b; };
+	Capture value = { 7, 2.5f };
+	const Capture * copy = arena.copy(value);
+	value.a = 0;
+	TEST_CHECK(copy->a == 7 && copy->b == 2.5f);
+	int x = 3;
+	auto lambda = [x](int y) { return x + y; };
+	const auto * stored = arena.copy(lambda);
+	TEST_CHECK((*stored)(4) == 7);
+}
+
+// Released objects come back as they were left, vectors and all
+static void testObjectPool()
+{
+	ObjectPool<std::vector<int> > pool;
+	std::vector<int> * first = pool.acquire();
+	TEST_CHECK(pool.size() == OBJECT_POOL_CHUNK);
+	TEST_CHECK(pool.available() == OBJECT_POOL_CHUNK - 1);
+	first->resize(1000);
+	size_t capacity = first->capacity();
+	first->clear();
+	pool.release(first);
+
+	AllocationCount before = threadAllocationTotals();
+	std::vector<int> * again = pool.acquire();
+	TEST_CHECK(again == first);
+	TEST_CHECK(again->capacity() == capacity);
+	again->resize(1000);
+	pool.release(again);
+	TEST_CHECK((threadAllocationTotals() - before).allocations == 0);
+
+	// Running out adds a chunk
+	std::vector<std::vector<int>*> taken;
+	for (int i = 0; i < OBJECT_POOL_CHUNK + 1; i++)
+		taken.push_back(pool.acquire());
+	TEST_CHECK(pool.size() == 2 * OBJECT_POOL_CHUNK);
+	for (size_t i = 0; i < taken.size(); i++)
+		pool.release(taken[i]);
+	TEST_CHECK(pool.available() == 2 * OBJECT_POOL_CHUNK);
+}
+
+// A full FixedVector refuses elements
+static void testFixedVector()
+{
+	FixedVector<int, 3> items;
+	TEST_CHECK(items.empty());
+	TEST_CHECK(items.push_back(1) && items.push_back(2) && items.push_back(3));
+	TEST_CHECK(!items.push_back(4));
+	TEST_CHECK(items.size() == 3 && items[2] == 3);
+	int sum = 0;
+	for (const int * i = items.begin(); i != items.end(); i++)
+		sum += *i;
+	TEST_CHECK(sum == 6);
+	items.clear();
+	TEST_CHECK(items.empty());
+}
+
+int main()
+{
+	testAlignment();
+	testGrowth();
+	testCopy();
+	testObjectPool();
+	testFixedVector();
+	return testReport("Arena");
+}
@@ -0,0 +1,107 @@
+// Sources : tests/capture_test.cpp common/capture.cpp common/jobsystem.cpp common/gpuresources.cpp common/trace.cpp
+#include <vector>
+#include <stdlib.h>
+
+#include <GL/glew.h>
+
+#include "tests/test.hpp"
+#include "common/capture.hpp"
+
+// Straightforward BT.601 limited range, one pixel at a time
+static void referenceI420(const unsigned char * bgra, int width, int height, unsigned char * out_yuv)
+{
+	unsigned char * luma = out_yuv;
+	unsigned char * blueDifference = luma + width * height;
+	unsigned char * redDifference = blueDifference + (width / 2) * (height / 2);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			const unsigned char * p = bgra + ((height - 1 - y) * width + x) * 4;
+			luma[y * width + x] = (unsigned char)(((66 * p[2] + 129 * p[1] + 25 * p[0] + 128) >> 8) + 16);
+		}
+	}
+	for (int y = 0; y < height; y += 2) {
+		for (int x = 0; x < width; x += 2) {
+			int sums[3] = { 0, 0, 0 };
+			for (int dy = 0; dy < 2; dy++) {
+				for (int dx = 0; dx < 2; dx++) {
+					const unsigned char * p = bgra + ((height - 1 - y - dy) * width + x + dx) * 4;
+					for (int c = 0; c < 3; c++)
+						sums[c] += p[c];
+				}
+			}
+			int b = (sums[0] + 2) >> 2, g = (sums[1] + 2) >> 2, r = (sums[2] + 2) >> 2;
+			int chroma = (y / 2) * (width / 2) + x / 2;
+			blueDifference[chroma] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+			redDifference[chroma] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+		}
+	}
+}
+
+// Random images of widths that use the SIMD blocks, the scalar tail or both
+// convert to the same bytes as the reference
+static void testAgainstReference()
+{
+	const int sizes[][2] = { { 2, 2 }, { 16, 2 }, { 18, 4 }, { 34, 6 }, { 46, 10 }, { 640, 360 } };
+	srand(7);
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		int width = sizes[s][0], height = sizes[s][1];
+		std::vector<unsigned char> bgra(width * height * 4);
+		for (size_t i = 0; i < bgra.size(); i++)
+			bgra[i] = (unsigned char)(rand() & 255);
+		size_t bytes = width * height + 2 * (width / 2) * (height / 2);
+		std::vector<unsigned char> expected(bytes), converted(bytes);
+		referenceI420(&bgra[0], width, height, &expected[0]);
+		convertBgraToI420(&bgra[0], width, height, &converted[0]);
+		if (!TEST_CHECK(converted == expected))
+			printf("  at %d x %d\n", width, height);
+	}
+}
+
+// Black, white and the primaries land on their BT.601 limited range values
+static void testKnownColors()
+{
+	struct Color { unsigned char b, g, r; int y, u, v; };
+	const Color colors[] = {
+		{ 0, 0, 0, 16, 128, 128 },
+		{ 255, 255, 255, 235, 128, 128 },
+		{ 0, 0, 255, 82, 90, 240 },
+		{ 0, 255, 0, 144, 54, 34 },
+		{ 255, 0, 0, 41, 240, 110 },
+	};
+	const int width = 32, height = 4;
+	for (size_t c = 0; c < sizeof(colors) / sizeof(colors[0]); c++) {
+		std::vector<unsigned char> bgra(width * height * 4);
+		for (int i = 0; i < width * height; i++) {
+			bgra[i * 4 + 0] = colors[c].b;
+			bgra[i * 4 + 1] = colors[c].g;
+			bgra[i * 4 + 2] = colors[c].r;
+			bgra[i * 4 + 3] = 255;
+		}
+		std::vector<unsigned char> yuv(width * height * 3 / 2);
+		convertBgraToI420(&bgra[0], width, height, &yuv[0]);
+		TEST_NEAR(yuv[0], colors[c].y, 1);
+		TEST_NEAR(yuv[width * height - 1], colors[c].y, 1);
+		TEST_NEAR(yuv[width * height], colors[c].u, 1);
+		TEST_NEAR(yuv[yuv.size() - 1], colors[c].v, 1);
+	}
+}
+
+// The bottom row of the image is the last row of the video
+static void testFlip()
+{
+	const int width = 4, height = 2;
+	unsigned char bgra[width * height * 4] = { 0 };
+	for (int x = 0; x < width; x++)
+		bgra[x * 4 + 0] = bgra[x * 4 + 1] = bgra[x * 4 + 2] = 255;
+	unsigned char yuv[width * height * 3 / 2];
+	convertBgraToI420(bgra, width, height, yuv);
+	TEST_CHECK(yuv[0] == 16 && yuv[width] == 235);
+}
+
+int main()
+{
+	testAgainstReference();
+	testKnownColors();
+	testFlip();
+	return testReport("Capture");
+}
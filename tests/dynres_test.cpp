@@ -0,0 +1,93 @@
+// Sources : tests/dynres_test.cpp common/dynres.cpp
+#include "tests/test.hpp"
+#include "common/dynres.hpp"
+
+// Slow frames lower the scale, but never under the minimum
+static void testScalesDownOverBudget()
+{
+	DynamicResolution dr;
+	initDynamicResolution(dr, 0.5f, 1.0f, 16.0f);
+	TEST_NEAR(dr.scale, 1.0f, 0.0);
+	float previous = dr.scale;
+	for (int frame = 0; frame < 100; frame++) {
+		float scale = updateDynamicResolution(dr, 40.0, 5.0);
+		TEST_CHECK(scale <= previous);
+		previous = scale;
+	}
+	TEST_NEAR(dr.scale, 0.5f, 0.0);
+}
+
+// Fast frames bring the scale back up to the maximum
+static void testScalesUpUnderBudget()
+{
+	DynamicResolution dr;
+	initDynamicResolution(dr, 0.25f, 1.0f, 16.0f);
+	for (int frame = 0; frame < 50; frame++)
+		updateDynamicResolution(dr, 40.0, 40.0);
+	float low = dr.scale;
+	TEST_CHECK(low < 1.0f);
+	for (int frame = 0; frame < 200; frame++)
+		updateDynamicResolution(dr, 2.0, 2.0);
+	TEST_CHECK(dr.scale > low);
+	TEST_NEAR(dr.scale, 1.0f, 0.0);
+}
+
+// Near the budget the scale holds still instead of oscillating
+static void testHoldsInsideHeadroom()
+{
+	DynamicResolution dr;
+	initDynamicResolution(dr, 0.25f, 1.0f, 16.0f);
+	dr.scale = 0.75f;
+	for (int frame = 0; frame < 20; frame++)
+		updateDynamicResolution(dr, 15.0, 1.0);
+	TEST_NEAR(dr.scale, 0.75f, 0.0);
+}
+
+// Unmeasured frames leave everything as it was
+static void testIgnoresMissingTimings()
+{
+	DynamicResolution dr;
+	initDynamicResolution(dr, 0.25f, 1.0f, 16.0f);
+	dr.scale = 0.5f;
+	updateDynamicResolution(dr, -1.0, -1.0);
+	TEST_NEAR(dr.scale, 0.5f, 0.0);
+	TEST_CHECK(dr.smoothedMs < 0.0f);
+}
+
+// A locked scale is kept whatever the timings, clamped to the range
+static void testLocked()
+{
+	DynamicResolution dr;
+	initDynamicResolution(dr, 0.25f, 1.0f, 16.0f);
+	dr.locked = true;
+	dr.lockedScale = 0.6f;
+	TEST_NEAR(updateDynamicResolution(dr, 100.0, 100.0), 0.6f, 0.0);
+	TEST_NEAR(updateDynamicResolution(dr, 1.0, 1.0), 0.6f, 0.0);
+	dr.lockedScale = 3.0f;
+	TEST_NEAR(updateDynamicResolution(dr, 1.0, 1.0), 1.0f, 0.0);
+}
+
+// Sizes are rounded down and never reach zero
+static void testSize()
+{
+	DynamicResolution dr;
+	initDynamicResolution(dr, 0.25f, 1.0f, 16.0f);
+	int width, height;
+	dr.scale = 0.5f;
+	dynamicResolutionSize(dr, 801, 600, width, height);
+	TEST_CHECK(width == 400 && height == 300);
+	dr.scale = 0.25f;
+	dynamicResolutionSize(dr, 2, 3, width, height);
+	TEST_CHECK(width == 1 && height == 1);
+}
+
+int main()
+{
+	testScalesDownOverBudget();
+	testScalesUpUnderBudget();
+	testHoldsInsideHeadroom();
+	testIgnoresMissingTimings();
+	testLocked();
+	testSize();
+	return testReport("Dynamic resolution");
+}
@@ -0,0 +1,141 @@
+// Sources : tests/framegraph_test.cpp common/framegraph.cpp common/gpuresources.cpp common/trace.cpp common/arena.cpp
+// The graph creates its textures when compiling, so this test opens a
+// hidden window for a GL context.
+// The header comes first : it must compile on its own
+#include "common/framegraph.hpp"
+
+#include <string.h>
+#include <GL/freeglut.h>
+
+#include "tests/test.hpp"
+
+static FrameGraph graph;
+
+// Names of the passes in the order execute() ran them
+static const char * executed[16];
+static int executedCount = 0;
+
+struct Chain {
+	FrameGraphResource a, b, c, unused, backbuffer;
+	int culledPass;
+};
+
+// A -> B -> C -> backbuffer, with a pass whose result nobody reads. A and C
+// never live at the same time and have the same size, so they can share.
+static Chain declareChain(bool keepUnused)
+{
+	FrameGraphTextureDesc color = { 64, 32, GL_RGBA8 };
+	FrameGraphTextureDesc depth = { 64, 32, GL_DEPTH_COMPONENT24 };
+	Chain chain;
+	graph.reset();
+	chain.a = graph.createTexture("A", color);
+	chain.b = graph.createTexture("B", color);
+	chain.c = graph.createTexture("C", color);
+	chain.unused = graph.createTexture("Unused", depth);
+	chain.backbuffer = graph.importBackbuffer("Backbuffer");
+
+	int pass = graph.addPass("Write A", []() { executed[executedCount++] = "Write A"; });
+	graph.write(pass, chain.a);
+	chain.culledPass = graph.addPass("Unused", []() { executed[executedCount++] = "Unused"; });
+	graph.read(chain.culledPass, chain.a);
+	graph.write(chain.culledPass, chain.unused);
+	if (keepUnused)
+		graph.keep(chain.culledPass);
+	pass = graph.addPass("A to B", []() { executed[executedCount++] = "A to B"; });
+	graph.read(pass, chain.a);
+	graph.write(pass, chain.b);
+	pass = graph.addPass("B to C", []() { executed[executedCount++] = "B to C"; });
+	graph.read(pass, chain.b);
+	graph.write(pass, chain.c);
+	pass = graph.addPass("Present", []() { executed[executedCount++] = "Present"; });
+	graph.read(pass, chain.c);
+	graph.write(pass, chain.backbuffer);
+	return chain;
+}
+
+// Textures with disjoint lifetimes share memory, the unread pass is culled
+static void testAliasing()
+{
+	graph.setAliasing(true);
+	Chain chain = declareChain(false);
+	graph.compile();
+	const FrameGraphStatistics & stats = graph.statistics();
+	TEST_CHECK(stats.passCount == 5);
+	TEST_CHECK(stats.culledPassCount == 1);
+	TEST_CHECK(stats.transientCount == 3);
+	TEST_CHECK(stats.physicalCount == 2);
+	TEST_CHECK(stats.transientBytes == 3 * 64 * 32 * 4);
+	TEST_CHECK(stats.aliasedBytes == 2 * 64 * 32 * 4);
+	TEST_CHECK(graph.texture(chain.a) == graph.texture(chain.c));
+	TEST_CHECK(graph.texture(chain.a) != graph.texture(chain.b));
+	TEST_CHECK(graph.texture(chain.a) != 0 && graph.texture(chain.b) != 0);
+
+	executedCount = 0;
+	graph.execute();
+	const char * expected[] = { "Write A", "A to B", "B to C", "Present" };
+	TEST_CHECK(executedCount == 4);
+	for (int i = 0; i < executedCount && i < 4; i++)
+		TEST_CHECK(strcmp(executed[i], expected[i]) == 0);
+}
+
+// The same frame again reuses the same textures without a layout change
+static void testSteadyState()
+{
+	graph.setAliasing(true);
+	Chain chain = declareChain(false);
+	graph.compile();
+	GLuint a = graph.texture(chain.a), b = graph.texture(chain.b);
+	chain = declareChain(false);
+	graph.compile();
+	TEST_CHECK(!graph.layoutChanged());
+	TEST_CHECK(graph.texture(chain.a) == a && graph.texture(chain.b) == b);
+}
+
+// Without aliasing every transient gets its own texture
+static void testAliasingOff()
+{
+	graph.setAliasing(false);
+	Chain chain = declareChain(false);
+	graph.compile();
+	const FrameGraphStatistics & stats = graph.statistics();
+	TEST_CHECK(stats.physicalCount == 3);
+	TEST_CHECK(stats.aliasedBytes == stats.transientBytes);
+	TEST_CHECK(graph.texture(chain.a) != graph.texture(chain.c));
+	graph.setAliasing(true);
+}
+
+// A kept pass survives culling, and its depth target never shares with color
+static void testKeep()
+{
+	graph.setAliasing(true);
+	Chain chain = declareChain(true);
+	graph.compile();
+	const FrameGraphStatistics & stats = graph.statistics();
+	TEST_CHECK(stats.culledPassCount == 0);
+	TEST_CHECK(stats.transientCount == 4);
+	TEST_CHECK(stats.physicalCount == 3);
+	TEST_CHECK(graph.texture(chain.unused) != graph.texture(chain.a));
+	TEST_CHECK(graph.texture(chain.unused) != graph.texture(chain.b));
+	TEST_CHECK(graph.texture(chain.unused) != graph.texture(chain.c));
+}
+
+int main(int argc, char * argv[])
+{
+	glutInit(&argc, argv);
+	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
+	glutInitWindowSize(64, 32);
+	glutCreateWindow("Frame graph test");
+	glutHideWindow();
+	glewExperimental = true;
+	if (glewInit() != GLEW_OK) {
+		printf("Failed to initialize GLEW\n");
+		return 1;
+	}
+
+	testAliasing();
+	testSteadyState();
+	testAliasingOff();
+	testKeep();
+	graph.destroy();
+	return testReport("Frame graph");
+}
@@ -0,0 +1,98 @@
+// Sources : tests/inputqueue_test.cpp common/inputqueue.cpp
+#include <thread>
+
+#include "tests/test.hpp"
+#include "common/inputqueue.hpp"
+
+static InputEvent mouseMove(int x)
+{
+	InputEvent event = { INPUT_MOUSE_MOVE, x, 0, 0, false, 0 };
+	return event;
+}
+
+// Peeking leaves the event for the next pop, like the late latch expects
+static void testPeekKeepsEvent()
+{
+	static InputQueue queue;
+	InputEvent event;
+	TEST_CHECK(!queue.peek(event));
+	queue.push(mouseMove(3));
+	queue.push(mouseMove(4));
+	TEST_CHECK(queue.peek(event) && event.x == 3);
+	TEST_CHECK(queue.peek(event) && event.x == 3);
+	TEST_CHECK(queue.pop(event) && event.x == 3);
+	TEST_CHECK(queue.peek(event) && event.x == 4);
+	TEST_CHECK(queue.pop(event) && event.x == 4);
+	TEST_CHECK(!queue.peek(event));
+	TEST_CHECK(!queue.pop(event));
+}
+
+// Draining the mouse moves stops at the first other event
+static void testDrainStopsAtKey()
+{
+	static InputQueue queue;
+	queue.push(mouseMove(1));
+	queue.push(mouseMove(2));
+	InputEvent key = { INPUT_KEY_DOWN, 0, 0, 't', false, 0 };
+	queue.push(key);
+	queue.push(mouseMove(5));
+
+	InputEvent event;
+	int lastX = 0, drained = 0;
+	while (queue.peek(event) && event.type == INPUT_MOUSE_MOVE) {
+		queue.pop(event);
+		lastX = event.x;
+		drained++;
+	}
+	TEST_CHECK(drained == 2 && lastX == 2);
+	TEST_CHECK(queue.pop(event) && event.type == INPUT_KEY_DOWN && event.key == 't');
+	TEST_CHECK(queue.pop(event) && event.x == 5);
+}
+
+// A full queue drops what it cannot hold and keeps the oldest events
+static void testFullQueueDrops()
+{
+	static InputQueue queue;
+	for (int i = 0; i < INPUT_QUEUE_SIZE + 10; i++)
+		queue.push(mouseMove(i));
+	TEST_CHECK(queue.dropped() == 10);
+	InputEvent event;
+	int count = 0;
+	bool ordered = true;
+	while (queue.pop(event))
+		ordered &= event.x == count++;
+	TEST_CHECK(count == INPUT_QUEUE_SIZE);
+	TEST_CHECK(ordered);
+}
+
+// Events pushed by one thread arrive complete and in order on another
+static void testAcrossThreads()
+{
+	static InputQueue queue;
+	const int total = 100000;
+	std::thread producer([]() {
+		for (int i = 0; i < total; i++)
+			while (!queue.push(mouseMove(i)))
+				std::this_thread::yield();
+	});
+	InputEvent event;
+	int expected = 0;
+	bool ordered = true;
+	while (expected < total) {
+		if (!queue.peek(event))
+			continue;
+		queue.pop(event);
+		ordered &= event.x == expected++ && event.type == INPUT_MOUSE_MOVE;
+	}
+	producer.join();
+	TEST_CHECK(ordered);
+}
+
+int main()
+{
+	testPeekKeepsEvent();
+	testDrainStopsAtKey();
+	testFullQueueDrops();
+	testAcrossThreads();
+	return testReport("Input queue");
+}
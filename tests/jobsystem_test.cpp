@@ -0,0 +1,174 @@
+// Sources : tests/jobsystem_test.cpp common/jobsystem.cpp common/trace.cpp common/gpuresources.cpp
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "tests/test.hpp"
+#include "common/jobsystem.hpp"
+#include "common/workstealingqueue.hpp"
+
+// The owner takes its newest job back, thieves take the oldest
+static void testQueueOrder()
+{
+	static WorkStealingQueue queue;
+	static Job jobs[3];
+	TEST_CHECK(queue.empty());
+	TEST_CHECK(queue.pop() == NULL && queue.steal() == NULL);
+	for (int i = 0; i < 3; i++)
+		TEST_CHECK(queue.push(&jobs[i]));
+	TEST_CHECK(!queue.empty());
+	TEST_CHECK(queue.pop() == &jobs[2]);
+	TEST_CHECK(queue.steal() == &jobs[0]);
+	TEST_CHECK(queue.pop() == &jobs[1]);
+	TEST_CHECK(queue.empty());
+	TEST_CHECK(queue.pop() == NULL);
+}
+
+// A full queue refuses jobs instead of overwriting them, and wraps around
+static void testQueueFull()
+{
+	static WorkStealingQueue queue;
+	static Job job;
+	bool accepted = true;
+	for (int i = 0; i < JOB_QUEUE_SIZE; i++)
+		accepted = accepted && queue.push(&job);
+	TEST_CHECK(accepted);
+	TEST_CHECK(!queue.push(&job));
+	TEST_CHECK(queue.steal() == &job);
+	TEST_CHECK(queue.push(&job));
+	int taken = 0;
+	while (queue.pop())
+		taken++;
+	TEST_CHECK(taken == JOB_QUEUE_SIZE);
+}
+
+// While the owner pushes and pops, thieves steal : every job is taken once
+static void testQueueConcurrent()
+{
+	const int jobCount = 200000, thiefCount = 3;
+	static WorkStealingQueue queue;
+	std::vector<Job> jobs(jobCount);
+	std::vector<std::atomic<int> > taken(jobCount);
+	for (int i = 0; i < jobCount; i++)
+		taken[i].store(0);
+	std::atomic<bool> done(false);
+
+	std::vector<std::thread> thieves;
+	for (int t = 0; t < thiefCount; t++) {
+		thieves.push_back(std::thread([&]() {
+			while (!done.load()) {
+				Job * job = queue.steal();
+				if (job)
+					taken[job - &jobs[0]]++;
+			}
+		}));
+	}
+	for (int i = 0; i < jobCount; i++) {
+		while (!queue.push(&jobs[i])) {
+			Job * job = queue.pop();
+			if (job)
+				taken[job - &jobs[0]]++;
+		}
+		if (i % 3 == 0) {
+			Job * job = queue.pop();
+			if (job)
+				taken[job - &jobs[0]]++;
+		}
+	}
+	while (Job * job = queue.pop())
+		taken[job - &jobs[0]]++;
+	done = true;
+	for (int t = 0; t < thiefCount; t++)
+		thieves[t].join();
+
+	bool once = true;
+	for (int i = 0; i < jobCount; i++)
+		once = once && taken[i].load() == 1;
+	TEST_CHECK(once);
+}
+
+static std::atomic<int> counter;
+
+static void countJob(Job *, const void *)
+{
+	counter++;
+}
+
+// Children finish before their parent, continuations run after both
+static void testChildrenAndContinuations(JobSystem & jobs)
+{
+	counter = 0;
+	Job * root = jobs.create(&countJob);
+	for (int i = 0; i < 1000; i++)
+		jobs.run(jobs.createChild(root, &countJob));
+	std::atomic<int> seenByContinuation(-1);
+	Job * continuation = jobs.createLambda(NULL, [&seenByContinuation]() { seenByContinuation = counter.load(); });
+	TEST_CHECK(jobs.addContinuation(root, continuation));
+	jobs.run(root);
+	jobs.wait(root);
+	TEST_CHECK(counter.load() == 1001);
+	jobs.wait(continuation);
+	TEST_CHECK(seenByContinuation.load() == 1001);
+}
+
+// Every index is visited once, also from a parallelFor nested in a job
+static void testParallelFor(JobSystem & jobs)
+{
+	const size_t count = 100000;
+	std::vector<std::atomic<int> > visits(count);
+	for (size_t i = 0; i < count; i++)
+		visits[i].store(0);
+	std::vector<std::atomic<int> > * visitsPointer = &visits;
+	JobSystem * system = &jobs;
+	Job * outer = jobs.createLambda(NULL, [system, visitsPointer]() {
+		system->parallelFor(visitsPointer->size(), 64, [visitsPointer](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+				(*visitsPointer)[i]++;
+		});
+	});
+	jobs.run(outer);
+	jobs.wait(outer);
+	jobs.parallelFor(count, 64, [&visits](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			visits[i]++;
+	});
+	bool twice = true;
+	for (size_t i = 0; i < count; i++)
+		twice = twice && visits[i].load() == 2;
+	TEST_CHECK(twice);
+}
+
+// Another thread takes thread 0 over, like the render thread after startup
+static void testHandoff(JobSystem & jobs)
+{
+	std::thread other([&jobs]() {
+		jobs.takeMainThread();
+		testChildrenAndContinuations(jobs);
+		testParallelFor(jobs);
+	});
+	other.join();
+	jobs.takeMainThread();
+	testChildrenAndContinuations(jobs);
+}
+
+int main()
+{
+	testQueueOrder();
+	testQueueFull();
+	testQueueConcurrent();
+
+	JobSystem jobs;
+	jobs.start(4);
+	TEST_CHECK(jobs.threadCount() == 4);
+	testChildrenAndContinuations(jobs);
+	testParallelFor(jobs);
+	testHandoff(jobs);
+	jobs.stop();
+
+	// A single thread runs everything itself
+	jobs.start(1);
+	testChildrenAndContinuations(jobs);
+	testParallelFor(jobs);
+	jobs.stop();
+	return testReport("Job system");
+}
@@ -0,0 +1,150 @@
+// Sources : tests/meshoptimizer_test.cpp common/meshoptimizer.cpp
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "tests/test.hpp"
+#include "common/meshpool.hpp"
+#include "common/meshoptimizer.hpp"
+
+// A grid of quads in the XY plane, its triangles shuffled so that the cache
+// starts out useless
+static void makeShuffledGrid(int size, std::vector<unsigned int> & indices, std::vector<MeshVertex> & vertices)
+{
+	indices.clear(); vertices.clear();
+	for (int y = 0; y <= size; y++) {
+		for (int x = 0; x <= size; x++) {
+			MeshVertex v;
+			v.position = glm::vec3((float)x, (float)y, 0.0f);
+			v.uv = glm::vec2((float)x / size, (float)y / size);
+			v.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+			v.tangent = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+			vertices.push_back(v);
+		}
+	}
+	std::vector<unsigned int> order;
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			unsigned int a = y * (size + 1) + x, b = a + 1, c = a + size + 1, d = c + 1;
+			order.push_back(a); order.push_back(b); order.push_back(d);
+			order.push_back(a); order.push_back(d); order.push_back(c);
+		}
+	}
+	size_t triangleCount = order.size() / 3;
+	std::vector<size_t> triangles(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangles[t] = t;
+	srand(1234);
+	for (size_t t = triangleCount - 1; t > 0; t--)
+		std::swap(triangles[t], triangles[rand() % (t + 1)]);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+			indices.push_back(order[triangles[t] * 3 + k]);
+}
+
+// A triangle as its three positions, rotated to start at the smallest one so
+// that the same triangle compares equal whichever corner it starts from
+struct Triangle {
+	float p[9];
+	bool operator<(const Triangle & other) const { return std::lexicographical_compare(p, p + 9, other.p, other.p + 9); }
+	bool operator==(const Triangle & other) const { return std::equal(p, p + 9, other.p); }
+};
+
+static std::vector<Triangle> triangles(const std::vector<unsigned int> & indices, const std::vector<MeshVertex> & vertices)
+{
+	std::vector<Triangle> result;
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		int first = 0;
+		for (int k = 1; k < 3; k++) {
+			const glm::vec3 & a = vertices[indices[t + k]].position, & b = vertices[indices[t + first]].position;
+			if (a.x < b.x || (a.x == b.x && a.y < b.y))
+				first = k;
+		}
+		Triangle triangle;
+		for (int k = 0; k < 3; k++) {
+			const glm::vec3 & position = vertices[indices[t + (first + k) % 3]].position;
+			triangle.p[k * 3 + 0] = position.x;
+			triangle.p[k * 3 + 1] = position.y;
+			triangle.p[k * 3 + 2] = position.z;
+		}
+		result.push_back(triangle);
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+// Tipsify keeps every triangle with its winding and brings the ACMR well down
+static void testVertexCache()
+{
+	std::vector<unsigned int> indices;
+	std::vector<MeshVertex> vertices;
+	makeShuffledGrid(32, indices, vertices);
+	std::vector<Triangle> original = triangles(indices, vertices);
+	MeshStatistics before = analyzeMesh(indices, vertices);
+
+	std::vector<unsigned int> clusters;
+	optimizeVertexCache(indices, vertices.size(), &clusters);
+	MeshStatistics after = analyzeMesh(indices, vertices);
+
+	TEST_CHECK(triangles(indices, vertices) == original);
+	TEST_CHECK(after.acmr < before.acmr * 0.5f);
+	// A regular grid with a 16 entry cache lands well under one vertex per triangle
+	TEST_CHECK(after.acmr < 0.9f);
+	TEST_CHECK(!clusters.empty() && clusters[0] == 0);
+	bool increasing = true;
+	for (size_t i = 1; i < clusters.size(); i++)
+		increasing = increasing && clusters[i] > clusters[i - 1] && clusters[i] < indices.size() / 3;
+	TEST_CHECK(increasing);
+}
+
+// After Tipsify, vertices come out in the order the triangles first use them
+static void testVertexFetch()
+{
+	std::vector<unsigned int> indices;
+	std::vector<MeshVertex> vertices;
+	makeShuffledGrid(16, indices, vertices);
+	optimizeVertexCache(indices, vertices.size(), NULL);
+	std::vector<Triangle> original = triangles(indices, vertices);
+	size_t vertexCount = vertices.size();
+	MeshStatistics before = analyzeMesh(indices, vertices);
+
+	optimizeVertexFetch(indices, vertices);
+
+	TEST_CHECK(vertices.size() == vertexCount);
+	TEST_CHECK(triangles(indices, vertices) == original);
+	unsigned int next = 0;
+	bool firstUseOrder = true;
+	for (size_t i = 0; i < indices.size(); i++) {
+		if (indices[i] == next)
+			next++;
+		else
+			firstUseOrder = firstUseOrder && indices[i] < next;
+	}
+	TEST_CHECK(firstUseOrder);
+	TEST_CHECK(analyzeMesh(indices, vertices).overfetch < before.overfetch);
+}
+
+// The whole pipeline never makes a mesh worse
+static void testOptimizeMesh()
+{
+	std::vector<unsigned int> indices;
+	std::vector<MeshVertex> vertices;
+	makeShuffledGrid(24, indices, vertices);
+	std::vector<Triangle> original = triangles(indices, vertices);
+	MeshStatistics before, after;
+	optimizeMesh(indices, vertices, &before, &after);
+	TEST_CHECK(triangles(indices, vertices) == original);
+	TEST_CHECK(after.acmr < before.acmr);
+	TEST_CHECK(after.overfetch <= before.overfetch);
+}
+
+int main()
+{
+	testVertexCache();
+	testVertexFetch();
+	testOptimizeMesh();
+	return testReport("Mesh optimizer");
+}
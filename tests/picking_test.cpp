@@ -0,0 +1,135 @@
+// Sources : tests/picking_test.cpp common/picking.cpp
+#include <vector>
+#include <stdlib.h>
+
+#include <glm/glm.hpp>
+
+#include "tests/test.hpp"
+#include "common/picking.hpp"
+
+static float randomFloat(float low, float high)
+{
+	return low + (high - low) * (float)rand() / (float)RAND_MAX;
+}
+
+// Moller-Trumbore on every triangle, from either side
+static bool bruteForce(const std::vector<glm::vec3> & positions, const std::vector<unsigned int> & indices,
+	const glm::vec3 & origin, const glm::vec3 & direction, float & inout_distance, int & out_triangle)
+{
+	bool hit = false;
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		glm::vec3 v0 = positions[indices[t]];
+		glm::vec3 e1 = positions[indices[t + 1]] - v0, e2 = positions[indices[t + 2]] - v0;
+		glm::vec3 p = glm::cross(direction, e2);
+		float determinant = glm::dot(e1, p);
+		if (fabs(determinant) < 1e-12f)
+			continue;
+		float inverse = 1.0f / determinant;
+		glm::vec3 s = origin - v0;
+		float u = glm::dot(s, p) * inverse;
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(direction, q) * inverse;
+		float distance = glm::dot(e2, q) * inverse;
+		if (u < 0.0f || v < 0.0f || u + v > 1.0f || distance < 0.0f || distance >= inout_distance)
+			continue;
+		inout_distance = distance;
+		out_triangle = (int)(t / 3);
+		hit = true;
+	}
+	return hit;
+}
+
+// Random rays through a random triangle soup find what testing every
+// triangle finds
+static void testAgainstBruteForce()
+{
+	srand(42);
+	std::vector<glm::vec3> positions;
+	std::vector<unsigned int> indices;
+	for (int t = 0; t < 2000; t++) {
+		glm::vec3 center(randomFloat(-10.0f, 10.0f), randomFloat(-10.0f, 10.0f), randomFloat(-10.0f, 10.0f));
+		for (int k = 0; k < 3; k++) {
+			indices.push_back((unsigned int)positions.size());
+			positions.push_back(center + glm::vec3(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f)));
+		}
+	}
+	MeshBVH bvh;
+	bvh.build(positions, indices);
+	TEST_CHECK(bvh.triangleCount() == 2000);
+	TEST_CHECK(bvh.nodeCount() > 1);
+
+	int agree = 0, hits = 0;
+	const int rays = 2000;
+	for (int r = 0; r < rays; r++) {
+		glm::vec3 origin(randomFloat(-15.0f, 15.0f), randomFloat(-15.0f, 15.0f), randomFloat(-15.0f, 15.0f));
+		glm::vec3 target(randomFloat(-10.0f, 10.0f), randomFloat(-10.0f, 10.0f), randomFloat(-10.0f, 10.0f));
+		glm::vec3 direction = target - origin;
+		float expectedDistance = 2.0f, distance = 2.0f;
+		int expectedTriangle = -1, triangle = -1;
+		bool expected = bruteForce(positions, indices, origin, direction, expectedDistance, expectedTriangle);
+		bool found = bvh.intersect(origin, direction, distance, triangle);
+		if (expected)
+			hits++;
+		if (found == expected && (!found || (triangle == expectedTriangle && fabs(distance - expectedDistance) < 1e-4f)))
+			agree++;
+	}
+	TEST_CHECK(hits > rays / 4);
+	TEST_CHECK(agree == rays);
+}
+
+// A hit past the distance given is not reported, the distance is kept
+static void testMaxDistance()
+{
+	std::vector<glm::vec3> positions;
+	positions.push_back(glm::vec3(-1.0f, -1.0f, 5.0f));
+	positions.push_back(glm::vec3(1.0f, -1.0f, 5.0f));
+	positions.push_back(glm::vec3(0.0f, 1.0f, 5.0f));
+	std::vector<unsigned int> indices;
+	indices.push_back(0); indices.push_back(1); indices.push_back(2);
+	MeshBVH bvh;
+	bvh.build(positions, indices);
+
+	float distance = 4.0f;
+	int triangle = -1;
+	TEST_CHECK(!bvh.intersect(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), distance, triangle));
+	TEST_CHECK(distance == 4.0f && triangle == -1);
+	distance = 10.0f;
+	TEST_CHECK(bvh.intersect(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), distance, triangle));
+	TEST_NEAR(distance, 5.0f, 1e-6);
+	TEST_CHECK(triangle == 0);
+	// From behind
+	distance = 10.0f;
+	TEST_CHECK(bvh.intersect(glm::vec3(0.0f, 0.0f, 8.0f), glm::vec3(0.0f, 0.0f, -1.0f), distance, triangle));
+	TEST_NEAR(distance, 3.0f, 1e-6);
+}
+
+// An empty mesh never hits
+static void testEmpty()
+{
+	MeshBVH bvh;
+	bvh.build(std::vector<glm::vec3>(), std::vector<unsigned int>());
+	float distance = 1.0f;
+	int triangle = -1;
+	TEST_CHECK(!bvh.intersect(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), distance, triangle));
+}
+
+// The clip space ray of the identity camera runs from z = -1 to z = 1
+static void testRayFromClip()
+{
+	glm::vec3 origin, direction;
+	rayFromClip(glm::mat4(1.0f), glm::vec2(0.5f, -0.25f), origin, direction);
+	TEST_NEAR(origin.x, 0.5f, 1e-6);
+	TEST_NEAR(origin.y, -0.25f, 1e-6);
+	TEST_NEAR(origin.z, -1.0f, 1e-6);
+	TEST_NEAR(direction.x, 0.0f, 1e-6);
+	TEST_NEAR(direction.z, 2.0f, 1e-6);
+}
+
+int main()
+{
+	testAgainstBruteForce();
+	testMaxDistance();
+	testEmpty();
+	testRayFromClip();
+	return testReport("Picking");
+}
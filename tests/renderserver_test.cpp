@@ -0,0 +1,103 @@
+// Sources : tests/renderserver_test.cpp common/renderserver.cpp common/capture.cpp common/jobsystem.cpp common/gpuresources.cpp common/trace.cpp
+// Links ws2_32 on Windows.
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include "tests/test.hpp"
+#include "common/renderserver.hpp"
+
+// Requests of this width stand for a frame whose readback failed
+#define FAILING_WIDTH 40
+
+static RenderServer server;
+static std::atomic<bool> renderStop(false);
+static std::atomic<int> largestBatch(0);
+
+// Stands in for the render thread : fills each frame with its request id
+static void renderLoop()
+{
+	int tickets[4];
+	while (!renderStop.load()) {
+		int count = server.takeRequests(tickets, 4);
+		if (count == 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		if (count > largestBatch.load())
+			largestBatch = count;
+		for (int i = 0; i < count; i++) {
+			RenderTicket & ticket = server.ticket(tickets[i]);
+			if (ticket.request.width == FAILING_WIDTH)
+				ticket.status = RENDER_FAILED;
+			else {
+				size_t pixels = (size_t)ticket.request.width * ticket.request.height;
+				ticket.pixels.resize(pixels * 4);
+				for (size_t p = 0; p < pixels; p++) {
+					ticket.pixels[p * 4 + 0] = (unsigned char)ticket.request.id;
+					ticket.pixels[p * 4 + 1] = 0;
+					ticket.pixels[p * 4 + 2] = 7;
+					ticket.pixels[p * 4 + 3] = 255;
+				}
+			}
+			server.finishRequest(tickets[i]);
+		}
+	}
+}
+
+static int readInt(const unsigned char * bytes)
+{
+	int value;
+	memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+int main()
+{
+	const char * path = "renderserver_test.sock";
+	const char * imagePath = "renderserver_test.bmp";
+	if (!TEST_CHECK(server.start(path, 256, 256)))
+		return testReport("Render server");
+	std::thread renderThread(renderLoop);
+
+	// Every request over several connections gets its image
+	TEST_CHECK(runRenderClient(path, 200, 4, 64, 48, RENDER_IMAGE_BMP, imagePath, false) == 0);
+	TEST_CHECK(largestBatch.load() >= 1);
+	FILE * file = fopen(imagePath, "rb");
+	std::vector<unsigned char> bmp(54 + 64 * 48 * 4);
+	size_t read = file ? fread(&bmp[0], 1, bmp.size() + 1, file) : 0;
+	if (file)
+		fclose(file);
+	remove(imagePath);
+	TEST_CHECK(read == bmp.size());
+	TEST_CHECK(bmp[0] == 'B' && bmp[1] == 'M');
+	TEST_CHECK(readInt(&bmp[18]) == 64 && readInt(&bmp[22]) == 48);
+	// The first request has id 0
+	TEST_CHECK(bmp[54] == 0 && bmp[56] == 7 && bmp[57] == 255);
+
+	TEST_CHECK(runRenderClient(path, 100, 8, 64, 48, RENDER_IMAGE_I420, NULL, false) == 0);
+
+	// Odd sizes cannot be I420, sizes over the server's are refused
+	TEST_CHECK(runRenderClient(path, 4, 1, 63, 48, RENDER_IMAGE_I420, NULL, false) != 0);
+	TEST_CHECK(runRenderClient(path, 4, 1, 300, 48, RENDER_IMAGE_BMP, NULL, false) != 0);
+
+	// A frame the render thread could not read back is answered as failed,
+	// and the server keeps serving
+	TEST_CHECK(runRenderClient(path, 4, 1, FAILING_WIDTH, 32, RENDER_IMAGE_BMP, NULL, false) != 0);
+	TEST_CHECK(runRenderClient(path, 20, 2, 32, 32, RENDER_IMAGE_BMP, NULL, true) == 0);
+
+	// The last client asked for a shutdown
+	for (int i = 0; i < 200 && !server.shutdownRequested(); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	TEST_CHECK(server.shutdownRequested());
+
+	renderStop = true;
+	renderThread.join();
+	server.stop();
+	return testReport("Render server");
+}
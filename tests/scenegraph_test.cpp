@@ -0,0 +1,123 @@
+// Sources : tests/scenegraph_test.cpp common/scenegraph.cpp
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "tests/test.hpp"
+#include "common/scenegraph.hpp"
+
+static glm::mat4 translation(float x, float y, float z)
+{
+	return glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
+}
+
+// Every parent comes before its children and every subtree is one range
+static bool depthFirstOrder(const SceneGraph & graph, const std::vector<SceneNode> & parentOf)
+{
+	std::vector<int> indexOf(parentOf.size());
+	for (int i = 0; i < graph.size(); i++)
+		indexOf[graph.nodeAt(i)] = i;
+	for (size_t node = 0; node < parentOf.size(); node++) {
+		if (parentOf[node] < 0)
+			continue;
+		int parentIndex = indexOf[parentOf[node]], index = indexOf[node];
+		if (parentIndex >= index)
+			return false;
+		// Everything between the parent and the node descends from the parent
+		for (int i = parentIndex + 1; i < index; i++) {
+			SceneNode ancestor = graph.nodeAt(i);
+			while (ancestor >= 0 && ancestor != parentOf[node])
+				ancestor = parentOf[ancestor];
+			if (ancestor != parentOf[node])
+				return false;
+		}
+	}
+	return true;
+}
+
+// Nodes added out of order are reordered on update, handles keep working
+static void testReordering()
+{
+	SceneGraph graph;
+	std::vector<SceneNode> parentOf;
+	SceneNode a = graph.createNode(-1, translation(1, 0, 0), -1);      parentOf.push_back(-1);
+	SceneNode b = graph.createNode(-1, translation(0, 10, 0), -1);     parentOf.push_back(-1);
+	SceneNode a1 = graph.createNode(a, translation(0, 0, 2), 0);       parentOf.push_back(a);
+	SceneNode b1 = graph.createNode(b, translation(3, 0, 0), 1);       parentOf.push_back(b);
+	SceneNode a11 = graph.createNode(a1, translation(0, 0, 5), 2);     parentOf.push_back(a1);
+	SceneNode a2 = graph.createNode(a, translation(0, 4, 0), 3);       parentOf.push_back(a);
+	graph.update();
+
+	TEST_CHECK(graph.statistics().rebuilt);
+	TEST_CHECK(graph.statistics().updatedNodes == 6);
+	TEST_CHECK(depthFirstOrder(graph, parentOf));
+	TEST_CHECK(graph.mesh(a11) == 2 && graph.mesh(b1) == 1 && graph.mesh(a) == -1);
+	glm::vec4 origin = graph.worldTransform(a11)[3];
+	TEST_CHECK(origin.x == 1.0f && origin.y == 0.0f && origin.z == 7.0f);
+	origin = graph.worldTransform(b1)[3];
+	TEST_CHECK(origin.x == 3.0f && origin.y == 10.0f && origin.z == 0.0f);
+	origin = graph.worldTransform(a2)[3];
+	TEST_CHECK(origin.x == 1.0f && origin.y == 4.0f && origin.z == 0.0f);
+
+	// A node added after the reorder joins it on the next update
+	SceneNode b2 = graph.createNode(b, translation(0, 0, 1), 4);       parentOf.push_back(b);
+	SceneNode a12 = graph.createNode(a1, translation(0, 1, 0), 5);     parentOf.push_back(a1);
+	graph.update();
+	TEST_CHECK(depthFirstOrder(graph, parentOf));
+	origin = graph.worldTransform(a12)[3];
+	TEST_CHECK(origin.x == 1.0f && origin.y == 1.0f && origin.z == 2.0f);
+	origin = graph.worldTransform(b2)[3];
+	TEST_CHECK(origin.x == 0.0f && origin.y == 10.0f && origin.z == 1.0f);
+}
+
+// Moving a node updates its subtree only and refits its ancestors
+static void testDirtyUpdate()
+{
+	SceneGraph graph;
+	SceneNode root = graph.createNode(-1, glm::mat4(1.0f), -1);
+	SceneNode left = graph.createNode(root, translation(-5, 0, 0), -1);
+	SceneNode leftLeaf = graph.createNode(left, glm::mat4(1.0f), 0);
+	SceneNode right = graph.createNode(root, translation(5, 0, 0), -1);
+	SceneNode rightLeaf = graph.createNode(right, glm::mat4(1.0f), 1);
+	graph.setLocalBounds(leftLeaf, glm::vec3(-1.0f), glm::vec3(1.0f));
+	graph.setLocalBounds(rightLeaf, glm::vec3(-1.0f), glm::vec3(1.0f));
+	graph.update();
+	TEST_CHECK(graph.statistics().rebuilt);
+
+	graph.update();
+	TEST_CHECK(graph.statistics().updatedNodes == 0 && !graph.statistics().rebuilt);
+
+	graph.setLocalTransform(left, translation(-20, 0, 0));
+	graph.update();
+	TEST_CHECK(!graph.statistics().rebuilt);
+	TEST_CHECK(graph.statistics().updatedNodes == 2);
+	TEST_CHECK(graph.statistics().refitNodes == 1);
+	TEST_CHECK(graph.worldTransform(leftLeaf)[3].x == -20.0f);
+	TEST_CHECK(graph.worldTransform(rightLeaf)[3].x == 5.0f);
+
+	// Culling sees the moved box : a view around x = 5 only finds the right leaf
+	Frustum frustum = frustumFromMatrix(glm::ortho(2.0f, 8.0f, -3.0f, 3.0f, -3.0f, 3.0f));
+	std::vector<SceneNode> visible;
+	graph.cull(frustum, [&](int index) { visible.push_back(graph.nodeAt(index)); });
+	TEST_CHECK(visible.size() == 1 && visible[0] == rightLeaf);
+	frustum = frustumFromMatrix(glm::ortho(-25.0f, 8.0f, -3.0f, 3.0f, -3.0f, 3.0f));
+	visible.clear();
+	graph.cull(frustum, [&](int index) { visible.push_back(graph.nodeAt(index)); });
+	TEST_CHECK(visible.size() == 2);
+
+	// A ray along x meets the left leaf first, a ray above both misses
+	float nearest = graph.raycast(glm::vec3(-100.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 1000.0f,
+		[&](int index, float) { return graph.worldMinAt(index).x + 100.0f; });
+	TEST_NEAR(nearest, 79.0f, 1e-4);
+	nearest = graph.raycast(glm::vec3(-100.0f, 5.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 1000.0f,
+		[](int, float) { return 0.0f; });
+	TEST_NEAR(nearest, 1000.0f, 0.0);
+}
+
+int main()
+{
+	testReordering();
+	testDirtyUpdate();
+	return testReport("Scene graph");
+}
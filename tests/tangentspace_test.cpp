@@ -0,0 +1,151 @@
+// Sources : tests/tangentspace_test.cpp common/tangentspace.cpp common/jobsystem.cpp common/trace.cpp common/gpuresources.cpp
+#include <vector>
+#include <string.h>
+#include <glm/glm.hpp>
+
+#include "tests/test.hpp"
+#include "common/jobsystem.hpp"
+#include "common/tangentspace.hpp"
+
+// A grid of quads in the XY plane facing +Z, with u along X. When mirrored,
+// the right half has u running backwards like a symmetric character's UVs.
+static void makeGrid(int size, bool mirrored,
+	std::vector<unsigned int> & indices, std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs, std::vector<glm::vec3> & normals)
+{
+	indices.clear(); vertices.clear(); uvs.clear(); normals.clear();
+	for (int y = 0; y <= size; y++) {
+		for (int x = 0; x <= size; x++) {
+			float u = (float)x / size;
+			if (mirrored && x * 2 > size)
+				u = 1.0f - u;
+			vertices.push_back(glm::vec3((float)x, (float)y, 0.0f));
+			uvs.push_back(glm::vec2(u, (float)y / size));
+			normals.push_back(glm::vec3(0.0f, 0.0f, 1.0f));
+		}
+	}
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			unsigned int a = y * (size + 1) + x, b = a + 1, c = a + size + 1, d = c + 1;
+			indices.push_back(a); indices.push_back(b); indices.push_back(d);
+			indices.push_back(a); indices.push_back(d); indices.push_back(c);
+		}
+	}
+}
+
+// A consistently mapped surface gets the UV direction everywhere and no copies
+static void testPlane()
+{
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices, normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec4> tangents;
+	// 7 x 7 quads is 98 triangles : the last two go through the scalar tail
+	makeGrid(7, false, indices, vertices, uvs, normals);
+	size_t vertexCount = vertices.size();
+	computeTangents(indices, vertices, uvs, normals, tangents);
+	TEST_CHECK(vertices.size() == vertexCount);
+	TEST_CHECK(tangents.size() == vertexCount);
+	bool allAlongX = true;
+	for (size_t i = 0; i < tangents.size(); i++)
+		allAlongX = allAlongX && fabs(tangents[i].x - 1.0f) < 1e-5f && tangents[i].w == 1.0f;
+	TEST_CHECK(allAlongX);
+}
+
+// The column on a mirror seam is split, each side keeping its own handedness
+static void testMirroredSeam()
+{
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices, normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec4> tangents;
+	const int size = 4;
+	makeGrid(size, true, indices, vertices, uvs, normals);
+	size_t vertexCount = vertices.size();
+	computeTangents(indices, vertices, uvs, normals, tangents);
+
+	// The seam runs along x = size / 2, one copy per row
+	TEST_CHECK(vertices.size() == vertexCount + size + 1);
+	TEST_CHECK(uvs.size() == vertices.size() && normals.size() == vertices.size() && tangents.size() == vertices.size());
+
+	// Every triangle still covers the same positions, and all of its corners agree
+	bool samePositions = true, consistent = true;
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		float side = 0.0f;
+		for (int k = 0; k < 3; k++)
+			side += vertices[indices[t + k]].x - size * 0.5f;
+		for (int k = 0; k < 3; k++) {
+			const glm::vec4 & tangent = tangents[indices[t + k]];
+			float expected = side < 0.0f ? 1.0f : -1.0f;
+			consistent = consistent && fabs(tangent.x - expected) < 1e-5f && tangent.w == expected;
+		}
+	}
+	for (size_t i = vertexCount; i < vertices.size(); i++)
+		samePositions = samePositions && vertices[i].x == size * 0.5f;
+	TEST_CHECK(samePositions);
+	TEST_CHECK(consistent);
+}
+
+// Bit-exact comparison, the parallel path must not change a single result
+template <typename T>
+static bool identical(const std::vector<T> & a, const std::vector<T> & b)
+{
+	return a.size() == b.size() && (a.empty() || memcmp(&a[0], &b[0], a.size() * sizeof(T)) == 0);
+}
+
+// The parallel path computes the same tangents as the serial one
+static void testParallel()
+{
+	std::vector<unsigned int> serialIndices, parallelIndices;
+	std::vector<glm::vec3> serialVertices, parallelVertices, serialNormals, parallelNormals;
+	std::vector<glm::vec2> serialUVs, parallelUVs;
+	std::vector<glm::vec4> serialTangents, parallelTangents;
+	// 130 x 130 quads is 33800 triangles, over the parallel threshold
+	makeGrid(130, true, serialIndices, serialVertices, serialUVs, serialNormals);
+	makeGrid(130, true, parallelIndices, parallelVertices, parallelUVs, parallelNormals);
+
+	computeTangents(serialIndices, serialVertices, serialUVs, serialNormals, serialTangents);
+	JobSystem jobs;
+	jobs.start(4);
+	computeTangents(parallelIndices, parallelVertices, parallelUVs, parallelNormals, parallelTangents, &jobs);
+	jobs.stop();
+
+	TEST_CHECK(identical(serialIndices, parallelIndices));
+	TEST_CHECK(identical(serialVertices, parallelVertices));
+	TEST_CHECK(identical(serialTangents, parallelTangents));
+}
+
+// Smooth normals of a flat grid point up, with or without jobs
+static void testSmoothNormals()
+{
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices, normals;
+	std::vector<glm::vec2> uvs;
+	makeGrid(130, false, indices, vertices, uvs, normals);
+	std::vector<glm::vec3> corners;
+	for (size_t i = 0; i < indices.size(); i++)
+		corners.push_back(vertices[indices[i]]);
+
+	std::vector<glm::vec3> serial, parallel;
+	computeSmoothNormals(corners, 60.0f, NORMAL_WEIGHT_ANGLE, serial);
+	JobSystem jobs;
+	jobs.start(4);
+	computeSmoothNormals(corners, 60.0f, NORMAL_WEIGHT_ANGLE, parallel, &jobs);
+	jobs.stop();
+
+	TEST_CHECK(serial.size() == corners.size());
+	TEST_CHECK(identical(serial, parallel));
+	bool up = true;
+	for (size_t i = 0; i < serial.size(); i++)
+		up = up && fabs(serial[i].z - 1.0f) < 1e-5f;
+	TEST_CHECK(up);
+}
+
+int main()
+{
+	testPlane();
+	testMirroredSeam();
+	testParallel();
+	testSmoothNormals();
+	return testReport("Tangent space");
+}
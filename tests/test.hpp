@@ -0,0 +1,44 @@
+#ifndef TEST_HPP
+#define TEST_HPP
+
+#include <stdio.h>
+#include <math.h>
+
+// Behavior tests of the modules in common/. Every tests/*_test.cpp is a
+// program of its own, built from the repository root with the sources listed
+// in its first comment, for example
+//
+//     g++ -std=gnu++14 -O1 -I. tests/dynres_test.cpp common/dynres.cpp -o dynres_test
+//
+// Tests that include GL headers link with -lglew32 -lopengl32. They cover
+// what the modules compute on the CPU and need no context, except where a
+// module creates GL objects as it goes, like the frame graph : those tests
+// open a hidden freeglut window first and also link -lfreeglut. A test
+// prints the checks that failed and exits with their count. The tests folder
+// is excluded from the Eclipse build.
+
+static int testFailures = 0;
+
+static inline bool testCheck(bool passed, const char * expression, const char * file, int line)
+{
+	if (!passed) {
+		printf("%s:%d : check failed : %s\n", file, line, expression);
+		testFailures++;
+	}
+	return passed;
+}
+
+#define TEST_CHECK(condition) testCheck((condition), #condition, __FILE__, __LINE__)
+#define TEST_NEAR(a, b, tolerance) testCheck(fabs((double)(a) - (double)(b)) <= (tolerance), #a " == " #b, __FILE__, __LINE__)
+
+// Prints the outcome, returns the exit code
+static inline int testReport(const char * name)
+{
+	if (testFailures == 0)
+		printf("%s : all checks passed\n", name);
+	else
+		printf("%s : %d checks failed\n", name, testFailures);
+	return testFailures;
+}
+
+#endif